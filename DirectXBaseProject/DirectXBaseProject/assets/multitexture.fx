@@ -34,6 +34,29 @@ Texture2D	gLayer3;
 float  height1;
 float  height2;
 float  height3;
+
+// how a compact terrain vertex is turned back into a full one - see TerrainVertexLayout
+cbuffer cbTerrainLayout{
+	float4	gTerrainOrigin;		// originX, originZ, cellSpacing
+	float4	gTerrainHeight;		// heightBias, heightScale, texScaleRow, texScaleCol
+	int4	gTerrainVertex;		// pitch, firstRow, firstCol, baseVertex
+};
+
+// lighting baked from the terrain's heights by TerrainLightBaker, a texel per vertex of the grid
+Texture2D	gOcclusionMap;		// part of the sky each vertex sees
+Texture2D	gHorizonMap0;		// sine of the horizon angle looking towards directions 0-3
+Texture2D	gHorizonMap1;		// and 4-7
+
+cbuffer cbTerrainLighting{
+	float4	gLightMapTransform;	// scale and offset from stretchedUV.yx to the baked maps
+	float4	gHorizonWeights0;	// how much the horizon in each direction counts towards the one under the light
+	float4	gHorizonWeights1;
+	int		gBakedLighting;		// 0 - none, 1 - occlusion, 2 - occlusion and horizons
+};
+
+// how quickly the parallel light fades as it drops below the horizon
+static const float HORIZON_SOFTNESS = 8.0f;
+
 ///////////////////
 // SAMPLE STATES //
 ///////////////////
@@ -43,6 +66,12 @@ SamplerState SampleType{
 	AddressV = Wrap;
 };
 
+SamplerState LightMapSampler{
+	Filter = MIN_MAG_MIP_LINEAR;
+	AddressU = Clamp;
+	AddressV = Clamp;
+};
+
 //////////////
 // TYPEDEFS //
 //////////////
@@ -52,6 +81,12 @@ struct VertexInputType{
     float2 tex		: TEXCOORD;
 };
 
+struct CompactVertexInputType{
+	float  height	: HEIGHT;
+	float2 normal	: NORMAL;
+	uint   vertexID	: SV_VertexID;
+};
+
 struct PixelInputType{
     float4 positionH	: SV_POSITION;
 	float3 positionW	: POSITION;
@@ -79,6 +114,61 @@ PixelInputType TextureVertexShader(VertexInputType input){
     return output;
 }
 
+////////////////////////////////////////////////////////////////////////////////
+// Vertex Shader for compact terrain vertices
+////////////////////////////////////////////////////////////////////////////////
+PixelInputType CompactTerrainVertexShader(CompactVertexInputType input){
+	// The index buffer value doesn't include the base vertex of the draw so add it back on to find the vertex in the grid.
+	uint id  = input.vertexID + (uint)gTerrainVertex.w;
+	uint row = id / (uint)gTerrainVertex.x + (uint)gTerrainVertex.y;
+	uint col = id % (uint)gTerrainVertex.x + (uint)gTerrainVertex.z;
+
+	float3 position;
+	position.x = gTerrainOrigin.x + col*gTerrainOrigin.z;
+	position.y = gTerrainHeight.x + input.height*gTerrainHeight.y;
+	position.z = gTerrainOrigin.y - row*gTerrainOrigin.z;
+
+	// Unfold the octahedral normal.
+	float2 f = input.normal*2.0f - 1.0f;
+	float3 normal = float3(f.x, 1.0f - abs(f.x) - abs(f.y), f.y);
+	float t = saturate(-normal.y);
+	normal.xz += (normal.xz >= 0.0f) ? -t : t;
+	normal = normalize(normal);
+
+	VertexInputType full;
+	full.position = position;
+	full.normal = normal;
+	full.tex = float2(row*gTerrainHeight.z, col*gTerrainHeight.w);
+
+	return TextureVertexShader(full);
+}
+
+////////////////////////////////////////////////////////////////////////////////
+// Baked lighting
+////////////////////////////////////////////////////////////////////////////////
+// Scales the parallel light's ambient term by the occlusion and the rest of it by how far the light is above the horizon.
+float3 ApplyBakedLighting(float3 litColor, float3 diffuse, float2 stretchedUV){
+	[branch]
+	if( gBakedLighting == 0 ){
+		return litColor;
+	}
+
+	float2 uv = stretchedUV.yx*gLightMapTransform.xy + gLightMapTransform.zw;
+	float ambient = gOcclusionMap.Sample( LightMapSampler, uv ).r;
+	float direct = 1.0f;
+
+	[branch]
+	if( gBakedLighting > 1 ){
+		float horizon = dot(gHorizonMap0.Sample( LightMapSampler, uv ), gHorizonWeights0) +
+						dot(gHorizonMap1.Sample( LightMapSampler, uv ), gHorizonWeights1);
+		float elevation = -normalize(gLight.dir).y;
+		direct = saturate((elevation - horizon)*HORIZON_SOFTNESS + 0.5f);
+	}
+
+	float3 ambientColor = diffuse*gLight.ambient.rgb;
+	return ambientColor*ambient + (litColor - ambientColor)*direct;
+}
+
 ////////////////////////////////////////////////////////////////////////////////
 // Pixel Shader for texturing based on height
 ////////////////////////////////////////////////////////////////////////////////
@@ -119,6 +209,7 @@ float4 TexturePixelShaderHeight(PixelInputType input) : SV_Target
 	if( gLightType == 0 ) // Parallel
     {
 		litColor = ParallelLight(v, gLight, gEyePosW); 
+		litColor = ApplyBakedLighting(litColor, terrainColor.rgb, input.stretchedUV);
     }
     else if( gLightType == 1 ) // Point
     {
@@ -166,6 +257,7 @@ float4 TexturePixelShaderBlendMap(PixelInputType input) : SV_Target
 	// Compute the lit color for this pixel.
 	SurfaceInfo v = {input.positionW, normalW, mixedColor, spec};
 	float3 litColor = ParallelLight(v, gLight, gEyePosW);
+	litColor = ApplyBakedLighting(litColor, mixedColor.rgb, input.stretchedUV);
 
 	return float4(litColor, mixedColor.a);	
 	
@@ -193,5 +285,15 @@ technique10 TextureTechniqueBlendMap
 		SetGeometryShader(NULL);
         SetPixelShader(CompileShader(ps_4_0, TexturePixelShaderBlendMap()));
         
+    }
+}
+technique10 TextureTechniqueCompact
+{
+    pass pass0
+    {
+        SetVertexShader(CompileShader(vs_4_0, CompactTerrainVertexShader()));
+		SetGeometryShader(NULL);
+        SetPixelShader(CompileShader(ps_4_0, TexturePixelShaderHeight()));
+        
     }
 }
\ No newline at end of file
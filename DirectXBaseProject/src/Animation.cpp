@@ -0,0 +1,342 @@
+#include "Animation.h"
+#include <string.h>
+
+#if defined(USE_SSE)
+//every lane gets the dot product of all four
+static inline __m128 Dot4(__m128 a, __m128 b){
+	__m128 m = _mm_mul_ps(a, b);
+	m = _mm_add_ps(m, _mm_shuffle_ps(m, m, _MM_SHUFFLE(2, 3, 0, 1)));
+	return _mm_add_ps(m, _mm_shuffle_ps(m, m, _MM_SHUFFLE(1, 0, 3, 2)));
+}
+
+//out = a * b for row vectors, out can be a but not b
+static inline void MultiplyMatrices(const D3DXMATRIX& a, const D3DXMATRIX& b, D3DXMATRIX& out){
+	__m128 b0 = _mm_loadu_ps(b.m[0]);
+	__m128 b1 = _mm_loadu_ps(b.m[1]);
+	__m128 b2 = _mm_loadu_ps(b.m[2]);
+	__m128 b3 = _mm_loadu_ps(b.m[3]);
+	for (int i = 0; i < 4; i++){
+		__m128 row = _mm_mul_ps(_mm_set1_ps(a.m[i][0]), b0);
+		row = _mm_add_ps(row, _mm_mul_ps(_mm_set1_ps(a.m[i][1]), b1));
+		row = _mm_add_ps(row, _mm_mul_ps(_mm_set1_ps(a.m[i][2]), b2));
+		row = _mm_add_ps(row, _mm_mul_ps(_mm_set1_ps(a.m[i][3]), b3));
+		_mm_storeu_ps(out.m[i], row);
+	}
+}
+#else
+static inline void MultiplyMatrices(const D3DXMATRIX& a, const D3DXMATRIX& b, D3DXMATRIX& out){
+	for (int i = 0; i < 4; i++){
+		float row[4];
+		for (int j = 0; j < 4; j++)
+			row[j] = a.m[i][0]*b.m[0][j] + a.m[i][1]*b.m[1][j] + a.m[i][2]*b.m[2][j] + a.m[i][3]*b.m[3][j];
+		memcpy(out.m[i], row, sizeof(row));
+	}
+}
+#endif
+
+//the same matrix D3DXMatrixTransformation makes from the scale, rotation and translation, without going through D3DX
+static void PoseMatrix(const BonePose& pose, D3DXMATRIX& out){
+	const D3DXQUATERNION& q = pose.rotation;
+	float xx = q.x*q.x, yy = q.y*q.y, zz = q.z*q.z;
+	float xy = q.x*q.y, xz = q.x*q.z, yz = q.y*q.z;
+	float wx = q.w*q.x, wy = q.w*q.y, wz = q.w*q.z;
+
+	out.m[0][0] = (1.0f - 2.0f*(yy + zz))*pose.scale.x;
+	out.m[0][1] = 2.0f*(xy + wz)*pose.scale.x;
+	out.m[0][2] = 2.0f*(xz - wy)*pose.scale.x;
+	out.m[0][3] = 0.0f;
+	out.m[1][0] = 2.0f*(xy - wz)*pose.scale.y;
+	out.m[1][1] = (1.0f - 2.0f*(xx + zz))*pose.scale.y;
+	out.m[1][2] = 2.0f*(yz + wx)*pose.scale.y;
+	out.m[1][3] = 0.0f;
+	out.m[2][0] = 2.0f*(xz + wy)*pose.scale.z;
+	out.m[2][1] = 2.0f*(yz - wx)*pose.scale.z;
+	out.m[2][2] = (1.0f - 2.0f*(xx + yy))*pose.scale.z;
+	out.m[2][3] = 0.0f;
+	out.m[3][0] = pose.translation.x;
+	out.m[3][1] = pose.translation.y;
+	out.m[3][2] = pose.translation.z;
+	out.m[3][3] = 1.0f;
+}
+
+D3DXQUATERNION DecodeRotation(const MeshKey& key){
+	//the three smallest components are between -1/sqrt(2) and 1/sqrt(2), in 15 bits each
+	const float scale = 1.41421356f/32767.0f;
+	int largest = (key.value[0] >> 15) | ((key.value[1] >> 14) & 2);
+	float small[3];
+	for (int i = 0; i < 3; i++)
+		small[i] = (key.value[i] & 0x7FFF)*scale - 0.70710678f;
+
+	float q[4];
+	for (int i = 0, j = 0; i < 4; i++){
+		if (i != largest)
+			q[i] = small[j++];
+	}
+	q[largest] = sqrtf(Max(1.0f - small[0]*small[0] - small[1]*small[1] - small[2]*small[2], 0.0f));
+	return D3DXQUATERNION(q[0], q[1], q[2], q[3]);
+}
+
+Vector3f DecodeVector(const MeshKey& key, const Vector3f& min, const Vector3f& step){
+	return Vector3f(min.x + key.value[0]*step.x, min.y + key.value[1]*step.y, min.z + key.value[2]*step.z);
+}
+
+D3DXQUATERNION BlendRotations(const D3DXQUATERNION& a, const D3DXQUATERNION& b, float weight){
+	float side = a.x*b.x + a.y*b.y + a.z*b.z + a.w*b.w < 0.0f ? -weight : weight;
+	D3DXQUATERNION r(a.x*(1.0f - weight) + b.x*side, a.y*(1.0f - weight) + b.y*side, a.z*(1.0f - weight) + b.z*side, a.w*(1.0f - weight) + b.w*side);
+	float length = sqrtf(r.x*r.x + r.y*r.y + r.z*r.z + r.w*r.w);
+	return D3DXQUATERNION(r.x/length, r.y/length, r.z/length, r.w/length);
+}
+
+float RotationAngle(const D3DXQUATERNION& a, const D3DXQUATERNION& b){
+	float side = a.x*b.x + a.y*b.y + a.z*b.z + a.w*b.w < 0.0f ? -1.0f : 1.0f;
+	float x = a.x - b.x*side, y = a.y - b.y*side, z = a.z - b.z*side, w = a.w - b.w*side;
+	return 4.0f*asinf(Min(sqrtf(x*x + y*y + z*z + w*w)*0.5f, 1.0f));
+}
+
+//the last of a channel's keys at or before the frame, and how far it is from there to the next one
+static int FindKey(const MeshKey* keys, int count, float frame, float& weight){
+	int first = 0, last = count - 1;
+	while (first < last){
+		int middle = (first + last + 1)/2;
+		if (keys[middle].frame <= frame)
+			first = middle;
+		else
+			last = middle - 1;
+	}
+	weight = 0.0f;
+	if (first + 1 < count && keys[first + 1].frame > keys[first].frame)
+		weight = Max(Min((frame - keys[first].frame)/(keys[first + 1].frame - keys[first].frame), 1.0f), 0.0f);
+	return first;
+}
+
+void SampleClip(const MeshClip& clip, const MeshTrack* tracks, const MeshKey* keys, int boneCount, float time, bool loop, BonePose* out){
+	if (loop && clip.duration > 0.0f){
+		time = fmodf(time, clip.duration);
+		if (time < 0.0f)
+			time += clip.duration;
+	}
+	float frame = Min(Max(Min(time, clip.duration), 0.0f)*clip.frameRate, (float)(clip.frameCount - 1));
+
+	for (int i = 0; i < boneCount; i++){
+		const MeshTrack& track = tracks[clip.firstTrack + i];
+		float weight[CHANNEL_COUNT];
+		const MeshKey* rotation = keys + track.firstKey[CHANNEL_ROTATION];
+		const MeshKey* translation = keys + track.firstKey[CHANNEL_TRANSLATION];
+		const MeshKey* scale = keys + track.firstKey[CHANNEL_SCALE];
+		rotation += FindKey(rotation, track.keyCount[CHANNEL_ROTATION], frame, weight[CHANNEL_ROTATION]);
+		translation += FindKey(translation, track.keyCount[CHANNEL_TRANSLATION], frame, weight[CHANNEL_TRANSLATION]);
+		scale += FindKey(scale, track.keyCount[CHANNEL_SCALE], frame, weight[CHANNEL_SCALE]);
+
+		out[i].rotation = DecodeRotation(rotation[0]);
+		if (weight[CHANNEL_ROTATION] > 0.0f)
+			out[i].rotation = BlendRotations(out[i].rotation, DecodeRotation(rotation[1]), weight[CHANNEL_ROTATION]);
+		out[i].translation = DecodeVector(translation[0], track.translationMin, track.translationStep);
+		if (weight[CHANNEL_TRANSLATION] > 0.0f){
+			Vector3f next = DecodeVector(translation[1], track.translationMin, track.translationStep);
+			out[i].translation += (next - out[i].translation)*weight[CHANNEL_TRANSLATION];
+		}
+		out[i].scale = DecodeVector(scale[0], track.scaleMin, track.scaleStep);
+		if (weight[CHANNEL_SCALE] > 0.0f){
+			Vector3f next = DecodeVector(scale[1], track.scaleMin, track.scaleStep);
+			out[i].scale += (next - out[i].scale)*weight[CHANNEL_SCALE];
+		}
+		out[i].pad0 = out[i].pad1 = 0.0f;
+	}
+}
+
+//the rotations go the shorter way round, which is whichever of the two quaternions for b is nearer a
+void BlendPoses(const BonePose* a, const BonePose* b, int boneCount, float weight, BonePose* out){
+#if defined(USE_SSE)
+	__m128 w = _mm_set1_ps(weight);
+	__m128 zero = _mm_setzero_ps();
+	__m128 signBit = _mm_set1_ps(-0.0f);
+	for (int i = 0; i < boneCount; i++){
+		__m128 ra = _mm_loadu_ps(&a[i].rotation.x);
+		__m128 rb = _mm_loadu_ps(&b[i].rotation.x);
+		__m128 ta = _mm_loadu_ps(&a[i].translation.x);
+		__m128 tb = _mm_loadu_ps(&b[i].translation.x);
+		__m128 sa = _mm_loadu_ps(&a[i].scale.x);
+		__m128 sb = _mm_loadu_ps(&b[i].scale.x);
+
+		rb = _mm_xor_ps(rb, _mm_and_ps(_mm_cmplt_ps(Dot4(ra, rb), zero), signBit));
+		__m128 r = _mm_add_ps(ra, _mm_mul_ps(_mm_sub_ps(rb, ra), w));
+		r = _mm_div_ps(r, _mm_sqrt_ps(Dot4(r, r)));
+
+		_mm_storeu_ps(&out[i].rotation.x, r);
+		_mm_storeu_ps(&out[i].translation.x, _mm_add_ps(ta, _mm_mul_ps(_mm_sub_ps(tb, ta), w)));
+		_mm_storeu_ps(&out[i].scale.x, _mm_add_ps(sa, _mm_mul_ps(_mm_sub_ps(sb, sa), w)));
+	}
+#else
+	for (int i = 0; i < boneCount; i++){
+		D3DXQUATERNION ra = a[i].rotation, rb = b[i].rotation;
+		if (ra.x*rb.x + ra.y*rb.y + ra.z*rb.z + ra.w*rb.w < 0.0f)
+			rb = D3DXQUATERNION(-rb.x, -rb.y, -rb.z, -rb.w);
+		D3DXQUATERNION r(ra.x + (rb.x - ra.x)*weight, ra.y + (rb.y - ra.y)*weight, ra.z + (rb.z - ra.z)*weight, ra.w + (rb.w - ra.w)*weight);
+		float length = sqrtf(r.x*r.x + r.y*r.y + r.z*r.z + r.w*r.w);
+
+		Vector3f ta = a[i].translation, tb = b[i].translation;
+		Vector3f sa = a[i].scale, sb = b[i].scale;
+		out[i].rotation = D3DXQUATERNION(r.x/length, r.y/length, r.z/length, r.w/length);
+		out[i].translation = ta + (tb - ta)*weight;
+		out[i].scale = sa + (sb - sa)*weight;
+	}
+#endif
+}
+
+void ComputeSkinningPalette(const MeshBone* bones, int boneCount, const BonePose* pose, D3DXMATRIX* modelSpace, D3DXMATRIX* palette){
+	D3DXMATRIX local;
+	for (int i = 0; i < boneCount; i++){
+		PoseMatrix(pose[i], local);
+		if (bones[i].parent < 0)
+			modelSpace[i] = local;
+		else
+			MultiplyMatrices(local, modelSpace[bones[i].parent], modelSpace[i]);
+		MultiplyMatrices(bones[i].inverseBind, modelSpace[i], palette[i]);
+	}
+}
+
+//the palette matrices are affine, so the rows the normal is moved by have nothing in w
+void SkinVertices(const VertexNT* vertices, const VertexSkin* skin, int count, const D3DXMATRIX* palette, VertexNT* out){
+#if defined(USE_SSE)
+	for (int v = 0; v < count; v++){
+		const VertexSkin& s = skin[v];
+		const D3DXMATRIX& first = palette[s.bones[0]];
+		__m128 w = _mm_set1_ps(s.weights[0]);
+		__m128 m0 = _mm_mul_ps(_mm_loadu_ps(first.m[0]), w);
+		__m128 m1 = _mm_mul_ps(_mm_loadu_ps(first.m[1]), w);
+		__m128 m2 = _mm_mul_ps(_mm_loadu_ps(first.m[2]), w);
+		__m128 m3 = _mm_mul_ps(_mm_loadu_ps(first.m[3]), w);
+		//the weights are strongest first, so the first one that's 0 is the end of them
+		for (int j = 1; j < 4 && s.weights[j] > 0.0f; j++){
+			const D3DXMATRIX& bone = palette[s.bones[j]];
+			w = _mm_set1_ps(s.weights[j]);
+			m0 = _mm_add_ps(m0, _mm_mul_ps(_mm_loadu_ps(bone.m[0]), w));
+			m1 = _mm_add_ps(m1, _mm_mul_ps(_mm_loadu_ps(bone.m[1]), w));
+			m2 = _mm_add_ps(m2, _mm_mul_ps(_mm_loadu_ps(bone.m[2]), w));
+			m3 = _mm_add_ps(m3, _mm_mul_ps(_mm_loadu_ps(bone.m[3]), w));
+		}
+
+		const VertexNT& vertex = vertices[v];
+		__m128 position = _mm_add_ps(_mm_add_ps(_mm_mul_ps(_mm_set1_ps(vertex.pos.x), m0), _mm_mul_ps(_mm_set1_ps(vertex.pos.y), m1)),
+									 _mm_add_ps(_mm_mul_ps(_mm_set1_ps(vertex.pos.z), m2), m3));
+		__m128 normal = _mm_add_ps(_mm_add_ps(_mm_mul_ps(_mm_set1_ps(vertex.normal.x), m0), _mm_mul_ps(_mm_set1_ps(vertex.normal.y), m1)),
+								   _mm_mul_ps(_mm_set1_ps(vertex.normal.z), m2));
+		__m128 lengthSq = Dot4(normal, normal);
+		normal = _mm_and_ps(_mm_div_ps(normal, _mm_sqrt_ps(lengthSq)), _mm_cmpgt_ps(lengthSq, _mm_setzero_ps()));
+
+		float p[4], n[4];
+		_mm_storeu_ps(p, position);
+		_mm_storeu_ps(n, normal);
+		out[v].pos = Vector3f(p[0], p[1], p[2]);
+		out[v].normal = Vector3f(n[0], n[1], n[2]);
+		out[v].texC = vertex.texC;
+	}
+#else
+	for (int v = 0; v < count; v++){
+		const VertexSkin& s = skin[v];
+		const VertexNT& vertex = vertices[v];
+		Vector3f position(0.0f, 0.0f, 0.0f), normal(0.0f, 0.0f, 0.0f);
+		for (int j = 0; j < 4 && (j == 0 || s.weights[j] > 0.0f); j++){
+			Vector3f p, n;
+			D3DXVec3TransformCoord(&p, &vertex.pos, &palette[s.bones[j]]);
+			D3DXVec3TransformNormal(&n, &vertex.normal, &palette[s.bones[j]]);
+			position += p*s.weights[j];
+			normal += n*s.weights[j];
+		}
+		out[v].pos = position;
+		D3DXVec3Normalize(&out[v].normal, &normal);
+		out[v].texC = vertex.texC;
+	}
+#endif
+}
+
+
+AnimationPlayer::AnimationPlayer(void){
+	Initialize(nullptr, 0, nullptr, 0, nullptr, nullptr);
+}
+
+void AnimationPlayer::Initialize(const MeshBone* bones, int boneCount, const MeshClip* clips, int clipCount, const MeshTrack* tracks, const MeshKey* keys){
+	this->bones = bones;
+	this->boneCount = bones ? boneCount : 0;
+	this->clips = clips;
+	this->clipCount = clips && tracks && keys ? clipCount : 0;
+	this->tracks = tracks;
+	this->keys = keys;
+
+	current = previous = -1;
+	currentTime = previousTime = 0.0f;
+	currentLoop = previousLoop = true;
+	fadeTime = fadeElapsed = 0.0f;
+	speed = 1.0f;
+
+	pose.resize(this->boneCount);
+	fadePose.resize(this->boneCount);
+	modelSpace.resize(this->boneCount);
+	palette.resize(this->boneCount);
+	Update(0.0f);
+}
+
+int AnimationPlayer::GetClipCount()const{
+	return clipCount;
+}
+
+int AnimationPlayer::FindClip(const char* name)const{
+	for (int i = 0; i < clipCount; i++){
+		if (strcmp(clips[i].name, name) == 0)
+			return i;
+	}
+	return -1;
+}
+
+void AnimationPlayer::Play(int clip, float blendTime, bool loop){
+	if (clip >= clipCount)
+		clip = -1;
+
+	previous = current;
+	previousTime = currentTime;
+	previousLoop = currentLoop;
+	fadeTime = Max(blendTime, 0.0f);
+	fadeElapsed = 0.0f;
+
+	current = clip;
+	currentTime = 0.0f;
+	currentLoop = loop;
+}
+
+void AnimationPlayer::SetSpeed(float speed){
+	this->speed = speed;
+}
+
+void AnimationPlayer::Update(float dt){
+	if (boneCount == 0)
+		return;
+
+	dt *= speed;
+	currentTime += dt;
+	previousTime += dt;
+	fadeElapsed = Min(fadeElapsed + dt, fadeTime);
+
+	GetClipPose(current, currentTime, currentLoop, &pose[0]);
+	if (fadeElapsed < fadeTime){
+		GetClipPose(previous, previousTime, previousLoop, &fadePose[0]);
+		BlendPoses(&fadePose[0], &pose[0], boneCount, fadeElapsed/fadeTime, &pose[0]);
+	}
+	ComputeSkinningPalette(bones, boneCount, &pose[0], &modelSpace[0], &palette[0]);
+}
+
+void AnimationPlayer::GetClipPose(int clip, float time, bool loop, BonePose* out){
+	if (clip < 0){
+		for (int i = 0; i < boneCount; i++)
+			out[i] = bones[i].bindPose;
+		return;
+	}
+	SampleClip(clips[clip], tracks, keys, boneCount, time, loop, out);
+}
+
+const D3DXMATRIX* AnimationPlayer::GetPalette()const{
+	return palette.empty() ? nullptr : &palette[0];
+}
+
+int AnimationPlayer::GetBoneCount()const{
+	return boneCount;
+}
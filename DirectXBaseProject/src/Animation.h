@@ -0,0 +1,84 @@
+#ifndef _H_ANIMATION
+#define _H_ANIMATION
+
+#include "MeshFile.h"
+#include "SimdMath.h"
+#include <vector>
+
+///PLAYS THE CLIPS OF A SKINNED MODEL AND WORKS OUT THE MATRICES THAT MOVE ITS VERTICES
+///A CLIP IS SAMPLED STRAIGHT FROM ITS COMPRESSED TRACKS (SEE AnimationCompressor.h) BY BLENDING THE KEYS EITHER SIDE OF THE
+///TIME IN EACH OF THEM, POSES ARE BLENDED BONE BY BONE (NORMALIZED LERP OF THE ROTATIONS), THEN EVERY BONE IS PUT INTO THE MODEL'S SPACE AFTER ITS PARENT AND MULTIPLIED BY ITS INVERSE BIND MATRIX INTO
+///THE SKINNING PALETTE. THE POSE, MATRIX AND SKINNING KERNELS USE SSE WHEN IT'S THERE (SEE SimdMath.h)
+
+const float DEFAULT_CLIP_BLEND_TIME	= 0.2f;		// seconds a clip takes to fade in over the one before it
+
+// the pose of the skeleton time seconds into the clip, wrapping round if it loops and holding the last frame if it doesn't
+void	SampleClip(const MeshClip& clip, const MeshTrack* tracks, const MeshKey* keys, int boneCount, float time, bool loop, BonePose* out);
+
+// the values of a track's keys - a rotation, or a translation or scale quantized between min and min + 65535*step
+D3DXQUATERNION	DecodeRotation(const MeshKey& key);
+Vector3f		DecodeVector(const MeshKey& key, const Vector3f& min, const Vector3f& step);
+
+// a where weight is 0 and b where it's 1, the shorter way round
+D3DXQUATERNION	BlendRotations(const D3DXQUATERNION& a, const D3DXQUATERNION& b, float weight);
+
+// radians between two unit rotations, the shorter way round. It's worked out from how far apart they are rather than the
+// acos of their dot product, which has next to no precision left once they're within a few thousandths of a radian
+float	RotationAngle(const D3DXQUATERNION& a, const D3DXQUATERNION& b);
+
+// a where weight is 0 and b where it's 1. out can be either of them
+void	BlendPoses(const BonePose* a, const BonePose* b, int boneCount, float weight, BonePose* out);
+
+// modelSpace gets every bone of the pose in the model's space and palette the matrix that takes a vertex from where it
+// was skinned to where the bone moves it
+void	ComputeSkinningPalette(const MeshBone* bones, int boneCount, const BonePose* pose, D3DXMATRIX* modelSpace, D3DXMATRIX* palette);
+
+// moves every vertex by the weighted palette matrices of its bones. Normals are moved without the translation and
+// renormalized, which is only exact for bones that don't scale unevenly
+void	SkinVertices(const VertexNT* vertices, const VertexSkin* skin, int count, const D3DXMATRIX* palette, VertexNT* out);
+
+// the playback of one skinned model - the clip playing and the one it's fading in over
+class AnimationPlayer
+{
+public:
+	AnimationPlayer(void);
+
+	// the arrays are used where they are and have to outlive the player. Starts off in the bind pose
+	void	Initialize(const MeshBone* bones, int boneCount, const MeshClip* clips, int clipCount, const MeshTrack* tracks, const MeshKey* keys);
+
+	int		GetClipCount()const;
+	int		FindClip(const char* name)const;		// -1 if there isn't one called that
+
+	// starts a clip from the beginning, fading it in over what was playing for blendTime seconds. -1 is the bind pose
+	void	Play(int clip, float blendTime = DEFAULT_CLIP_BLEND_TIME, bool loop = true);
+	void	SetSpeed(float speed);
+
+	// moves the clips on and works out the palette. Players share nothing, so different ones can be updated at once
+	void	Update(float dt);
+
+	const D3DXMATRIX*	GetPalette()const;		// one for every bone, null if there's no skeleton
+	int					GetBoneCount()const;
+
+private:
+	void	GetClipPose(int clip, float time, bool loop, BonePose* out);
+
+	const MeshBone		*bones;
+	const MeshClip		*clips;
+	const MeshTrack		*tracks;
+	const MeshKey		*keys;
+	int					boneCount;
+	int					clipCount;
+
+	int					current, previous;
+	float				currentTime, previousTime;
+	bool				currentLoop, previousLoop;
+	float				fadeTime, fadeElapsed;		// no fade when fadeElapsed has reached fadeTime
+	float				speed;
+
+	std::vector<BonePose>	pose;
+	std::vector<BonePose>	fadePose;
+	std::vector<D3DXMATRIX>	modelSpace;
+	std::vector<D3DXMATRIX>	palette;
+};
+
+#endif
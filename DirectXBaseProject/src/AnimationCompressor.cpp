@@ -0,0 +1,284 @@
+#include "AnimationCompressor.h"
+#include "Animation.h"
+#include <math.h>
+#include <string.h>
+
+//one of a bone's channels over the whole clip, four floats a frame - a rotation, or a vector and a 0
+struct Channel
+{
+	TrackChannel			type;
+	std::vector<float>		raw;		// as the frames had it
+	std::vector<float>		decoded;	// as it comes back from its key
+	std::vector<MeshKey>	quantized;	// every frame's key
+	Vector3f				min, step;
+};
+
+//the largest component is left out, and made positive so it can be worked out from the others
+static void EncodeRotation(const float* q, MeshKey& key){
+	int largest = 0;
+	for (int i = 1; i < 4; i++){
+		if (fabsf(q[i]) > fabsf(q[largest]))
+			largest = i;
+	}
+	float sign = q[largest] < 0.0f ? -1.0f : 1.0f;
+	for (int i = 0, j = 0; i < 4; i++){
+		if (i == largest)
+			continue;
+		float value = (q[i]*sign + 0.70710678f)*(32767.0f/1.41421356f);
+		key.value[j++] = (WORD)Max(Min((int)floorf(value + 0.5f), 32767), 0);
+	}
+	key.value[0] |= (largest & 1) << 15;
+	key.value[1] |= (largest & 2) << 14;
+}
+
+static void EncodeVector(const float* v, const Vector3f& min, const Vector3f& step, MeshKey& key){
+	for (int i = 0; i < 3; i++){
+		float value = ((const float*)step)[i] > 0.0f ? (v[i] - ((const float*)min)[i])/((const float*)step)[i] : 0.0f;
+		key.value[i] = (WORD)Max(Min((int)floorf(value + 0.5f), 65535), 0);
+	}
+}
+
+//every frame of a bone's channel, quantized and back again
+static void BuildChannel(Channel& channel, TrackChannel type, const BonePose* poses, int boneCount, int bone, int frameCount){
+	channel.type = type;
+	channel.raw.assign(frameCount*4, 0.0f);
+	channel.decoded.assign(frameCount*4, 0.0f);
+	channel.quantized.assign(frameCount, MeshKey());
+	for (int f = 0; f < frameCount; f++){
+		const BonePose& pose = poses[f*boneCount + bone];
+		float* raw = &channel.raw[f*4];
+		if (type == CHANNEL_ROTATION){
+			const D3DXQUATERNION& q = pose.rotation;
+			float length = sqrtf(q.x*q.x + q.y*q.y + q.z*q.z + q.w*q.w);
+			if (length > 0.0f){
+				raw[0] = q.x/length; raw[1] = q.y/length; raw[2] = q.z/length; raw[3] = q.w/length;
+			}
+			else
+				raw[3] = 1.0f;
+		}
+		else
+			memcpy(raw, type == CHANNEL_TRANSLATION ? &pose.translation : &pose.scale, sizeof(Vector3f));
+	}
+
+	//the box around the channel's values is split into 65535 steps each way
+	if (type != CHANNEL_ROTATION){
+		Vector3f max;
+		memcpy(&channel.min, &channel.raw[0], sizeof(Vector3f));
+		max = channel.min;
+		for (int f = 1; f < frameCount; f++){
+			D3DXVec3Minimize(&channel.min, &channel.min, (const Vector3f*)&channel.raw[f*4]);
+			D3DXVec3Maximize(&max, &max, (const Vector3f*)&channel.raw[f*4]);
+		}
+		channel.step = (max - channel.min)/65535.0f;
+	}
+
+	for (int f = 0; f < frameCount; f++){
+		MeshKey& key = channel.quantized[f];
+		memset(&key, 0, sizeof(key));
+		key.frame = (WORD)f;
+		if (type == CHANNEL_ROTATION){
+			EncodeRotation(&channel.raw[f*4], key);
+			D3DXQUATERNION q = DecodeRotation(key);
+			memcpy(&channel.decoded[f*4], &q, sizeof(q));
+		}
+		else{
+			EncodeVector(&channel.raw[f*4], channel.min, channel.step, key);
+			Vector3f v = DecodeVector(key, channel.min, channel.step);
+			memcpy(&channel.decoded[f*4], &v, sizeof(v));
+		}
+	}
+}
+
+//how far frame f is from the keys on frames a and b blended the way SampleClip blends them
+static float InterpolationError(const Channel& channel, int a, int b, int f){
+	float weight = b > a ? (float)(f - a)/(b - a) : 0.0f;
+	const float* from = &channel.decoded[a*4];
+	const float* to = &channel.decoded[b*4];
+	const float* raw = &channel.raw[f*4];
+
+	if (channel.type == CHANNEL_ROTATION){
+		D3DXQUATERNION q = BlendRotations(*(const D3DXQUATERNION*)from, *(const D3DXQUATERNION*)to, weight);
+		return RotationAngle(q, *(const D3DXQUATERNION*)raw);
+	}
+
+	float error[3];
+	for (int i = 0; i < 3; i++)
+		error[i] = from[i] + (to[i] - from[i])*weight - raw[i];
+	if (channel.type == CHANNEL_TRANSLATION)
+		return sqrtf(error[0]*error[0] + error[1]*error[1] + error[2]*error[2]);
+	return Max(Max(fabsf(error[0]), fabsf(error[1])), fabsf(error[2]));
+}
+
+//appends the keys of the frames that have to be kept to stay within the tolerance
+static void ReduceChannel(const Channel& channel, float tolerance, std::vector<MeshKey>& keys){
+	int frameCount = channel.quantized.size();
+	int last = frameCount - 1;
+
+	//a channel that stays close enough to its first frame needs nothing else
+	bool constant = true;
+	for (int f = 1; f < frameCount && constant; f++)
+		constant = InterpolationError(channel, 0, 0, f) <= tolerance;
+
+	std::vector<bool> kept(frameCount, false);
+	kept[0] = true;
+	if (!constant){
+		kept[last] = true;
+		std::vector<std::pair<int, int> > spans(1, std::make_pair(0, last));
+		while (!spans.empty()){
+			int a = spans.back().first, b = spans.back().second;
+			spans.pop_back();
+			int worst = -1;
+			float worstError = tolerance;
+			for (int f = a + 1; f < b; f++){
+				float error = InterpolationError(channel, a, b, f);
+				if (error > worstError){
+					worst = f;
+					worstError = error;
+				}
+			}
+			if (worst < 0)
+				continue;
+			kept[worst] = true;
+			spans.push_back(std::make_pair(a, worst));
+			spans.push_back(std::make_pair(worst, b));
+		}
+	}
+
+	for (int f = 0; f < frameCount; f++){
+		if (kept[f])
+			keys.push_back(channel.quantized[f]);
+	}
+}
+
+/*
+A bone's translation error moves it and every bone below it by that much times the scale of the bones above it. Its
+rotation error turns every bone below it round it, moving each by up to the angle times how far away it is, and its
+scale error moves them by up to that times their distance in each axis. So the joints on a chain are out by up to the
+sum of those over the bones above them, and giving each bone a share of the joint tolerance no bigger than one over the
+longest chain through it keeps every chain within it. The distances and scales are the furthest they get in the clip.
+*/
+static void GetBoneTolerances(const BonePose* poses, const MeshBone* bones, int boneCount, int frameCount,
+							  const AnimationTolerance& tolerance, std::vector<float>& boneTolerances){
+	std::vector<int> depth(boneCount), height(boneCount, 0);
+	for (int b = 0; b < boneCount; b++)
+		depth[b] = bones[b].parent < 0 ? 1 : depth[bones[b].parent] + 1;
+	for (int b = boneCount - 1; b >= 0; b--){
+		if (bones[b].parent >= 0)
+			height[bones[b].parent] = Max(height[bones[b].parent], height[b] + 1);
+	}
+
+	//reach is the furthest any bone below gets from the bone, parentScale the most the bones above it stretch its translation
+	std::vector<float> reach(boneCount, 0.0f), parentScale(boneCount, 1.0f);
+	std::vector<D3DXMATRIX> modelSpace(boneCount), palette(boneCount);
+	for (int f = 0; f < frameCount; f++){
+		ComputeSkinningPalette(bones, boneCount, poses + f*boneCount, &modelSpace[0], &palette[0]);
+		for (int b = 0; b < boneCount; b++){
+			int parent = bones[b].parent;
+			if (parent >= 0){
+				for (int row = 0; row < 3; row++){
+					const float* m = modelSpace[parent].m[row];
+					parentScale[b] = Max(parentScale[b], sqrtf(m[0]*m[0] + m[1]*m[1] + m[2]*m[2]));
+				}
+			}
+			Vector3f position(modelSpace[b].m[3]);
+			for (int a = parent; a >= 0; a = bones[a].parent){
+				Vector3f offset = position - Vector3f(modelSpace[a].m[3]);
+				reach[a] = Max(reach[a], sqrtf(offset.x*offset.x + offset.y*offset.y + offset.z*offset.z));
+			}
+		}
+	}
+
+	boneTolerances.resize(boneCount*CHANNEL_COUNT);
+	for (int b = 0; b < boneCount; b++){
+		float share = tolerance.joint/(depth[b] + height[b])/CHANNEL_COUNT;
+		float* out = &boneTolerances[b*CHANNEL_COUNT];
+		out[CHANNEL_ROTATION] = reach[b] > 0.0f ? Min(tolerance.rotation, share/reach[b]) : tolerance.rotation;
+		out[CHANNEL_TRANSLATION] = Min(tolerance.translation, share/parentScale[b]);
+		out[CHANNEL_SCALE] = reach[b] > 0.0f ? Min(tolerance.scale, share/(reach[b]*1.7320508f)) : tolerance.scale;
+	}
+}
+
+AnimationTolerance GetDefaultTolerance(const MeshBone* bones, int boneCount){
+	//the skeleton's size is the box around its bones in the pose it was bound in
+	float size = 0.0f;
+	if (boneCount > 0){
+		std::vector<BonePose> pose(boneCount);
+		std::vector<D3DXMATRIX> modelSpace(boneCount), palette(boneCount);
+		for (int i = 0; i < boneCount; i++)
+			pose[i] = bones[i].bindPose;
+		ComputeSkinningPalette(bones, boneCount, &pose[0], &modelSpace[0], &palette[0]);
+
+		Vector3f boxMin(modelSpace[0].m[3]), boxMax(modelSpace[0].m[3]);
+		for (int i = 1; i < boneCount; i++){
+			Vector3f position(modelSpace[i].m[3]);
+			D3DXVec3Minimize(&boxMin, &boxMin, &position);
+			D3DXVec3Maximize(&boxMax, &boxMax, &position);
+		}
+		Vector3f extent = boxMax - boxMin;
+		size = sqrtf(extent.x*extent.x + extent.y*extent.y + extent.z*extent.z);
+	}
+
+	AnimationTolerance tolerance;
+	tolerance.rotation = DEFAULT_ROTATION_TOLERANCE;
+	tolerance.translation = DEFAULT_TRANSLATION_TOLERANCE*(size > 0.0f ? size : 1.0f);
+	tolerance.scale = DEFAULT_SCALE_TOLERANCE;
+	tolerance.joint = DEFAULT_JOINT_TOLERANCE*(size > 0.0f ? size : 1.0f);
+	return tolerance;
+}
+
+void CompressClip(MeshClip& clip, const BonePose* poses, const MeshBone* bones, int boneCount, const AnimationTolerance& tolerance,
+				  std::vector<MeshTrack>& tracks, std::vector<MeshKey>& keys, AnimationCompressionStats* stats){
+	int frameCount = Min((int)clip.frameCount, (int)MESH_MAX_CLIP_FRAMES);
+	clip.frameCount = frameCount;
+	clip.firstTrack = tracks.size();
+	size_t firstKey = keys.size();
+
+	std::vector<float> boneTolerances;
+	GetBoneTolerances(poses, bones, boneCount, frameCount, tolerance, boneTolerances);
+	Channel channel;
+	for (int b = 0; b < boneCount; b++){
+		MeshTrack track;
+		memset(&track, 0, sizeof(track));
+		for (int c = 0; c < CHANNEL_COUNT; c++){
+			BuildChannel(channel, (TrackChannel)c, poses, boneCount, b, frameCount);
+			track.firstKey[c] = keys.size();
+			ReduceChannel(channel, boneTolerances[b*CHANNEL_COUNT + c], keys);
+			track.keyCount[c] = keys.size() - track.firstKey[c];
+			if (c == CHANNEL_TRANSLATION){
+				track.translationMin = channel.min;
+				track.translationStep = channel.step;
+			}
+			else if (c == CHANNEL_SCALE){
+				track.scaleMin = channel.min;
+				track.scaleStep = channel.step;
+			}
+		}
+		tracks.push_back(track);
+	}
+
+	if (!stats)
+		return;
+	stats->rawBytes = frameCount*boneCount*sizeof(BonePose);
+	stats->compressedBytes = boneCount*sizeof(MeshTrack) + (keys.size() - firstKey)*sizeof(MeshKey);
+	stats->ratio = stats->compressedBytes > 0 ? (float)stats->rawBytes/stats->compressedBytes : 0.0f;
+	stats->maxJointError = 0.0f;
+	stats->maxErrorBone = -1;
+
+	//every frame is sampled back out of the keys and its bones compared where they end up in the model
+	std::vector<BonePose> sampled(boneCount);
+	std::vector<D3DXMATRIX> rawSpace(boneCount), sampledSpace(boneCount), palette(boneCount);
+	for (int f = 0; f < frameCount && boneCount > 0; f++){
+		float time = clip.frameRate > 0.0f ? f/clip.frameRate : 0.0f;
+		SampleClip(clip, &tracks[0], &keys[0], boneCount, time, false, &sampled[0]);
+		ComputeSkinningPalette(bones, boneCount, poses + f*boneCount, &rawSpace[0], &palette[0]);
+		ComputeSkinningPalette(bones, boneCount, &sampled[0], &sampledSpace[0], &palette[0]);
+		for (int b = 0; b < boneCount; b++){
+			Vector3f error = Vector3f(rawSpace[b].m[3]) - Vector3f(sampledSpace[b].m[3]);
+			float distance = sqrtf(error.x*error.x + error.y*error.y + error.z*error.z);
+			if (distance > stats->maxJointError){
+				stats->maxJointError = distance;
+				stats->maxErrorBone = b;
+			}
+		}
+	}
+}
@@ -0,0 +1,49 @@
+#ifndef _H_ANIMATIONCOMPRESSOR
+#define _H_ANIMATIONCOMPRESSOR
+
+#include "MeshFile.h"
+#include <vector>
+
+///SHRINKS A CLIP FROM A POSE OF EVERY BONE FOR EVERY FRAME DOWN TO THE KEYS Animation.h SAMPLES IT FROM
+///EACH BONE'S ROTATION, TRANSLATION AND SCALE BECOMES A CHANNEL OF ITS OWN THAT ONLY KEEPS THE FRAMES LINEAR INTERPOLATION
+///BETWEEN THE OTHERS CAN'T GET CLOSE ENOUGH TO - THE FRAME THAT'S FURTHEST OUT IS KEPT AND EACH SIDE OF IT DONE AGAIN UNTIL
+///EVERY FRAME IS WITHIN THE TOLERANCE. THE KEYS ARE QUANTIZED BEFORE THE FRAMES ARE MEASURED AGAINST THEM, SO THE TOLERANCE
+///COVERS BOTH, DOWN TO WHAT THE QUANTIZING LOSES ON ITS OWN. ROTATIONS ARE KEPT AS THEIR SMALLEST THREE COMPONENTS IN 15 BITS
+///EACH, TRANSLATIONS AND SCALES IN 16 BITS A COMPONENT ACROSS THE BOX AROUND THEIR CHANNEL
+///A BONE'S ERRORS MOVE EVERY BONE BELOW IT, THE ROTATION AND SCALE ONES BY AS MUCH MORE AS THOSE BONES ARE FURTHER AWAY, SO EACH
+///BONE'S CHANNELS ARE HELD TIGHTER THAN THE TOLERANCE WHERE IT TAKES THAT TO KEEP EVERY JOINT WITHIN THE JOINT TOLERANCE OF
+///WHERE ITS FRAME PUT IT - EACH BONE ON THE LONGEST CHAIN THROUGH IT GETS AN EQUAL SHARE, SPLIT BETWEEN ITS THREE CHANNELS
+
+const float DEFAULT_ROTATION_TOLERANCE		= 0.001f;	// radians a bone may turn from where the frame had it, 15 bit components lose about 0.0001
+const float DEFAULT_TRANSLATION_TOLERANCE	= 0.0001f;	// distance a bone may move, as a fraction of the skeleton's size
+const float DEFAULT_SCALE_TOLERANCE			= 0.0001f;	// difference in any axis of a bone's scale
+const float DEFAULT_JOINT_TOLERANCE			= 0.001f;	// distance a joint may end up from where its frame had it, as a fraction of the skeleton's size
+
+struct AnimationTolerance
+{
+	float	rotation;		// radians
+	float	translation;	// in the model's units
+	float	scale;
+	float	joint;			// in the model's units
+};
+
+struct AnimationCompressionStats
+{
+	UINT	rawBytes;		// a BonePose for every bone for every frame
+	UINT	compressedBytes;	// the tracks and their keys
+	float	ratio;			// raw for every compressed byte
+	float	maxJointError;	// furthest any bone ends up in the model's space from where its frame put it, in the model's units.
+							// Within the joint tolerance unless the quantizing alone moves it further
+	int		maxErrorBone;
+};
+
+// the tolerance for a skeleton as big as its bind pose, with the defaults above
+AnimationTolerance	GetDefaultTolerance(const MeshBone* bones, int boneCount);
+
+// appends a track for every bone to tracks and their keys to keys, and points clip.firstTrack at them. poses has
+// clip.frameCount frames of boneCount poses one after the other. stats, if it isn't null, gets what was saved and the error
+// of sampling the compressed clip on every frame
+void	CompressClip(MeshClip& clip, const BonePose* poses, const MeshBone* bones, int boneCount, const AnimationTolerance& tolerance,
+					 std::vector<MeshTrack>& tracks, std::vector<MeshKey>& keys, AnimationCompressionStats* stats = nullptr);
+
+#endif
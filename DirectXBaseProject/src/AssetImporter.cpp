@@ -0,0 +1,113 @@
+#include "AssetImporter.h"
+#include "ThreadPool.h"
+#include <malloc.h>
+#include <new>
+
+AssetImporter::AssetImporter(void){
+	finished = (PSLIST_HEADER)_aligned_malloc(sizeof(SLIST_HEADER), MEMORY_ALLOCATION_ALIGNMENT);
+	InitializeSListHead(finished);
+	pending = 0;
+}
+
+AssetImporter::~AssetImporter(void){
+	while (pending > 0){
+		FinishRequests(false);
+		if (pending > 0)
+			Sleep(1);
+	}
+	_aligned_free(finished);
+}
+
+void AssetImporter::ImportModel(ModelObject* model, const char* fbxFilename, const char* cookedFilename){
+	void* memory = _aligned_malloc(sizeof(ImportRequest), MEMORY_ALLOCATION_ALIGNMENT);
+	ImportRequest* request = new (memory) ImportRequest;
+	request->importer = this;
+	request->model = model;
+	request->fbxFilename = fbxFilename;
+	if (cookedFilename)
+		request->cookedFilename = cookedFilename;
+	request->loader = nullptr;
+	request->succeeded = false;
+
+	InterlockedIncrement(&pending);
+	ThreadPool::GetShared()->Submit(ImportJob, request);
+}
+
+void AssetImporter::ImportJob(void* data){
+	ImportRequest* request = (ImportRequest*)data;
+
+	//the pages are read in here so making the buffers doesn't stall on the disk
+	if (!request->cookedFilename.empty() && request->meshFile.Load(request->cookedFilename.c_str())){
+		request->meshFile.Prefetch();
+		request->succeeded = true;
+	}
+	else{
+		request->loader = new ModelLoader();
+		request->succeeded = request->loader->LoadModel(request->fbxFilename.c_str());
+		//the model is made from what was just imported whether or not it could be cooked
+		if (request->succeeded && !request->cookedFilename.empty())
+			ModelObject::WriteCookedModel(*request->loader, request->cookedFilename.c_str());
+	}
+
+	InterlockedPushEntrySList(request->importer->finished, &request->entry);
+}
+
+bool AssetImporter::Update(){
+	return FinishRequests(true);
+}
+
+bool AssetImporter::WaitForAll(){
+	bool allLoaded = true;
+	while (pending > 0){
+		if (!FinishRequests(true))
+			allLoaded = false;
+		if (pending > 0)
+			Sleep(1);
+	}
+	return allLoaded;
+}
+
+int AssetImporter::GetPendingCount()const{
+	return pending;
+}
+
+bool AssetImporter::FinishRequests(bool create){
+	//the list comes back newest first, so it's turned round to make them in the order they finished
+	PSLIST_ENTRY entry = InterlockedFlushSList(finished);
+	PSLIST_ENTRY ordered = nullptr;
+	while (entry){
+		PSLIST_ENTRY next = entry->Next;
+		entry->Next = ordered;
+		ordered = entry;
+		entry = next;
+	}
+
+	bool allLoaded = true;
+	while (ordered){
+		ImportRequest* request = CONTAINING_RECORD(ordered, ImportRequest, entry);
+		ordered = ordered->Next;
+
+		bool loaded = request->succeeded;
+		if (loaded && create){
+			if (request->loader)
+				loaded = request->model->CreateFromLoader(*request->loader, request->fbxFilename.c_str());
+			else
+				loaded = request->model->CreateFromMeshFile(request->meshFile, request->cookedFilename.c_str());
+		}
+		if (!loaded){
+			std::cout << "Could not load " << request->fbxFilename << std::endl;
+			allLoaded = false;
+		}
+
+		FreeRequest(request);
+		InterlockedDecrement(&pending);
+	}
+	return allLoaded;
+}
+
+void AssetImporter::FreeRequest(ImportRequest* request){
+	if (request->loader)
+		delete request->loader;
+	request->~ImportRequest();
+	_aligned_free(request);
+}
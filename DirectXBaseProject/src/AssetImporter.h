@@ -0,0 +1,56 @@
+#ifndef _H_ASSETIMPORTER
+#define _H_ASSETIMPORTER
+
+#include <windows.h>
+#include <string>
+#include "ModelObject.h"
+#include "MeshFile.h"
+
+///READS MODELS IN ON THE SHARED THREAD POOL SO THE GAME DOESN'T STALL WHILE THEY'RE PARSED, OPTIMIZED AND SIMPLIFIED
+///EVERY MODEL IS ITS OWN JOB, SO SEVERAL FILES ARE READ AT ONCE, AND THE MESHES OF ONE FILE ARE SPREAD OVER THE POOL BY
+///THE LOADER ITSELF. A FINISHED MODEL GOES ON A LOCK-FREE LIST THAT Update TAKES IT OFF, ON THE THREAD WITH THE DEVICE,
+///TO MAKE ITS BUFFERS AND TEXTURES - THE WORKERS NEVER TOUCH D3D OR THE MODEL OBJECT
+class AssetImporter
+{
+public:
+	AssetImporter(void);
+	~AssetImporter(void);		// waits for the imports still going and throws them away
+
+	// starts reading a model into the object. The cooked file is used if it can be, otherwise the FBX file is imported
+	// and cooked into it for next time - cookedFilename can be null to always import the FBX. The object mustn't be
+	// deleted until Update has made its buffers
+	void	ImportModel(ModelObject* model, const char* fbxFilename, const char* cookedFilename = nullptr);
+
+	// makes the buffers of every model that's finished since the last call, in the order they finished. Call once a
+	// frame from the thread with the device, returns false if any of them couldn't be loaded
+	bool	Update();
+	bool	WaitForAll();		// blocks until everything submitted has been read in and made
+
+	int		GetPendingCount()const;		// submitted and not made yet
+
+private:
+	AssetImporter(const AssetImporter&);
+	AssetImporter& operator=(const AssetImporter&);
+
+	// allocated on MEMORY_ALLOCATION_ALIGNMENT like the list needs
+	struct ImportRequest
+	{
+		SLIST_ENTRY		entry;			// has to come first
+		AssetImporter	*importer;
+		ModelObject		*model;
+		std::string		fbxFilename;
+		std::string		cookedFilename;
+		MeshFile		meshFile;		// open if the cooked file was used
+		ModelLoader		*loader;		// otherwise what was imported from the FBX
+		bool			succeeded;
+	};
+
+	static void ImportJob(void* data);
+	bool	FinishRequests(bool create);
+	static void FreeRequest(ImportRequest* request);
+
+	PSLIST_HEADER	finished;
+	volatile LONG	pending;
+};
+
+#endif
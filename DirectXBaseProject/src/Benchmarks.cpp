@@ -0,0 +1,491 @@
+#include "Benchmarks.h"
+#include "Grid.h"
+#include "TerrainKernels.h"
+#include "TerrainQuadtree.h"
+#include "TerrainLightBaker.h"
+#include "GameTimer.h"
+#include "Vertex.h"
+#include "ModelLoader.h"
+#include <iostream>
+#include <iomanip>
+#include <sstream>
+#include <string.h>
+#include <vector>
+#include <math.h>
+
+//results are added into this so the compiler can't drop the loops being timed
+static volatile double benchmarkSink;
+
+//a heightmap the benchmarks run on, row major with a pitch of cols
+struct BenchmarkMap
+{
+	std::string			name;
+	int					rows, cols;
+	std::vector<float>	heights;
+};
+
+//the heights the game loads, laid out and scaled the way Grid::LoadHeights does
+static bool LoadBenchmarkMap(const char* filename, BenchmarkMap& map){
+	TerrainLoader loader;
+	std::vector<char> path(filename, filename + strlen(filename) + 1);
+	if (!loader.LoadTerrain(&path[0]))
+		return false;
+	map.name = filename;
+	map.rows = loader.GetWidth();
+	map.cols = loader.GetDepth();
+	map.heights.resize(map.rows*map.cols);
+	for (int i = 0; i < map.rows; i++){
+		for (int j = 0; j < map.cols; j++)
+			map.heights[i*map.cols + j] = loader.GetHeight(i, j)*HEIGHT_FACTOR;
+	}
+	return true;
+}
+
+//rolling hills with noise on top, the same every run
+static void MakeBenchmarkMap(int size, BenchmarkMap& map){
+	std::ostringstream name;
+	name << "synthetic " << size << "x" << size;
+	map.name = name.str();
+	map.rows = map.cols = size;
+	map.heights.resize(size*size);
+	unsigned int seed = 12345;
+	for (int i = 0; i < size; i++){
+		for (int j = 0; j < size; j++){
+			seed = seed*1664525 + 1013904223;
+			float noise = (seed >> 8)/16777216.0f;
+			map.heights[i*size + j] = 8.0f*sinf(i*0.013f)*cosf(j*0.011f) + 3.0f*sinf((i + j)*0.047f) + 0.4f*noise;
+		}
+	}
+}
+
+static float ElapsedMs(GameTimer& timer){
+	timer.tick();
+	return timer.getDeltaTime()*1000.0f;
+}
+
+/////////////////////////////////////////////////////////////////////////
+// NORMALS
+/////////////////////////////////////////////////////////////////////////
+
+//what Grid::ComputeNormal did before the kernels - the normals of the four triangles fanning round the vertex, averaged
+static Vector3f ReferenceNormal(const float* heights, int rows, int cols, int i, int j){
+	float dx = CELLSPACING;
+	float h = heights[i*cols+j];
+
+	Vector3f v1,v2,v3,v4,v12,v23,v34,v41,v;
+	v1 = v2 = v3 = v4 = v12 = v23 = v34 = v41 = v = Vector3f(0.0f,0.0f,0.0f);
+	if (j != cols - 1)
+		v1 = Vector3f(dx, heights[i*cols+j+1] - h, 0.0f);
+	if (i != rows - 1)
+		v2 = Vector3f(0.0f, heights[(i+1)*cols+j] - h, -dx);
+	if (j > 0)
+		v3 = Vector3f(-dx, heights[i*cols+j-1] - h, 0.0f);
+	if (i > 0)
+		v4 = Vector3f(0.0f, heights[(i-1)*cols+j] - h, dx);
+
+	D3DXVec3Cross(&v12,&v1,&v2);
+	D3DXVec3Normalize(&v12,&v12);
+	D3DXVec3Cross(&v23,&v2,&v3);
+	D3DXVec3Normalize(&v23,&v23);
+	D3DXVec3Cross(&v34,&v3,&v4);
+	D3DXVec3Normalize(&v34,&v34);
+	D3DXVec3Cross(&v41,&v4,&v1);
+	D3DXVec3Normalize(&v41,&v41);
+
+	if (D3DXVec3Length(&v12) > 0.0f)
+		v = v + v12;
+	if (D3DXVec3Length(&v23) > 0.0f)
+		v = v + v23;
+	if (D3DXVec3Length(&v34) > 0.0f)
+		v = v + v34;
+	if (D3DXVec3Length(&v41) > 0.0f)
+		v = v + v41;
+
+	D3DXVec3Normalize(&v,&v);
+	return v;
+}
+
+//both write a row at a time into a buffer that's summed, so neither can be optimised away or is timed writing more memory
+static bool BenchmarkNormals(const BenchmarkMap& map){
+	const float* heights = &map.heights[0];
+	std::vector<Vector3f> reference(map.cols);
+	std::vector<float> normals(map.cols*3);
+	float* nx = &normals[0];
+	float* ny = nx + map.cols;
+	float* nz = ny + map.cols;
+	double referenceSum = 0.0, kernelSum = 0.0;
+	GameTimer timer;
+
+	timer.reset();
+	for (int i = 0; i < map.rows; i++){
+		for (int j = 0; j < map.cols; j++)
+			reference[j] = ReferenceNormal(heights, map.rows, map.cols, i, j);
+		referenceSum += reference[i % map.cols].y;
+	}
+	float referenceMs = ElapsedMs(timer);
+
+	timer.reset();
+	for (int i = 0; i < map.rows; i++){
+		ComputeTerrainNormalRow(heights, map.rows, map.cols, i, 0, map.cols, CELLSPACING, nx, ny, nz);
+		kernelSum += ny[i % map.cols];
+	}
+	float kernelMs = ElapsedMs(timer);
+
+	//the vectorised rows have to give what the scalar kernel does vertex by vertex. The old normals average four
+	//triangles rather than taking central differences, so how far they are from the new ones is only printed
+	float maxKernelError = 0.0f, maxAngle = 0.0f;
+	for (int i = 0; i < map.rows; i++){
+		ComputeTerrainNormalRow(heights, map.rows, map.cols, i, 0, map.cols, CELLSPACING, nx, ny, nz);
+		for (int j = 0; j < map.cols; j++){
+			float x, y, z;
+			ComputeTerrainNormal(heights, map.rows, map.cols, i, j, CELLSPACING, x, y, z);
+			maxKernelError = Max(maxKernelError, Max(Max(fabsf(nx[j] - x), fabsf(ny[j] - y)), fabsf(nz[j] - z)));
+		}
+		if (i % 64 == 0){
+			for (int j = 0; j < map.cols; j++){
+				Vector3f old = ReferenceNormal(heights, map.rows, map.cols, i, j);
+				float dot = Min(old.x*nx[j] + old.y*ny[j] + old.z*nz[j], 1.0f);
+				maxAngle = Max(maxAngle, acosf(dot)*180.0f/PI);
+			}
+		}
+	}
+
+	std::cout << std::fixed << std::setprecision(2) << "  normals: four cross products " << referenceMs << " ms, row kernel " <<
+				 kernelMs << " ms (" << (kernelMs > 0.0f ? referenceMs/kernelMs : 0.0f) << "x), kernel error " << std::setprecision(7) <<
+				 maxKernelError << std::setprecision(2) << ", up to " << maxAngle << " degrees from the old normals" << std::endl;
+	benchmarkSink = referenceSum + kernelSum;
+	return maxKernelError <= 1e-5f;
+}
+
+/////////////////////////////////////////////////////////////////////////
+// SMOOTHING
+/////////////////////////////////////////////////////////////////////////
+
+//what TerrainLoader::SmoothHeights did before the kernels, called the same four times with 0.75. It walks down the
+//columns, so every height it reads is a row away from the last. The two passes that ran backwards never looped and are left out
+static void ReferenceSmoothHeights(float* height, int rows, int cols, float k){
+	int terrainWidth = cols, terrainDepth = rows;
+	for (int i = 1; i < terrainWidth; i++){
+		for (int j = 0; j < terrainDepth; j++)
+			height[j*terrainWidth + i] = height[j*terrainWidth + i - 1]*(1-k) + height[j*terrainWidth + i] * k;
+	}
+	for (int i = 0; i < terrainWidth; i++){
+		for (int j = 1; j < terrainDepth; j++)
+			height[j*terrainWidth + i] = height[(j-1)*terrainWidth + i]*(1-k) + height[j*terrainWidth + i] * k;
+	}
+}
+
+//one pass of the box or gaussian kernel the way TerrainLoader builds them, checked against convolving every 64th row
+//directly in two dimensions. There was no box or gaussian smoothing before, so there's nothing older to time them against
+static bool BenchmarkSeparable(const BenchmarkMap& map, SMOOTH_KERNEL kernel, float amount, std::vector<float>& smoothed){
+	int radius = Clamp(kernel == SMOOTH_BOX ? (int)(amount + 0.5f) : (int)ceilf(amount*3.0f), 0, MAX_SMOOTH_RADIUS);
+	int taps = 2*radius + 1;
+	float weights[2*MAX_SMOOTH_RADIUS + 1];
+	float total = 0.0f;
+	for (int t = 0; t < taps; t++){
+		float d = (float)(t - radius);
+		weights[t] = (kernel == SMOOTH_BOX) ? 1.0f : expf(-d*d / (2.0f*amount*amount));
+		total += weights[t];
+	}
+	for (int t = 0; t < taps; t++)
+		weights[t] /= total;
+
+	smoothed = map.heights;
+	std::vector<float> scratch(taps*map.cols);
+	GameTimer timer;
+	timer.reset();
+	SmoothHeightsSeparable(&smoothed[0], map.rows, map.cols, weights, radius, &scratch[0]);
+	float kernelMs = ElapsedMs(timer);
+
+	float maxError = 0.0f;
+	for (int i = 0; i < map.rows; i += 64){
+		for (int j = 0; j < map.cols; j++){
+			float sum = 0.0f;
+			for (int y = -radius; y <= radius; y++){
+				const float* row = &map.heights[Clamp(i + y, 0, map.rows - 1)*map.cols];
+				for (int x = -radius; x <= radius; x++)
+					sum += weights[y + radius]*weights[x + radius]*row[Clamp(j + x, 0, map.cols - 1)];
+			}
+			maxError = Max(maxError, fabsf(sum - smoothed[i*map.cols + j]));
+		}
+	}
+
+	std::cout << std::fixed << std::setprecision(2) << "  smoothing: " << (kernel == SMOOTH_BOX ? "box" : "gaussian") << " radius " <<
+				 radius << " " << kernelMs << " ms, error " << std::setprecision(7) << maxError << std::endl;
+	benchmarkSink = smoothed[smoothed.size()/2];
+	return maxError <= 1e-4f;
+}
+
+//smoothing works on a copy of the map, and the old routine's copy is the one the box and gaussian kernels reuse, so
+//there are never more than two maps' worth of heights besides the map itself
+static bool BenchmarkSmoothing(const BenchmarkMap& map){
+	const int passes = 4;
+	const float factor = 0.75f;
+	std::vector<float> reference(map.heights), smoothed(map.heights);
+	GameTimer timer;
+
+	timer.reset();
+	for (int i = 0; i < passes; i++)
+		ReferenceSmoothHeights(&reference[0], map.rows, map.cols, factor);
+	float referenceMs = ElapsedMs(timer);
+
+	timer.reset();
+	for (int i = 0; i < passes; i++)
+		SmoothHeightsExponential(&smoothed[0], map.rows, map.cols, factor);
+	float kernelMs = ElapsedMs(timer);
+
+	//the kernel does the same arithmetic in a different order of rows and columns, so the heights should match exactly
+	float maxError = 0.0f;
+	for (size_t i = 0; i < smoothed.size(); i++)
+		maxError = Max(maxError, fabsf(smoothed[i] - reference[i]));
+
+	std::cout << std::fixed << std::setprecision(2) << "  smoothing: old column sweeps " << referenceMs << " ms, exponential kernel " <<
+				 kernelMs << " ms (" << (kernelMs > 0.0f ? referenceMs/kernelMs : 0.0f) << "x), error " << std::setprecision(7) <<
+				 maxError << std::endl;
+	benchmarkSink = smoothed[smoothed.size()/2];
+	bool passed = maxError <= 1e-5f;
+
+	std::vector<float>().swap(smoothed);
+	passed = BenchmarkSeparable(map, SMOOTH_BOX, 2.0f, reference) && passed;
+	passed = BenchmarkSeparable(map, SMOOTH_GAUSSIAN, 1.5f, reference) && passed;
+	return passed;
+}
+
+/////////////////////////////////////////////////////////////////////////
+// RAY CASTS
+/////////////////////////////////////////////////////////////////////////
+
+//how rays were cast at the terrain before the quadtree - against both triangles of every cell, keeping the nearest hit
+static bool ReferenceRayCast(const BenchmarkMap& map, float originX, float originZ, const Vector3f& origin, const Vector3f& dir,
+							 float maxDistance, float& hitDistance){
+	bool hit = false;
+	for (int row = 0; row < map.rows - 1; row++){
+		for (int col = 0; col < map.cols - 1; col++){
+			float x0 = originX + col*CELLSPACING;
+			float z0 = originZ - row*CELLSPACING;
+			const float* top = &map.heights[row*map.cols + col];
+			Vector3f A(x0, top[0], z0);
+			Vector3f B(x0 + CELLSPACING, top[1], z0);
+			Vector3f C(x0, top[map.cols], z0 - CELLSPACING);
+			Vector3f D(x0 + CELLSPACING, top[map.cols + 1], z0 - CELLSPACING);
+			const Vector3f* triangles[2][3] = {{&A, &B, &C}, {&C, &B, &D}};
+
+			for (int k = 0; k < 2; k++){
+				Vector3f edge1 = *triangles[k][1] - *triangles[k][0];
+				Vector3f edge2 = *triangles[k][2] - *triangles[k][0];
+				Vector3f p, q;
+				D3DXVec3Cross(&p, &dir, &edge2);
+				float det = D3DXVec3Dot(&edge1, &p);
+				if (fabsf(det) < 1e-12f)
+					continue;
+				float invDet = 1.0f / det;
+				Vector3f s = origin - *triangles[k][0];
+				float u = D3DXVec3Dot(&s, &p)*invDet;
+				if (u < 0.0f || u > 1.0f)
+					continue;
+				D3DXVec3Cross(&q, &s, &edge1);
+				float v = D3DXVec3Dot(&dir, &q)*invDet;
+				if (v < 0.0f || u + v > 1.0f)
+					continue;
+				float t = D3DXVec3Dot(&edge2, &q)*invDet;
+				if (t >= 0.0f && t <= maxDistance){
+					maxDistance = hitDistance = t;
+					hit = true;
+				}
+			}
+		}
+	}
+	return hit;
+}
+
+//a million rays from above the terrain looking down at anything from grazing to steep angles, so some cross most of
+//the map before they land and some miss it altogether. They're cast one at a time and as a batch on the pool, and the
+//first few are also cast at every triangle to check the tree doesn't miss anything
+static bool BenchmarkRayCasts(const BenchmarkMap& map){
+	float originX = -(map.cols - 1)*CELLSPACING*0.5f;
+	float originZ = (map.rows - 1)*CELLSPACING*0.5f;
+	float minHeight = map.heights[0], maxHeight = map.heights[0];
+	for (size_t i = 1; i < map.heights.size(); i++){
+		minHeight = Min(minHeight, map.heights[i]);
+		maxHeight = Max(maxHeight, map.heights[i]);
+	}
+
+	TerrainQuadtree tree;
+	GameTimer timer;
+	timer.reset();
+	if (!tree.Build(&map.heights[0], map.rows, map.cols, CELLSPACING, originX, originZ)){
+		std::cout << "  ray casts: could not build the quadtree" << std::endl;
+		return false;
+	}
+	float buildMs = ElapsedMs(timer);
+
+	std::vector<Vector3f> origins(BENCHMARK_RAYS), dirs(BENCHMARK_RAYS);
+	unsigned int seed = 54321;
+	for (int i = 0; i < BENCHMARK_RAYS; i++){
+		float r[4];
+		for (int k = 0; k < 4; k++){
+			seed = seed*1664525 + 1013904223;
+			r[k] = (seed >> 8)/16777216.0f;
+		}
+		origins[i] = Vector3f(originX + r[0]*(map.cols - 1)*CELLSPACING, maxHeight + 1.0f + r[1]*(maxHeight - minHeight),
+							  originZ - r[2]*(map.rows - 1)*CELLSPACING);
+		float yaw = r[3]*2.0f*PI;
+		float pitch = 0.02f + (r[1]*r[1])*1.2f;
+		dirs[i] = Vector3f(cosf(yaw)*cosf(pitch), -sinf(pitch), sinf(yaw)*cosf(pitch));
+	}
+	float maxDistance = (map.rows + map.cols)*CELLSPACING*2.0f;
+
+	std::vector<float> single(BENCHMARK_RAYS), batched(BENCHMARK_RAYS);
+	int hits = 0;
+	timer.reset();
+	for (int i = 0; i < BENCHMARK_RAYS; i++){
+		float t;
+		single[i] = tree.RayCast(origins[i], dirs[i], maxDistance, t) ? t : -1.0f;
+		hits += single[i] >= 0.0f;
+	}
+	float singleMs = ElapsedMs(timer);
+
+	timer.reset();
+	tree.RayCast(&origins[0], &dirs[0], BENCHMARK_RAYS, maxDistance, &batched[0]);
+	float batchedMs = ElapsedMs(timer);
+
+	//the batch runs the same code on every ray so it has to give the same distances
+	bool passed = memcmp(&single[0], &batched[0], BENCHMARK_RAYS*sizeof(float)) == 0;
+
+	//walking every triangle is slow enough that only around a hundred million triangles' worth of rays are cast
+	int referenceRays = Clamp(50000000/((map.rows - 1)*(map.cols - 1)), 4, BENCHMARK_RAYS);
+	int mismatches = 0;
+	timer.reset();
+	for (int i = 0; i < referenceRays; i++){
+		float t;
+		float reference = ReferenceRayCast(map, originX, originZ, origins[i], dirs[i], maxDistance, t) ? t : -1.0f;
+		if ((reference < 0.0f) != (single[i] < 0.0f) || fabsf(reference - single[i]) > 1e-3f*Max(1.0f, reference))
+			mismatches++;
+	}
+	float referenceMs = ElapsedMs(timer)/referenceRays;
+	passed = passed && mismatches == 0;
+
+	std::cout << std::fixed << std::setprecision(2) << "  ray casts: tree built in " << buildMs << " ms, " << BENCHMARK_RAYS <<
+				 " rays (" << hits << " hit) one at a time " << singleMs << " ms, batched " << batchedMs << " ms on " <<
+				 ThreadPool::GetShared()->GetThreadCount() << " workers, every triangle " << referenceMs << " ms a ray (" <<
+				 referenceRays << " rays, " << mismatches << " disagreed)" << std::endl;
+	return passed;
+}
+
+/////////////////////////////////////////////////////////////////////////
+// LIGHT BAKING
+/////////////////////////////////////////////////////////////////////////
+
+//the whole map baked the way Grid bakes it at load, ambient occlusion on its own and then with the horizons. Every 64th
+//row is baked again a few vertices at a time, too few for the vector loops, and has to come out byte for byte the same
+static bool BenchmarkBake(const BenchmarkMap& map){
+	TerrainLightBaker baker;
+	std::vector<BYTE> occlusion(map.rows*map.cols), horizons(map.rows*map.cols*8), aoOnly(map.rows*map.cols);
+	GameTimer timer;
+
+	timer.reset();
+	baker.Bake(&map.heights[0], map.rows, map.cols, CELLSPACING, 0, 0, map.rows - 1, map.cols - 1, &aoOnly[0], nullptr, map.cols);
+	float aoMs = ElapsedMs(timer);
+
+	timer.reset();
+	baker.Bake(&map.heights[0], map.rows, map.cols, CELLSPACING, 0, 0, map.rows - 1, map.cols - 1, &occlusion[0], &horizons[0], map.cols);
+	float horizonMs = ElapsedMs(timer);
+
+	int mismatches = memcmp(&aoOnly[0], &occlusion[0], aoOnly.size()) != 0;
+	const DWORD* planes[2] = {(const DWORD*)&horizons[0], (const DWORD*)&horizons[map.rows*map.cols*4]};
+	for (int i = 0; i < map.rows; i += 64){
+		for (int j = 0; j + 3 <= map.cols; j += 61){
+			BYTE spanOcclusion[3];
+			DWORD spanHorizons[2][3];
+			baker.Bake(&map.heights[0], map.rows, map.cols, CELLSPACING, i, j, i, j + 2, spanOcclusion, (BYTE*)spanHorizons, 3);
+			for (int k = 0; k < 3; k++){
+				if (spanOcclusion[k] != occlusion[i*map.cols + j + k] || spanHorizons[0][k] != planes[0][i*map.cols + j + k] ||
+					spanHorizons[1][k] != planes[1][i*map.cols + j + k])
+					mismatches++;
+			}
+		}
+	}
+
+	double total = 0.0;
+	for (size_t i = 0; i < occlusion.size(); i++)
+		total += occlusion[i];
+	std::cout << std::fixed << std::setprecision(2) << "  light baking: reach " << baker.GetReach() << ", ambient occlusion " <<
+				 aoMs << " ms, with horizons " << horizonMs << " ms on " << ThreadPool::GetShared()->GetThreadCount() <<
+				 " workers, average occlusion " << total/occlusion.size() << ", " << mismatches << " vertices baked differently" << std::endl;
+	benchmarkSink = total;
+	return mismatches == 0;
+}
+
+/////////////////////////////////////////////////////////////////////////
+// MODEL LOADING
+/////////////////////////////////////////////////////////////////////////
+
+#if defined(MODELLOADER_USE_FBXSDK)
+//the whole load either way, welding, optimizing and simplifying included, each into a loader of its own. Both paths feed
+//the same corners to the same welder so they have to end up with the same vertices and indices
+static bool BenchmarkModelLoad(const char* filename){
+	GameTimer timer;
+	ModelLoader native, sdk;
+	timer.reset();
+	bool nativeLoaded = native.LoadModel(filename);
+	float nativeMs = ElapsedMs(timer);
+	timer.reset();
+	bool sdkLoaded = sdk.LoadModelWithSDK(filename);
+	float sdkMs = ElapsedMs(timer);
+	if (!nativeLoaded || !sdkLoaded){
+		std::cout << "  " << filename << ": could not be loaded with " << (nativeLoaded ? "the SDK" : "FBXParser") << std::endl;
+		return false;
+	}
+
+	bool passed = native.GetVertexCount() == sdk.GetVertexCount() && native.GetIndexCount() == sdk.GetIndexCount();
+	std::cout << std::fixed << std::setprecision(2) << "  " << filename << ": FBXParser " << nativeMs << " ms, " <<
+				 native.GetVertexCount() << " vertices, " << native.GetIndexCount() << " indices; SDK " << sdkMs << " ms (" <<
+				 (nativeMs > 0.0f ? sdkMs/nativeMs : 0.0f) << "x), " << sdk.GetVertexCount() << " vertices, " <<
+				 sdk.GetIndexCount() << " indices" << std::endl;
+	return passed;
+}
+#endif
+
+/////////////////////////////////////////////////////////////////////////
+
+static bool RunMapBenchmarks(const BenchmarkMap& map){
+	std::cout << map.name << " (" << map.rows << "x" << map.cols << ")" << std::endl;
+	bool passed = true;
+	passed = BenchmarkNormals(map) && passed;
+	passed = BenchmarkSmoothing(map) && passed;
+	//the bottom level of the tree has a min and max for every cell, twice the size of the heights - on the biggest map
+	//that's more than a 32 bit process can be sure of finding next to everything else
+	if (map.rows <= BENCHMARK_LARGE_MAP && map.cols <= BENCHMARK_LARGE_MAP)
+		passed = BenchmarkRayCasts(map) && passed;
+	//and the horizons are eight bytes a vertex
+	if (map.rows <= BENCHMARK_LARGE_MAP && map.cols <= BENCHMARK_LARGE_MAP)
+		passed = BenchmarkBake(map) && passed;
+	return passed;
+}
+
+bool RunBenchmarks(const char* heightmap){
+	bool passed = true;
+	{
+		BenchmarkMap map;
+		if (LoadBenchmarkMap(heightmap, map))
+			passed = RunMapBenchmarks(map) && passed;
+		else{
+			std::cout << "Could not load " << heightmap << std::endl;
+			passed = false;
+		}
+	}
+
+	const int sizes[2] = {BENCHMARK_LARGE_MAP, BENCHMARK_HUGE_MAP};
+	for (int i = 0; i < 2; i++){
+		BenchmarkMap map;
+		MakeBenchmarkMap(sizes[i], map);
+		passed = RunMapBenchmarks(map) && passed;
+	}
+
+#if defined(MODELLOADER_USE_FBXSDK)
+	std::cout << "models" << std::endl;
+	for (int i = 0; i < BENCHMARK_MODEL_COUNT; i++)
+		passed = BenchmarkModelLoad(BENCHMARK_MODELS[i]) && passed;
+#endif
+	return passed;
+}
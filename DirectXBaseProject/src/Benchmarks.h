@@ -0,0 +1,20 @@
+#ifndef _H_BENCHMARKS
+#define _H_BENCHMARKS
+
+///TIMES THE TERRAIN KERNELS AGAINST THE ROUTINES THEY REPLACED, RUN FROM THE CONSOLE WITH -bench INSTEAD OF STARTING THE GAME
+///EVERY BENCHMARK RUNS ON THE HEIGHTMAP THE GAME LOADS AND ON SYNTHETIC 4096x4096 AND 8192x8192 MAPS, ONE MAP AT A TIME SO
+///ONLY ONE OF THE BIG ONES IS EVER IN MEMORY. THE OLD ROUTINES ARE KEPT HERE AS THEY WERE SO THERE'S SOMETHING TO MEASURE AGAINST
+///BUILT WITH MODELLOADER_USE_FBXSDK IT ALSO TIMES LOADING THE SAMPLE MODELS WITH FBXParser AGAINST THE FBX SDK
+
+const int BENCHMARK_LARGE_MAP	= 4096;		// sides of the synthetic maps
+const int BENCHMARK_HUGE_MAP	= 8192;
+const int BENCHMARK_RAYS		= 1000000;	// random rays cast at each map
+
+// loaded with FBXParser and with the FBX SDK when the game is built with MODELLOADER_USE_FBXSDK
+const int BENCHMARK_MODEL_COUNT	= 2;
+const char* const BENCHMARK_MODELS[BENCHMARK_MODEL_COUNT] = {"assets/models/Grunt/Grunt.fbx", "assets/models/BloodyZombie.FBX"};
+
+// prints the timings to the console. Returns false if a kernel's results didn't match what it replaced or couldn't be run
+bool RunBenchmarks(const char* heightmap);
+
+#endif
@@ -0,0 +1,599 @@
+#include "FBXParser.h"
+#include "Inflate.h"
+#include <string.h>
+
+static const char BINARY_MAGIC[] = "Kaydara FBX Binary  ";	//followed by a 0, 0x1A, 0 and the version
+const size_t BINARY_HEADER_SIZE = 27;
+const int MAX_NODE_DEPTH = 64;		//deeper than any real file, it stops damaged ones running away
+
+//////////////////////////////////////////////////////////////////////////////////////////
+// Reading numbers out of ASCII files - the text isn't terminated so everything stops at end
+//////////////////////////////////////////////////////////////////////////////////////////
+
+static inline bool IsDigit(char c){
+	return c >= '0' && c <= '9';
+}
+
+static bool ParseDouble(const char*& p, const char* end, double& value){
+	bool negative = false;
+	if (p < end && (*p == '-' || *p == '+'))
+		negative = (*p++ == '-');
+
+	//up to 19 significant digits are gathered in an integer, the rest only move the decimal point
+	unsigned long long mantissa = 0;
+	int digits = 0;
+	int exponent = 0;
+	bool any = false;
+	for (; p < end && IsDigit(*p); p++, any = true){
+		if (digits < 19){
+			mantissa = mantissa*10 + (*p - '0');
+			if (mantissa)
+				digits++;
+		}
+		else{
+			exponent++;
+		}
+	}
+	if (p < end && *p == '.'){
+		for (p++; p < end && IsDigit(*p); p++, any = true){
+			if (digits < 19){
+				mantissa = mantissa*10 + (*p - '0');
+				exponent--;
+				if (mantissa)
+					digits++;
+			}
+		}
+	}
+	if (!any)
+		return false;
+
+	if (p < end && (*p == 'e' || *p == 'E')){
+		p++;
+		bool negativeExponent = false;
+		if (p < end && (*p == '-' || *p == '+'))
+			negativeExponent = (*p++ == '-');
+		int e = 0;
+		for (; p < end && IsDigit(*p); p++)
+			e = e < 10000 ? e*10 + (*p - '0') : e;
+		exponent += negativeExponent ? -e : e;
+	}
+
+	static const double POWERS[] = {1e0, 1e1, 1e2, 1e3, 1e4, 1e5, 1e6, 1e7, 1e8, 1e9, 1e10, 1e11, 1e12, 1e13, 1e14, 1e15,
+									1e16, 1e17, 1e18, 1e19, 1e20, 1e21, 1e22};
+	double result = (double)mantissa;
+	while (exponent > 22 && result != 0.0){
+		result *= 1e22;
+		exponent -= 22;
+	}
+	while (exponent < -22 && result != 0.0){
+		result /= 1e22;
+		exponent += 22;
+	}
+	if (exponent > 0)
+		result *= POWERS[exponent > 22 ? 22 : exponent];
+	else if (exponent < 0)
+		result /= POWERS[-exponent > 22 ? 22 : -exponent];
+
+	value = negative ? -result : result;
+	return true;
+}
+
+static long long ParseInteger(const char* p, const char* end){
+	bool negative = false;
+	if (p < end && (*p == '-' || *p == '+'))
+		negative = (*p++ == '-');
+	long long value = 0;
+	for (; p < end && IsDigit(*p); p++)
+		value = value*10 + (*p - '0');
+	return negative ? -value : value;
+}
+
+static inline bool IsSpace(char c){
+	return c == ' ' || c == '\t' || c == '\r' || c == '\n';
+}
+
+//////////////////////////////////////////////////////////////////////////////////////////
+// Nodes
+//////////////////////////////////////////////////////////////////////////////////////////
+
+bool FBXNode::IsNamed(const char* name)const{
+	return strncmp(this->name, name, nameLength) == 0 && name[nameLength] == 0;
+}
+
+std::string FBXNode::GetName()const{
+	return std::string(name, nameLength);
+}
+
+const FBXNode* FBXNode::GetFirstChild()const{
+	return firstChild >= 0 ? &document->nodes[firstChild] : nullptr;
+}
+
+const FBXNode* FBXNode::GetNext()const{
+	return nextSibling >= 0 ? &document->nodes[nextSibling] : nullptr;
+}
+
+const FBXNode* FBXNode::GetChild(const char* name)const{
+	const FBXNode* child = GetFirstChild();
+	while (child && !child->IsNamed(name))
+		child = child->GetNext();
+	return child;
+}
+
+const FBXNode* FBXNode::GetNextNamed(const char* name)const{
+	const FBXNode* node = GetNext();
+	while (node && !node->IsNamed(name))
+		node = node->GetNext();
+	return node;
+}
+
+int FBXNode::GetPropertyCount()const{
+	return propertyCount;
+}
+
+const FBXProperty* FBXNode::GetProperty(int index)const{
+	return (index >= 0 && index < propertyCount) ? &document->properties[firstProperty + index] : nullptr;
+}
+
+//the single values are unaligned in the file so they're copied out
+template<class T> static T ReadValue(const unsigned char* data){
+	T value;
+	memcpy(&value, data, sizeof(T));
+	return value;
+}
+
+long long FBXNode::GetInt(int index)const{
+	const FBXProperty* p = GetProperty(index);
+	if (!p)
+		return 0;
+	switch (p->type){
+	case 'Y':	return ReadValue<short>(p->data);
+	case 'C':	return *p->data;
+	case 'I':	return ReadValue<int>(p->data);
+	case 'L':	return ReadValue<long long>(p->data);
+	case 'F':	return (long long)ReadValue<float>(p->data);
+	case 'D':	return (long long)ReadValue<double>(p->data);
+	case 'N':	return ParseInteger((const char*)p->data, (const char*)p->data + p->size);
+	}
+	return 0;
+}
+
+double FBXNode::GetDouble(int index)const{
+	const FBXProperty* p = GetProperty(index);
+	if (!p)
+		return 0.0;
+	switch (p->type){
+	case 'F':	return ReadValue<float>(p->data);
+	case 'D':	return ReadValue<double>(p->data);
+	case 'N':{
+		const char* text = (const char*)p->data;
+		double value = 0.0;
+		ParseDouble(text, text + p->size, value);
+		return value;
+	}
+	}
+	return (double)GetInt(index);
+}
+
+std::string FBXNode::GetString(int index)const{
+	const FBXProperty* p = GetProperty(index);
+	if (!p || (p->type != 'S' && p->type != 'R'))
+		return std::string();
+	return std::string((const char*)p->data, p->size);
+}
+
+bool FBXNode::IsString(int index, const char* value)const{
+	const FBXProperty* p = GetProperty(index);
+	return p && p->type == 'S' && strlen(value) == p->size && memcmp(p->data, value, p->size) == 0;
+}
+
+static char ArrayType(const double*){	return 'd';}
+static char ArrayType(const float*){	return 'f';}
+static char ArrayType(const int*){		return 'i';}
+static char ArrayType(const long long*){return 'l';}
+
+template<class T> static bool DecodeArray(const FBXProperty* p, std::vector<T>& out){
+	if (!p)
+		return false;
+
+	if (p->type == 'A'){
+		const char* text = (const char*)p->data;
+		const char* end = text + p->size;
+		out.resize(p->count);
+		for (unsigned int i = 0; i < p->count; i++){
+			while (text < end && (IsSpace(*text) || *text == ','))
+				text++;
+			double value;
+			if (!ParseDouble(text, end, value))
+				return false;
+			out[i] = (T)value;
+		}
+		return true;
+	}
+
+	size_t elementSize;
+	switch (p->type){
+	case 'd': case 'l':	elementSize = 8;	break;
+	case 'f': case 'i':	elementSize = 4;	break;
+	case 'b':			elementSize = 1;	break;
+	default:			return false;
+	}
+	size_t bytes = p->count*elementSize;
+	out.resize(p->count);
+	if (p->count == 0)
+		return true;
+
+	//an array of the type asked for is unpacked or copied straight into the vector, anything else goes through a buffer
+	const unsigned char* src = p->data;
+	std::vector<unsigned char> scratch;
+	if (p->type == ArrayType((T*)nullptr)){
+		if (p->compressed)
+			return Inflate(p->data, p->size, (unsigned char*)&out[0], bytes);
+		if (p->size != bytes)
+			return false;
+		memcpy(&out[0], p->data, bytes);
+		return true;
+	}
+	if (p->compressed){
+		scratch.resize(bytes);
+		if (!Inflate(p->data, p->size, &scratch[0], bytes))
+			return false;
+		src = &scratch[0];
+	}
+	else if (p->size != bytes){
+		return false;
+	}
+
+	for (unsigned int i = 0; i < p->count; i++){
+		const unsigned char* element = src + i*elementSize;
+		switch (p->type){
+		case 'd':	out[i] = (T)ReadValue<double>(element);		break;
+		case 'f':	out[i] = (T)ReadValue<float>(element);		break;
+		case 'l':	out[i] = (T)ReadValue<long long>(element);	break;
+		case 'i':	out[i] = (T)ReadValue<int>(element);		break;
+		case 'b':	out[i] = (T)*element;						break;
+		}
+	}
+	return true;
+}
+
+bool FBXNode::GetArray(int index, std::vector<double>& out)const{
+	return DecodeArray(GetProperty(index), out);
+}
+
+bool FBXNode::GetArray(int index, std::vector<float>& out)const{
+	return DecodeArray(GetProperty(index), out);
+}
+
+bool FBXNode::GetArray(int index, std::vector<int>& out)const{
+	return DecodeArray(GetProperty(index), out);
+}
+
+bool FBXNode::GetArray(int index, std::vector<long long>& out)const{
+	return DecodeArray(GetProperty(index), out);
+}
+
+//////////////////////////////////////////////////////////////////////////////////////////
+// Document
+//////////////////////////////////////////////////////////////////////////////////////////
+
+FBXDocument::FBXDocument(void){
+	data = nullptr;
+	size = 0;
+	binary = false;
+	version = 0;
+}
+
+FBXDocument::~FBXDocument(void){
+	Close();
+}
+
+bool FBXDocument::Open(const char* filename){
+	Close();
+	if (!file.Open(filename))
+		return false;
+	return Parse(file.GetData(), file.GetSize());
+}
+
+void FBXDocument::Close(){
+	nodes.clear();
+	properties.clear();
+	file.Close();
+	data = nullptr;
+	size = 0;
+	binary = false;
+	version = 0;
+}
+
+bool FBXDocument::Parse(const unsigned char* data, size_t size){
+	this->data = data;
+	this->size = size;
+	nodes.clear();
+	properties.clear();
+
+	int lastChild = -1;
+	AddNode(-1, lastChild, "", 0);
+
+	binary = size >= BINARY_HEADER_SIZE && memcmp(data, BINARY_MAGIC, sizeof(BINARY_MAGIC)) == 0;
+	bool result = binary ? ParseBinary() : ParseAscii();
+	if (!result){
+		nodes.clear();
+		properties.clear();
+	}
+	return result;
+}
+
+bool FBXDocument::IsBinary()const{
+	return binary;
+}
+
+int FBXDocument::GetVersion()const{
+	return version;
+}
+
+const FBXNode* FBXDocument::GetRoot()const{
+	return nodes.empty() ? nullptr : &nodes[0];
+}
+
+const FBXNode* FBXDocument::Find(const char* name)const{
+	return nodes.empty() ? nullptr : nodes[0].GetChild(name);
+}
+
+//adds a node after lastChild under parent, and makes it the last child
+int FBXDocument::AddNode(int parent, int& lastChild, const char* name, int nameLength){
+	FBXNode node;
+	node.document = this;
+	node.name = name;
+	node.nameLength = nameLength;
+	node.firstProperty = properties.size();
+	node.propertyCount = 0;
+	node.firstChild = -1;
+	node.nextSibling = -1;
+
+	int index = nodes.size();
+	nodes.push_back(node);
+	if (lastChild >= 0)
+		nodes[lastChild].nextSibling = index;
+	else if (parent >= 0)
+		nodes[parent].firstChild = index;
+	lastChild = index;
+	return index;
+}
+
+/*
+Binary - a node is its end offset, property count, property bytes and name, then its properties and child nodes, with
+a record of zeroes after the children. The offsets and counts are 32 bit before version 7.5 and 64 bit from it.
+*/
+bool FBXDocument::ParseBinary(){
+	version = ReadValue<unsigned int>(data + 23);
+	size_t pos = BINARY_HEADER_SIZE;
+	return ParseBinaryList(pos, size, 0, 0);
+}
+
+bool FBXDocument::ParseBinaryList(size_t& pos, size_t listEnd, int parent, int depth){
+	if (depth > MAX_NODE_DEPTH)
+		return false;
+
+	bool wide = version >= 7500;
+	size_t headerSize = wide ? 25 : 13;
+	int lastChild = -1;
+
+	while (pos + headerSize <= listEnd){
+		const unsigned char* header = data + pos;
+		size_t endOffset, propertyCount, propertyBytes;
+		if (wide){
+			endOffset = (size_t)ReadValue<unsigned long long>(header);
+			propertyCount = (size_t)ReadValue<unsigned long long>(header + 8);
+			propertyBytes = (size_t)ReadValue<unsigned long long>(header + 16);
+		}
+		else{
+			endOffset = ReadValue<unsigned int>(header);
+			propertyCount = ReadValue<unsigned int>(header + 4);
+			propertyBytes = ReadValue<unsigned int>(header + 8);
+		}
+		unsigned int nameLength = header[headerSize - 1];
+
+		//the record of zeroes closing the list
+		if (endOffset == 0){
+			pos += headerSize;
+			return true;
+		}
+
+		size_t propertyStart = pos + headerSize + nameLength;
+		size_t propertyEnd = propertyStart + propertyBytes;
+		if (endOffset > listEnd || endOffset <= pos || propertyEnd > endOffset)
+			return false;
+
+		int node = AddNode(parent, lastChild, (const char*)header + headerSize, nameLength);
+		size_t p = propertyStart;
+		for (size_t i = 0; i < propertyCount; i++){
+			if (!ParseBinaryProperty(p, propertyEnd))
+				return false;
+		}
+		nodes[node].propertyCount = properties.size() - nodes[node].firstProperty;
+
+		if (propertyEnd < endOffset){
+			size_t childPos = propertyEnd;
+			if (!ParseBinaryList(childPos, endOffset, node, depth + 1))
+				return false;
+		}
+		pos = endOffset;
+	}
+	//the top level list runs into the footer rather than ending exactly
+	return depth == 0;
+}
+
+bool FBXDocument::ParseBinaryProperty(size_t& pos, size_t end){
+	if (pos >= end)
+		return false;
+
+	FBXProperty property;
+	property.type = data[pos++];
+	property.count = 1;
+	property.compressed = false;
+
+	switch (property.type){
+	case 'C':	property.size = 1;	break;
+	case 'Y':	property.size = 2;	break;
+	case 'I':
+	case 'F':	property.size = 4;	break;
+	case 'D':
+	case 'L':	property.size = 8;	break;
+	case 'S':
+	case 'R':
+		if (pos + 4 > end)
+			return false;
+		property.size = ReadValue<unsigned int>(data + pos);
+		property.count = property.size;
+		pos += 4;
+		break;
+	case 'f': case 'd': case 'l': case 'i': case 'b':
+		if (pos + 12 > end)
+			return false;
+		property.count = ReadValue<unsigned int>(data + pos);
+		property.compressed = ReadValue<unsigned int>(data + pos + 4) == 1;
+		property.size = ReadValue<unsigned int>(data + pos + 8);
+		pos += 12;
+		break;
+	default:
+		return false;
+	}
+
+	if (property.size > end - pos)
+		return false;
+	property.data = data + pos;
+	pos += property.size;
+	properties.push_back(property);
+	return true;
+}
+
+/*
+ASCII - "Name: property, property, ..." with the children between braces after the properties, and ; starting a
+comment. Arrays are written "*count { a: element, element, ... }" and are kept as text until they're read.
+*/
+static void SkipSpaceAndComments(const char*& p, const char* end){
+	while (p < end){
+		if (IsSpace(*p)){
+			p++;
+		}
+		else if (*p == ';'){
+			while (p < end && *p != '\n')
+				p++;
+		}
+		else{
+			break;
+		}
+	}
+}
+
+bool FBXDocument::ParseAscii(){
+	const char* p = (const char*)data;
+	if (!ParseAsciiList(p, 0, 0))
+		return false;
+
+	const FBXNode* header = Find("FBXHeaderExtension");
+	const FBXNode* fbxVersion = header ? header->GetChild("FBXVersion") : nullptr;
+	version = fbxVersion ? (int)fbxVersion->GetInt(0) : 0;
+	return true;
+}
+
+bool FBXDocument::ParseAsciiList(const char*& p, int parent, int depth){
+	if (depth > MAX_NODE_DEPTH)
+		return false;
+
+	const char* end = (const char*)data + size;
+	int lastChild = -1;
+	for (;;){
+		SkipSpaceAndComments(p, end);
+		if (p >= end)
+			return depth == 0;
+		if (*p == '}'){
+			p++;
+			return depth > 0;
+		}
+
+		const char* name = p;
+		while (p < end && *p != ':' && !IsSpace(*p) && *p != '{' && *p != '}')
+			p++;
+		if (p >= end || *p != ':')
+			return false;
+
+		int node = AddNode(parent, lastChild, name, p - name);
+		p++;
+		if (!ParseAsciiProperties(p, node, depth))
+			return false;
+	}
+}
+
+bool FBXDocument::ParseAsciiProperties(const char*& p, int node, int depth){
+	const char* end = (const char*)data + size;
+	for (;;){
+		while (p < end && (*p == ' ' || *p == '\t' || *p == '\r'))
+			p++;
+		if (p >= end || *p == '\n' || *p == ';' || *p == '}'){
+			nodes[node].propertyCount = properties.size() - nodes[node].firstProperty;
+			return true;
+		}
+
+		//a trailing comma carries the list on to the next line
+		if (*p == ','){
+			p++;
+			SkipSpaceAndComments(p, end);
+			continue;
+		}
+
+		if (*p == '{'){
+			nodes[node].propertyCount = properties.size() - nodes[node].firstProperty;
+			p++;
+			return ParseAsciiList(p, node, depth + 1);
+		}
+
+		FBXProperty property;
+		property.count = 1;
+		property.compressed = false;
+
+		if (*p == '"'){
+			const char* close = (const char*)memchr(p + 1, '"', end - p - 1);
+			if (!close)
+				return false;
+			property.type = 'S';
+			property.data = (const unsigned char*)p + 1;
+			property.size = close - p - 1;
+			p = close + 1;
+		}
+		else if (*p == '*'){
+			//the count, then the elements after "a:" up to the closing brace
+			p++;
+			property.type = 'A';
+			property.count = (unsigned int)ParseInteger(p, end);
+			const char* open = (const char*)memchr(p, '{', end - p);
+			const char* close = open ? (const char*)memchr(open, '}', end - open) : nullptr;
+			if (!close)
+				return false;
+			const char* elements = open + 1;
+			SkipSpaceAndComments(elements, close);
+			if (elements < close && *elements == 'a'){
+				elements++;
+				while (elements < close && IsSpace(*elements))
+					elements++;
+				if (elements < close && *elements == ':')
+					elements++;
+			}
+			property.data = (const unsigned char*)elements;
+			property.size = close - elements;
+			properties.push_back(property);
+			nodes[node].propertyCount = properties.size() - nodes[node].firstProperty;
+			p = close + 1;
+			return true;
+		}
+		else{
+			//a number, or a bare word like the T or Y of a flag
+			const char* start = p;
+			while (p < end && *p != ',' && !IsSpace(*p) && *p != '{' && *p != '}' && *p != ';')
+				p++;
+			property.type = (IsDigit(*start) || *start == '-' || *start == '+' || *start == '.') ? 'N' : 'S';
+			property.data = (const unsigned char*)start;
+			property.size = p - start;
+		}
+		properties.push_back(property);
+	}
+}
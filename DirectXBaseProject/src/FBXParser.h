@@ -0,0 +1,103 @@
+#ifndef _H_FBXPARSER
+#define _H_FBXPARSER
+
+#include "MappedFile.h"
+#include <vector>
+#include <string>
+
+///READS THE NODE TREE OF AN FBX FILE, BINARY OR ASCII, WITHOUT THE AUTODESK SDK
+///THE FILE IS MAPPED AND THE TREE IS BUILT IN ONE PASS OVER IT WITH THE NODES AND PROPERTIES ONLY POINTING INTO IT -
+///ARRAYS ARE DECOMPRESSED (BINARY) OR PARSED (ASCII) STRAIGHT INTO THE CALLER'S VECTOR WHEN THEY'RE ASKED FOR
+
+class FBXDocument;
+
+struct FBXProperty
+{
+	// binary files use the FBX type codes - Y, C, I, F, D, L for int16, bool, int32, float, double, int64, lowercase f, d, l,
+	// i, b for arrays of them, S for strings and R for raw bytes. ASCII properties are N (a number), S or A (an array), as text
+	char					type;
+	const unsigned char*	data;		// in the file - the value, the array's elements (maybe compressed) or the string
+	unsigned int			count;		// elements of an array
+	unsigned int			size;		// bytes at data
+	bool					compressed;	// a zlib compressed array
+};
+
+class FBXNode
+{
+public:
+	bool			IsNamed(const char* name)const;
+	std::string		GetName()const;
+
+	const FBXNode*	GetFirstChild()const;
+	const FBXNode*	GetNext()const;							// next node under the same parent
+	const FBXNode*	GetChild(const char* name)const;		// first child with the name, null if there's none
+	const FBXNode*	GetNextNamed(const char* name)const;	// next node under the same parent with the name
+
+	int					GetPropertyCount()const;
+	const FBXProperty*	GetProperty(int index)const;
+
+	// properties converted to what's asked for - numbers to either kind and strings as they are, defaulting to 0 or ""
+	long long		GetInt(int index)const;
+	double			GetDouble(int index)const;
+	std::string		GetString(int index)const;
+	bool			IsString(int index, const char* value)const;
+
+	// array properties (of any element type) converted to the vector's element type. False if it isn't an array or is damaged
+	bool			GetArray(int index, std::vector<double>& out)const;
+	bool			GetArray(int index, std::vector<float>& out)const;
+	bool			GetArray(int index, std::vector<int>& out)const;
+	bool			GetArray(int index, std::vector<long long>& out)const;
+
+private:
+	friend class FBXDocument;
+
+	const FBXDocument*	document;
+	const char*			name;
+	int					nameLength;
+	int					firstProperty;
+	int					propertyCount;
+	int					firstChild;			// indices into the document's nodes, -1 for none
+	int					nextSibling;
+};
+
+class FBXDocument
+{
+public:
+	FBXDocument(void);
+	~FBXDocument(void);
+
+	bool	Open(const char* filename);							// maps the file and reads its tree
+	bool	Parse(const unsigned char* data, size_t size);		// reads a file already in memory, which has to outlive the document
+	void	Close();
+
+	bool	IsBinary()const;
+	int		GetVersion()const;				// 7200 for 7.2 and so on, 0 if an ASCII file doesn't say
+
+	const FBXNode*	GetRoot()const;			// the top level nodes are its children
+	const FBXNode*	Find(const char* name)const;	// first top level node with the name
+
+private:
+	friend class FBXNode;
+
+	FBXDocument(const FBXDocument&);
+	FBXDocument& operator=(const FBXDocument&);
+
+	int		AddNode(int parent, int& lastChild, const char* name, int nameLength);
+	bool	ParseBinary();
+	bool	ParseBinaryList(size_t& pos, size_t listEnd, int parent, int depth);
+	bool	ParseBinaryProperty(size_t& pos, size_t end);
+	bool	ParseAscii();
+	bool	ParseAsciiList(const char*& p, int parent, int depth);
+	bool	ParseAsciiProperties(const char*& p, int node, int depth);
+
+private:
+	MappedFile					file;
+	const unsigned char*		data;
+	size_t						size;
+	bool						binary;
+	int							version;
+	std::vector<FBXNode>		nodes;			// the root first
+	std::vector<FBXProperty>	properties;
+};
+
+#endif
@@ -130,10 +130,29 @@ bool GameObject::SetupArraysAndInitBuffers(){
 //The InitializeBuffers function is where we handle creating the vertex and index buffers. 
 bool GameObject::InitializeBuffers(DWORD* indices, VertexNT* vertices){
 
+	//keep a box around the vertices for culling
+	Vector3f boxMin(0,0,0), boxMax(0,0,0);
+	if (mVertexCount > 0){
+		boxMin = boxMax = vertices[0].pos;
+		for (DWORD i = 1; i < mVertexCount; i++){
+			D3DXVec3Minimize(&boxMin, &boxMin, &vertices[i].pos);
+			D3DXVec3Maximize(&boxMax, &boxMax, &vertices[i].pos);
+		}
+	}
+
+	return InitializeBuffers(indices, vertices, boxMin, boxMax);
+}
+
+//the same with the box already known, so the vertices are only read by D3D - they can be straight out of a mapped file
+bool GameObject::InitializeBuffers(const DWORD* indices, const VertexNT* vertices, const Vector3f& boxMin, const Vector3f& boxMax){
+
 	D3D10_BUFFER_DESC vertexBufferDesc, indexBufferDesc;
 	D3D10_SUBRESOURCE_DATA vertexData, indexData;
 	HRESULT result;
 
+	boundsMin = boxMin;
+	boundsMax = boxMax;
+
 	// Set up the description of the vertex buffer.
 	vertexBufferDesc.Usage = D3D10_USAGE_DEFAULT;
 	vertexBufferDesc.ByteWidth = sizeof(VertexNT) * mVertexCount;
@@ -303,4 +322,30 @@ ID3D10ShaderResourceView* GameObject::GetBlendTexture(){
 
 ID3D10ShaderResourceView* GameObject::GetDiffuseMap(int rvWhich){
 	return diffuseMapRV[rvWhich]->GetTexture();
-}
\ No newline at end of file
+}
+
+//the object's box moved, turned and scaled the way setTrans places it, boxed again in world space
+void GameObject::GetWorldBounds(Vector3f& boxMin, Vector3f& boxMax){
+	D3DXMATRIX world, m;
+	D3DXMatrixScaling(&world, scale.x, scale.y, scale.z);
+	D3DXMatrixRotationX(&m, theta.x);
+	world *= m;
+	D3DXMatrixRotationY(&m, theta.y);
+	world *= m;
+	D3DXMatrixRotationZ(&m, theta.z);
+	world *= m;
+	D3DXMatrixTranslation(&m, pos.x, pos.y, pos.z);
+	world *= m;
+
+	for (int i = 0; i < 8; i++){
+		Vector3f corner((i & 1) ? boundsMax.x : boundsMin.x, (i & 2) ? boundsMax.y : boundsMin.y, (i & 4) ? boundsMax.z : boundsMin.z);
+		D3DXVec3TransformCoord(&corner, &corner, &world);
+		if (i == 0){
+			boxMin = boxMax = corner;
+		}
+		else{
+			D3DXVec3Minimize(&boxMin, &boxMin, &corner);
+			D3DXVec3Maximize(&boxMax, &boxMax, &corner);
+		}
+	}
+}
@@ -25,7 +25,7 @@ public:
 	D3DXVECTOR3 pos, theta, scale;	
 
 public:
-	GameObject(): mVertexCount(0), mIndexCount(0), mNumFaces(0), md3dDevice(0), mVB(0), mIB(0), scale(1,1,1),pos(0,0,0),theta(0,0,0)
+	GameObject(): mVertexCount(0), mIndexCount(0), mNumFaces(0), md3dDevice(0), mVB(0), mIB(0), scale(1,1,1),pos(0,0,0),theta(0,0,0),boundsMin(0,0,0),boundsMax(0,0,0)
 	{
 		diffuseMap = specularMap = blendMap = 0;
 		for (int i = 0; i < 3; i++) diffuseMapRV[i] = 0;
@@ -55,12 +55,12 @@ public:
 	ID3D10ShaderResourceView* GetDiffuseMap(int rvWhich);
 
 	int						  GetIndexCount();
+	void					  GetWorldBounds(Vector3f& boxMin, Vector3f& boxMax);	// box around the object where it is now, for culling
 	///////////////////////////////////////////////
 private:
 	
 	void ShutdownBuffers();
 	void RenderBuffers();
-	void setTrans(D3DXMATRIX worldMatrix);
 	
 
 	TextureLoader* specularMap;
@@ -72,6 +72,7 @@ protected:
 	DWORD mVertexCount;
 	DWORD mIndexCount;
 	DWORD mNumFaces;
+	Vector3f boundsMin, boundsMax;	// around the vertices, in object space
 
 	ID3D10Device* md3dDevice;
 	ID3D10Buffer* mVB;
@@ -81,8 +82,11 @@ protected:
 	unsigned int offset;
 
 	virtual bool InitializeBuffers(DWORD* indices,  VertexNT* vertices);
+	bool InitializeBuffers(const DWORD* indices, const VertexNT* vertices, const Vector3f& boxMin, const Vector3f& boxMax);
 	virtual bool SetupArraysAndInitBuffers();
 
+	void setTrans(D3DXMATRIX worldMatrix);
+
 	bool LoadTexture(WCHAR* diffuseMapTex, WCHAR* specularMapTex);
 	bool LoadMultiTexture(WCHAR* specularMapTex, WCHAR* blendMapTex, WCHAR* diffuseMapRV1Tex,
 																						   WCHAR* diffuseMapRV2Tex,
@@ -0,0 +1,335 @@
+#include "GeoMipmap.h"
+
+
+GeoMipmap::GeoMipmap(void){
+	mIB = nullptr;
+	gridRows = gridCols = 0;
+	patchSize = 0;
+	patchRows = patchCols = 0;
+	levelCount = 0;
+	cellSpacing = 1.0f;
+	originX = originZ = 0.0f;
+}
+
+GeoMipmap::~GeoMipmap(void){
+	Shutdown();
+}
+
+bool GeoMipmap::Initialize(ID3D10Device* device, const float* heights, int rows, int cols, int patchSize, float cellSpacing, float originX, float originZ){
+	Shutdown();
+
+	if (rows < 2 || cols < 2 || patchSize < 2)
+		return false;
+
+	//the patch size has to be a power of two so every level halves it - round down to one, and to the most levels there
+	//can be. Every level has an index list for each of the 16 ways it can be stitched, so bigger patches would soon
+	//take more index memory than the vertices they draw
+	this->patchSize = 2;
+	levelCount = 2;
+	while (this->patchSize*2 <= patchSize && levelCount < GEOMIPMAP_MAX_LEVELS){
+		this->patchSize *= 2;
+		levelCount++;
+	}
+
+	gridRows = rows;
+	gridCols = cols;
+	this->cellSpacing = cellSpacing;
+	this->originX = originX;
+	this->originZ = originZ;
+
+	patchRows = (gridRows - 2)/this->patchSize + 1;
+	patchCols = (gridCols - 2)/this->patchSize + 1;
+
+	//lay out the patches - the ones along the far edges are smaller when the grid isn't a multiple of the patch size
+	for (int pr = 0; pr < patchRows; pr++){
+		for (int pc = 0; pc < patchCols; pc++){
+			Patch patch;
+			patch.firstRow = pr*this->patchSize;
+			patch.firstCol = pc*this->patchSize;
+			patch.rows = Min(this->patchSize, gridRows-1-patch.firstRow);
+			patch.cols = Min(this->patchSize, gridCols-1-patch.firstCol);
+			patch.shape = FindShape(patch.rows, patch.cols);
+			patch.level = 0;
+			ComputePatchErrors(patch, heights);
+			patches.push_back(patch);
+		}
+	}
+
+	//build every level and stitch combination for every shape into one index buffer
+	std::vector<DWORD> indices;
+	ranges.resize(shapes.size()*levelCount*16);
+	for (unsigned int shape = 0; shape < shapes.size(); shape++){
+		for (int level = 0; level < levelCount; level++){
+			for (int mask = 0; mask < 16; mask++){
+				IndexRange& range = ranges[(shape*levelCount + level)*16 + mask];
+				range.start = indices.size();
+				BuildIndices(shapes[shape].first, shapes[shape].second, level, mask, indices);
+				range.count = indices.size() - range.start;
+			}
+		}
+	}
+
+	D3D10_BUFFER_DESC indexBufferDesc;
+	D3D10_SUBRESOURCE_DATA indexData;
+
+	indexBufferDesc.Usage = D3D10_USAGE_IMMUTABLE;
+	indexBufferDesc.ByteWidth = sizeof(DWORD) * indices.size();
+	indexBufferDesc.BindFlags = D3D10_BIND_INDEX_BUFFER;
+	indexBufferDesc.CPUAccessFlags = 0;
+	indexBufferDesc.MiscFlags = 0;
+
+	indexData.pSysMem = &indices[0];
+
+	if (FAILED(device->CreateBuffer(&indexBufferDesc, &indexData, &mIB))){
+		return false;
+	}
+
+	return true;
+}
+
+void GeoMipmap::Shutdown(){
+	ReleaseCOM(mIB);
+	patches.clear();
+	shapes.clear();
+	ranges.clear();
+	batches.clear();
+}
+
+int GeoMipmap::FindShape(int rows, int cols){
+	for (unsigned int i = 0; i < shapes.size(); i++){
+		if (shapes[i].first == rows && shapes[i].second == cols)
+			return i;
+	}
+	shapes.push_back(std::make_pair(rows, cols));
+	return shapes.size() - 1;
+}
+
+/*
+Triangulates a patch of rows x cols quads at the given level, with the same diagonal the full grid uses.
+Bits 0-3 of the stitch mask are set when the neighbour above/below/left/right is one level coarser - the
+edge vertices on that side that the neighbour doesn't have are snapped onto the next vertex it does have
+and the triangles that collapse are dropped, which leaves a fan matching the neighbour's edge exactly.
+*/
+void GeoMipmap::BuildIndices(int rows, int cols, int level, int stitchMask, std::vector<DWORD>& out){
+	int step = 1 << level;
+
+	//the rows and columns this level keeps - every step'th one plus the last one
+	std::vector<int> rowSamples, colSamples;
+	for (int r = 0; r < rows; r += step)
+		rowSamples.push_back(r);
+	rowSamples.push_back(rows);
+	for (int c = 0; c < cols; c += step)
+		colSamples.push_back(c);
+	colSamples.push_back(cols);
+
+	for (unsigned int a = 0; a + 1 < rowSamples.size(); a++){
+		for (unsigned int b = 0; b + 1 < colSamples.size(); b++){
+			int quad[4][2] = {
+				{rowSamples[a],   colSamples[b]},		// top left
+				{rowSamples[a],   colSamples[b+1]},		// top right
+				{rowSamples[a+1], colSamples[b]},		// bottom left
+				{rowSamples[a+1], colSamples[b+1]}		// bottom right
+			};
+
+			//snap the corners that sit on a stitched edge
+			for (int v = 0; v < 4; v++){
+				int& r = quad[v][0];
+				int& c = quad[v][1];
+				if ((stitchMask & 1) && r == 0 && c % (2*step) != 0 && c != cols)
+					c -= step;
+				if ((stitchMask & 2) && r == rows && c % (2*step) != 0 && c != cols)
+					c = Min(c + step, cols);
+				if ((stitchMask & 4) && c == 0 && r % (2*step) != 0 && r != rows)
+					r -= step;
+				if ((stitchMask & 8) && c == cols && r % (2*step) != 0 && r != rows)
+					r = Min(r + step, rows);
+			}
+
+			const int triangles[2][3] = {{0,1,2}, {2,1,3}};
+			for (int t = 0; t < 2; t++){
+				const int* v0 = quad[triangles[t][0]];
+				const int* v1 = quad[triangles[t][1]];
+				const int* v2 = quad[triangles[t][2]];
+
+				//drop the triangles the snapping flattened
+				int area = (v1[1]-v0[1])*(v2[0]-v0[0]) - (v2[1]-v0[1])*(v1[0]-v0[0]);
+				if (area == 0)
+					continue;
+
+				out.push_back(v0[0]*gridCols + v0[1]);
+				out.push_back(v1[0]*gridCols + v1[1]);
+				out.push_back(v2[0]*gridCols + v2[1]);
+			}
+		}
+	}
+}
+
+void GeoMipmap::UpdateHeights(const float* heights, int firstRow, int firstCol, int lastRow, int lastCol){
+	//vertices on a patch edge belong to the patches on both sides
+	int pr0 = Max(firstRow - 1, 0)/patchSize;
+	int pc0 = Max(firstCol - 1, 0)/patchSize;
+	int pr1 = Min(lastRow/patchSize, patchRows - 1);
+	int pc1 = Min(lastCol/patchSize, patchCols - 1);
+
+	for (int pr = pr0; pr <= pr1; pr++){
+		for (int pc = pc0; pc <= pc1; pc++){
+			ComputePatchErrors(patches[pr*patchCols + pc], heights);
+		}
+	}
+}
+
+//find how far each level strays from the full detail heights - the height of every vertex is compared against
+//the triangle of the coarser level it falls in
+void GeoMipmap::ComputePatchErrors(Patch& patch, const float* heights){
+	const float* base = heights + patch.firstRow*gridCols + patch.firstCol;
+
+	patch.minHeight = patch.maxHeight = base[0];
+	for (int r = 0; r <= patch.rows; r++){
+		for (int c = 0; c <= patch.cols; c++){
+			float h = base[r*gridCols + c];
+			patch.minHeight = Min(patch.minHeight, h);
+			patch.maxHeight = Max(patch.maxHeight, h);
+		}
+	}
+
+	for (int i = 0; i < GEOMIPMAP_MAX_LEVELS; i++)
+		patch.error[i] = 0.0f;
+
+	for (int level = 1; level < levelCount; level++){
+		int step = 1 << level;
+		int lastRow = ((patch.rows-1)/step)*step;		// start of the last cell of this level
+		int lastCol = ((patch.cols-1)/step)*step;
+		float worst = patch.error[level-1];
+
+		for (int r = 0; r <= patch.rows; r++){
+			int r0 = Min((r/step)*step, lastRow);
+			int r1 = Min(r0 + step, patch.rows);
+			float v = (float)(r - r0)/(r1 - r0);
+
+			for (int c = 0; c <= patch.cols; c++){
+				int c0 = Min((c/step)*step, lastCol);
+				int c1 = Min(c0 + step, patch.cols);
+				float u = (float)(c - c0)/(c1 - c0);
+
+				float A = base[r0*gridCols + c0];
+				float B = base[r0*gridCols + c1];
+				float C = base[r1*gridCols + c0];
+				float D = base[r1*gridCols + c1];
+
+				float coarse;
+				if (u + v <= 1.0f)
+					coarse = A + u*(B - A) + v*(C - A);
+				else
+					coarse = D + (1.0f-u)*(C - D) + (1.0f-v)*(B - D);
+
+				worst = Max(worst, fabsf(base[r*gridCols + c] - coarse));
+			}
+		}
+		patch.error[level] = worst;
+	}
+}
+
+GeoMipmap::Patch* GeoMipmap::GetNeighbour(int patchRow, int patchCol){
+	if (patchRow < 0 || patchCol < 0 || patchRow >= patchRows || patchCol >= patchCols)
+		return nullptr;
+	return &patches[patchRow*patchCols + patchCol];
+}
+
+void GeoMipmap::Update(const Vector3f& cameraPos, float fovY, int screenHeight, float pixelError){
+	batches.clear();
+	if (patches.empty())
+		return;
+
+	//how many pixels a unit of height error covers at a distance of one unit
+	float lodScale = screenHeight / (2.0f*tanf(fovY*0.5f));
+
+	for (unsigned int i = 0; i < patches.size(); i++){
+		Patch& patch = patches[i];
+
+		//distance from the camera to the patch's bounding box
+		float minX = originX + patch.firstCol*cellSpacing;
+		float maxX = originX + (patch.firstCol + patch.cols)*cellSpacing;
+		float maxZ = originZ - patch.firstRow*cellSpacing;
+		float minZ = originZ - (patch.firstRow + patch.rows)*cellSpacing;
+
+		float dx = Max(Max(minX - cameraPos.x, cameraPos.x - maxX), 0.0f);
+		float dy = Max(Max(patch.minHeight - cameraPos.y, cameraPos.y - patch.maxHeight), 0.0f);
+		float dz = Max(Max(minZ - cameraPos.z, cameraPos.z - maxZ), 0.0f);
+		float distance = sqrtf(dx*dx + dy*dy + dz*dz);
+
+		//coarsest level whose error still projects to less than the tolerance
+		patch.level = 0;
+		while (patch.level + 1 < levelCount && patch.error[patch.level+1]*lodScale <= pixelError*distance)
+			patch.level++;
+	}
+
+	//neighbours may only be one level apart for the stitching to line up - refine the coarse side until they are
+	bool changed = true;
+	while (changed){
+		changed = false;
+		for (int pr = 0; pr < patchRows; pr++){
+			for (int pc = 0; pc < patchCols; pc++){
+				Patch* patch = GetNeighbour(pr, pc);
+				Patch* neighbours[4] = {GetNeighbour(pr-1, pc), GetNeighbour(pr+1, pc), GetNeighbour(pr, pc-1), GetNeighbour(pr, pc+1)};
+				for (int n = 0; n < 4; n++){
+					if (neighbours[n] && patch->level > neighbours[n]->level + 1){
+						patch->level = neighbours[n]->level + 1;
+						changed = true;
+					}
+				}
+			}
+		}
+	}
+
+	for (int pr = 0; pr < patchRows; pr++){
+		for (int pc = 0; pc < patchCols; pc++){
+			Patch* patch = GetNeighbour(pr, pc);
+			Patch* neighbours[4] = {GetNeighbour(pr-1, pc), GetNeighbour(pr+1, pc), GetNeighbour(pr, pc-1), GetNeighbour(pr, pc+1)};
+
+			int stitchMask = 0;
+			for (int n = 0; n < 4; n++){
+				if (neighbours[n] && neighbours[n]->level > patch->level)
+					stitchMask |= 1 << n;
+			}
+
+			IndexRange& range = ranges[(patch->shape*levelCount + patch->level)*16 + stitchMask];
+			TerrainBatch batch;
+			batch.indexCount = range.count;
+			batch.startIndex = range.start;
+			batch.baseVertex = patch->firstRow*gridCols + patch->firstCol;
+			batches.push_back(batch);
+		}
+	}
+}
+
+int GeoMipmap::GetBatchCount(){
+	return batches.size();
+}
+
+TerrainBatch GeoMipmap::GetBatch(int which){
+	return batches[which];
+}
+
+//there's a batch for every patch in the same order
+void GeoMipmap::GetBatchArea(int which, int& firstRow, int& firstCol, int& rows, int& cols){
+	const Patch& patch = patches[which];
+	firstRow = patch.firstRow;
+	firstCol = patch.firstCol;
+	rows = patch.rows;
+	cols = patch.cols;
+}
+
+ID3D10Buffer* GeoMipmap::GetIndexBuffer(){
+	return mIB;
+}
+
+int GeoMipmap::GetLevelCount(){
+	return levelCount;
+}
+
+DWORD GeoMipmap::GetTriangleCount(){
+	DWORD count = 0;
+	for (unsigned int i = 0; i < batches.size(); i++)
+		count += batches[i].indexCount/3;
+	return count;
+}
@@ -0,0 +1,90 @@
+/////////////////////////////////////////////////////////////////////////
+// GEOMIPMAP - PICKS A LEVEL OF DETAIL FOR EVERY PATCH OF THE TERRAIN
+/////////////////////////////////////////////////////////////////////////
+
+#ifndef _GEOMIPMAP_H
+#define _GEOMIPMAP_H
+
+#include "d3dUtil.h"
+#include "Vertex.h"
+#include <vector>
+
+const int GEOMIPMAP_MAX_LEVELS = 8;		// levels a patch can have, counting full detail - patches are at most 128 quads
+
+//one indexed draw out of the shared vertex and index buffers
+struct TerrainBatch
+{
+	UINT	indexCount;
+	UINT	startIndex;
+	INT		baseVertex;
+};
+
+/*
+The terrain is split into square patches of patchSize quads (a power of two, no more than 128) that all draw out of
+the grid's single vertex buffer. Every level of detail skips every other row and column of the level before it. The index
+lists for each level are shared between all patches of the same shape - a patch just offsets them with its
+base vertex. A patch next to a coarser patch uses a stitched list that snaps its edge vertices onto the coarser
+neighbour's so no cracks open up between them, which is why neighbours may only be one level apart.
+*/
+class GeoMipmap
+{
+public:
+	GeoMipmap(void);
+	~GeoMipmap(void);
+
+	// rows/cols are the vertex counts of the grid and heights is row major with a pitch of cols. originX/originZ
+	// is the position of the first vertex, columns run along +x and rows along -z like they do in the grid
+	bool Initialize(ID3D10Device* device, const float* heights, int rows, int cols, int patchSize, float cellSpacing, float originX, float originZ);
+	void Shutdown();
+	// works the errors out again for the patches over the vertices in rows firstRow to lastRow and columns firstCol to lastCol
+	void UpdateHeights(const float* heights, int firstRow, int firstCol, int lastRow, int lastCol);
+
+	// picks the level of every patch from the camera position (in grid space) so no patch is more than
+	// pixelError pixels off the full detail terrain. fovY is the vertical field of view of the projection
+	void Update(const Vector3f& cameraPos, float fovY, int screenHeight, float pixelError);
+
+	int				GetBatchCount();
+	TerrainBatch	GetBatch(int which);
+	void			GetBatchArea(int which, int& firstRow, int& firstCol, int& rows, int& cols);	// quads the batch covers
+	ID3D10Buffer*	GetIndexBuffer();
+	int				GetLevelCount();
+	DWORD			GetTriangleCount();		// triangles drawn with the current selection
+
+private:
+	struct Patch
+	{
+		int		firstRow, firstCol;
+		int		rows, cols;					// in quads
+		int		shape;						// which set of shared index lists it draws with
+		float	minHeight, maxHeight;
+		float	error[GEOMIPMAP_MAX_LEVELS];	// worst height difference to the full detail terrain for each level
+		int		level;
+	};
+
+	struct IndexRange
+	{
+		UINT	start;
+		UINT	count;
+	};
+
+	int		FindShape(int rows, int cols);
+	void	BuildIndices(int rows, int cols, int level, int stitchMask, std::vector<DWORD>& out);
+	void	ComputePatchErrors(Patch& patch, const float* heights);
+	Patch*	GetNeighbour(int patchRow, int patchCol);
+
+private:
+	ID3D10Buffer*				mIB;
+	int							gridRows, gridCols;
+	int							patchSize;
+	int							patchRows, patchCols;	// patches along each side
+	int							levelCount;
+	float						cellSpacing;
+	float						originX, originZ;
+
+	std::vector<Patch>			patches;
+	std::vector<std::pair<int,int> > shapes;			// rows/cols of each distinct patch shape
+	std::vector<IndexRange>		ranges;					// [shape][level][stitch mask] into the shared index buffer
+	std::vector<TerrainBatch>	batches;
+};
+
+#endif
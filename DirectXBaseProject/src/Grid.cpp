@@ -1,26 +1,68 @@
 #include "Grid.h"
+#include "TerrainKernels.h"
+#include <algorithm>
+#include <string>
 
 
 Grid::Grid(void)
 {
-	maxHeight = 0.0f;
+	maxHeight = minHeight = 0.0f;
 	heightData = nullptr;
 	vertices = nullptr;
+	compactVertices = nullptr;
 	indices = nullptr;
+	gridWidth = gridDepth = 0;
+
+	tiled = false;
+	tileSize = 0;
+	tileBudget = 0;
+	tileLoadDistance = 0.0f;
+	residentBytes = 0;
+	frameNumber = 0;
+
+	geoMipmap = nullptr;
+	lodPatchSize = 0;
+	lodPixelError = 0.0f;
+
+	smoothKernel = SMOOTH_EXPONENTIAL;
+	smoothIterations = 4;
+	smoothAmount = 0.75f;
+	caching = true;
+	compact = false;
+
+	indexMode = TERRAIN_INDEX_LIST32;
+	indexPatchSize = 0;
+	vertexCacheSize = DEFAULT_VERTEX_CACHE;
+
+	bakeLighting = false;
+	bakeHorizons = false;
+	occlusionMap = nullptr;
+	horizonMaps[0] = horizonMaps[1] = nullptr;
 }
 
 
 Grid::~Grid(void)
 {
 	Shutdown();
+	ReleaseTiles();
+	ReleaseLightMaps();
+	if (geoMipmap){
+		delete geoMipmap;
+		geoMipmap = nullptr;
+	}
 	if (vertices){
 		delete [] vertices;
 		vertices = nullptr;		
 	}
+	if (compactVertices){
+		delete [] compactVertices;
+		compactVertices = nullptr;
+	}
 	if (indices){
 		delete [] indices;
 		indices = nullptr;		
 	}
+	quadtree.Shutdown();
 	if (heightData){
 		delete [] heightData;
 		heightData = nullptr;
@@ -28,209 +70,582 @@ Grid::~Grid(void)
 }
 
 bool Grid::GenerateGridFromTGA(char* filename){
+	return GenerateGridFromFile(filename, false, HEIGHTMAP_R16, 0, 0);
+}
+
+bool Grid::GenerateGridFromRaw(char* filename, HEIGHTMAP_FORMAT format, int width, int depth){
+	return GenerateGridFromFile(filename, true, format, width, depth);
+}
+
+bool Grid::GenerateGridFromFile(char* filename, bool raw, HEIGHTMAP_FORMAT format, int width, int depth){
+	//a cache next to the heightmap built from the same file with the same settings skips all the processing below
+	TerrainCacheKey key;
+	std::string cacheName = std::string(filename) + ".cache";
+	bool useCache = caching && MakeCacheKey(filename, raw ? format : -1, width, depth, key);
+	if (useCache){
+		TerrainCache cache;
+		if (cache.Load(cacheName.c_str(), key))
+			return BuildFromCache(cache);
+	}
+
 	TerrainLoader *terrainLoader = new TerrainLoader();
+	terrainLoader->SetSmoothing(smoothKernel, smoothIterations, smoothAmount);
 
-	if (!terrainLoader->LoadTerrain(filename)){
+	bool loaded = raw ? terrainLoader->LoadTerrainRaw(filename, format, width, depth) : terrainLoader->LoadTerrain(filename);
+	if (!loaded){
+		delete terrainLoader;
 		return false;
 	}
 
-	gridWidth = terrainLoader->GetWidth();
-	gridDepth = terrainLoader->GetDepth();
+	bool result = LoadHeights(terrainLoader);
 
-	mVertexCount = (gridWidth*gridDepth);
-	vertices = new VertexNT[mVertexCount];
+	delete terrainLoader;
+	terrainLoader = nullptr;
+
+	if (!result || !BuildFromHeights())
+		return false;
+
+	//a cache that can't be written only costs the next run its head start
+	if (useCache){
+		TerrainCache::Save(cacheName.c_str(), key, gridWidth, gridDepth, maxHeight, heightData,
+						   vertices, vertices ? mVertexCount : 0, indices, indices ? mIndexCount : 0);
+	}
+	return true;
+}
 
+//everything after the heights, whichever way they were made
+bool Grid::BuildFromHeights(){
+	float dx = CELLSPACING;
+	quadtree.Build(heightData, gridWidth, gridDepth, dx, -(gridWidth-1)*dx*0.5f, (gridDepth-1)*dx*0.5f);
+	if (!BakeLighting())
+		return false;
+
+	//in tiled mode the tiles are built on demand as the camera gets near them
+	if (tiled){
+		InitializeTiles();
+		return true;
+	}
+	return BuildMesh();
+}
+
+void Grid::SetSmoothing(SMOOTH_KERNEL kernel, int iterations, float amount){
+	smoothKernel = kernel;
+	smoothIterations = iterations;
+	smoothAmount = amount;
+}
+
+void Grid::SetCaching(bool enabled){
+	caching = enabled;
+}
+
+void Grid::SetCompactVertices(bool enabled){
+	compact = enabled;
+}
+
+//format is -1 for a TGA, the dimensions only matter for the headerless formats
+bool Grid::MakeCacheKey(const char* filename, int format, int width, int depth, TerrainCacheKey& key){
+	MappedFile source;
+	if (!source.Open(filename))
+		return false;
+
+	memset(&key, 0, sizeof(key));
+	key.sourceHash = TerrainCache::Hash(source.GetData(), source.GetSize());
+	key.heightFactor = HEIGHT_FACTOR;
+	key.cellSpacing = CELLSPACING;
+	key.textureRepeat = TEXTURE_REPEAT;
+	key.smoothKernel = smoothKernel;
+	key.smoothIterations = smoothIterations;
+	key.smoothAmount = smoothAmount;
+	key.sourceFormat = format;
+	key.sourceWidth = width;
+	key.sourceDepth = depth;
+	return true;
+}
+
+//the buffers are made straight from the mapped cache so, unlike after BuildMesh, no copy of the vertices or indices is kept
+bool Grid::BuildFromCache(const TerrainCache& cache){
+	gridWidth = cache.GetWidth();
+	gridDepth = cache.GetDepth();
+	maxHeight = cache.GetMaxHeight();
 	heightData = new float[gridWidth*gridDepth];
+	memcpy(heightData, cache.GetHeights(), gridWidth*gridDepth*sizeof(float));
+	minHeight = heightData[0];
+	for (int i = 1; i < gridWidth*gridDepth; i++)
+		minHeight = Min(minHeight, heightData[i]);
 
 	float dx = CELLSPACING;
 	float halfWidth = (gridWidth-1)*dx*0.5f;
 	float halfDepth = (gridDepth-1)*dx*0.5f;
+	quadtree.Build(heightData, gridWidth, gridDepth, dx, -halfWidth, halfDepth);
+	if (!BakeLighting())
+		return false;
 
-	for(DWORD i = 0; i < gridWidth; ++i){
-		float z = halfDepth - i*dx;
+	if (tiled){
+		InitializeTiles();
+		return true;
+	}
 
-		for(DWORD j = 0; j < gridDepth; ++j){
-			float x = -halfWidth + j*dx;
-			// Graph of this function looks like a mountain range.
+	//the cache was written in a different mode and is missing the buffers this one needs - the heights still saved the loading and smoothing.
+	//The cache only holds full size vertices so compact ones are always rebuilt, which is cheap next to the loading
+	mVertexCount = gridWidth*gridDepth;
+	if (compact || cache.GetVertexCount() != mVertexCount || (lodPatchSize <= 0 && indexMode == TERRAIN_INDEX_LIST32 && cache.GetIndexCount() == 0))
+		return BuildMesh();
+
+	stride = sizeof(VertexNT);
+	if (lodPatchSize > 0){
+		mIndexCount = 0;
+		if (!CreateVertexBuffer(cache.GetVertices(), sizeof(VertexNT), mVertexCount, &mVB))
+			return false;
+
+		geoMipmap = new GeoMipmap();
+		return geoMipmap->Initialize(md3dDevice, heightData, gridWidth, gridDepth, lodPatchSize, dx, -halfWidth, halfDepth);
+	}
+
+	if (indexMode != TERRAIN_INDEX_LIST32){
+		if (!CreateVertexBuffer(cache.GetVertices(), sizeof(VertexNT), mVertexCount, &mVB))
+			return false;
+		return BuildPatches();
+	}
+
+	mIndexCount = cache.GetIndexCount();
+	return CreateBuffers(cache.GetVertices(), sizeof(VertexNT), mVertexCount, cache.GetIndices(), sizeof(DWORD), mIndexCount, &mVB, &mIB);
+}
+
+void Grid::SetTiling(int tileSize, size_t budgetBytes, float loadDistance){
+	tiled = tileSize > 0;
+	this->tileSize = tileSize;
+	tileBudget = budgetBytes;
+	tileLoadDistance = loadDistance;
+	if (tiled)
+		lodPatchSize = 0;
+}
+
+void Grid::SetIndexMode(TERRAIN_INDEX_MODE mode, int patchSize, int cacheSize){
+	indexMode = mode;
+	indexPatchSize = Max(patchSize, 1);
+	vertexCacheSize = Max(cacheSize, 4);
+}
+
+void Grid::SetGeoMipmapping(int patchSize, float pixelError){
+	lodPatchSize = patchSize;
+	lodPixelError = pixelError;
+	if (lodPatchSize > 0)
+		tiled = false;
+}
+
+bool Grid::LoadHeights(TerrainLoader* terrainLoader){
+	gridWidth = terrainLoader->GetWidth();
+	gridDepth = terrainLoader->GetDepth();
+
+	if (gridWidth < 2 || gridDepth < 2)
+		return false;
+
+	heightData = new float[gridWidth*gridDepth];
+	maxHeight = 0.0f;
+	minHeight = terrainLoader->GetHeight(0,0)*HEIGHT_FACTOR;
+
+	for(int i = 0; i < gridWidth; ++i){
+		for(int j = 0; j < gridDepth; ++j){
 			float y = terrainLoader->GetHeight(i,j)*HEIGHT_FACTOR;
 			heightData[i*gridDepth+j] = y;//place in height data array
-			vertices[i*gridDepth+j].pos = Vector3f(x, y, z);
 			if (y > maxHeight){
 				maxHeight = y;
 			}
+			if (y < minHeight){
+				minHeight = y;
+			}
 		}
 	}
+	return true;
+}
 
-	ComputeNormals();
-	ComputeTextureCoords();
-	
-	// Iterate over each quad and compute indices.
-	mIndexCount = ((gridWidth-1)*(gridDepth-1)*6);
-	indices = new DWORD[mIndexCount];
-	int k = 0;
-	for(DWORD i = 0; i < gridWidth-1; ++i){
-		for(DWORD j = 0; j < gridDepth-1; ++j){
-			// Upper left.
+bool Grid::BuildMesh(){
+	BuildMeshArrays(ThreadPool::GetShared());
 
-			indices[k] = i*gridDepth+j;
-			indices[k+1] = i*gridDepth+j+1;
-			indices[k+2] = (i+1)*gridDepth+j;
+	const void *vertexData = compact ? (const void*)compactVertices : (const void*)vertices;
+	stride = GetVertexSize();
 
-			indices[k+3] = (i+1)*gridDepth+j;
-			indices[k+4] = i*gridDepth+j+1;
-			indices[k+5] = (i+1)*gridDepth+j+1;
-			k += 6; // next quad
-		}
+	if (lodPatchSize > 0){
+		if (!CreateVertexBuffer(vertexData, stride, mVertexCount, &mVB))
+			return false;
+
+		float dx = CELLSPACING;
+		geoMipmap = new GeoMipmap();
+		return geoMipmap->Initialize(md3dDevice, heightData, gridWidth, gridDepth, lodPatchSize, dx, -(gridWidth-1)*dx*0.5f, (gridDepth-1)*dx*0.5f);
+	}
+
+	if (indexMode != TERRAIN_INDEX_LIST32){
+		if (!CreateVertexBuffer(vertexData, stride, mVertexCount, &mVB))
+			return false;
+		return BuildPatches();
 	}
 
 	//initialize the buffers with the index and vertex data
-	if (!InitializeBuffers(indices, vertices))
+	return CreateBuffers(vertexData, stride, mVertexCount, indices, sizeof(DWORD), mIndexCount, &mVB, &mIB);
+}
+
+void Grid::BuildMeshArrays(ThreadPool* pool){
+	mVertexCount = (gridWidth*gridDepth);
+	if (compact)
+		compactVertices = new VertexTerrain[mVertexCount];
+	else
+		vertices = new VertexNT[mVertexCount];
+
+	//geomipmapped patches draw out of the grid's vertex buffer with their own shared index buffer
+	mIndexCount = 0;
+	if (lodPatchSize <= 0 && indexMode == TERRAIN_INDEX_LIST32){
+		mIndexCount = ((gridWidth-1)*(gridDepth-1)*6);
+		indices = new DWORD[mIndexCount];
+	}
+
+	//every band of rows only reads the height data and writes its own vertices and indices,
+	//so the bands can be built in any order on any thread and still give the same mesh
+	pool->ParallelFor(gridWidth, BUILD_BAND_ROWS, BuildBand, this);
+}
+
+//the grids the checks make are never given a device, so only their arrays are built
+void Grid::BuildCheckArrays(int width, int depth, bool compact, const float* heights, float minHeight, float maxHeight, ThreadPool* pool){
+	gridWidth = width;
+	gridDepth = depth;
+	this->compact = compact;
+	heightData = new float[width*depth];
+	memcpy(heightData, heights, width*depth*sizeof(float));
+	this->minHeight = minHeight;
+	this->maxHeight = maxHeight;
+	quadtree.Build(heightData, gridWidth, gridDepth, CELLSPACING, -(gridWidth-1)*CELLSPACING*0.5f, (gridDepth-1)*CELLSPACING*0.5f);
+	BuildMeshArrays(pool);
+}
+
+bool Grid::CheckParallelBuild(int width, int depth, int threadCount){
+	TerrainGenSettings settings;
+	std::vector<float> heights(width*depth);
+	TerrainGenerator generator(settings.seed);
+	generator.Generate(&heights[0], width, depth, settings);
+
+	//a pool that was never initialized has no workers, so ParallelFor runs every band in order on this thread
+	ThreadPool serial, parallel;
+	if (!parallel.Initialize(threadCount))
 		return false;
 
-	delete terrainLoader;
-	terrainLoader = nullptr;
+	bool same = true;
+	for (int pass = 0; pass < 2; pass++){
+		Grid grids[2];
+		for (int g = 0; g < 2; g++){
+			grids[g].BuildCheckArrays(width, depth, pass == 1, &heights[0], *std::min_element(heights.begin(), heights.end()),
+									  *std::max_element(heights.begin(), heights.end()), g == 0 ? &serial : &parallel);
+		}
 
-	return true;
+		if (grids[0].compact)
+			same = same && memcmp(grids[0].compactVertices, grids[1].compactVertices, width*depth*sizeof(VertexTerrain)) == 0;
+		else
+			same = same && memcmp(grids[0].vertices, grids[1].vertices, width*depth*sizeof(VertexNT)) == 0;
+		same = same && memcmp(grids[0].indices, grids[1].indices, grids[0].mIndexCount*sizeof(DWORD)) == 0;
+	}
+	return same;
 }
 
-///Generate a grid by an arbitrary function GetHeight
-bool Grid::GenerateGrid(int width, int depth)const{
-/*
-	mVertexCount = (width*depth);
-	vertices = new VertexC[mVertexCount];
+//after every deform the grid's vertices have to be what building the whole grid again from its heights gives. The
+//deforms dig inside the height range, raise it so compact vertices have to be packed again, and reach over the edges
+bool Grid::CheckDeform(int width, int depth){
+	TerrainGenSettings settings;
+	std::vector<float> heights(width*depth);
+	TerrainGenerator generator(settings.seed);
+	generator.Generate(&heights[0], width, depth, settings);
+	float minHeight = *std::min_element(heights.begin(), heights.end());
+	float maxHeight = *std::max_element(heights.begin(), heights.end());
 
-	float dx = CELLSPACING;
-	float halfWidth = (width-1)*dx*0.5f;
-	float halfDepth = (depth-1)*dx*0.5f;
+	//the first vertex, and the middle of the grid, the way Deform places them
+	float originX = -(width-1)*CELLSPACING*0.5f, originZ = (depth-1)*CELLSPACING*0.5f;
+	float middleX = originX + (depth-1)*CELLSPACING*0.5f, middleZ = originZ - (width-1)*CELLSPACING*0.5f;
+	const float deforms[][4] = {
+		{middleX, middleZ, 6.0f, -0.5f},													// x, z, radius, amount
+		{middleX + 10.0f, middleZ - 7.0f, 9.5f, maxHeight - minHeight + 2.0f},
+		{originX, originZ, 7.0f, -1.0f},													// over the first vertex's corner
+		{originX + (depth-1)*CELLSPACING - 1.5f, middleZ + 0.3f, 4.0f, 0.75f},				// over the last column
+		{middleX + 10.0f, middleZ - 7.0f, 3.0f, -(maxHeight - minHeight)*0.5f},
+	};
+	const int deformCount = sizeof(deforms)/sizeof(deforms[0]);
 
-	for(DWORD i = 0; i < width; ++i){
-		float z = halfDepth - i*dx;
+	bool same = true;
+	for (int pass = 0; pass < 2 && same; pass++){
+		Grid grid;
+		grid.BuildCheckArrays(width, depth, pass == 1, &heights[0], minHeight, maxHeight, ThreadPool::GetShared());
+		for (int d = 0; d < deformCount && same; d++){
+			same = grid.Deform(deforms[d][0], deforms[d][1], deforms[d][2], deforms[d][3]);
 
-		for(DWORD j = 0; j < depth; ++j){
-			float x = -halfWidth + j*dx;
-			// Graph of this function looks like a mountain range.
-			float y = GetHeight(x,z);
-			//float y = 0.0f;
-			vertices[i*depth+j].pos = D3DXVECTOR3(x, y, z);
-			// Color the vertex based on its height.
-			if( y < -10.0f )
-				vertices[i*depth+j].color = BEACH_SAND;
-			else if( y < 5.0f )
-				vertices[i*depth+j].color = LIGHT_YELLOW_GREEN;
-			else if( y < 12.0f )
-				vertices[i*depth+j].color = DARK_YELLOW_GREEN;
-			else if( y < 20.0f )
-				vertices[i*depth+j].color = DARKBROWN;
+			Grid rebuilt;
+			rebuilt.BuildCheckArrays(width, depth, grid.compact, grid.heightData, grid.minHeight, grid.maxHeight, ThreadPool::GetShared());
+			if (grid.compact)
+				same = same && memcmp(grid.compactVertices, rebuilt.compactVertices, width*depth*sizeof(VertexTerrain)) == 0;
 			else
-				vertices[i*depth+j].color = WHITE;
+				same = same && memcmp(grid.vertices, rebuilt.vertices, width*depth*sizeof(VertexNT)) == 0;
 		}
 	}
-	
-	// Iterate over each quad and compute indices.
-	mIndexCount = ((width-1)*(depth-1)*6);
-	indices = new DWORD[mIndexCount];
-	int k = 0;
-	for(DWORD i = 0; i < width-1; ++i){
-		for(DWORD j = 0; j < depth-1; ++j){
-			indices[k] = i*depth+j;
-			indices[k+1] = i*depth+j+1;
-			indices[k+2] = (i+1)*depth+j;
-
-			indices[k+3] = (i+1)*depth+j;
-			indices[k+4] = i*depth+j+1;
-			indices[k+5] = (i+1)*depth+j+1;
-			k += 6; // next quad
+	return same;
+}
+
+/*
+Splits the whole grid into patches drawn as separate batches out of the one vertex buffer. A patch is indexed from
+its first vertex with the grid's pitch, so patches of the same size share their indices - there are only ever the
+full size patches and the thinner ones along the far edges. A patch gets as many rows as still fit 16 bit indices.
+*/
+bool Grid::BuildPatches(){
+	patches.clear();
+	patchIndices.clear();
+
+	int patchCols = Min(indexPatchSize, gridDepth-1);
+	int patchRows = Min(indexPatchSize, GetMaxPatchRows(patchCols, gridDepth));
+	if (patchRows <= 0){
+		//the grid is too wide for even one row of quads to fit 16 bit indices
+		indexMode = TERRAIN_INDEX_LIST32;
+		mIndexCount = ((gridWidth-1)*(gridDepth-1)*6);
+		indices = new DWORD[mIndexCount];
+		ComputeIndices(0, gridWidth);
+		return CreateIndexBuffer(indices, sizeof(DWORD), mIndexCount, &mIB);
+	}
+
+	bool strip = indexMode == TERRAIN_INDEX_STRIP16;
+	std::vector<TerrainPatch> shapes;
+
+	for (int i = 0; i < gridWidth-1; i += patchRows){
+		for (int j = 0; j < gridDepth-1; j += patchCols){
+			TerrainPatch patch;
+			patch.firstRow = i;
+			patch.firstCol = j;
+			patch.rows = Min(patchRows, gridWidth-1-i);
+			patch.cols = Min(patchCols, gridDepth-1-j);
+
+			unsigned int shape = 0;
+			while (shape < shapes.size() && (shapes[shape].rows != patch.rows || shapes[shape].cols != patch.cols))
+				shape++;
+			if (shape == shapes.size()){
+				TerrainPatch first = patch;
+				first.batch.startIndex = patchIndices.size();
+				first.batch.indexCount = GetPatchIndexCount(patch.rows, patch.cols, strip, vertexCacheSize);
+				patchIndices.resize(first.batch.startIndex + first.batch.indexCount);
+				BuildPatchIndices(patch.rows, patch.cols, gridDepth, strip, &patchIndices[first.batch.startIndex], vertexCacheSize);
+				shapes.push_back(first);
+			}
+
+			patch.batch.startIndex = shapes[shape].batch.startIndex;
+			patch.batch.indexCount = shapes[shape].batch.indexCount;
+			patch.batch.baseVertex = i*gridDepth + j;
+			patches.push_back(patch);
 		}
 	}
 
-	//initialize the buffers with the index and vertex data
-	if (!InitializeBuffers(indices, vertices))
-		return false;*/
+	mIndexCount = patchIndices.size();
+	return CreateIndexBuffer(&patchIndices[0], sizeof(WORD), mIndexCount, &mIB);
+}
+
+bool Grid::MeasureIndices(int cacheSize, VertexCacheStats& stats){
+	memset(&stats, 0, sizeof(stats));
+	if (tiled || geoMipmap)
+		return false;
 
+	if (!patches.empty()){
+		bool strip = indexMode == TERRAIN_INDEX_STRIP16;
+		for (unsigned int i = 0; i < patches.size(); i++){
+			VertexCacheStats patchStats;
+			MeasureVertexCache(&patchIndices[patches[i].batch.startIndex], sizeof(WORD), patches[i].batch.indexCount, strip, cacheSize, patchStats);
+			AddVertexCacheStats(stats, patchStats);
+		}
+		return true;
+	}
+
+	//a grid made straight from the cache keeps no copy of its indices
+	if (!indices)
+		return false;
+	MeasureVertexCache(indices, sizeof(DWORD), mIndexCount, false, cacheSize, stats);
 	return true;
 }
 
-//compute the vertex normals
-void Grid::ComputeNormals()const{
+void Grid::BuildBand(int firstRow, int lastRow, void* data){
+	Grid *grid = (Grid*)data;
+	if (grid->compact){
+		grid->ComputeCompactVertices(firstRow, lastRow);
+	}
+	else{
+		grid->ComputePositions(firstRow, lastRow);
+		grid->ComputeNormals(firstRow, lastRow);
+		grid->ComputeTextureCoords(firstRow, lastRow);
+	}
+	if (grid->indices)
+		grid->ComputeIndices(firstRow, lastRow);
+}
 
-	for (int i = 0; i < gridWidth; i++){
-		for (int j = 0; j < gridDepth; j++){
-			Vector3f v1,v2,v3,v4,v12,v23,v34,v41,v;
-			v1 = v2 = v3 = v4 = v12 = v23 = v34 = v41 = v = Vector3f(0.0f,0.0f,0.0f);
-			//grab 2 vectors for this
-			if (j != gridWidth - 1){
-				v1 = Vector3f(vertices[i*gridDepth+j+1].pos-vertices[i*gridDepth+j].pos);
-			}
-			if (i != gridWidth - 1){
-				v2 = Vector3f(vertices[(i+1)*gridDepth+j].pos-vertices[i*gridDepth+j].pos);
-			}
-			if (j > 0){
-				v3 = Vector3f(vertices[i*gridDepth+j-1].pos-vertices[i*gridDepth+j].pos);
-			}
-			if (i > 0){
-				v4 = Vector3f(vertices[(i-1)*gridDepth+j].pos-vertices[i*gridDepth+j].pos);
+void Grid::ComputeCompactVertices(int firstRow, int lastRow)const{
+	for (int i = firstRow; i < lastRow; i++){
+		PackVertexRow(i, 0, gridDepth, compactVertices + i*gridDepth);
+	}
+}
+
+/*
+The normal is folded onto an octahedron (|x|+|y|+|z| = 1) which is flattened onto the xz square - the lower half
+folds out over the corners. Both coordinates are then stored as bytes. It's decoded in multitexture.fx
+*/
+void Grid::PackVertexRow(int row, int firstCol, int count, VertexTerrain* out)const{
+	float nx[MAX_PACK_COLUMNS], ny[MAX_PACK_COLUMNS], nz[MAX_PACK_COLUMNS];
+	float invRange = (maxHeight > minHeight) ? 65535.0f / (maxHeight - minHeight) : 0.0f;
+	const float* heights = heightData + row*gridDepth + firstCol;
+
+	for (int first = 0; first < count; first += MAX_PACK_COLUMNS){
+		int n = Min(MAX_PACK_COLUMNS, count - first);
+		ComputeTerrainNormalRow(heightData, gridWidth, gridDepth, row, firstCol + first, n, CELLSPACING, nx, ny, nz);
+
+		for (int j = 0; j < n; j++){
+			VertexTerrain& vertex = out[first + j];
+			vertex.height = (USHORT)((heights[first + j] - minHeight)*invRange + 0.5f);
+
+			float invL1 = 1.0f / (fabsf(nx[j]) + fabsf(ny[j]) + fabsf(nz[j]));
+			float u = nx[j]*invL1;
+			float v = nz[j]*invL1;
+			if (ny[j] < 0.0f){
+				float foldU = (1.0f - fabsf(v))*(u >= 0.0f ? 1.0f : -1.0f);
+				float foldV = (1.0f - fabsf(u))*(v >= 0.0f ? 1.0f : -1.0f);
+				u = foldU;
+				v = foldV;
 			}
+			vertex.normal[0] = (BYTE)((u*0.5f + 0.5f)*255.0f + 0.5f);
+			vertex.normal[1] = (BYTE)((v*0.5f + 0.5f)*255.0f + 0.5f);
+		}
+	}
+}
 
-			D3DXVec3Cross(&v12,&v1,&v2);
-			D3DXVec3Normalize(&v12,&v12);
+void Grid::ComputePositions(int firstRow, int lastRow)const{
+	float dx = CELLSPACING;
+	float halfWidth = (gridWidth-1)*dx*0.5f;
+	float halfDepth = (gridDepth-1)*dx*0.5f;
 
-			D3DXVec3Cross(&v23,&v2,&v3);
-			D3DXVec3Normalize(&v23,&v23);
-			
-			D3DXVec3Cross(&v34,&v3,&v4);
-			D3DXVec3Normalize(&v34,&v34);
-			
-			D3DXVec3Cross(&v41,&v4,&v1);
-			D3DXVec3Normalize(&v41,&v41);
+	for(int i = firstRow; i < lastRow; ++i){
+		float z = halfDepth - i*dx;
 
-			
-			if (D3DXVec3Length(&v12) > 0.0f)
-				v = v + v12;
+		for(int j = 0; j < gridDepth; ++j){
+			float x = -halfWidth + j*dx;
+			vertices[i*gridDepth+j].pos = Vector3f(x, heightData[i*gridDepth+j], z);
+		}
+	}
+}
 
-			if (D3DXVec3Length(&v23) > 0.0f)
-				v = v + v23;
-			
-			if (D3DXVec3Length(&v34) > 0.0f)
-				v = v + v34;
+//the quads below rows firstRow to lastRow - the last row of the grid has none
+void Grid::ComputeIndices(int firstRow, int lastRow)const{
+	if (lastRow > gridWidth-1)
+		lastRow = gridWidth-1;
 
-			if (D3DXVec3Length(&v41) > 0.0f)
-				v = v + v41;
+	// Iterate over each quad and compute indices.
+	int k = firstRow*(gridDepth-1)*6;
+	for(int i = firstRow; i < lastRow; ++i){
+		for(int j = 0; j < gridDepth-1; ++j){
+			// Upper left.
 
-			D3DXVec3Normalize(&v,&v);
+			indices[k] = i*gridDepth+j;
+			indices[k+1] = i*gridDepth+j+1;
+			indices[k+2] = (i+1)*gridDepth+j;
 
-			vertices[i*gridDepth+j].normal = v;			
+			indices[k+3] = (i+1)*gridDepth+j;
+			indices[k+4] = i*gridDepth+j+1;
+			indices[k+5] = (i+1)*gridDepth+j+1;
+			k += 6; // next quad
 		}
 	}
 }
 
-void Grid::ComputeTextureCoords()const{
+///Generate a grid from noise and erosion rather than a heightmap, see TerrainGenerator
+bool Grid::GenerateGrid(int width, int depth, const TerrainGenSettings& settings){
+	if (width < 2 || depth < 2)
+		return false;
 
-	float incrementValue;
+	gridWidth = width;
+	gridDepth = depth;
+	heightData = new float[gridWidth*gridDepth];
+
+	TerrainGenerator generator(settings.seed);
+	generator.Generate(heightData, gridWidth, gridDepth, settings);
+
+	minHeight = maxHeight = heightData[0];
+	for (int i = 1; i < gridWidth*gridDepth; i++){
+		minHeight = Min(minHeight, heightData[i]);
+		maxHeight = Max(maxHeight, heightData[i]);
+	}
+
+	return BuildFromHeights();
+}
 
-	// Calculate how much to increment the texture coordinates by.
-	incrementValue = (float)TEXTURE_REPEAT / (float)gridDepth;
+//compute the vertex normals - a row at a time straight from the height array so the kernel can vectorise them
+void Grid::ComputeNormals(int firstRow, int lastRow)const{
+	float *nx = new float[gridDepth*3];
+	float *ny = nx + gridDepth;
+	float *nz = ny + gridDepth;
 
+	for (int i = firstRow; i < lastRow; i++){
+		ComputeTerrainNormalRow(heightData, gridWidth, gridDepth, i, 0, gridDepth, CELLSPACING, nx, ny, nz);
+
+		VertexNT* row = vertices + i*gridDepth;
+		for (int j = 0; j < gridDepth; j++){
+			row[j].normal = Vector3f(nx[j], ny[j], nz[j]);
+		}
+	}
+
+	delete [] nx;
+}
+
+//build the position and texture coordinate of a single vertex of the grid - gives the same result as the passes over the whole grid
+void Grid::BuildVertex(int i, int j, VertexNT& vertex)const{
+	float dx = CELLSPACING;
+	float halfWidth = (gridWidth-1)*dx*0.5f;
+	float halfDepth = (gridDepth-1)*dx*0.5f;
+
+	vertex.pos = Vector3f(-halfWidth + j*dx, heightData[i*gridDepth+j], halfDepth - i*dx);
+	vertex.texC = Vector2f(i / (float)(gridWidth/TEXTURE_REPEAT), j / (float)(gridDepth/TEXTURE_REPEAT));
+}
+
+void Grid::ComputeTextureCoords(int firstRow, int lastRow)const{
 	float widthRepeat = (float)(gridWidth/TEXTURE_REPEAT);
 	float depthRepeat = (float)(gridDepth/TEXTURE_REPEAT);
 
-	// Loop through the entire height map and calculate the tu and tv texture coordinates for each vertex.
-	for(int i=0; i<gridWidth; i++){
+	// Loop through the rows of the height map and calculate the tu and tv texture coordinates for each vertex.
+	for(int i=firstRow; i<lastRow; i++){
 		for(int j=0; j<gridDepth; j++){
 			vertices[i*gridDepth+j].texC = Vector2f(i / widthRepeat, j / depthRepeat);
 		}
 	}
 }
 
+bool Grid::SetupArraysAndInitBuffers(){
+	return true;
+}
+
 //The InitializeBuffers function is where we handle creating the vertex and index buffers. 
 bool Grid::InitializeBuffers(DWORD* indices,  VertexNT* vertices){
+	if (!CreateBuffers(vertices, sizeof(VertexNT), mVertexCount, indices, sizeof(DWORD), mIndexCount, &mVB, &mIB))
+		return false;
+
+	stride = sizeof(VertexNT);
+	return true;	
+}
+
+bool Grid::CreateBuffers(const void* vertices, UINT vertexSize, DWORD vertexCount, const void* indices, UINT indexSize, DWORD indexCount, ID3D10Buffer** vb, ID3D10Buffer** ib){
+	if (!CreateVertexBuffer(vertices, vertexSize, vertexCount, vb))
+		return false;
+
+	if (!CreateIndexBuffer(indices, indexSize, indexCount, ib)){
+		ReleaseCOM((*vb));
+		return false;
+	}
+	return true;
+}
+
+UINT Grid::GetVertexSize()const{
+	return compact ? sizeof(VertexTerrain) : sizeof(VertexNT);
+}
 
-	D3D10_BUFFER_DESC vertexBufferDesc, indexBufferDesc;
-	D3D10_SUBRESOURCE_DATA vertexData, indexData;
-	HRESULT result;
+bool Grid::CreateVertexBuffer(const void* vertices, UINT vertexSize, DWORD vertexCount, ID3D10Buffer** vb){
+	D3D10_BUFFER_DESC vertexBufferDesc;
+	D3D10_SUBRESOURCE_DATA vertexData;
 
 	// Set up the description of the vertex buffer.
 	vertexBufferDesc.Usage = D3D10_USAGE_DEFAULT;
-	vertexBufferDesc.ByteWidth = sizeof(VertexNT) * mVertexCount;
+	vertexBufferDesc.ByteWidth = vertexSize * vertexCount;
 	vertexBufferDesc.BindFlags = D3D10_BIND_VERTEX_BUFFER;
 	vertexBufferDesc.CPUAccessFlags = 0;
 	vertexBufferDesc.MiscFlags = 0;
@@ -239,15 +654,19 @@ bool Grid::InitializeBuffers(DWORD* indices,  VertexNT* vertices){
 	vertexData.pSysMem = vertices;
 
 	// Now finally create the vertex buffer.
-	result = md3dDevice->CreateBuffer(&vertexBufferDesc, &vertexData, &mVB);
-	if(FAILED(result))
-	{
+	if(FAILED(md3dDevice->CreateBuffer(&vertexBufferDesc, &vertexData, vb))){
 		return false;
 	}
+	return true;
+}
+
+bool Grid::CreateIndexBuffer(const void* indices, UINT indexSize, DWORD indexCount, ID3D10Buffer** ib){
+	D3D10_BUFFER_DESC indexBufferDesc;
+	D3D10_SUBRESOURCE_DATA indexData;
 
 	// Set up the description of the index buffer.
 	indexBufferDesc.Usage = D3D10_USAGE_DEFAULT;
-	indexBufferDesc.ByteWidth = sizeof(unsigned long) * mIndexCount;
+	indexBufferDesc.ByteWidth = indexSize * indexCount;
 	indexBufferDesc.BindFlags = D3D10_BIND_INDEX_BUFFER;
 	indexBufferDesc.CPUAccessFlags = 0;
 	indexBufferDesc.MiscFlags = 0;
@@ -256,53 +675,658 @@ bool Grid::InitializeBuffers(DWORD* indices,  VertexNT* vertices){
 	indexData.pSysMem = indices;
 
 	// Create the index buffer.
-	result = md3dDevice->CreateBuffer(&indexBufferDesc, &indexData, &mIB);
-
-	if(FAILED(result)){
+	if(FAILED(md3dDevice->CreateBuffer(&indexBufferDesc, &indexData, ib))){
 		return false;
 	}
-	stride = sizeof(VertexNT);
 	return true;	
 }
 
+///TILED TERRAIN
+//lay out the tile grid - no tile is built until the camera comes near it
+void Grid::InitializeTiles(){
+	ReleaseTiles();
+
+	for (int i = 0; i < gridWidth-1; i += tileSize){
+		for (int j = 0; j < gridDepth-1; j += tileSize){
+			TerrainTile tile;
+			tile.firstRow = i;
+			tile.firstCol = j;
+			tile.rows = Min(tileSize, gridWidth-1-i) + 1;
+			tile.cols = Min(tileSize, gridDepth-1-j) + 1;
+			tile.vb = tile.ib = nullptr;
+			tile.indexCount = 0;
+			tile.indexSize = sizeof(DWORD);
+			tile.bytes = 0;
+			tile.lastUsedFrame = 0;
+			tiles.push_back(tile);
+		}
+	}
+}
+
+//the vertices of a block of the grid packed together with a pitch of cols, in whichever format the grid uses
+void Grid::BuildVertices(int firstRow, int firstCol, int rows, int cols, void* out)const{
+	if (compact){
+		for (int i = 0; i < rows; i++){
+			PackVertexRow(firstRow + i, firstCol, cols, (VertexTerrain*)out + i*cols);
+		}
+		return;
+	}
+
+	float *nx = new float[cols*3];
+	float *ny = nx + cols;
+	float *nz = ny + cols;
+
+	for (int i = 0; i < rows; i++){
+		ComputeTerrainNormalRow(heightData, gridWidth, gridDepth, firstRow + i, firstCol, cols, CELLSPACING, nx, ny, nz);
+
+		for (int j = 0; j < cols; j++){
+			VertexNT& vertex = ((VertexNT*)out)[i*cols+j];
+			BuildVertex(firstRow + i, firstCol + j, vertex);
+			vertex.normal = Vector3f(nx[j], ny[j], nz[j]);
+		}
+	}
+	delete [] nx;
+}
+
+//generate the vertices and indices of a tile and upload them
+bool Grid::LoadTile(TerrainTile& tile){
+	DWORD vertexCount = tile.rows*tile.cols;
+	bool sixteenBit = indexMode != TERRAIN_INDEX_LIST32 && GetMaxPatchRows(tile.cols-1, tile.cols) >= tile.rows-1;
+	bool strip = sixteenBit && indexMode == TERRAIN_INDEX_STRIP16;
+	DWORD indexCount = sixteenBit ? GetPatchIndexCount(tile.rows-1, tile.cols-1, strip, vertexCacheSize) : (tile.rows-1)*(tile.cols-1)*6;
+	UINT indexSize = sixteenBit ? sizeof(WORD) : sizeof(DWORD);
+
+	UINT	 vertexSize = GetVertexSize();
+	BYTE	 *tileVertices = new BYTE[vertexCount*vertexSize];
+	BYTE	 *tileIndices = new BYTE[indexCount*indexSize];
+
+	BuildVertices(tile.firstRow, tile.firstCol, tile.rows, tile.cols, tileVertices);
+
+	//same triangulation as the whole grid uses so the tiles line up exactly
+	if (sixteenBit){
+		BuildPatchIndices(tile.rows-1, tile.cols-1, tile.cols, strip, (WORD*)tileIndices, vertexCacheSize);
+	}
+	else{
+		DWORD *list = (DWORD*)tileIndices;
+		int k = 0;
+		for (int i = 0; i < tile.rows-1; i++){
+			for (int j = 0; j < tile.cols-1; j++){
+				list[k] = i*tile.cols+j;
+				list[k+1] = i*tile.cols+j+1;
+				list[k+2] = (i+1)*tile.cols+j;
+
+				list[k+3] = (i+1)*tile.cols+j;
+				list[k+4] = i*tile.cols+j+1;
+				list[k+5] = (i+1)*tile.cols+j+1;
+				k += 6;
+			}
+		}
+	}
+
+	//without a device, as in the self-tests, the tile is built and counted against the budget but has no buffers
+	bool result = !md3dDevice || CreateBuffers(tileVertices, vertexSize, vertexCount, tileIndices, indexSize, indexCount, &tile.vb, &tile.ib);
+
+	//the cpu side copy is not needed once the buffers have been made
+	delete [] tileVertices;
+	delete [] tileIndices;
+
+	if (!result)
+		return false;
+
+	tile.indexCount = indexCount;
+	tile.indexSize = indexSize;
+	tile.bytes = vertexCount*vertexSize + indexCount*indexSize;
+	residentBytes += tile.bytes;
+	return true;
+}
+
+void Grid::UnloadTile(TerrainTile& tile){
+	ReleaseCOM(tile.vb);
+	ReleaseCOM(tile.ib);
+	residentBytes -= tile.bytes;
+	tile.bytes = 0;
+	tile.indexCount = 0;
+}
+
+void Grid::ReleaseTiles(){
+	for (unsigned int i = 0; i < tiles.size(); i++){
+		if (tiles[i].bytes)
+			UnloadTile(tiles[i]);
+	}
+	tiles.clear();
+	visibleTiles.clear();
+	residentBytes = 0;
+}
+
+void Grid::UpdateTiles(const Vector3f& cameraPos){
+	if (!tiled)
+		return;
+
+	const int MAX_TILE_LOADS_PER_FRAME = 4;		// spreads the cost of building tiles over a few frames when the camera moves fast
+
+	frameNumber++;
+	visibleTiles.clear();
+
+	float dx = CELLSPACING;
+	float halfWidth = (gridWidth-1)*dx*0.5f;
+	float halfDepth = (gridDepth-1)*dx*0.5f;
+	Vector3f camera = cameraPos - pos;		// into the grid's local space
+
+	//gather the tiles in reach of the camera, nearest first
+	std::vector<std::pair<float,int> > wanted;
+	for (unsigned int t = 0; t < tiles.size(); t++){
+		TerrainTile& tile = tiles[t];
+		float centreX = -halfWidth + (tile.firstCol + (tile.cols-1)*0.5f)*dx;
+		float centreZ = halfDepth - (tile.firstRow + (tile.rows-1)*0.5f)*dx;
+		float radius = 0.5f*dx*sqrtf((float)((tile.rows-1)*(tile.rows-1) + (tile.cols-1)*(tile.cols-1)));
+		float distX = centreX - camera.x;
+		float distZ = centreZ - camera.z;
+		float distance = sqrtf(distX*distX + distZ*distZ) - radius;
+
+		if (distance <= tileLoadDistance)
+			wanted.push_back(std::make_pair(distance, (int)t));
+	}
+	std::sort(wanted.begin(), wanted.end());
+
+	int loadsThisFrame = 0;
+	for (unsigned int w = 0; w < wanted.size(); w++){
+		TerrainTile& tile = tiles[wanted[w].second];
+		if (!tile.bytes){
+			if (loadsThisFrame >= MAX_TILE_LOADS_PER_FRAME)
+				continue;
+			if (!LoadTile(tile))
+				continue;
+			loadsThisFrame++;
+		}
+		tile.lastUsedFrame = frameNumber;
+		visibleTiles.push_back(wanted[w].second);
+	}
+
+	//evict the least recently used tiles until we are back within budget - tiles in use this frame are never evicted
+	while (residentBytes > tileBudget){
+		int oldest = -1;
+		for (unsigned int t = 0; t < tiles.size(); t++){
+			if (tiles[t].bytes && tiles[t].lastUsedFrame != frameNumber){
+				if (oldest < 0 || tiles[t].lastUsedFrame < tiles[oldest].lastUsedFrame)
+					oldest = t;
+			}
+		}
+		if (oldest < 0)
+			break;
+		UnloadTile(tiles[oldest]);
+	}
+}
+
+//the camera circles the middle of the terrain close enough to the ground that only the tiles round it are in reach,
+//so it keeps coming back to tiles it had to evict. Every tile is the same size, which makes the budget a number of tiles
+bool Grid::CheckTilePaging(int tiles, int tileSize, int budgetTiles, int frames, int& loads, int& evictions){
+	loads = evictions = 0;
+	Grid grid;
+	grid.SetTiling(tileSize, 0, tileSize*CELLSPACING*0.25f);
+	TerrainGenSettings settings;
+	settings.thermalIterations = 0;
+	settings.droplets = 0;
+	if (!grid.GenerateGrid(tiles*tileSize + 1, tiles*tileSize + 1, settings))
+		return false;
+
+	//the first tile is built once to find out what a tile takes
+	grid.LoadTile(grid.tiles[0]);
+	size_t tileBytes = grid.tiles[0].bytes;
+	grid.UnloadTile(grid.tiles[0]);
+	grid.tileBudget = tileBytes*budgetTiles;
+
+	bool passed = tileBytes > 0;
+	float radius = tiles*tileSize*CELLSPACING*0.3f;
+	for (int f = 0; f < frames && passed; f++){
+		std::vector<TerrainTile> before(grid.tiles);
+		float angle = f*2.0f*PI/(frames/2.5f);
+		grid.UpdateTiles(Vector3f(cosf(angle)*radius, 0.0f, sinf(angle)*radius));
+
+		std::vector<bool> used(grid.tiles.size(), false);
+		for (unsigned int v = 0; v < grid.visibleTiles.size(); v++)
+			used[grid.visibleTiles[v]] = true;
+
+		size_t resident = 0;
+		unsigned int evictedFrame = 0, keptFrame = grid.frameNumber;
+		int evicted = 0;
+		for (unsigned int t = 0; t < grid.tiles.size(); t++){
+			const TerrainTile& tile = grid.tiles[t];
+			resident += tile.bytes;
+			passed = passed && (!used[t] || tile.bytes == tileBytes);
+			if (before[t].bytes && !tile.bytes){
+				evicted++;
+				evictedFrame = Max(evictedFrame, before[t].lastUsedFrame);
+				passed = passed && !used[t];
+			}
+			else if (before[t].bytes && !used[t])
+				keptFrame = Min(keptFrame, before[t].lastUsedFrame);
+			else if (!before[t].bytes && tile.bytes)
+				loads++;
+		}
+		//nothing evicted was used more recently than a tile that stayed, and one tile fewer evicted would be over budget
+		passed = passed && resident == grid.residentBytes && resident <= grid.tileBudget;
+		passed = passed && (evicted == 0 || (evictedFrame <= keptFrame && resident + tileBytes > grid.tileBudget));
+		evictions += evicted;
+	}
+	return passed && evictions > 0;
+}
+
+///GEOMIPMAPPING
+void Grid::UpdateLOD(const Vector3f& cameraPos, float fovY, int screenHeight){
+	if (!geoMipmap)
+		return;
+
+	geoMipmap->Update(cameraPos - pos, fovY, screenHeight, lodPixelError);
+}
+
+///BATCHES
+int Grid::GetBatchCount(){
+	if (tiled)
+		return visibleTiles.size();
+	if (geoMipmap)
+		return geoMipmap->GetBatchCount();
+	if (!patches.empty())
+		return patches.size();
+	return 1;
+}
+
+void Grid::RenderBatch(int which, D3DXMATRIX worldMatrix){
+	if (!tiled && !geoMipmap && patches.empty()){
+		Render(worldMatrix);
+		return;
+	}
+
+	ID3D10Buffer *vb = mVB;
+	ID3D10Buffer *ib = mIB;
+	bool sixteenBit = false;
+	if (tiled){
+		vb = tiles[visibleTiles[which]].vb;
+		ib = tiles[visibleTiles[which]].ib;
+		sixteenBit = tiles[visibleTiles[which]].indexSize == sizeof(WORD);
+	}
+	else if (geoMipmap){
+		ib = geoMipmap->GetIndexBuffer();
+	}
+	else{
+		sixteenBit = true;
+	}
+	bool strip = sixteenBit && indexMode == TERRAIN_INDEX_STRIP16;
+
+	offset = 0;
+	stride = GetVertexSize();
+	md3dDevice->IASetVertexBuffers(0, 1, &vb, &stride, &offset);
+	md3dDevice->IASetIndexBuffer(ib, sixteenBit ? DXGI_FORMAT_R16_UINT : DXGI_FORMAT_R32_UINT, 0);
+	md3dDevice->IASetPrimitiveTopology(strip ? D3D10_PRIMITIVE_TOPOLOGY_TRIANGLESTRIP : D3D10_PRIMITIVE_TOPOLOGY_TRIANGLELIST);
+
+	setTrans(worldMatrix);
+}
+
+TerrainBatch Grid::GetBatch(int which){
+	if (geoMipmap)
+		return geoMipmap->GetBatch(which);
+	if (!tiled && !patches.empty())
+		return patches[which].batch;
+
+	TerrainBatch batch;
+	batch.indexCount = tiled ? tiles[visibleTiles[which]].indexCount : mIndexCount;
+	batch.startIndex = 0;
+	batch.baseVertex = 0;
+	return batch;
+}
+
+void Grid::GetBatchBounds(int which, Vector3f& boxMin, Vector3f& boxMax){
+	//the quads the batch draws
+	int firstRow = 0, firstCol = 0, rows = gridWidth-1, cols = gridDepth-1;
+	if (tiled){
+		const TerrainTile& tile = tiles[visibleTiles[which]];
+		firstRow = tile.firstRow;
+		firstCol = tile.firstCol;
+		rows = tile.rows-1;
+		cols = tile.cols-1;
+	}
+	else if (geoMipmap){
+		geoMipmap->GetBatchArea(which, firstRow, firstCol, rows, cols);
+	}
+	else if (!patches.empty()){
+		firstRow = patches[which].firstRow;
+		firstCol = patches[which].firstCol;
+		rows = patches[which].rows;
+		cols = patches[which].cols;
+	}
+
+	float lo = 0.0f, hi = 0.0f;
+	quadtree.GetBounds(firstRow, firstCol, rows, cols, lo, hi);
+
+	float dx = CELLSPACING;
+	float originX = -(gridWidth-1)*dx*0.5f;
+	float originZ = (gridDepth-1)*dx*0.5f;
+	boxMin = pos + Vector3f(originX + firstCol*dx, lo, originZ - (firstRow + rows)*dx);
+	boxMax = pos + Vector3f(originX + (firstCol + cols)*dx, hi, originZ - firstRow*dx);
+}
+
+void Grid::BeginOcclusion(TerrainOcclusion& occlusion, const Vector3f& cameraPos){
+	occlusion.Begin(quadtree, cameraPos, pos);
+}
+
+const TerrainVertexLayout* Grid::GetCompactLayout(int which){
+	if (!compact)
+		return nullptr;
+
+	float dx = CELLSPACING;
+	compactLayout.originX = -(gridWidth-1)*dx*0.5f;
+	compactLayout.originZ = (gridDepth-1)*dx*0.5f;
+	compactLayout.cellSpacing = dx;
+	compactLayout.heightBias = minHeight;
+	compactLayout.heightScale = maxHeight - minHeight;
+	compactLayout.texScaleRow = 1.0f / (float)(gridWidth/TEXTURE_REPEAT);
+	compactLayout.texScaleCol = 1.0f / (float)(gridDepth/TEXTURE_REPEAT);
+
+	//tiles each have their own vertex buffer starting at their first vertex, everything else draws out of the whole grid's
+	if (tiled){
+		const TerrainTile& tile = tiles[visibleTiles[which]];
+		compactLayout.pitch = tile.cols;
+		compactLayout.firstRow = tile.firstRow;
+		compactLayout.firstCol = tile.firstCol;
+		compactLayout.baseVertex = 0;
+	}
+	else{
+		compactLayout.pitch = gridDepth;
+		compactLayout.firstRow = 0;
+		compactLayout.firstCol = 0;
+		compactLayout.baseVertex = GetBatch(which).baseVertex;
+	}
+	return &compactLayout;
+}
+
 float Grid::GetMaxHeight(){
 	return maxHeight;
 }
 
+//height of the terrain under a point, on the same triangles the grid is drawn with. Points off the terrain are clamped onto its edge
 float Grid::GetHeight(float x, float z){
-	// Transform from terrain local space to cell space.
-	float c = (x + 0.5f*gridWidth) / CELLSPACING;
-	float d = (z - 0.5f*gridDepth) / -CELLSPACING;
-	// Get the row and column we are in.
-	int row = (int)floorf(d);//z
-	int col = (int)floorf(c);//x
-
-	// Grab the heights of the cell we are in.
-	// A*--*B
-	// | /|
-	// |/ |
-	// C*--*D
-	float A = heightData[row*gridWidth + col];
-	float B = heightData[row*gridWidth + col + 1];
-	float C = heightData[(row+1)*gridWidth + col];
-	float D = heightData[(row+1)*gridWidth + col + 1];
-
-	// Find out which of the two triangles of the cell we are in
-	// if s + t <= 1 we are in the upper triangle
-	// else we are in the lower one
-	float s = c - (float)col;
-	float t = d - (float)row;
-
-	// If upper triangle ABC.
-	if( s + t <= 1.0f){
-		float uy = B - A;
-		float vy = C - A;
-		return A + s*uy + t*vy;
-	}
-	// lower triangle DCB.
-	else{ 	
-		float uy = C - D;
-		float vy = B - D;
-		return D + (1.0f-s)*uy + (1.0f-t)*vy;
-	}
-}
\ No newline at end of file
+	float height = 0.0f;
+	GetHeights(&x, &z, 1, &height);
+	return height;
+}
+
+void Grid::GetHeights(const float* x, const float* z, int count, float* heights, Vector3f* normals){
+	if (!heightData){
+		for (int i = 0; i < count; i++)
+			heights[i] = 0.0f;
+		return;
+	}
+
+	float dx = CELLSPACING;
+	float originX = -(gridWidth-1)*dx*0.5f;
+	float originZ = (gridDepth-1)*dx*0.5f;
+
+	if (!normals){
+		SampleTerrainHeights(heightData, gridWidth, gridDepth, dx, originX, originZ, x, z, count, heights, nullptr, nullptr, nullptr);
+		return;
+	}
+
+	//the kernel writes the normals out as separate x/y/z arrays, so go through them a chunk at a time
+	const int CHUNK = 256;
+	float nx[CHUNK], ny[CHUNK], nz[CHUNK];
+	for (int first = 0; first < count; first += CHUNK){
+		int n = Min(CHUNK, count - first);
+		SampleTerrainHeights(heightData, gridWidth, gridDepth, dx, originX, originZ, x + first, z + first, n, heights + first, nx, ny, nz);
+		for (int i = 0; i < n; i++){
+			normals[first + i] = Vector3f(nx[i], ny[i], nz[i]);
+		}
+	}
+}
+
+bool Grid::RayCast(const Vector3f& origin, const Vector3f& dir, float maxDistance, float& hitDistance){
+	return quadtree.RayCast(origin, dir, maxDistance, hitDistance);
+}
+
+void Grid::RayCast(const Vector3f* origins, const Vector3f* dirs, int count, float maxDistance, float* hitDistances){
+	quadtree.RayCast(origins, dirs, count, maxDistance, hitDistances);
+}
+
+///DEFORMATION
+bool Grid::SetHeights(int firstRow, int firstCol, int rows, int cols, const float* heights){
+	if (!heightData || firstRow < 0 || firstCol < 0 || rows <= 0 || cols <= 0 || firstRow + rows > gridWidth || firstCol + cols > gridDepth)
+		return false;
+
+	for (int i = 0; i < rows; i++){
+		memcpy(heightData + (firstRow + i)*gridDepth + firstCol, heights + i*cols, cols*sizeof(float));
+	}
+	return UpdateRegion(firstRow, firstCol, firstRow + rows - 1, firstCol + cols - 1);
+}
+
+bool Grid::Deform(float x, float z, float radius, float amount){
+	if (!heightData || radius <= 0.0f)
+		return false;
+
+	float dx = CELLSPACING;
+	float originX = -(gridWidth-1)*dx*0.5f;
+	float originZ = (gridDepth-1)*dx*0.5f;
+
+	//the vertices under the circle - columns run along +x and rows along -z
+	int firstRow = Max((int)ceilf((originZ - z - radius)/dx), 0);
+	int lastRow = Min((int)floorf((originZ - z + radius)/dx), gridWidth-1);
+	int firstCol = Max((int)ceilf((x - radius - originX)/dx), 0);
+	int lastCol = Min((int)floorf((x + radius - originX)/dx), gridDepth-1);
+	if (firstRow > lastRow || firstCol > lastCol)
+		return false;
+
+	float invRadiusSq = 1.0f / (radius*radius);
+	for (int i = firstRow; i <= lastRow; i++){
+		float distZ = originZ - i*dx - z;
+		for (int j = firstCol; j <= lastCol; j++){
+			float distX = originX + j*dx - x;
+			float t = 1.0f - (distX*distX + distZ*distZ)*invRadiusSq;
+			if (t > 0.0f)
+				heightData[i*gridDepth+j] += amount*t*t;	// smooth falloff to nothing at the edge
+		}
+	}
+	return UpdateRegion(firstRow, firstCol, lastRow, lastCol);
+}
+
+/*
+The heights of the vertices in rows firstRow to lastRow and columns firstCol to lastCol have changed. Their
+positions change and so do the normals one vertex further out, which are worked out from the heights either side
+of them. Only that block is rebuilt and uploaded, a row at a time unless it spans whole rows of the buffer.
+*/
+bool Grid::UpdateRegion(int firstRow, int firstCol, int lastRow, int lastCol){
+	bool rangeChanged = false;
+	for (int i = firstRow; i <= lastRow; i++){
+		for (int j = firstCol; j <= lastCol; j++){
+			float y = heightData[i*gridDepth+j];
+			if (y > maxHeight){
+				maxHeight = y;
+				rangeChanged = true;
+			}
+			if (y < minHeight){
+				minHeight = y;
+				rangeChanged = true;
+			}
+		}
+	}
+
+	quadtree.Refit(firstRow, firstCol, lastRow, lastCol);
+	if (geoMipmap)
+		geoMipmap->UpdateHeights(heightData, firstRow, firstCol, lastRow, lastCol);
+	RebakeLighting(firstRow, firstCol, lastRow, lastCol);
+
+	//compact heights are stored relative to the height range, so when it grows every vertex has to be packed again
+	if (compact && rangeChanged)
+		return RepackAll();
+
+	firstRow = Max(firstRow - 1, 0);
+	firstCol = Max(firstCol - 1, 0);
+	lastRow = Min(lastRow + 1, gridWidth-1);
+	lastCol = Min(lastCol + 1, gridDepth-1);
+	int rows = lastRow - firstRow + 1;
+	int cols = lastCol - firstCol + 1;
+
+	UINT vertexSize = GetVertexSize();
+	BYTE *region = new BYTE[rows*cols*vertexSize];
+	BuildVertices(firstRow, firstCol, rows, cols, region);
+	BYTE *copy = compact ? (BYTE*)compactVertices : (BYTE*)vertices;
+
+	bool result = true;
+	if (tiled){
+		//resident tiles take the part of the block they overlap, the rest are built from the new heights when they're loaded
+		for (unsigned int t = 0; t < tiles.size(); t++){
+			const TerrainTile& tile = tiles[t];
+			int r0 = Max(firstRow, tile.firstRow);
+			int c0 = Max(firstCol, tile.firstCol);
+			int r1 = Min(lastRow, tile.firstRow + tile.rows - 1);
+			int c1 = Min(lastCol, tile.firstCol + tile.cols - 1);
+			if (!tile.vb || r0 > r1 || c0 > c1)
+				continue;
+
+			UploadVertices(tile.vb, tile.cols, r0 - tile.firstRow, c0 - tile.firstCol, r1 - r0 + 1, c1 - c0 + 1,
+						   region + ((r0 - firstRow)*cols + (c0 - firstCol))*vertexSize, cols);
+		}
+	}
+	else if (mVB){
+		UploadVertices(mVB, gridDepth, firstRow, firstCol, rows, cols, region, cols);
+	}
+	else if (md3dDevice || !copy){
+		//without a device, as in the self-tests, there's only the cpu side copy to keep up to date
+		result = false;
+	}
+
+	//keep the cpu side copy the same as the buffer, when there is one
+	if (copy){
+		for (int i = 0; i < rows; i++){
+			memcpy(copy + ((firstRow + i)*gridDepth + firstCol)*vertexSize, region + i*cols*vertexSize, cols*vertexSize);
+		}
+	}
+
+	delete [] region;
+	return result;
+}
+
+//copies a rows x cols block of vertices with a pitch of srcPitch into a vertex buffer holding a block of the grid with a pitch of pitch
+void Grid::UploadVertices(ID3D10Buffer* vb, int pitch, int firstRow, int firstCol, int rows, int cols, const BYTE* src, int srcPitch){
+	UINT vertexSize = GetVertexSize();
+	D3D10_BOX box;
+	box.top = box.front = 0;
+	box.bottom = box.back = 1;
+
+	//whole rows sit next to each other in the buffer so they go in one go
+	if (cols == pitch && srcPitch == pitch){
+		box.left = firstRow*pitch*vertexSize;
+		box.right = (firstRow + rows)*pitch*vertexSize;
+		md3dDevice->UpdateSubresource(vb, 0, &box, src, 0, 0);
+		return;
+	}
+
+	for (int i = 0; i < rows; i++){
+		box.left = ((firstRow + i)*pitch + firstCol)*vertexSize;
+		box.right = box.left + cols*vertexSize;
+		md3dDevice->UpdateSubresource(vb, 0, &box, src + i*srcPitch*vertexSize, 0, 0);
+	}
+}
+
+//packs every compact vertex again after the height range has grown
+bool Grid::RepackAll(){
+	if (tiled){
+		for (unsigned int t = 0; t < tiles.size(); t++){
+			if (!tiles[t].vb)
+				continue;
+			UnloadTile(tiles[t]);
+			if (!LoadTile(tiles[t]))
+				return false;
+		}
+		return true;
+	}
+
+	if (!compactVertices || (md3dDevice && !mVB))
+		return false;
+
+	ThreadPool::GetShared()->ParallelFor(gridWidth, BUILD_BAND_ROWS, RepackBand, this);
+	if (mVB)
+		md3dDevice->UpdateSubresource(mVB, 0, nullptr, compactVertices, 0, 0);
+	return true;
+}
+
+void Grid::RepackBand(int firstRow, int lastRow, void* data){
+	((Grid*)data)->ComputeCompactVertices(firstRow, lastRow);
+}
+
+void Grid::SetBakedLighting(bool enabled, bool horizons, int reach){
+	bakeLighting = enabled;
+	bakeHorizons = horizons;
+	lightBaker.Initialize(reach);
+}
+
+//the maps are laid out like heightData - a texel per vertex, a row of the grid to a row of the texture
+bool Grid::BakeLighting(){
+	ReleaseLightMaps();
+	if (!bakeLighting)
+		return true;
+
+	int texels = gridWidth*gridDepth;
+	BYTE *occlusion = new BYTE[texels];
+	BYTE *horizons = bakeHorizons ? new BYTE[texels*4*2] : nullptr;
+	lightBaker.Bake(heightData, gridWidth, gridDepth, CELLSPACING, 0, 0, gridWidth-1, gridDepth-1, occlusion, horizons, gridDepth);
+
+	occlusionMap = new TextureLoader();
+	bool result = occlusionMap->Initialize(md3dDevice, occlusion, gridDepth, gridWidth, gridDepth, DXGI_FORMAT_R8_UNORM);
+	for (int i = 0; i < 2 && horizons && result; i++){
+		horizonMaps[i] = new TextureLoader();
+		result = horizonMaps[i]->Initialize(md3dDevice, horizons + i*texels*4, gridDepth, gridWidth, gridDepth*4, DXGI_FORMAT_R8G8B8A8_UNORM);
+	}
+
+	delete [] occlusion;
+	if (horizons)
+		delete [] horizons;
+	return result;
+}
+
+//the terrain shades vertices up to the reach away, so the block grows by that much before it's baked again
+void Grid::RebakeLighting(int firstRow, int firstCol, int lastRow, int lastCol){
+	if (!occlusionMap)
+		return;
+
+	int reach = lightBaker.GetReach();
+	firstRow = Max(firstRow - reach, 0);
+	firstCol = Max(firstCol - reach, 0);
+	lastRow = Min(lastRow + reach, gridWidth-1);
+	lastCol = Min(lastCol + reach, gridDepth-1);
+	int rows = lastRow - firstRow + 1;
+	int cols = lastCol - firstCol + 1;
+
+	BYTE *occlusion = new BYTE[rows*cols];
+	BYTE *horizons = horizonMaps[0] ? new BYTE[rows*cols*4*2] : nullptr;
+	lightBaker.Bake(heightData, gridWidth, gridDepth, CELLSPACING, firstRow, firstCol, lastRow, lastCol, occlusion, horizons, cols);
+
+	occlusionMap->Update(md3dDevice, occlusion, cols, firstCol, firstRow, cols, rows);
+	for (int i = 0; i < 2 && horizons; i++){
+		horizonMaps[i]->Update(md3dDevice, horizons + i*rows*cols*4, cols*4, firstCol, firstRow, cols, rows);
+	}
+
+	delete [] occlusion;
+	if (horizons)
+		delete [] horizons;
+}
+
+void Grid::ReleaseLightMaps(){
+	if (occlusionMap){occlusionMap->Shutdown(); delete occlusionMap; occlusionMap = nullptr;}
+	for (int i = 0; i < 2; i++){
+		if (horizonMaps[i]){horizonMaps[i]->Shutdown(); delete horizonMaps[i]; horizonMaps[i] = nullptr;}
+	}
+}
+
+ID3D10ShaderResourceView* Grid::GetOcclusionMap(){
+	return occlusionMap ? occlusionMap->GetTexture() : nullptr;
+}
+
+ID3D10ShaderResourceView* Grid::GetHorizonMap(int which){
+	return horizonMaps[which] ? horizonMaps[which]->GetTexture() : nullptr;
+}
+
+//vertex i, j has the texture coordinate (i/(gridWidth/TEXTURE_REPEAT), j/(gridDepth/TEXTURE_REPEAT)) and its texel is
+//column j, row i of the maps - the offset puts it on the centre of the texel
+D3DXVECTOR4 Grid::GetLightMapTransform(){
+	if (gridWidth <= 0 || gridDepth <= 0)
+		return D3DXVECTOR4(0.0f, 0.0f, 0.0f, 0.0f);
+	return D3DXVECTOR4((float)(gridDepth/TEXTURE_REPEAT) / gridDepth, (float)(gridWidth/TEXTURE_REPEAT) / gridWidth,
+					   0.5f / gridDepth, 0.5f / gridWidth);
+}
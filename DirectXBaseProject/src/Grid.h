@@ -4,11 +4,43 @@
 #include "GameObject.h"
 #include "d3dUtil.h"
 #include "TerrainLoader.h"
+#include "GeoMipmap.h"
+#include "ThreadPool.h"
+#include "TerrainQuadtree.h"
+#include "TerrainCache.h"
+#include "TerrainGenerator.h"
+#include "TerrainIndices.h"
+#include "TerrainOcclusion.h"
+#include "TerrainLightBaker.h"
+#include <vector>
 
 #define CELLSPACING		1.0f
-#define	HEIGHT_FACTOR	0.2f;
+#define	HEIGHT_FACTOR	0.2f
 
 const int TEXTURE_REPEAT = 1;	//how often the texture will repeat over the terrain grid
+const int BUILD_BAND_ROWS = 32;	//rows of the grid built by each job when the mesh is built on the thread pool
+const int MAX_PACK_COLUMNS = 256;	//columns packed into compact vertices at a time
+
+//a square block of the terrain with its own vertex and index buffer that is paged in and out around the camera
+struct TerrainTile
+{
+	int				firstRow, firstCol;		// first grid vertex of the tile
+	int				rows, cols;				// vertices along each side (neighbouring tiles share their border vertices)
+	ID3D10Buffer	*vb;
+	ID3D10Buffer	*ib;
+	DWORD			indexCount;
+	UINT			indexSize;				// 2 when the tile fits 16 bit indices and they're turned on
+	size_t			bytes;					// video memory taken by the buffers while resident, 0 when it isn't
+	unsigned int	lastUsedFrame;			// for least recently used eviction
+};
+
+//a block of the whole grid drawn as its own batch, see Grid::BuildPatches
+struct TerrainPatch
+{
+	int				firstRow, firstCol;		// first grid vertex of the patch
+	int				rows, cols;				// in quads
+	TerrainBatch	batch;
+};
 
 class Grid : public GameObject
 {
@@ -16,28 +48,178 @@ public:
 	Grid(void);
 	~Grid(void);
 
-	bool GenerateGrid(int width, int depth)const;
+	// a procedural terrain of width rows by depth columns made from noise and erosion - it isn't cached
+	bool GenerateGrid(int width, int depth, const TerrainGenSettings& settings = TerrainGenSettings());
 	bool GenerateGridFromTGA(char* filename);
+	bool GenerateGridFromRaw(char* filename, HEIGHTMAP_FORMAT format, int width = 0, int depth = 0);	// 16 bit or float heightmaps, see TerrainLoader
+
+	// how the heightmap is smoothed once it's loaded, defaults to what TerrainLoader does - call before generating the grid
+	void SetSmoothing(SMOOTH_KERNEL kernel, int iterations, float amount);
+	// the built terrain is saved next to the heightmap as <filename>.cache and mapped back in while the heightmap and
+	// the build settings stay the same. On by default
+	void SetCaching(bool enabled);
+	// stores the terrain as 4 byte VertexTerrain vertices instead of VertexNT - call before generating the grid.
+	// It has to be drawn with the layout from GetCompactLayout
+	void SetCompactVertices(bool enabled);
+
+	// switches to the tiled mode - call before generating the grid. tileSize is in quads, budgetBytes is the most
+	// vertex/index buffer memory the resident tiles may take and loadDistance is how close the camera has to get before a tile is built.
+	// Only the buffers are paged. The heights stay in memory, 4 bytes a vertex, for collision, ray casts, deforming and
+	// baking, so a tiled map is still limited to what can hold its heights
+	void SetTiling(int tileSize, size_t budgetBytes, float loadDistance);
+	void UpdateTiles(const Vector3f& cameraPos);	// pages tiles in and out around the camera, call once per frame
+
+	// how the whole grid and its tiles are indexed - call before generating the grid. The 16 bit modes draw the whole grid as
+	// patches of up to patchSize quads and order the indices for a post-transform cache of cacheSize vertices
+	void SetIndexMode(TERRAIN_INDEX_MODE mode, int patchSize = 32, int cacheSize = DEFAULT_VERTEX_CACHE);
+	// how well the whole grid's indices use a vertex cache of cacheSize vertices, false when tiled or geomipmapped
+	bool MeasureIndices(int cacheSize, VertexCacheStats& stats);
+
+	// switches to the geomipmapped mode - call before generating the grid. patchSize is in quads and gets rounded
+	// down to a power of two, and to 128 if it's bigger (see GEOMIPMAP_MAX_LEVELS). pixelError is how far (in pixels)
+	// a patch may stray from the full detail terrain
+	void SetGeoMipmapping(int patchSize, float pixelError);
+	void UpdateLOD(const Vector3f& cameraPos, float fovY, int screenHeight);	// picks the patch levels, call once per frame
+
+	// the terrain is drawn as one or more batches - the whole grid normally, every resident tile near the camera
+	// when tiled, or every patch at its current level when geomipmapped
+	int  GetBatchCount();
+	void RenderBatch(int which, D3DXMATRIX worldMatrix);
+	TerrainBatch GetBatch(int which);
+	void GetBatchBounds(int which, Vector3f& boxMin, Vector3f& boxMax);	// world space box around a batch, for culling
+
+	// sets occlusion up with the terrain as the occluder for this frame, cameraPos is in world space
+	void BeginOcclusion(TerrainOcclusion& occlusion, const Vector3f& cameraPos);
+	const TerrainVertexLayout* GetCompactLayout(int which);	// null unless the vertices are compact
+
+	// bakes ambient occlusion from the heights once they're loaded, and the horizon in HORIZON_DIRECTIONS directions for
+	// shadowing a parallel light when horizons is set - call before generating the grid. reach is in cells, see TerrainLightBaker
+	void SetBakedLighting(bool enabled, bool horizons = true, int reach = DEFAULT_HORIZON_REACH);
+	ID3D10ShaderResourceView* GetOcclusionMap();		// a byte per vertex, null unless the lighting is baked
+	ID3D10ShaderResourceView* GetHorizonMap(int which);	// directions 0-3 and 4-7, null unless the horizons are baked
+	D3DXVECTOR4 GetLightMapTransform();	// scale and offset from the terrain's texture coordinates (swapped) to the baked maps
 
 	float GetMaxHeight();
 
 	float GetHeight(float x, float z);
+	// heights of the terrain under count points given as separate x and z arrays, and the normals of the triangles
+	// they're on if normals isn't null. Much cheaper than calling GetHeight for every point
+	void  GetHeights(const float* x, const float* z, int count, float* heights, Vector3f* normals = nullptr);
+
+	// changes the heights of a rows x cols block of vertices starting at firstRow/firstCol, heights is row major with a pitch of cols.
+	// Only the vertices whose position or normal changes are rebuilt and uploaded, so an edit costs about as much as it is big
+	bool  SetHeights(int firstRow, int firstCol, int rows, int cols, const float* heights);
+	// raises the terrain around x/z (in grid space) by up to amount, falling off smoothly out to radius - a negative amount digs
+	bool  Deform(float x, float z, float radius, float amount);
+
+	// first hit of a ray (in grid space) with the terrain, for picking, line of sight and projectiles. Distances are in lengths of dir
+	bool  RayCast(const Vector3f& origin, const Vector3f& dir, float maxDistance, float& hitDistance);
+	// casts count rays at once, hitDistances gets -1 for the ones that miss
+	void  RayCast(const Vector3f* origins, const Vector3f* dirs, int count, float maxDistance, float* hitDistances);
+
+	// builds the mesh of a generated terrain one band after another and again on a pool of threadCount workers, in both
+	// vertex formats, and checks the two come out byte for byte the same. No device is needed
+	static bool CheckParallelBuild(int width, int depth, int threadCount);
+	// moves a camera round a generated terrain tiled into tileSize quad tiles with room for budgetTiles of them, and checks
+	// every frame that the tiles in reach are resident, the budget holds and only the least recently used tiles were evicted,
+	// no more of them than it took. loads and evictions get how many there were. No device is needed
+	static bool CheckTilePaging(int tiles, int tileSize, int budgetTiles, int frames, int& loads, int& evictions);
+	// deforms a generated terrain in both vertex formats, inside the height range, past it and over the edges, and checks
+	// the vertices come out byte for byte what building the whole grid again from the new heights gives. No device is needed
+	static bool CheckDeform(int width, int depth);
 
 private:
 	bool InitializeBuffers(DWORD* indices,  VertexNT* vertices);
+	bool SetupArraysAndInitBuffers();		// the grid has no placeholder geometry, its buffers are made once the heights are known
+	bool CreateBuffers(const void* vertices, UINT vertexSize, DWORD vertexCount, const void* indices, UINT indexSize, DWORD indexCount, ID3D10Buffer** vb, ID3D10Buffer** ib);
+	bool CreateVertexBuffer(const void* vertices, UINT vertexSize, DWORD vertexCount, ID3D10Buffer** vb);
+	UINT GetVertexSize()const;
+	bool CreateIndexBuffer(const void* indices, UINT indexSize, DWORD indexCount, ID3D10Buffer** ib);
+
+	bool  GenerateGridFromFile(char* filename, bool raw, HEIGHTMAP_FORMAT format, int width, int depth);
+	bool  LoadHeights(TerrainLoader* terrainLoader);	// copies the heightmap into heightData and scales it, tiled or not
+	bool  BuildFromHeights();							// builds the quadtree and the mesh or tiles once heightData is filled
+	bool  BuildMesh();									// builds the whole grid into one vertex and index buffer
+	void  BuildMeshArrays(ThreadPool* pool);			// fills the vertices and indices BuildMesh makes the buffers from
+	void  BuildCheckArrays(int width, int depth, bool compact, const float* heights, float minHeight, float maxHeight, ThreadPool* pool);
+	bool  BuildPatches();								// the 16 bit index buffer and patches of the whole grid
+	bool  MakeCacheKey(const char* filename, int format, int width, int depth, TerrainCacheKey& key);
+	bool  BuildFromCache(const TerrainCache& cache);
+
+	// the whole grid is built in bands of rows [firstRow, lastRow) on the thread pool
+	static void BuildBand(int firstRow, int lastRow, void* grid);
+	void  ComputePositions(int firstRow, int lastRow)const;
+	void  ComputeNormals(int firstRow, int lastRow)const;		// computes the normals of the terrain on a per-vertex level
+	void  ComputeTextureCoords(int firstRow, int lastRow)const;	// computes the texture coordinates of the terrain
+	void  ComputeIndices(int firstRow, int lastRow)const;
+	void  ComputeCompactVertices(int firstRow, int lastRow)const;
+	void  PackVertexRow(int row, int firstCol, int count, VertexTerrain* out)const;	// count compact vertices of a row
+
+	void  BuildVertex(int i, int j, VertexNT& vertex)const;	// position and texture coordinate of the vertex at row i, column j
+
+	bool  UpdateRegion(int firstRow, int firstCol, int lastRow, int lastCol);	// after the heights of a block of vertices have changed
+	void  BuildVertices(int firstRow, int firstCol, int rows, int cols, void* out)const;
+	void  UploadVertices(ID3D10Buffer* vb, int pitch, int firstRow, int firstCol, int rows, int cols, const BYTE* src, int srcPitch);
+	bool  RepackAll();
+	static void RepackBand(int firstRow, int lastRow, void* grid);
 
-	
-	void  ComputeNormals()const;				// computes the normals of the terrain on a per-vertex level
-	void  ComputeTextureCoords()const;		// computes the texture coordinates of the terrain
+	bool  BakeLighting();										// bakes the whole grid and makes the maps
+	void  RebakeLighting(int firstRow, int firstCol, int lastRow, int lastCol);	// after the heights of a block have changed
+	void  ReleaseLightMaps();
+
+	void  InitializeTiles();
+	bool  LoadTile(TerrainTile& tile);
+	void  UnloadTile(TerrainTile& tile);
+	void  ReleaseTiles();
 
 private:	
 	DWORD			*indices;
 	VertexNT		*vertices;
+	VertexTerrain	*compactVertices;		//used instead of vertices when the vertices are compact
 	int				gridWidth;
 	int				gridDepth;
 	float			maxHeight;
+	float			minHeight;
 
 	float			*heightData;			//array containing the height data for ease of access for terrain collision
+	TerrainQuadtree	quadtree;				//min/max bounds over the height data for ray casts
+
+	//tiled mode
+	bool						tiled;
+	int							tileSize;
+	size_t						tileBudget;
+	float						tileLoadDistance;
+	size_t						residentBytes;
+	unsigned int				frameNumber;
+	std::vector<TerrainTile>	tiles;
+	std::vector<int>			visibleTiles;	// resident tiles within reach of the camera this frame
+
+	//loading
+	SMOOTH_KERNEL				smoothKernel;
+	int							smoothIterations;
+	float						smoothAmount;
+	bool						caching;
+	bool						compact;
+	TerrainVertexLayout			compactLayout;
+
+	//indexing
+	TERRAIN_INDEX_MODE			indexMode;
+	int							indexPatchSize;
+	int							vertexCacheSize;
+	std::vector<TerrainPatch>	patches;		// empty unless the whole grid uses 16 bit indices
+	std::vector<WORD>			patchIndices;	// indices of every patch shape
+
+	//baked lighting
+	bool						bakeLighting;
+	bool						bakeHorizons;
+	TerrainLightBaker			lightBaker;
+	TextureLoader				*occlusionMap;
+	TextureLoader				*horizonMaps[2];
+
+	//geomipmapped mode
+	GeoMipmap					*geoMipmap;
+	int							lodPatchSize;
+	float						lodPixelError;
 };
 
-#endif
\ No newline at end of file
+#endif
@@ -0,0 +1,287 @@
+#include "Inflate.h"
+#include <string.h>
+
+const int MAX_CODE_BITS = 15;
+const int FAST_BITS = 10;		//codes up to this long are decoded with a single table lookup
+
+static const unsigned short LENGTH_BASE[29] = {3, 4, 5, 6, 7, 8, 9, 10, 11, 13, 15, 17, 19, 23, 27, 31, 35, 43, 51, 59, 67, 83, 99, 115, 131, 163, 195, 227, 258};
+static const unsigned char LENGTH_EXTRA[29] = {0, 0, 0, 0, 0, 0, 0, 0, 1, 1, 1, 1, 2, 2, 2, 2, 3, 3, 3, 3, 4, 4, 4, 4, 5, 5, 5, 5, 0};
+static const unsigned short DISTANCE_BASE[30] = {1, 2, 3, 4, 5, 7, 9, 13, 17, 25, 33, 49, 65, 97, 129, 193, 257, 385, 513, 769, 1025, 1537, 2049, 3073,
+												 4097, 6145, 8193, 12289, 16385, 24577};
+static const unsigned char DISTANCE_EXTRA[30] = {0, 0, 0, 0, 1, 1, 2, 2, 3, 3, 4, 4, 5, 5, 6, 6, 7, 7, 8, 8, 9, 9, 10, 10, 11, 11, 12, 12, 13, 13};
+static const unsigned char CODE_LENGTH_ORDER[19] = {16, 17, 18, 0, 8, 7, 9, 6, 10, 5, 11, 4, 12, 3, 13, 2, 14, 1, 15};
+
+//deflate packs its bits starting from the lowest bit of each byte
+struct BitStream
+{
+	const unsigned char*	next;
+	const unsigned char*	end;
+	unsigned long long		bits;
+	int						count;		// bits held in bits
+	int						padding;	// zero bytes made up past the end, which mustn't be used
+};
+
+static inline void Refill(BitStream& s){
+	while (s.count <= 56){
+		if (s.next < s.end)
+			s.bits |= (unsigned long long)*s.next++ << s.count;
+		else
+			s.padding++;
+		s.count += 8;
+	}
+}
+
+static inline unsigned int GetBits(BitStream& s, int n){
+	if (s.count < n)
+		Refill(s);
+	unsigned int value = (unsigned int)(s.bits & ((1ull << n) - 1));
+	s.bits >>= n;
+	s.count -= n;
+	return value;
+}
+
+static inline bool Overrun(const BitStream& s){
+	return s.padding*8 > s.count;
+}
+
+//canonical huffman code - symbols sorted by code length, plus a table straight from the next FAST_BITS bits for the short codes
+struct Huffman
+{
+	unsigned short	fast[1 << FAST_BITS];	// symbol << 4 | length, 0 when the code is longer than FAST_BITS
+	short			count[MAX_CODE_BITS + 1];
+	short			symbol[288];
+};
+
+static bool BuildHuffman(Huffman& h, const unsigned char* lengths, int n){
+	memset(h.count, 0, sizeof(h.count));
+	for (int i = 0; i < n; i++)
+		h.count[lengths[i]]++;
+	h.count[0] = 0;
+
+	//more codes of a length than there's room for can't be decoded - fewer is fine, the unused codes are just invalid
+	int left = 1;
+	for (int len = 1; len <= MAX_CODE_BITS; len++){
+		left = (left << 1) - h.count[len];
+		if (left < 0)
+			return false;
+	}
+
+	short offset[MAX_CODE_BITS + 1];
+	offset[1] = 0;
+	for (int len = 1; len < MAX_CODE_BITS; len++)
+		offset[len + 1] = offset[len] + h.count[len];
+	for (int i = 0; i < n; i++){
+		if (lengths[i])
+			h.symbol[offset[lengths[i]]++] = (short)i;
+	}
+
+	//the codes are stored first bit first, so the table is indexed by them reversed
+	memset(h.fast, 0, sizeof(h.fast));
+	int code = 0;
+	int k = 0;
+	for (int len = 1; len <= FAST_BITS; len++){
+		for (int i = 0; i < h.count[len]; i++, k++, code++){
+			int reversed = 0;
+			for (int b = 0; b < len; b++)
+				reversed |= ((code >> b) & 1) << (len - 1 - b);
+			for (int j = reversed; j < (1 << FAST_BITS); j += 1 << len)
+				h.fast[j] = (unsigned short)(h.symbol[k] << 4 | len);
+		}
+		code <<= 1;
+	}
+	return true;
+}
+
+//a bit at a time through the lengths, for the codes too long for the table
+static int DecodeSlow(BitStream& s, const Huffman& h){
+	int code = 0;
+	int first = 0;
+	int index = 0;
+	for (int len = 1; len <= MAX_CODE_BITS; len++){
+		code |= GetBits(s, 1);
+		int count = h.count[len];
+		if (code - count < first)
+			return h.symbol[index + (code - first)];
+		index += count;
+		first = (first + count) << 1;
+		code <<= 1;
+	}
+	return -1;
+}
+
+static inline int Decode(BitStream& s, const Huffman& h){
+	if (s.count < MAX_CODE_BITS)
+		Refill(s);
+	unsigned int entry = h.fast[s.bits & ((1 << FAST_BITS) - 1)];
+	if (entry){
+		int len = entry & 15;
+		s.bits >>= len;
+		s.count -= len;
+		return entry >> 4;
+	}
+	return DecodeSlow(s, h);
+}
+
+static bool InflateCodes(BitStream& s, const Huffman& lengths, const Huffman& distances, unsigned char* dst, size_t dstSize, size_t& out){
+	for (;;){
+		int symbol = Decode(s, lengths);
+		if (symbol < 256){
+			if (symbol < 0 || out >= dstSize)
+				return false;
+			dst[out++] = (unsigned char)symbol;
+			continue;
+		}
+		if (symbol == 256)
+			return !Overrun(s);
+
+		symbol -= 257;
+		if (symbol >= 29)
+			return false;
+		size_t length = LENGTH_BASE[symbol] + GetBits(s, LENGTH_EXTRA[symbol]);
+		int code = Decode(s, distances);
+		if (code < 0 || code >= 30)
+			return false;
+		size_t distance = DISTANCE_BASE[code] + GetBits(s, DISTANCE_EXTRA[code]);
+		if (distance > out || length > dstSize - out)
+			return false;
+
+		//a match closer than its length repeats the bytes it's writing, so it's copied a byte at a time
+		unsigned char* to = dst + out;
+		const unsigned char* from = to - distance;
+		if (distance >= length){
+			memcpy(to, from, length);
+		}
+		else{
+			for (size_t i = 0; i < length; i++)
+				to[i] = from[i];
+		}
+		out += length;
+	}
+}
+
+static bool InflateStored(BitStream& s, unsigned char* dst, size_t dstSize, size_t& out){
+	GetBits(s, s.count & 7);		//to the next byte
+	unsigned int length = GetBits(s, 16);
+	unsigned int inverse = GetBits(s, 16);
+	if (length != (~inverse & 0xFFFF) || length > dstSize - out || Overrun(s))
+		return false;
+
+	//whatever whole bytes are still in the bit buffer first, then straight from the source
+	while (length > 0 && s.count >= 8){
+		dst[out++] = (unsigned char)GetBits(s, 8);
+		length--;
+	}
+	if (Overrun(s) || length > (size_t)(s.end - s.next))
+		return false;
+	memcpy(dst + out, s.next, length);
+	s.next += length;
+	out += length;
+	return true;
+}
+
+static bool InflateFixed(BitStream& s, unsigned char* dst, size_t dstSize, size_t& out){
+	unsigned char lengths[288 + 30];
+	memset(lengths, 8, 144);
+	memset(lengths + 144, 9, 256 - 144);
+	memset(lengths + 256, 7, 280 - 256);
+	memset(lengths + 280, 8, 288 - 280);
+	memset(lengths + 288, 5, 30);
+
+	Huffman literals, distances;
+	BuildHuffman(literals, lengths, 288);
+	BuildHuffman(distances, lengths + 288, 30);
+	return InflateCodes(s, literals, distances, dst, dstSize, out);
+}
+
+static bool InflateDynamic(BitStream& s, unsigned char* dst, size_t dstSize, size_t& out){
+	int literalCount = GetBits(s, 5) + 257;
+	int distanceCount = GetBits(s, 5) + 1;
+	int codeCount = GetBits(s, 4) + 4;
+	if (literalCount > 286 || distanceCount > 30)
+		return false;
+
+	//the code lengths are themselves huffman coded
+	unsigned char lengths[286 + 30];
+	memset(lengths, 0, 19);
+	for (int i = 0; i < codeCount; i++)
+		lengths[CODE_LENGTH_ORDER[i]] = (unsigned char)GetBits(s, 3);
+
+	Huffman codes;
+	if (!BuildHuffman(codes, lengths, 19))
+		return false;
+
+	int total = literalCount + distanceCount;
+	int index = 0;
+	while (index < total){
+		int symbol = Decode(s, codes);
+		if (symbol < 0)
+			return false;
+		if (symbol < 16){
+			lengths[index++] = (unsigned char)symbol;
+			continue;
+		}
+
+		unsigned char repeat = 0;
+		int times;
+		if (symbol == 16){
+			if (index == 0)
+				return false;
+			repeat = lengths[index - 1];
+			times = 3 + GetBits(s, 2);
+		}
+		else if (symbol == 17){
+			times = 3 + GetBits(s, 3);
+		}
+		else{
+			times = 11 + GetBits(s, 7);
+		}
+		if (index + times > total)
+			return false;
+		memset(lengths + index, repeat, times);
+		index += times;
+	}
+	if (lengths[256] == 0 || Overrun(s))
+		return false;
+
+	Huffman literals, distances;
+	if (!BuildHuffman(literals, lengths, literalCount) || !BuildHuffman(distances, lengths + literalCount, distanceCount))
+		return false;
+	return InflateCodes(s, literals, distances, dst, dstSize, out);
+}
+
+bool InflateRaw(const unsigned char* src, size_t srcSize, unsigned char* dst, size_t dstSize){
+	BitStream s;
+	s.next = src;
+	s.end = src + srcSize;
+	s.bits = 0;
+	s.count = 0;
+	s.padding = 0;
+
+	size_t out = 0;
+	unsigned int last;
+	do{
+		last = GetBits(s, 1);
+		bool result;
+		switch (GetBits(s, 2)){
+		case 0:		result = InflateStored(s, dst, dstSize, out);	break;
+		case 1:		result = InflateFixed(s, dst, dstSize, out);	break;
+		case 2:		result = InflateDynamic(s, dst, dstSize, out);	break;
+		default:	result = false;									break;
+		}
+		if (!result)
+			return false;
+	} while (!last);
+
+	return out == dstSize;
+}
+
+bool Inflate(const unsigned char* src, size_t srcSize, unsigned char* dst, size_t dstSize){
+	//deflate with a window of at most 32k and no preset dictionary
+	if (srcSize < 2)
+		return false;
+	unsigned int method = src[0];
+	unsigned int flags = src[1];
+	if ((method & 15) != 8 || (method >> 4) > 7 || (method*256 + flags) % 31 != 0 || (flags & 0x20))
+		return false;
+	return InflateRaw(src + 2, srcSize - 2, dst, dstSize);
+}
@@ -0,0 +1,16 @@
+#ifndef _H_INFLATE
+#define _H_INFLATE
+
+#include <stddef.h>
+
+///DECOMPRESSES DEFLATE DATA (RFC 1951) WRAPPED IN A ZLIB STREAM (RFC 1950), AS USED BY THE COMPRESSED ARRAYS OF FBX FILES
+///THE WHOLE OUTPUT HAS TO FIT IN ONE BUFFER WHOSE SIZE IS KNOWN UP FRONT, SO NOTHING IS ALLOCATED WHILE DECODING
+
+// unpacks the zlib stream of srcSize bytes at src into dst. False if the stream is damaged or doesn't unpack to
+// exactly dstSize bytes. The adler-32 checksum at the end of the stream isn't checked
+bool	Inflate(const unsigned char* src, size_t srcSize, unsigned char* dst, size_t dstSize);
+
+// the same for raw deflate data without the zlib header
+bool	InflateRaw(const unsigned char* src, size_t srcSize, unsigned char* dst, size_t dstSize);
+
+#endif
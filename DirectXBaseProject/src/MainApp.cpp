@@ -18,8 +18,14 @@
 #include "TexShader.h"
 #include "Grid.h"
 #include "ModelObject.h"
+#include "Benchmarks.h"
+#include "SelfTests.h"
 #include "console.h"
+#include "TerrainOcclusion.h"
+#include "AssetImporter.h"
 #include <list>
+#include <vector>
+#include <sstream>
 
 class MainApp : public D3DApp
 {
@@ -47,6 +53,7 @@ private:
 	void animateLights();
 	void SwitchCameras();
 	void MouseInput();
+	void cullObjects();
  
 private:
 
@@ -59,6 +66,7 @@ private:
 
 	ModelObject		*model;
 	//ModelObject	*model2;
+	AssetImporter	importer;		//models are read in on the thread pool and made in updateScene
 	Grid			*grid;
 
 	GameCamera		*godCamera;
@@ -72,6 +80,13 @@ private:
 
 	float			aspectRatio;
 
+	//occlusion culling against the terrain - the grid's batches come first in the lists, then the model
+	TerrainOcclusion		occlusion;
+	std::vector<Vector3f>	cullMin;
+	std::vector<Vector3f>	cullMax;
+	std::vector<BYTE>		cullVisible;
+	std::wstring			cullStats;
+
 	D3DXMATRIX mView;
 	D3DXMATRIX mProj;
 	D3DXMATRIX mWVP;
@@ -88,6 +103,19 @@ int WINAPI WinMain(HINSTANCE hInstance, HINSTANCE prevInstance,
 #endif
 
 	ShowWin32Console();
+
+	//-cook model.fbx model.mesh cooks a model offline without starting the game
+	if (__argc == 4 && strcmp(__argv[1], "-cook") == 0){
+		bool cooked = ModelObject::CookModel(__argv[2], __argv[3]);
+		std::cout << (cooked ? "Cooked " : "Could not cook ") << __argv[2] << " into " << __argv[3] << std::endl;
+		return cooked ? 0 : 1;
+	}
+	//-bench times the terrain kernels against the routines they replaced on the game's heightmap and bigger synthetic ones
+	if (__argc == 2 && strcmp(__argv[1], "-bench") == 0)
+		return RunBenchmarks("assets/heightmap.tga") ? 0 : 1;
+	//-test runs the checks that don't need a device and prints what they found
+	if (__argc == 2 && strcmp(__argv[1], "-test") == 0)
+		return RunSelfTests() ? 0 : 1;
 	
 	MainApp theApp(hInstance);
 	
@@ -212,6 +240,18 @@ void MainApp::initModels(){
 	bool result;
 
 	model = new ModelObject();
+	result = model->InitializeWithTexture(md3dDevice,L"assets/models/Grunt/grunt_texture.jpg",NULL);
+
+	if(!result){
+		MessageBox(getMainWnd(), L"Could not initialize the model object.", L"Error", MB_OK);
+	}
+
+	//the model is read in on the workers while the grid is built - the cooked model is made from the FBX the first
+	//time round if it hasn't been cooked offline
+	importer.ImportModel(model, "assets/models/Grunt/Grunt.fbx", "assets/models/Grunt/Grunt.mesh");
+	gameObjectList.push_back(model);
+	model->pos = Vector3f(0,1.5f,0);
+
 	grid = new Grid();
 	result = grid->InitializeWithMultiTexture(md3dDevice,L"assets/defaultspec.dds", NULL,L"assets/stone2.dds",
 																						 L"assets/ground0.dds",
@@ -219,24 +259,12 @@ void MainApp::initModels(){
 	if(!result){
 		MessageBox(getMainWnd(), L"Could not initialize the grid object.", L"Error", MB_OK);
 	}
+	grid->SetBakedLighting(true);
 	result = grid->GenerateGridFromTGA("assets/heightmap.tga");
 	if(!result){
 		MessageBox(getMainWnd(), L"Could properly generate heightmap.", L"Error", MB_OK);
 	}
 	gameObjectList.push_back(grid);
-
-	result = model->InitializeWithTexture(md3dDevice,L"assets/models/Grunt/grunt_texture.jpg",NULL);
-
-	if(!result){
-		MessageBox(getMainWnd(), L"Could not initialize the model object.", L"Error", MB_OK);
-	}
-
-	result = model->LoadModelFromFBX("assets/models/Grunt/Grunt.fbx");
-	if (!result){
-		MessageBox(getMainWnd(), L"Could not load in the FBX object.", L"Error", MB_OK);
-	}
-	gameObjectList.push_back(model);
-	model->pos = Vector3f(0,1.5f,0);
 	/*model2 = new ModelObject(*model);
 	model2->pos = Vector3f(8,7,0);
 	gameObjectList.push_back(model2);*/
@@ -259,6 +287,7 @@ void MainApp::initShaders(){
 	if(!result){
 		MessageBox(getMainWnd(), L"Could not initialize the multi tex shader object.", L"Error", MB_OK);
 	}
+	multiTexShader->SetBakedLighting(grid->GetOcclusionMap(), grid->GetHorizonMap(0), grid->GetHorizonMap(1), grid->GetLightMapTransform());
 
 	shaderList.push_back(multiTexShader);
 }
@@ -370,7 +399,19 @@ void MainApp::onResize(){
 
 void MainApp::updateScene(float dt){
 	D3DApp::updateScene(dt);
+	if (!importer.Update()){
+		MessageBox(getMainWnd(), L"Could not load in the FBX object.", L"Error", MB_OK);
+	}
+	//skinned models are posed on the workers, then their vertices go into the buffers here where the device is
+	ModelObject* animatedModels[] = {model};
+	int animatedCount = sizeof(animatedModels)/sizeof(animatedModels[0]);
+	ModelObject::AnimateModels(animatedModels, animatedCount, dt);
+	for (int i = 0; i < animatedCount; i++)
+		animatedModels[i]->UpdateSkinnedVertices();
 	animateLights();
+	grid->UpdateTiles(currentCam->GetPosition());
+	grid->UpdateLOD(currentCam->GetPosition(), aspectRatio*PI, mClientHeight);
+	model->UpdateLOD(currentCam->GetPosition(), aspectRatio*PI, mClientHeight);
 }
 
 void MainApp::drawScene(){
@@ -390,31 +431,75 @@ void MainApp::drawScene(){
 	// Get the world, view, and projection matrices from the camera and d3d objects.
 	currentCam->GetViewMatrix(mView);
 
-	//Render the Model
-	model->Render(mWVP);
-	texShader->RenderTexturing(md3dDevice,model->GetIndexCount(),model->objMatrix,mView,mProj,currentCam->GetPosition(),light[lightType],model->GetDiffuseTexture(),model->GetSpecularTexture());
+	cullObjects();
+	int batchCount = grid->GetBatchCount();
+
+	//Render the Model at the level of detail picked for how far away it is, one draw for each of its materials
+	if (model->IsLoaded() && cullVisible[batchCount]){
+		model->Render(mWVP);
+		for (int i = 0; i < model->GetBatchCount(); i++){
+			texShader->RenderTexturing(md3dDevice,model->GetBatchIndexCount(i),model->objMatrix,mView,mProj,currentCam->GetPosition(),light[lightType],model->GetBatchTexture(i),model->GetSpecularTexture(),
+									   model->GetBatchStartIndex(i));
+		}
+	}
 
 	/*model2->Render(mWVP);
 	texShader->RenderTexturing(md3dDevice,model2->GetIndexCount(),model2->objMatrix,mView,mProj,camera->GetPosition(),light[lightType],model2->GetDiffuseTexture(),model2->GetSpecularTexture());*/
 
-	grid->Render(mWVP);
-	multiTexShader->RenderMultiTexturing(md3dDevice,grid->GetIndexCount(),grid->objMatrix,mView,mProj,currentCam->GetPosition(),light[lightType],
-																															 grid->GetSpecularTexture(),
-																															 NULL,
-																															 grid->GetDiffuseMap(0),
-																															 grid->GetDiffuseMap(1),
-																															 grid->GetDiffuseMap(2),
-																															 grid->GetMaxHeight(),
-																															 lightType);
+	//the grid is drawn as a single batch, one batch per resident tile when it is tiled or one per patch when geomipmapped
+	//or indexed in patches - batches hidden behind the terrain are skipped
+	for (int i = 0; i < batchCount; i++){
+		if (!cullVisible[i])
+			continue;
+		TerrainBatch batch = grid->GetBatch(i);
+		grid->RenderBatch(i, mWVP);
+		multiTexShader->RenderMultiTexturing(md3dDevice,batch.indexCount,grid->objMatrix,mView,mProj,currentCam->GetPosition(),light[lightType],
+																																 grid->GetSpecularTexture(),
+																																 NULL,
+																																 grid->GetDiffuseMap(0),
+																																 grid->GetDiffuseMap(1),
+																																 grid->GetDiffuseMap(2),
+																																 grid->GetMaxHeight(),
+																																 lightType,
+																																 batch.startIndex,
+																																 batch.baseVertex,
+																																 grid->GetCompactLayout(i));
+	}
 
 
 	// We specify DT_NOCLIP, so we do not care about width/height of the rect.
 	RECT R = {5, 5, 0, 0};
 	md3dDevice->RSSetState(0);
-	mFont->DrawText(0, mFrameStats.c_str(), -1, &R, DT_NOCLIP, BLACK);
+	std::wstring stats = mFrameStats + L"\n" + cullStats;
+	mFont->DrawText(0, stats.c_str(), -1, &R, DT_NOCLIP, BLACK);
 	mSwapChain->Present(0, 0);
 }
 
+//finds out which of the grid's batches and the model the terrain hides from the camera this frame
+void MainApp::cullObjects(){
+	int batchCount = grid->GetBatchCount();
+	int count = batchCount + 1;
+	cullMin.resize(count);
+	cullMax.resize(count);
+	cullVisible.resize(count);
+
+	for (int i = 0; i < batchCount; i++)
+		grid->GetBatchBounds(i, cullMin[i], cullMax[i]);
+	model->GetWorldBounds(cullMin[batchCount], cullMax[batchCount]);
+
+	grid->BeginOcclusion(occlusion, currentCam->GetPosition());
+	occlusion.Cull(&cullMin[0], &cullMax[0], count, &cullVisible[0]);
+
+	int batchesCulled = 0;
+	for (int i = 0; i < batchCount; i++)
+		batchesCulled += cullVisible[i] ? 0 : 1;
+
+	std::wostringstream outs;
+	outs << L"Occluded: " << batchesCulled << L"/" << batchCount << L" terrain batches, "
+		 << (cullVisible[batchCount] ? 0 : 1) << L"/1 objects";
+	cullStats = outs.str();
+}
+
 void MainApp::animateLights(){
 	// Set the light type based on user input.
 	if(GetAsyncKeyState('1') & 0x8000) lightType = L_PARALLEL;
@@ -0,0 +1,72 @@
+#include "MappedFile.h"
+
+
+MappedFile::MappedFile(void){
+	fileHandle = INVALID_HANDLE_VALUE;
+	mappingHandle = NULL;
+	data = nullptr;
+	size = 0;
+}
+
+MappedFile::~MappedFile(void){
+	Close();
+}
+
+bool MappedFile::Open(const char* filename){
+	Close();
+
+	fileHandle = CreateFileA(filename, GENERIC_READ, FILE_SHARE_READ, NULL, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL | FILE_FLAG_SEQUENTIAL_SCAN, NULL);
+	if (fileHandle == INVALID_HANDLE_VALUE){
+		return false;
+	}
+
+	LARGE_INTEGER fileSize;
+	if (!GetFileSizeEx(fileHandle, &fileSize) || fileSize.QuadPart == 0 || (ULONGLONG)fileSize.QuadPart > (size_t)-1){
+		//a zero sized file can't be mapped and a file bigger than the address space can't be viewed in one go
+		Close();
+		return false;
+	}
+	size = (size_t)fileSize.QuadPart;
+
+	mappingHandle = CreateFileMappingA(fileHandle, NULL, PAGE_READONLY, 0, 0, NULL);
+	if (mappingHandle == NULL){
+		Close();
+		return false;
+	}
+
+	data = (const unsigned char*)MapViewOfFile(mappingHandle, FILE_MAP_READ, 0, 0, 0);
+	if (data == nullptr){
+		Close();
+		return false;
+	}
+
+	return true;
+}
+
+void MappedFile::Close(){
+	if (data){
+		UnmapViewOfFile(data);
+		data = nullptr;
+	}
+	if (mappingHandle){
+		CloseHandle(mappingHandle);
+		mappingHandle = NULL;
+	}
+	if (fileHandle != INVALID_HANDLE_VALUE){
+		CloseHandle(fileHandle);
+		fileHandle = INVALID_HANDLE_VALUE;
+	}
+	size = 0;
+}
+
+bool MappedFile::IsOpen()const{
+	return data != nullptr;
+}
+
+const unsigned char* MappedFile::GetData()const{
+	return data;
+}
+
+size_t MappedFile::GetSize()const{
+	return size;
+}
@@ -0,0 +1,31 @@
+#ifndef _H_MAPPEDFILE
+#define _H_MAPPEDFILE
+
+#include <windows.h>
+
+///READ-ONLY MEMORY MAPPED VIEW OF A FILE - THE CONTENTS ARE PAGED IN BY THE OS ON DEMAND
+///SO LARGE FILES CAN BE READ WITHOUT COPYING THEM INTO A HEAP BUFFER FIRST
+class MappedFile
+{
+public:
+	MappedFile(void);
+	~MappedFile(void);
+
+	bool	Open(const char* filename);		// maps the whole file into memory, returns false if it can't be opened or is empty
+	void	Close();						// unmaps the view and closes the file handles
+
+	bool					IsOpen()const;
+	const unsigned char*	GetData()const;
+	size_t					GetSize()const;
+
+private:
+	MappedFile(const MappedFile&);				// not copyable - the view would be unmapped twice
+	MappedFile& operator=(const MappedFile&);
+
+	HANDLE					fileHandle;
+	HANDLE					mappingHandle;
+	const unsigned char*	data;
+	size_t					size;
+};
+
+#endif
@@ -0,0 +1,330 @@
+#include "MeshFile.h"
+#include <stdio.h>
+#include <string.h>
+
+//the next section starts at the first aligned offset after the end of this one
+static UINT64 AlignSection(UINT64 offset){
+	return (offset + MESH_FILE_ALIGNMENT - 1) & ~(UINT64)(MESH_FILE_ALIGNMENT - 1);
+}
+
+//a section has to start aligned and end inside the file
+static bool SectionFits(UINT64 offset, UINT64 count, UINT64 elementSize, UINT64 fileSize){
+	return offset % MESH_FILE_ALIGNMENT == 0 && offset <= fileSize && count <= (fileSize - offset)/elementSize;
+}
+
+//pads the file from where it's written up to the section's offset, then writes the section
+static bool WriteSection(FILE* fp, UINT64& written, UINT64 offset, const void* data, size_t elementSize, DWORD count){
+	static const char zeros[MESH_FILE_ALIGNMENT] = {0};
+	size_t padding = (size_t)(offset - written);
+	if (offset < written || padding > MESH_FILE_ALIGNMENT || (padding > 0 && fwrite(zeros, 1, padding, fp) != padding))
+		return false;
+	if (count > 0 && fwrite(data, elementSize, count, fp) != count)
+		return false;
+	written = offset + (UINT64)count*elementSize;
+	return true;
+}
+
+
+MeshFile::MeshFile(void){
+	header = nullptr;
+}
+
+MeshFile::~MeshFile(void){
+	Close();
+}
+
+void MeshFile::Close(){
+	file.Close();
+	header = nullptr;
+}
+
+void MeshFile::Prefetch()const{
+	if (!file.IsOpen())
+		return;
+	SYSTEM_INFO info;
+	GetSystemInfo(&info);
+	const unsigned char* data = file.GetData();
+	volatile unsigned char sum = 0;
+	for (size_t offset = 0; offset < file.GetSize(); offset += info.dwPageSize)
+		sum += data[offset];
+}
+
+bool MeshFile::Load(const char* filename){
+	Close();
+
+	if (!file.Open(filename))
+		return false;
+
+	if (file.GetSize() < sizeof(Header)){
+		Close();
+		return false;
+	}
+
+	//only the header, the sections' extents and the tables are checked - the vertices and indices go to D3D as they are,
+	//which reads zeros rather than past the buffer for an index out of range
+	const Header* h = (const Header*)file.GetData();
+	if (h->magic != MESH_FILE_MAGIC || h->version != MESH_FILE_VERSION || h->vertexSize != sizeof(VertexNT) || h->indexSize != sizeof(DWORD) ||
+		h->fileSize != file.GetSize() || h->vertexCount == 0 || h->indexCount == 0 ||
+		!SectionFits(h->vertexOffset, h->vertexCount, sizeof(VertexNT), h->fileSize) ||
+		!SectionFits(h->indexOffset, h->indexCount, sizeof(DWORD), h->fileSize) ||
+		!SectionFits(h->subsetOffset, h->subsetCount, sizeof(MeshSubset), h->fileSize) ||
+		!SectionFits(h->materialOffset, h->materialCount, sizeof(MeshMaterial), h->fileSize) ||
+		!SectionFits(h->batchOffset, h->batchCount, sizeof(MeshBatch), h->fileSize) ||
+		!SectionFits(h->lodOffset, h->lodCount, sizeof(MeshLod), h->fileSize) ||
+		(h->skinCount != 0 && h->skinCount != h->vertexCount) || h->boneCount > MESH_MAX_BONES ||
+		!SectionFits(h->skinOffset, h->skinCount, sizeof(VertexSkin), h->fileSize) ||
+		!SectionFits(h->boneOffset, h->boneCount, sizeof(MeshBone), h->fileSize) ||
+		!SectionFits(h->clipOffset, h->clipCount, sizeof(MeshClip), h->fileSize) ||
+		!SectionFits(h->trackOffset, h->trackCount, sizeof(MeshTrack), h->fileSize) ||
+		!SectionFits(h->keyOffset, h->keyCount, sizeof(MeshKey), h->fileSize)){
+		Close();
+		return false;
+	}
+
+	bool valid = true;
+	const MeshSubset* subsets = (const MeshSubset*)(file.GetData() + h->subsetOffset);
+	for (DWORD i = 0; i < h->subsetCount; i++){
+		if (subsets[i].firstIndex > h->indexCount || subsets[i].indexCount > h->indexCount - subsets[i].firstIndex ||
+			subsets[i].firstVertex > h->vertexCount || subsets[i].vertexCount > h->vertexCount - subsets[i].firstVertex ||
+			subsets[i].material >= h->materialCount)
+			valid = false;
+	}
+
+	//the names are only ever read as strings, so they have to end inside the table
+	const MeshMaterial* materials = (const MeshMaterial*)(file.GetData() + h->materialOffset);
+	for (DWORD i = 0; i < h->materialCount; i++){
+		if (!memchr(materials[i].name, 0, MESH_NAME_LENGTH) || !memchr(materials[i].diffuseMap, 0, MESH_NAME_LENGTH))
+			valid = false;
+	}
+
+	const MeshBatch* batches = (const MeshBatch*)(file.GetData() + h->batchOffset);
+	for (DWORD i = 0; i < h->batchCount; i++){
+		if (batches[i].firstIndex > h->indexCount || batches[i].indexCount > h->indexCount - batches[i].firstIndex ||
+			batches[i].material >= h->materialCount)
+			valid = false;
+	}
+
+	const MeshLod* lods = (const MeshLod*)(file.GetData() + h->lodOffset);
+	for (DWORD i = 0; i < h->lodCount; i++){
+		if (lods[i].firstIndex > h->indexCount || lods[i].indexCount > h->indexCount - lods[i].firstIndex ||
+			lods[i].firstBatch > h->batchCount || lods[i].batchCount > h->batchCount - lods[i].firstBatch)
+			valid = false;
+	}
+
+	//the skin is read on the CPU to index the bones, so unlike the rest of the vertices it has to point at ones there are
+	const VertexSkin* skin = (const VertexSkin*)(file.GetData() + h->skinOffset);
+	for (DWORD i = 0; i < h->skinCount; i++){
+		for (int j = 0; j < 4; j++){
+			if (skin[i].bones[j] >= h->boneCount)
+				valid = false;
+		}
+	}
+
+	const MeshBone* bones = (const MeshBone*)(file.GetData() + h->boneOffset);
+	for (DWORD i = 0; i < h->boneCount; i++){
+		if (!memchr(bones[i].name, 0, MESH_NAME_LENGTH) || bones[i].parent < -1 || bones[i].parent >= (int)i)
+			valid = false;
+	}
+
+	const MeshClip* clips = (const MeshClip*)(file.GetData() + h->clipOffset);
+	for (DWORD i = 0; i < h->clipCount; i++){
+		if (!memchr(clips[i].name, 0, MESH_NAME_LENGTH) || clips[i].frameCount == 0 || clips[i].frameCount > MESH_MAX_CLIP_FRAMES ||
+			clips[i].firstTrack > h->trackCount || h->boneCount > h->trackCount - clips[i].firstTrack)
+			valid = false;
+	}
+
+	//the keys are searched by frame, which only needs them to be inside the table - frames out of order just sample wrong
+	const MeshTrack* tracks = (const MeshTrack*)(file.GetData() + h->trackOffset);
+	for (DWORD i = 0; i < h->trackCount; i++){
+		for (int j = 0; j < CHANNEL_COUNT; j++){
+			if (tracks[i].keyCount[j] == 0 || tracks[i].firstKey[j] > h->keyCount || tracks[i].keyCount[j] > h->keyCount - tracks[i].firstKey[j])
+				valid = false;
+		}
+	}
+
+	if (!valid){
+		Close();
+		return false;
+	}
+
+	header = h;
+	return true;
+}
+
+bool MeshFile::Save(const char* filename, const MeshContents& contents){
+	if (contents.vertexCount == 0 || contents.indexCount == 0)
+		return false;
+
+	Header h;
+	memset(&h, 0, sizeof(h));
+	h.magic = MESH_FILE_MAGIC;
+	h.version = MESH_FILE_VERSION;
+	h.vertexSize = sizeof(VertexNT);
+	h.indexSize = sizeof(DWORD);
+	h.vertexCount = contents.vertexCount;
+	h.indexCount = contents.indexCount;
+	h.subsetCount = contents.subsetCount;
+	h.materialCount = contents.materialCount;
+	h.batchCount = contents.batchCount;
+	h.lodCount = contents.lodCount;
+	h.skinCount = contents.skin ? contents.vertexCount : 0;
+	h.boneCount = contents.boneCount;
+	h.clipCount = contents.clipCount;
+	h.trackCount = contents.trackCount;
+	h.keyCount = contents.keyCount;
+	h.vertexOffset = AlignSection(sizeof(Header));
+	h.indexOffset = AlignSection(h.vertexOffset + (UINT64)h.vertexCount*sizeof(VertexNT));
+	h.subsetOffset = AlignSection(h.indexOffset + (UINT64)h.indexCount*sizeof(DWORD));
+	h.materialOffset = AlignSection(h.subsetOffset + (UINT64)h.subsetCount*sizeof(MeshSubset));
+	h.batchOffset = AlignSection(h.materialOffset + (UINT64)h.materialCount*sizeof(MeshMaterial));
+	h.lodOffset = AlignSection(h.batchOffset + (UINT64)h.batchCount*sizeof(MeshBatch));
+	h.skinOffset = AlignSection(h.lodOffset + (UINT64)h.lodCount*sizeof(MeshLod));
+	h.boneOffset = AlignSection(h.skinOffset + (UINT64)h.skinCount*sizeof(VertexSkin));
+	h.clipOffset = AlignSection(h.boneOffset + (UINT64)h.boneCount*sizeof(MeshBone));
+	h.trackOffset = AlignSection(h.clipOffset + (UINT64)h.clipCount*sizeof(MeshClip));
+	h.keyOffset = AlignSection(h.trackOffset + (UINT64)h.trackCount*sizeof(MeshTrack));
+	h.fileSize = h.keyOffset + (UINT64)h.keyCount*sizeof(MeshKey);
+
+	h.boundsMin = h.boundsMax = contents.vertices[0].pos;
+	for (DWORD i = 1; i < contents.vertexCount; i++){
+		D3DXVec3Minimize(&h.boundsMin, &h.boundsMin, &contents.vertices[i].pos);
+		D3DXVec3Maximize(&h.boundsMax, &h.boundsMax, &contents.vertices[i].pos);
+	}
+
+	FILE *fp = fopen(filename, "wb");
+	if (!fp)
+		return false;
+
+	UINT64 written = 0;
+	bool result = WriteSection(fp, written, 0, &h, sizeof(h), 1) &&
+				  WriteSection(fp, written, h.vertexOffset, contents.vertices, sizeof(VertexNT), h.vertexCount) &&
+				  WriteSection(fp, written, h.indexOffset, contents.indices, sizeof(DWORD), h.indexCount) &&
+				  WriteSection(fp, written, h.subsetOffset, contents.subsets, sizeof(MeshSubset), h.subsetCount) &&
+				  WriteSection(fp, written, h.materialOffset, contents.materials, sizeof(MeshMaterial), h.materialCount) &&
+				  WriteSection(fp, written, h.batchOffset, contents.batches, sizeof(MeshBatch), h.batchCount) &&
+				  WriteSection(fp, written, h.lodOffset, contents.lods, sizeof(MeshLod), h.lodCount) &&
+				  WriteSection(fp, written, h.skinOffset, contents.skin, sizeof(VertexSkin), h.skinCount) &&
+				  WriteSection(fp, written, h.boneOffset, contents.bones, sizeof(MeshBone), h.boneCount) &&
+				  WriteSection(fp, written, h.clipOffset, contents.clips, sizeof(MeshClip), h.clipCount) &&
+				  WriteSection(fp, written, h.trackOffset, contents.tracks, sizeof(MeshTrack), h.trackCount) &&
+				  WriteSection(fp, written, h.keyOffset, contents.keys, sizeof(MeshKey), h.keyCount);
+
+	if (fclose(fp) != 0)
+		result = false;
+
+	//a file cut short would only be rejected when it's loaded
+	if (!result)
+		remove(filename);
+	return result;
+}
+
+const VertexNT* MeshFile::GetVertices()const{
+	return header ? (const VertexNT*)(file.GetData() + header->vertexOffset) : nullptr;
+}
+
+DWORD MeshFile::GetVertexCount()const{
+	return header ? header->vertexCount : 0;
+}
+
+const DWORD* MeshFile::GetIndices()const{
+	return header ? (const DWORD*)(file.GetData() + header->indexOffset) : nullptr;
+}
+
+DWORD MeshFile::GetIndexCount()const{
+	return header ? header->indexCount : 0;
+}
+
+const MeshSubset* MeshFile::GetSubsets()const{
+	if (!header || header->subsetCount == 0)
+		return nullptr;
+	return (const MeshSubset*)(file.GetData() + header->subsetOffset);
+}
+
+DWORD MeshFile::GetSubsetCount()const{
+	return header ? header->subsetCount : 0;
+}
+
+const MeshMaterial* MeshFile::GetMaterials()const{
+	if (!header || header->materialCount == 0)
+		return nullptr;
+	return (const MeshMaterial*)(file.GetData() + header->materialOffset);
+}
+
+DWORD MeshFile::GetMaterialCount()const{
+	return header ? header->materialCount : 0;
+}
+
+const MeshBatch* MeshFile::GetBatches()const{
+	if (!header || header->batchCount == 0)
+		return nullptr;
+	return (const MeshBatch*)(file.GetData() + header->batchOffset);
+}
+
+DWORD MeshFile::GetBatchCount()const{
+	return header ? header->batchCount : 0;
+}
+
+const MeshLod* MeshFile::GetLods()const{
+	if (!header || header->lodCount == 0)
+		return nullptr;
+	return (const MeshLod*)(file.GetData() + header->lodOffset);
+}
+
+DWORD MeshFile::GetLodCount()const{
+	return header ? header->lodCount : 0;
+}
+
+const VertexSkin* MeshFile::GetSkin()const{
+	if (!header || header->skinCount == 0)
+		return nullptr;
+	return (const VertexSkin*)(file.GetData() + header->skinOffset);
+}
+
+const MeshBone* MeshFile::GetBones()const{
+	if (!header || header->boneCount == 0)
+		return nullptr;
+	return (const MeshBone*)(file.GetData() + header->boneOffset);
+}
+
+DWORD MeshFile::GetBoneCount()const{
+	return header ? header->boneCount : 0;
+}
+
+const MeshClip* MeshFile::GetClips()const{
+	if (!header || header->clipCount == 0)
+		return nullptr;
+	return (const MeshClip*)(file.GetData() + header->clipOffset);
+}
+
+DWORD MeshFile::GetClipCount()const{
+	return header ? header->clipCount : 0;
+}
+
+const MeshTrack* MeshFile::GetTracks()const{
+	if (!header || header->trackCount == 0)
+		return nullptr;
+	return (const MeshTrack*)(file.GetData() + header->trackOffset);
+}
+
+DWORD MeshFile::GetTrackCount()const{
+	return header ? header->trackCount : 0;
+}
+
+const MeshKey* MeshFile::GetKeys()const{
+	if (!header || header->keyCount == 0)
+		return nullptr;
+	return (const MeshKey*)(file.GetData() + header->keyOffset);
+}
+
+DWORD MeshFile::GetKeyCount()const{
+	return header ? header->keyCount : 0;
+}
+
+void MeshFile::GetBounds(Vector3f& boxMin, Vector3f& boxMax)const{
+	if (!header){
+		boxMin = boxMax = Vector3f(0.0f, 0.0f, 0.0f);
+		return;
+	}
+	boxMin = header->boundsMin;
+	boxMax = header->boundsMax;
+}
@@ -0,0 +1,237 @@
+#ifndef _H_MESHFILE
+#define _H_MESHFILE
+
+#include "d3dUtil.h"
+#include "Vertex.h"
+#include "MappedFile.h"
+
+///A MODEL COOKED OFFLINE INTO THE LAYOUT ITS BUFFERS ARE MADE FROM, SO LOADING IT IS JUST MAPPING THE FILE
+///AND HANDING THE POINTERS INTO THE VIEW STRAIGHT TO D3D - NOTHING IS PARSED OR COPIED ON THE WAY
+
+const unsigned int MESH_FILE_MAGIC		= 0x4853454D;	// "MESH"
+const unsigned int MESH_FILE_VERSION	= 11;			// bump whenever the layout or the way models are built changes
+const unsigned int MESH_FILE_ALIGNMENT	= 16;			// every section starts on this boundary in the file
+const unsigned int MESH_NAME_LENGTH		= 64;			// characters kept of a name or texture, counting the terminator
+const unsigned int MESH_MAX_BONES		= 256;			// bones a skinned model can have, VertexSkin keeps them in a byte
+const unsigned int MESH_MAX_CLIP_FRAMES	= 65536;		// frames a clip can have, MeshKey keeps them in a WORD
+
+// a run of the index array drawn on its own - one for each material the polygons of each mesh in the source file use
+struct MeshSubset
+{
+	DWORD		firstIndex;
+	DWORD		indexCount;
+	DWORD		firstVertex;		// the vertices its indices use
+	DWORD		vertexCount;
+	DWORD		material;			// into the materials
+	DWORD		pad[3];
+	D3DXMATRIX	transform;			// where the mesh's node puts it in the model, already applied to the vertices
+};
+
+struct MeshMaterial
+{
+	char		name[MESH_NAME_LENGTH];
+	char		diffuseMap[MESH_NAME_LENGTH];	// file name of the texture without its directory, empty if there isn't one
+	Vector3f	diffuseColor;
+	float		pad;
+};
+
+// the subsets of a level of detail that share a material, which sit next to each other and are drawn with one call
+struct MeshBatch
+{
+	DWORD		firstIndex;
+	DWORD		indexCount;
+	DWORD		material;
+	DWORD		pad;
+};
+
+// one level of detail of the whole model - every subset simplified, one after the other in the same order, into a run of
+// the index array that uses the same vertices as full detail. Level 0 is the full detail mesh the subsets describe
+struct MeshLod
+{
+	DWORD		firstIndex;
+	DWORD		indexCount;
+	DWORD		firstBatch;			// into the batches
+	DWORD		batchCount;
+	float		error;				// furthest the level strays from full detail, in the model's units
+	DWORD		pad[3];
+};
+
+// a bone's transform relative to its parent - scaled, then rotated, then moved
+struct BonePose
+{
+	D3DXQUATERNION	rotation;
+	Vector3f		translation;
+	float			pad0;
+	Vector3f		scale;
+	float			pad1;
+};
+
+// a node of the skeleton a skinned model is animated by. Parents always come before their children
+struct MeshBone
+{
+	char		name[MESH_NAME_LENGTH];
+	int			parent;				// into the bones, -1 for a root
+	DWORD		pad[3];
+	D3DXMATRIX	inverseBind;		// from the model's space into the bone's, in the pose the mesh was skinned in
+	BonePose	bindPose;			// the bone in that pose
+};
+
+// an animation of the whole skeleton, sampled at fixed steps and compressed into a track for every bone (see AnimationCompressor.h)
+struct MeshClip
+{
+	char		name[MESH_NAME_LENGTH];
+	float		duration;			// seconds
+	float		frameRate;			// frames a second
+	DWORD		frameCount;			// at least 1, the last one is at the end of the clip
+	DWORD		firstTrack;			// into the tracks, one for each bone in the bones' order
+};
+
+enum TrackChannel
+{
+	CHANNEL_ROTATION,
+	CHANNEL_TRANSLATION,
+	CHANNEL_SCALE,
+	CHANNEL_COUNT
+};
+
+// a frame of a track that was kept, with its value quantized to 16 bits a component. A rotation is the three smallest
+// components of the quaternion with the largest positive, and which one that was in the top bits of the first two
+struct MeshKey
+{
+	WORD		frame;
+	WORD		value[3];
+};
+
+// the keys of a bone's rotation, translation and scale in a clip. Each channel's keys are together in the order of their
+// frames, from the first frame to the last, linear interpolation between them being close enough for the frames between
+struct MeshTrack
+{
+	DWORD		firstKey[CHANNEL_COUNT];	// into the keys
+	DWORD		keyCount[CHANNEL_COUNT];	// at least 1, a channel that doesn't change has just the one
+	DWORD		pad[2];
+	Vector3f	translationMin;				// a quantized component q is min + q*step
+	Vector3f	translationStep;
+	Vector3f	scaleMin;
+	Vector3f	scaleStep;
+};
+
+// everything a model is cooked from, as arrays in memory
+struct MeshContents
+{
+	const VertexNT*		vertices;
+	DWORD				vertexCount;
+	const DWORD*		indices;
+	DWORD				indexCount;
+	const MeshSubset*	subsets;
+	DWORD				subsetCount;
+	const MeshMaterial*	materials;
+	DWORD				materialCount;
+	const MeshBatch*	batches;
+	DWORD				batchCount;
+	const MeshLod*		lods;
+	DWORD				lodCount;
+	const VertexSkin*	skin;				// one for every vertex, or null if the model isn't skinned
+	const MeshBone*		bones;
+	DWORD				boneCount;
+	const MeshClip*		clips;
+	DWORD				clipCount;
+	const MeshTrack*	tracks;
+	DWORD				trackCount;
+	const MeshKey*		keys;
+	DWORD				keyCount;
+};
+
+/*
+File layout - all of it little endian, each section starting at the offset given in the header
+	Header
+	VertexNT		vertices[vertexCount]
+	DWORD			indices[indexCount]		(into the whole vertex array)
+	MeshSubset		subsets[subsetCount]
+	MeshMaterial	materials[materialCount]
+	MeshBatch		batches[batchCount]
+	MeshLod			lods[lodCount]
+	VertexSkin		skin[vertexCount]		(only if the model is skinned)
+	MeshBone		bones[boneCount]
+	MeshClip		clips[clipCount]
+	MeshTrack		tracks[trackCount]
+	MeshKey			keys[keyCount]
+*/
+class MeshFile
+{
+public:
+	MeshFile(void);
+	~MeshFile(void);
+
+	// maps the file and checks it was written by this version with sections that fit, returns false if it can't be used
+	bool	Load(const char* filename);
+	void	Close();
+	// reads a byte of every page so they're all in memory before anything waits on them, for loading off the main thread
+	void	Prefetch()const;
+
+	// the box is worked out from the vertices while saving, so nothing has to look at them when loading
+	static bool Save(const char* filename, const MeshContents& contents);
+
+	// the arrays point into the mapped file and stay valid until it's closed
+	const VertexNT*		GetVertices()const;
+	DWORD				GetVertexCount()const;
+	const DWORD*		GetIndices()const;
+	DWORD				GetIndexCount()const;
+	const MeshSubset*	GetSubsets()const;
+	DWORD				GetSubsetCount()const;
+	const MeshMaterial*	GetMaterials()const;
+	DWORD				GetMaterialCount()const;
+	const MeshBatch*	GetBatches()const;
+	DWORD				GetBatchCount()const;
+	const MeshLod*		GetLods()const;
+	DWORD				GetLodCount()const;
+	const VertexSkin*	GetSkin()const;			// null if the model isn't skinned
+	const MeshBone*		GetBones()const;
+	DWORD				GetBoneCount()const;
+	const MeshClip*		GetClips()const;
+	DWORD				GetClipCount()const;
+	const MeshTrack*	GetTracks()const;
+	DWORD				GetTrackCount()const;
+	const MeshKey*		GetKeys()const;
+	DWORD				GetKeyCount()const;
+	void				GetBounds(Vector3f& boxMin, Vector3f& boxMax)const;
+
+private:
+	struct Header
+	{
+		unsigned int	magic;
+		unsigned int	version;
+		unsigned int	vertexSize;		// sizeof(VertexNT) when it was written
+		unsigned int	indexSize;
+		DWORD			vertexCount;
+		DWORD			indexCount;
+		DWORD			subsetCount;
+		DWORD			materialCount;
+		DWORD			batchCount;
+		DWORD			lodCount;
+		DWORD			skinCount;		// vertexCount or 0
+		DWORD			boneCount;
+		DWORD			clipCount;
+		DWORD			trackCount;
+		DWORD			keyCount;
+		DWORD			pad;
+		UINT64			vertexOffset;	// bytes from the start of the file
+		UINT64			indexOffset;
+		UINT64			subsetOffset;
+		UINT64			materialOffset;
+		UINT64			batchOffset;
+		UINT64			lodOffset;
+		UINT64			skinOffset;
+		UINT64			boneOffset;
+		UINT64			clipOffset;
+		UINT64			trackOffset;
+		UINT64			keyOffset;
+		UINT64			fileSize;
+		Vector3f		boundsMin;
+		Vector3f		boundsMax;
+	};
+
+	MappedFile		file;
+	const Header	*header;
+};
+
+#endif
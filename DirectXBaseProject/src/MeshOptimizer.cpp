@@ -0,0 +1,361 @@
+#include "MeshOptimizer.h"
+#include <algorithm>
+#include <float.h>
+#include <math.h>
+#include <string.h>
+
+//FIFO post-transform cache kept as the time every vertex went in - a vertex is still in it if fewer than size others
+//have gone in since
+struct CacheSimulator
+{
+	std::vector<int>	stamp;
+	int					time;
+	int					size;
+
+	CacheSimulator(int vertexCount, int cacheSize) : stamp(vertexCount, 0), time(cacheSize + 1), size(cacheSize){}
+
+	// true if the vertex had to be transformed
+	bool Use(DWORD vertex){
+		if (time - stamp[vertex] <= size)
+			return false;
+		stamp[vertex] = time++;
+		return true;
+	}
+
+	void Flush(){
+		time += size + 1;
+	}
+};
+
+void OptimizeVertexCache(DWORD* indices, int indexCount, int vertexCount, int cacheSize, std::vector<int>* clusters){
+	int triangleCount = indexCount/3;
+	if (clusters)
+		clusters->clear();
+	if (triangleCount == 0 || vertexCount == 0)
+		return;
+
+	//the triangles using every vertex, and how many of them are still to be drawn
+	std::vector<int> live(vertexCount, 0);
+	for (int i = 0; i < triangleCount*3; i++)
+		live[indices[i]]++;
+	std::vector<int> firstTriangle(vertexCount + 1, 0);
+	for (int v = 0; v < vertexCount; v++)
+		firstTriangle[v + 1] = firstTriangle[v] + live[v];
+	std::vector<int> triangles(triangleCount*3);
+	std::vector<int> fill(firstTriangle.begin(), firstTriangle.end() - 1);
+	for (int i = 0; i < triangleCount*3; i++)
+		triangles[fill[indices[i]]++] = i/3;
+
+	std::vector<bool> emitted(triangleCount, false);
+	std::vector<int> cacheTime(vertexCount, 0);
+	std::vector<DWORD> deadEnd;			// vertices of the triangles drawn so far, the most recent on top
+	std::vector<DWORD> candidates;
+	std::vector<DWORD> out;
+	out.reserve(triangleCount*3);
+	int time = cacheSize + 1;
+	int cursor = 0;
+	bool newCluster = true;
+
+	//fan out from one vertex at a time, drawing every triangle still left around it
+	int fan = 0;
+	while (fan < vertexCount && live[fan] == 0)
+		fan++;
+	while (fan < vertexCount){
+		candidates.clear();
+		for (int k = firstTriangle[fan]; k < firstTriangle[fan + 1]; k++){
+			int t = triangles[k];
+			if (emitted[t])
+				continue;
+			if (newCluster && clusters)
+				clusters->push_back(out.size());
+			newCluster = false;
+
+			for (int corner = 0; corner < 3; corner++){
+				DWORD v = indices[t*3 + corner];
+				out.push_back(v);
+				deadEnd.push_back(v);
+				candidates.push_back(v);
+				live[v]--;
+				if (time - cacheTime[v] > cacheSize)
+					cacheTime[v] = time++;
+			}
+			emitted[t] = true;
+		}
+
+		//the next fan is the vertex just drawn that will still be in the cache after its own triangles are drawn,
+		//the one that went in earliest since it's the closest to falling out
+		int next = -1;
+		int best = -1;
+		for (unsigned int i = 0; i < candidates.size(); i++){
+			DWORD v = candidates[i];
+			if (live[v] <= 0)
+				continue;
+			int priority = 0;
+			if (time - cacheTime[v] + 2*live[v] <= cacheSize)
+				priority = time - cacheTime[v];
+			if (priority > best){
+				best = priority;
+				next = v;
+			}
+		}
+
+		//nowhere to go from here - back up to the latest vertex drawn that still has triangles, then to any vertex
+		if (next < 0){
+			while (!deadEnd.empty()){
+				DWORD v = deadEnd.back();
+				deadEnd.pop_back();
+				if (live[v] > 0){
+					next = v;
+					break;
+				}
+			}
+		}
+		if (next < 0){
+			while (cursor < vertexCount && live[cursor] == 0)
+				cursor++;
+			next = cursor;
+			newCluster = true;
+		}
+		fan = next;
+	}
+
+	std::copy(out.begin(), out.end(), indices);
+}
+
+void OptimizeOverdraw(DWORD* indices, int indexCount, const VertexNT* vertices, int vertexCount, const std::vector<int>& clusters,
+					  int cacheSize, float threshold){
+	int triangleCount = indexCount/3;
+	if (triangleCount == 0 || vertexCount == 0)
+		return;
+
+	//the runs from OptimizeVertexCache, in triangles, with the end of the last one on the end
+	std::vector<int> runs;
+	runs.push_back(0);
+	for (unsigned int i = 0; i < clusters.size(); i++){
+		if (clusters[i]/3 > runs.back() && clusters[i]/3 < triangleCount)
+			runs.push_back(clusters[i]/3);
+	}
+	runs.push_back(triangleCount);
+
+	//split every run as soon as the triangles since the last split are doing as well for the cache as the run does as a whole
+	std::vector<int> starts;
+	CacheSimulator cache(vertexCount, cacheSize);
+	for (unsigned int r = 0; r + 1 < runs.size(); r++){
+		int first = runs[r];
+		int last = runs[r + 1];
+
+		cache.Flush();
+		int runMisses = 0;
+		for (int t = first; t < last; t++){
+			for (int corner = 0; corner < 3; corner++)
+				runMisses += cache.Use(indices[t*3 + corner]);
+		}
+		float limit = threshold*runMisses/(last - first);
+
+		cache.Flush();
+		starts.push_back(first);
+		int misses = 0;
+		for (int t = first; t < last; t++){
+			for (int corner = 0; corner < 3; corner++)
+				misses += cache.Use(indices[t*3 + corner]);
+			if (t + 1 < last && misses <= limit*(t + 1 - starts.back())){
+				starts.push_back(t + 1);
+				misses = 0;
+				cache.Flush();
+			}
+		}
+	}
+	starts.push_back(triangleCount);
+
+	float centre[3] = {0.0f, 0.0f, 0.0f};
+	for (int v = 0; v < vertexCount; v++){
+		for (int k = 0; k < 3; k++)
+			centre[k] += vertices[v].pos[k]/vertexCount;
+	}
+
+	//how far out from the middle of the mesh each cluster is, along the way it faces
+	int clusterCount = starts.size() - 1;
+	std::vector<std::pair<float, int> > order(clusterCount);
+	for (int c = 0; c < clusterCount; c++){
+		float middle[3] = {0.0f, 0.0f, 0.0f};
+		float normal[3] = {0.0f, 0.0f, 0.0f};
+		float area = 0.0f;
+		for (int t = starts[c]; t < starts[c + 1]; t++){
+			const float* a = vertices[indices[t*3]].pos;
+			const float* b = vertices[indices[t*3 + 1]].pos;
+			const float* d = vertices[indices[t*3 + 2]].pos;
+			float e0[3] = {b[0] - a[0], b[1] - a[1], b[2] - a[2]};
+			float e1[3] = {d[0] - a[0], d[1] - a[1], d[2] - a[2]};
+			float n[3] = {e0[1]*e1[2] - e0[2]*e1[1], e0[2]*e1[0] - e0[0]*e1[2], e0[0]*e1[1] - e0[1]*e1[0]};
+			float twiceArea = sqrtf(n[0]*n[0] + n[1]*n[1] + n[2]*n[2]);
+			for (int k = 0; k < 3; k++){
+				middle[k] += (a[k] + b[k] + d[k])*twiceArea;
+				normal[k] += n[k];
+			}
+			area += twiceArea;
+		}
+
+		float key = 0.0f;
+		float length = sqrtf(normal[0]*normal[0] + normal[1]*normal[1] + normal[2]*normal[2]);
+		if (area > 0.0f && length > 0.0f){
+			for (int k = 0; k < 3; k++)
+				key += (middle[k]/(area*3.0f) - centre[k])*normal[k]/length;
+		}
+		order[c] = std::make_pair(-key, c);
+	}
+	std::stable_sort(order.begin(), order.end());
+
+	std::vector<DWORD> out;
+	out.reserve(triangleCount*3);
+	for (int i = 0; i < clusterCount; i++){
+		int c = order[i].second;
+		out.insert(out.end(), indices + starts[c]*3, indices + starts[c + 1]*3);
+	}
+	std::copy(out.begin(), out.end(), indices);
+}
+
+void OptimizeVertexFetch(DWORD* indices, int indexCount, VertexNT* vertices, int vertexCount, std::vector<DWORD>* remap){
+	const DWORD UNUSED = 0xFFFFFFFF;
+	std::vector<DWORD> table(vertexCount, UNUSED);
+	DWORD next = 0;
+	for (int i = 0; i < indexCount; i++){
+		DWORD& place = table[indices[i]];
+		if (place == UNUSED)
+			place = next++;
+		indices[i] = place;
+	}
+	for (int v = 0; v < vertexCount; v++){
+		if (table[v] == UNUSED)
+			table[v] = next++;
+	}
+
+	std::vector<VertexNT> old(vertices, vertices + vertexCount);
+	for (int v = 0; v < vertexCount; v++)
+		vertices[table[v]] = old[v];
+
+	if (remap)
+		remap->swap(table);
+}
+
+//the way a view looks, its right and up on the screen for D3D's left handed coordinates
+static const int VIEW_COUNT = 6;
+static const float VIEW_AXES[VIEW_COUNT][3][3] = {
+	//forward		right			up
+	{{0, 0, 1},		{1, 0, 0},		{0, 1, 0}},
+	{{0, 0, -1},	{-1, 0, 0},		{0, 1, 0}},
+	{{1, 0, 0},		{0, 0, -1},		{0, 1, 0}},
+	{{-1, 0, 0},	{0, 0, 1},		{0, 1, 0}},
+	{{0, 1, 0},		{-1, 0, 0},		{0, 0, 1}},
+	{{0, -1, 0},	{1, 0, 0},		{0, 0, 1}},
+};
+
+static inline float Dot(const float* a, const float* b){
+	return a[0]*b[0] + a[1]*b[1] + a[2]*b[2];
+}
+
+void MeasureOverdraw(const DWORD* indices, int indexCount, const VertexNT* vertices, int vertexCount, OverdrawStats& stats){
+	memset(&stats, 0, sizeof(stats));
+	if (vertexCount == 0)
+		return;
+
+	const int size = OVERDRAW_RESOLUTION;
+	std::vector<float> depth(size*size);
+	std::vector<float> screen(vertexCount*3);
+
+	for (int view = 0; view < VIEW_COUNT; view++){
+		const float* forward = VIEW_AXES[view][0];
+		const float* right = VIEW_AXES[view][1];
+		const float* up = VIEW_AXES[view][2];
+
+		//the mesh fitted to the screen, keeping its shape
+		float minX = FLT_MAX, minY = FLT_MAX, maxX = -FLT_MAX, maxY = -FLT_MAX;
+		for (int v = 0; v < vertexCount; v++){
+			float x = Dot(vertices[v].pos, right);
+			float y = Dot(vertices[v].pos, up);
+			screen[v*3] = x;
+			screen[v*3 + 1] = y;
+			screen[v*3 + 2] = Dot(vertices[v].pos, forward);
+			minX = Min(minX, x);	maxX = Max(maxX, x);
+			minY = Min(minY, y);	maxY = Max(maxY, y);
+		}
+		float extent = Max(maxX - minX, maxY - minY);
+		float scale = extent > 0.0f ? (size - 1)/extent : 0.0f;
+		for (int v = 0; v < vertexCount; v++){
+			screen[v*3] = (screen[v*3] - minX)*scale;
+			screen[v*3 + 1] = (screen[v*3 + 1] - minY)*scale;
+		}
+
+		std::fill(depth.begin(), depth.end(), FLT_MAX);
+		for (int i = 0; i + 2 < indexCount; i += 3){
+			const float* a = &screen[indices[i]*3];
+			const float* b = &screen[indices[i + 1]*3];
+			const float* c = &screen[indices[i + 2]*3];
+
+			//front faces go clockwise on the screen
+			float area = (b[0] - a[0])*(c[1] - a[1]) - (b[1] - a[1])*(c[0] - a[0]);
+			if (area >= 0.0f)
+				continue;
+
+			int x0 = Max((int)ceilf(Min(a[0], Min(b[0], c[0])) - 0.5f), 0);
+			int x1 = Min((int)floorf(Max(a[0], Max(b[0], c[0])) - 0.5f), size - 1);
+			int y0 = Max((int)ceilf(Min(a[1], Min(b[1], c[1])) - 0.5f), 0);
+			int y1 = Min((int)floorf(Max(a[1], Max(b[1], c[1])) - 0.5f), size - 1);
+
+			for (int y = y0; y <= y1; y++){
+				float py = y + 0.5f;
+				for (int x = x0; x <= x1; x++){
+					float px = x + 0.5f;
+					//edge functions, all negative inside a clockwise triangle
+					float wa = (c[0] - b[0])*(py - b[1]) - (c[1] - b[1])*(px - b[0]);
+					float wb = (a[0] - c[0])*(py - c[1]) - (a[1] - c[1])*(px - c[0]);
+					float wc = (b[0] - a[0])*(py - a[1]) - (b[1] - a[1])*(px - a[0]);
+					if (wa > 0.0f || wb > 0.0f || wc > 0.0f)
+						continue;
+
+					float z = (wa*a[2] + wb*b[2] + wc*c[2])/area;
+					float& stored = depth[y*size + x];
+					if (z < stored){
+						stored = z;
+						stats.shaded++;
+					}
+				}
+			}
+		}
+
+		for (int p = 0; p < size*size; p++){
+			if (depth[p] != FLT_MAX)
+				stats.covered++;
+		}
+	}
+
+	stats.overdraw = stats.covered ? (float)stats.shaded/stats.covered : 0.0f;
+}
+
+void MeasureVertexFetch(const DWORD* indices, int indexCount, int vertexCount, UINT vertexSize, VertexFetchStats& stats){
+	memset(&stats, 0, sizeof(stats));
+
+	std::vector<UINT> lines(FETCH_CACHE_LINES, 0xFFFFFFFF);
+	int next = 0;
+	std::vector<bool> used(vertexCount, false);
+	UINT usedCount = 0;
+
+	for (int i = 0; i < indexCount; i++){
+		DWORD v = indices[i];
+		if (!used[v]){
+			used[v] = true;
+			usedCount++;
+		}
+
+		UINT first = v*vertexSize/FETCH_CACHE_LINE;
+		UINT last = (v*vertexSize + vertexSize - 1)/FETCH_CACHE_LINE;
+		for (UINT line = first; line <= last; line++){
+			if (std::find(lines.begin(), lines.end(), line) == lines.end()){
+				lines[next] = line;
+				next = (next + 1) % FETCH_CACHE_LINES;
+				stats.bytesFetched += FETCH_CACHE_LINE;
+			}
+		}
+	}
+
+	stats.overfetch = usedCount ? (float)stats.bytesFetched/(usedCount*vertexSize) : 0.0f;
+}
@@ -0,0 +1,53 @@
+#ifndef _H_MESHOPTIMIZER
+#define _H_MESHOPTIMIZER
+
+#include "Vertex.h"
+#include "TerrainIndices.h"
+#include <vector>
+
+///REORDERS AN INDEXED TRIANGLE LIST SO THE GPU DOES LESS WORK DRAWING IT, WITHOUT CHANGING WHAT'S DRAWN
+///THE STAGES ARE MEANT TO BE RUN IN ORDER - TRIANGLES FOR THE POST-TRANSFORM VERTEX CACHE (TIPSIFY), THEN CLUSTERS OF THOSE
+///TRIANGLES FOR OVERDRAW, THEN THE VERTICES INTO THE ORDER THE INDICES FIRST USE THEM SO THEY'RE FETCHED FROM MEMORY IN ORDER
+///EVERYTHING WORKS ON ONE MESH WITH INDICES FROM 0 TO vertexCount - 1
+
+const float	DEFAULT_OVERDRAW_THRESHOLD	= 1.05f;	// how much worse the vertex cache is allowed to get for the sake of overdraw
+const int	OVERDRAW_RESOLUTION			= 256;		// pixels across the views MeasureOverdraw renders
+const int	FETCH_CACHE_LINE			= 64;		// bytes the simulated vertex fetch reads at a time
+const int	FETCH_CACHE_LINES			= 128;		// lines the simulated vertex fetch cache holds
+
+struct OverdrawStats
+{
+	UINT	covered;			// pixels with something drawn on them, over all the views
+	UINT	shaded;				// pixels that passed the depth test when they were drawn
+	float	overdraw;			// shaded per covered pixel, 1 is ideal
+};
+
+struct VertexFetchStats
+{
+	UINT	bytesFetched;		// cache lines read, in bytes
+	float	overfetch;			// bytes read per byte of the vertices used, 1 is ideal
+};
+
+// reorders the triangles for a FIFO vertex cache of cacheSize entries. If clusters isn't null it gets the first index
+// of every run of triangles started after the walk had nowhere left to go, which OptimizeOverdraw can move around
+void	OptimizeVertexCache(DWORD* indices, int indexCount, int vertexCount, int cacheSize = DEFAULT_VERTEX_CACHE,
+							std::vector<int>* clusters = nullptr);
+
+// splits the triangles ordered by OptimizeVertexCache into clusters no more than threshold times worse for the vertex
+// cache than the runs they come from, then draws the clusters facing out from the middle of the mesh first since
+// they're the most likely to hide the rest of it
+void	OptimizeOverdraw(DWORD* indices, int indexCount, const VertexNT* vertices, int vertexCount, const std::vector<int>& clusters,
+						 int cacheSize = DEFAULT_VERTEX_CACHE, float threshold = DEFAULT_OVERDRAW_THRESHOLD);
+
+// moves the vertices into the order the indices first use them and rewrites the indices to match. Vertices no index
+// uses go at the end. remap, if it isn't null, gets the new place of every old vertex
+void	OptimizeVertexFetch(DWORD* indices, int indexCount, VertexNT* vertices, int vertexCount, std::vector<DWORD>* remap = nullptr);
+
+// software renders the mesh with a depth buffer and back face culling from both ends of each axis and counts how
+// many pixels get shaded more than once
+void	MeasureOverdraw(const DWORD* indices, int indexCount, const VertexNT* vertices, int vertexCount, OverdrawStats& stats);
+
+// runs the vertex reads through a FIFO cache of FETCH_CACHE_LINES lines
+void	MeasureVertexFetch(const DWORD* indices, int indexCount, int vertexCount, UINT vertexSize, VertexFetchStats& stats);
+
+#endif
@@ -0,0 +1,551 @@
+#include "MeshSimplifier.h"
+#include <algorithm>
+#include <queue>
+#include <math.h>
+#include <string.h>
+
+const double BORDER_WEIGHT = 10.0;		//how hard open edges are held in place, against the planes of the triangles
+const double MIN_FLIP_COSINE = 0.25;	//cosine of the furthest a triangle may turn from before a collapse or from its normals
+const DWORD NO_VERTEX = 0xFFFFFFFF;
+
+//what a position can collapse along - every vertex at a position has the same kind
+enum VERTEX_KIND{KIND_MANIFOLD, KIND_BORDER, KIND_SEAM, KIND_LOCKED};
+
+//sum of squared distances to a set of planes, each weighted by the area of the triangle it came from
+struct Quadric
+{
+	double	a00, a01, a02, a11, a12, a22;
+	double	b0, b1, b2;
+	double	c;
+	double	area;
+};
+
+static void AddPlane(Quadric& q, const double* n, double d, double weight){
+	q.a00 += weight*n[0]*n[0];	q.a01 += weight*n[0]*n[1];	q.a02 += weight*n[0]*n[2];
+	q.a11 += weight*n[1]*n[1];	q.a12 += weight*n[1]*n[2];	q.a22 += weight*n[2]*n[2];
+	q.b0 += weight*n[0]*d;		q.b1 += weight*n[1]*d;		q.b2 += weight*n[2]*d;
+	q.c += weight*d*d;
+}
+
+static void AddQuadric(Quadric& q, const Quadric& other){
+	q.a00 += other.a00;	q.a01 += other.a01;	q.a02 += other.a02;
+	q.a11 += other.a11;	q.a12 += other.a12;	q.a22 += other.a22;
+	q.b0 += other.b0;	q.b1 += other.b1;	q.b2 += other.b2;
+	q.c += other.c;
+	q.area += other.area;
+}
+
+static double EvaluateQuadric(const Quadric& q, const Vector3f& p){
+	double x = p.x, y = p.y, z = p.z;
+	double result = q.a00*x*x + q.a11*y*y + q.a22*z*z + 2.0*(q.a01*x*y + q.a02*x*z + q.a12*y*z) +
+					2.0*(q.b0*x + q.b1*y + q.b2*z) + q.c;
+	return result > 0.0 ? result : 0.0;
+}
+
+static void Cross(const Vector3f& a, const Vector3f& b, const Vector3f& c, double* n){
+	double e0[3] = {b.x - a.x, b.y - a.y, b.z - a.z};
+	double e1[3] = {c.x - a.x, c.y - a.y, c.z - a.z};
+	n[0] = e0[1]*e1[2] - e0[2]*e1[1];
+	n[1] = e0[2]*e1[0] - e0[0]*e1[2];
+	n[2] = e0[0]*e1[1] - e0[1]*e1[0];
+}
+
+//sorts vertices so the ones at the same position end up together
+struct PositionOrder
+{
+	const VertexNT*	vertices;
+
+	bool operator()(DWORD a, DWORD b)const{
+		return memcmp(&vertices[a].pos, &vertices[b].pos, sizeof(Vector3f)) < 0;
+	}
+};
+
+//a vertex's cheapest collapse when it was worked out - it's worked out again before it's made, since the
+//vertices around it may have moved since
+struct Collapse
+{
+	float	cost;
+	DWORD	from, to;
+
+	bool operator<(const Collapse& other)const{
+		return cost > other.cost;		// std::priority_queue puts the largest on top
+	}
+};
+
+struct Simplifier
+{
+	const VertexNT*					vertices;
+	std::vector<DWORD>				triangles;
+	std::vector<bool>				alive;
+	int								aliveCount;
+	std::vector<std::vector<int> >	vertexTriangles;
+	std::vector<int>				group;			// vertex -> the position it's at
+	std::vector<std::vector<DWORD> > wedges;		// position -> the vertices at it
+	std::vector<Quadric>			quadrics;		// per position
+	std::vector<unsigned char>		kind;			// per position
+	std::vector<bool>				removed;		// per vertex
+	std::vector<bool>				queued;			// has a collapse on the heap
+	double							attributeScale;
+	float							maxError;
+	std::priority_queue<Collapse>	heap;
+	mutable std::vector<int>		neighbours[2], opposite;	// scratch for BreaksLink, kept to save allocating them every time
+
+	void	Build(const DWORD* indices, int indexCount, int vertexCount);
+	bool	TriangleHasGroup(int t, int g)const;
+	int		CountEdgeTriangles(DWORD v, int g)const;
+	int		CountExactEdgeTriangles(DWORD v0, DWORD v1)const;
+	DWORD	FindTwin(DWORD v, int g)const;
+	bool	Flips(DWORD v, const Vector3f& to, int g)const;
+	void	GatherNeighbours(int g, std::vector<int>& neighbours)const;
+	bool	BreaksLink(int g0, int g1)const;
+	double	AttributeCost(DWORD v0, DWORD v1)const;
+	bool	Evaluate(DWORD v0, DWORD v1, float& cost, float& error, DWORD& twin0, DWORD& twin1)const;
+	bool	FindBest(DWORD v, Collapse& best)const;
+	void	PushBest(DWORD v);
+	void	Move(DWORD from, DWORD to);
+	void	Run(int targetIndexCount);
+};
+
+void Simplifier::Build(const DWORD* indices, int indexCount, int vertexCount){
+	int triangleCount = indexCount/3;
+	triangles.assign(indices, indices + triangleCount*3);
+	alive.assign(triangleCount, true);
+	aliveCount = triangleCount;
+	vertexTriangles.assign(vertexCount, std::vector<int>());
+	for (int i = 0; i < triangleCount*3; i++)
+		vertexTriangles[triangles[i]].push_back(i/3);
+	removed.assign(vertexCount, false);
+	queued.assign(vertexCount, false);
+	maxError = 0.0f;
+
+	//vertices at exactly the same position are the wedges of one position, split by a normal or UV seam
+	std::vector<DWORD> order(vertexCount);
+	for (int v = 0; v < vertexCount; v++)
+		order[v] = v;
+	PositionOrder byPosition = {vertices};
+	std::sort(order.begin(), order.end(), byPosition);
+	group.assign(vertexCount, 0);
+	wedges.clear();
+	for (int i = 0; i < vertexCount; i++){
+		if (i == 0 || memcmp(&vertices[order[i]].pos, &vertices[order[i - 1]].pos, sizeof(Vector3f)) != 0)
+			wedges.push_back(std::vector<DWORD>());
+		group[order[i]] = wedges.size() - 1;
+		wedges.back().push_back(order[i]);
+	}
+	int groupCount = wedges.size();
+
+	Quadric zero;
+	memset(&zero, 0, sizeof(zero));
+	quadrics.assign(groupCount, zero);
+	Vector3f boxMin = vertices[0].pos, boxMax = vertices[0].pos;
+	for (int t = 0; t < triangleCount; t++){
+		const Vector3f& a = vertices[triangles[t*3]].pos;
+		const Vector3f& b = vertices[triangles[t*3 + 1]].pos;
+		const Vector3f& c = vertices[triangles[t*3 + 2]].pos;
+		double n[3];
+		Cross(a, b, c, n);
+		double length = sqrt(n[0]*n[0] + n[1]*n[1] + n[2]*n[2]);
+		if (length <= 0.0)
+			continue;
+		n[0] /= length;	n[1] /= length;	n[2] /= length;
+		double d = -(n[0]*a.x + n[1]*a.y + n[2]*a.z);
+		for (int k = 0; k < 3; k++){
+			Quadric& q = quadrics[group[triangles[t*3 + k]]];
+			AddPlane(q, n, d, length*0.5);
+			q.area += length*0.5;
+		}
+	}
+	for (int v = 0; v < vertexCount; v++){
+		boxMin = Vector3f(Min(boxMin.x, vertices[v].pos.x), Min(boxMin.y, vertices[v].pos.y), Min(boxMin.z, vertices[v].pos.z));
+		boxMax = Vector3f(Max(boxMax.x, vertices[v].pos.x), Max(boxMax.y, vertices[v].pos.y), Max(boxMax.z, vertices[v].pos.z));
+	}
+	Vector3f size = boxMax - boxMin;
+	attributeScale = (double)size.x*size.x + (double)size.y*size.y + (double)size.z*size.z;
+
+	//every edge between two positions with the triangle it came from - sorted so the copies of an edge end up together
+	std::vector<std::pair<UINT64, int> > edges;
+	edges.reserve(triangleCount*3);
+	for (int t = 0; t < triangleCount; t++){
+		for (int k = 0; k < 3; k++){
+			UINT64 g0 = group[triangles[t*3 + k]];
+			UINT64 g1 = group[triangles[t*3 + (k + 1) % 3]];
+			if (g0 != g1)
+				edges.push_back(std::make_pair(Min(g0, g1) << 32 | Max(g0, g1), t));
+		}
+	}
+	std::sort(edges.begin(), edges.end());
+
+	std::vector<bool> border(groupCount, false), complex(groupCount, false);
+	for (unsigned int i = 0; i < edges.size(); ){
+		unsigned int j = i;
+		while (j < edges.size() && edges[j].first == edges[i].first)
+			j++;
+		int g0 = (int)(edges[i].first >> 32);
+		int g1 = (int)(edges[i].first & 0xFFFFFFFF);
+		if (j - i > 2){
+			complex[g0] = complex[g1] = true;
+		}
+		else if (j - i == 1){
+			//an open edge - a plane through it at right angles to its triangle keeps it from moving in or out
+			border[g0] = border[g1] = true;
+			int t = edges[i].second;
+			const Vector3f& p0 = vertices[wedges[g0][0]].pos;
+			const Vector3f& p1 = vertices[wedges[g1][0]].pos;
+			double faceNormal[3];
+			Cross(vertices[triangles[t*3]].pos, vertices[triangles[t*3 + 1]].pos, vertices[triangles[t*3 + 2]].pos, faceNormal);
+			double e[3] = {p1.x - p0.x, p1.y - p0.y, p1.z - p0.z};
+			double n[3] = {e[1]*faceNormal[2] - e[2]*faceNormal[1], e[2]*faceNormal[0] - e[0]*faceNormal[2], e[0]*faceNormal[1] - e[1]*faceNormal[0]};
+			double length = sqrt(n[0]*n[0] + n[1]*n[1] + n[2]*n[2]);
+			if (length > 0.0){
+				n[0] /= length;	n[1] /= length;	n[2] /= length;
+				double d = -(n[0]*p0.x + n[1]*p0.y + n[2]*p0.z);
+				double weight = BORDER_WEIGHT*(e[0]*e[0] + e[1]*e[1] + e[2]*e[2]);
+				AddPlane(quadrics[g0], n, d, weight);
+				AddPlane(quadrics[g1], n, d, weight);
+			}
+		}
+		i = j;
+	}
+
+	//a position split into two wedges is a seam as long as it's in the middle of the surface - anything more tangled stays put
+	kind.assign(groupCount, KIND_LOCKED);
+	for (int g = 0; g < groupCount; g++){
+		if (complex[g])
+			continue;
+		if (wedges[g].size() == 1)
+			kind[g] = border[g] ? KIND_BORDER : KIND_MANIFOLD;
+		else if (wedges[g].size() == 2 && !border[g])
+			kind[g] = KIND_SEAM;
+	}
+}
+
+bool Simplifier::TriangleHasGroup(int t, int g)const{
+	return group[triangles[t*3]] == g || group[triangles[t*3 + 1]] == g || group[triangles[t*3 + 2]] == g;
+}
+
+int Simplifier::CountEdgeTriangles(DWORD v, int g)const{
+	int count = 0;
+	const std::vector<int>& list = vertexTriangles[v];
+	for (unsigned int i = 0; i < list.size(); i++){
+		if (alive[list[i]] && TriangleHasGroup(list[i], g))
+			count++;
+	}
+	return count;
+}
+
+int Simplifier::CountExactEdgeTriangles(DWORD v0, DWORD v1)const{
+	int count = 0;
+	const std::vector<int>& list = vertexTriangles[v0];
+	for (unsigned int i = 0; i < list.size(); i++){
+		int t = list[i];
+		if (alive[t] && (triangles[t*3] == v1 || triangles[t*3 + 1] == v1 || triangles[t*3 + 2] == v1))
+			count++;
+	}
+	return count;
+}
+
+//the vertex at position g that shares a triangle with v
+DWORD Simplifier::FindTwin(DWORD v, int g)const{
+	const std::vector<int>& list = vertexTriangles[v];
+	for (unsigned int i = 0; i < list.size(); i++){
+		int t = list[i];
+		if (!alive[t])
+			continue;
+		for (int k = 0; k < 3; k++){
+			if (group[triangles[t*3 + k]] == g)
+				return triangles[t*3 + k];
+		}
+	}
+	return NO_VERTEX;
+}
+
+//true if moving v to the position would turn any of its triangles that stay too far, from where they are or from the
+//way the normals of their corners say the surface faces. Only stopping them turning over isn't enough - a triangle can
+//go most of the way over in one collapse and the rest of the way in the next, or stand up on its edge a little at a time
+//over every level of detail, while the normals stay where they are
+bool Simplifier::Flips(DWORD v, const Vector3f& to, int g)const{
+	const std::vector<int>& list = vertexTriangles[v];
+	for (unsigned int i = 0; i < list.size(); i++){
+		int t = list[i];
+		if (!alive[t] || TriangleHasGroup(t, g))
+			continue;
+		Vector3f p[3], moved[3];
+		for (int k = 0; k < 3; k++){
+			p[k] = vertices[triangles[t*3 + k]].pos;
+			moved[k] = triangles[t*3 + k] == v ? to : p[k];
+		}
+		double before[3], after[3];
+		Cross(p[0], p[1], p[2], before);
+		Cross(moved[0], moved[1], moved[2], after);
+		double dot = before[0]*after[0] + before[1]*after[1] + before[2]*after[2];
+		double afterLength = sqrt(after[0]*after[0] + after[1]*after[1] + after[2]*after[2]);
+		if (dot <= MIN_FLIP_COSINE*sqrt(before[0]*before[0] + before[1]*before[1] + before[2]*before[2])*afterLength)
+			return true;
+
+		Vector3f surface = vertices[triangles[t*3]].normal + vertices[triangles[t*3 + 1]].normal + vertices[triangles[t*3 + 2]].normal;
+		double surfaceLength = sqrt((double)surface.x*surface.x + (double)surface.y*surface.y + (double)surface.z*surface.z);
+		if (surfaceLength > 0.0 && surface.x*after[0] + surface.y*after[1] + surface.z*after[2] <= MIN_FLIP_COSINE*surfaceLength*afterLength)
+			return true;
+	}
+	return false;
+}
+
+//the positions that share a live triangle with position g, sorted, from every wedge at it
+void Simplifier::GatherNeighbours(int g, std::vector<int>& neighbours)const{
+	neighbours.clear();
+	for (unsigned int w = 0; w < wedges[g].size(); w++){
+		const std::vector<int>& list = vertexTriangles[wedges[g][w]];
+		for (unsigned int i = 0; i < list.size(); i++){
+			int t = list[i];
+			if (!alive[t])
+				continue;
+			for (int k = 0; k < 3; k++){
+				int other = group[triangles[t*3 + k]];
+				if (other != g)
+					neighbours.push_back(other);
+			}
+		}
+	}
+	std::sort(neighbours.begin(), neighbours.end());
+	neighbours.erase(std::unique(neighbours.begin(), neighbours.end()), neighbours.end());
+}
+
+//true if the ends of the edge have a neighbour in common that isn't the far corner of a triangle along the edge.
+//Collapsing it would fold the surface onto itself, leaving two triangles back to back or an edge with three
+bool Simplifier::BreaksLink(int g0, int g1)const{
+	std::vector<int>& neighbours0 = neighbours[0];
+	std::vector<int>& neighbours1 = neighbours[1];
+	GatherNeighbours(g0, neighbours0);
+	GatherNeighbours(g1, neighbours1);
+	opposite.clear();
+	for (unsigned int w = 0; w < wedges[g0].size(); w++){
+		const std::vector<int>& list = vertexTriangles[wedges[g0][w]];
+		for (unsigned int i = 0; i < list.size(); i++){
+			int t = list[i];
+			if (!alive[t] || !TriangleHasGroup(t, g1))
+				continue;
+			for (int k = 0; k < 3; k++){
+				int other = group[triangles[t*3 + k]];
+				if (other != g0 && other != g1)
+					opposite.push_back(other);
+			}
+		}
+	}
+
+	for (unsigned int i = 0, j = 0; i < neighbours0.size() && j < neighbours1.size(); ){
+		if (neighbours0[i] < neighbours1[j])
+			i++;
+		else if (neighbours1[j] < neighbours0[i])
+			j++;
+		else{
+			if (std::find(opposite.begin(), opposite.end(), neighbours0[i]) == opposite.end())
+				return true;
+			i++;
+			j++;
+		}
+	}
+	return false;
+}
+
+double Simplifier::AttributeCost(DWORD v0, DWORD v1)const{
+	const VertexNT& a = vertices[v0];
+	const VertexNT& b = vertices[v1];
+	Vector3f dn = a.normal - b.normal;
+	Vector2f duv = a.texC - b.texC;
+	return quadrics[group[v0]].area*attributeScale*(SIMPLIFY_NORMAL_WEIGHT*((double)dn.x*dn.x + (double)dn.y*dn.y + (double)dn.z*dn.z) +
+													SIMPLIFY_UV_WEIGHT*((double)duv.x*duv.x + (double)duv.y*duv.y));
+}
+
+bool Simplifier::Evaluate(DWORD v0, DWORD v1, float& cost, float& error, DWORD& twin0, DWORD& twin1)const{
+	int g0 = group[v0];
+	int g1 = group[v1];
+	twin0 = twin1 = NO_VERTEX;
+	if (g0 == g1 || removed[v1])
+		return false;
+
+	switch (kind[g0]){
+	case KIND_LOCKED:
+		return false;
+
+	case KIND_BORDER:
+		//only along the open edge, so the outline stays closed
+		if (CountEdgeTriangles(v0, g1) != 1)
+			return false;
+		break;
+
+	case KIND_SEAM:
+		//along the seam, with the vertex on the other side of it going the same way
+		if (kind[g1] != KIND_SEAM && kind[g1] != KIND_LOCKED)
+			return false;
+		if (CountExactEdgeTriangles(v0, v1) != 1)
+			return false;
+		twin0 = wedges[g0][0] == v0 ? wedges[g0][1] : wedges[g0][0];
+		if (removed[twin0] || CountEdgeTriangles(twin0, g1) != 1)
+			return false;
+		twin1 = FindTwin(twin0, g1);
+		if (twin1 == NO_VERTEX || twin1 == v1 || removed[twin1])
+			return false;
+		break;
+
+	default:
+		//onto a seam only if all of its triangles there are on the same side of it
+		if (kind[g1] != KIND_MANIFOLD && CountEdgeTriangles(v0, g1) != CountExactEdgeTriangles(v0, v1))
+			return false;
+		break;
+	}
+
+	const Vector3f& to = vertices[v1].pos;
+	if (Flips(v0, to, g1) || (twin0 != NO_VERTEX && Flips(twin0, to, g1)))
+		return false;
+	if (BreaksLink(g0, g1))
+		return false;
+
+	Quadric q = quadrics[g0];
+	AddQuadric(q, quadrics[g1]);
+	double distance = EvaluateQuadric(q, to);
+	double attributes = AttributeCost(v0, v1);
+	if (twin0 != NO_VERTEX)
+		attributes += AttributeCost(twin0, twin1);
+
+	cost = (float)(distance + attributes);
+	error = q.area > 0.0 ? (float)sqrt(distance/q.area) : 0.0f;
+	return true;
+}
+
+bool Simplifier::FindBest(DWORD v, Collapse& best)const{
+	best.from = v;
+	best.to = NO_VERTEX;
+	best.cost = 0.0f;
+	if (removed[v])
+		return false;
+
+	const std::vector<int>& list = vertexTriangles[v];
+	for (unsigned int i = 0; i < list.size(); i++){
+		int t = list[i];
+		if (!alive[t])
+			continue;
+		for (int k = 0; k < 3; k++){
+			DWORD other = triangles[t*3 + k];
+			if (other == v)
+				continue;
+			float cost, error;
+			DWORD twin0, twin1;
+			if (Evaluate(v, other, cost, error, twin0, twin1) && (best.to == NO_VERTEX || cost < best.cost)){
+				best.cost = cost;
+				best.to = other;
+			}
+		}
+	}
+	return best.to != NO_VERTEX;
+}
+
+void Simplifier::PushBest(DWORD v){
+	Collapse best;
+	if (!queued[v] && FindBest(v, best)){
+		heap.push(best);
+		queued[v] = true;
+	}
+}
+
+//hands the triangles of one vertex over to another, dropping the ones that join them
+void Simplifier::Move(DWORD from, DWORD to){
+	int g = group[to];
+	std::vector<int>& list = vertexTriangles[from];
+	for (unsigned int i = 0; i < list.size(); i++){
+		int t = list[i];
+		if (!alive[t])
+			continue;
+		if (TriangleHasGroup(t, g)){
+			alive[t] = false;
+			aliveCount--;
+			continue;
+		}
+		for (int k = 0; k < 3; k++){
+			if (triangles[t*3 + k] == from)
+				triangles[t*3 + k] = to;
+		}
+		vertexTriangles[to].push_back(t);
+	}
+	list.clear();
+	removed[from] = true;
+
+	//the dead triangles aren't needed on the list any more
+	std::vector<int>& target = vertexTriangles[to];
+	unsigned int kept = 0;
+	for (unsigned int i = 0; i < target.size(); i++){
+		if (alive[target[i]])
+			target[kept++] = target[i];
+	}
+	target.resize(kept);
+}
+
+void Simplifier::Run(int targetIndexCount){
+	for (DWORD v = 0; v < vertexTriangles.size(); v++)
+		PushBest(v);
+
+	//a collapse only ever gets dearer as the mesh around it is simplified, so one that's still the cheapest once
+	//it's been worked out again is made and the rest go back on the heap with their new cost
+	while (aliveCount*3 > targetIndexCount && !heap.empty()){
+		Collapse c = heap.top();
+		heap.pop();
+		queued[c.from] = false;
+
+		Collapse best;
+		if (!FindBest(c.from, best))
+			continue;
+		if (!heap.empty() && best.cost > heap.top().cost){
+			heap.push(best);
+			queued[c.from] = true;
+			continue;
+		}
+
+		float cost, error;
+		DWORD twin0, twin1;
+		Evaluate(best.from, best.to, cost, error, twin0, twin1);
+		int g0 = group[best.from];
+		int g1 = group[best.to];
+		Move(best.from, best.to);
+		if (twin0 != NO_VERTEX)
+			Move(twin0, twin1);
+		AddQuadric(quadrics[g1], quadrics[g0]);
+		maxError = Max(maxError, error);
+
+		//vertices that couldn't go anywhere before may be able to now
+		DWORD targets[2] = {best.to, twin1};
+		for (int i = 0; i < 2; i++){
+			if (targets[i] == NO_VERTEX)
+				continue;
+			const std::vector<int>& list = vertexTriangles[targets[i]];
+			for (unsigned int j = 0; j < list.size(); j++){
+				for (int k = 0; k < 3; k++)
+					PushBest(triangles[list[j]*3 + k]);
+			}
+		}
+	}
+}
+
+int SimplifyMesh(const DWORD* indices, int indexCount, const VertexNT* vertices, int vertexCount, int targetIndexCount,
+				 DWORD* out, float* error){
+	if (error)
+		*error = 0.0f;
+	if (vertexCount == 0 || indexCount < 3 || indexCount <= targetIndexCount){
+		memcpy(out, indices, indexCount*sizeof(DWORD));
+		return indexCount;
+	}
+
+	Simplifier simplifier;
+	simplifier.vertices = vertices;
+	simplifier.Build(indices, indexCount, vertexCount);
+	simplifier.Run(targetIndexCount);
+
+	int count = 0;
+	for (unsigned int t = 0; t < simplifier.alive.size(); t++){
+		if (!simplifier.alive[t])
+			continue;
+		for (int k = 0; k < 3; k++)
+			out[count++] = simplifier.triangles[t*3 + k];
+	}
+	if (error)
+		*error = simplifier.maxError;
+	return count;
+}
@@ -0,0 +1,24 @@
+#ifndef _H_MESHSIMPLIFIER
+#define _H_MESHSIMPLIFIER
+
+#include "Vertex.h"
+#include <vector>
+
+///REDUCES THE TRIANGLES OF A MESH BY COLLAPSING ITS EDGES, CHEAPEST FIRST, UNTIL THERE ARE FEW ENOUGH LEFT
+///EVERY VERTEX IS COLLAPSED ONTO ONE OF ITS NEIGHBOURS RATHER THAN A NEW POINT, SO THE SIMPLER MESH IS A NEW INDEX LIST
+///INTO THE SAME VERTICES AND ALL THE LEVELS OF DETAIL OF A MODEL CAN SHARE ONE VERTEX BUFFER
+///A COLLAPSE COSTS THE QUADRIC ERROR (GARLAND & HECKBERT) OF MOVING THE VERTEX, PLUS HOW FAR ITS NORMAL AND TEXTURE
+///COORDINATE ARE FROM THE ONE IT'S MERGED INTO. OPEN EDGES AND UV/NORMAL SEAMS ONLY COLLAPSE ALONG THEMSELVES SO THEY DON'T TEAR
+///AND NO EDGE IS COLLAPSED WHOSE ENDS SHARE A NEIGHBOUR OFF IT, SO A CLOSED MESH STAYS CLOSED WITHOUT FOLDING OVER
+
+const float	SIMPLIFY_NORMAL_WEIGHT	= 0.0025f;	// cost of a unit normal difference, as a squared fraction of the mesh's size
+const float	SIMPLIFY_UV_WEIGHT		= 0.25f;	// cost of a unit texture coordinate difference, the same way
+
+// writes the triangles left after simplifying the mesh down to about targetIndexCount indices to out, which has to
+// hold indexCount indices, and returns how many there are. It can stop short of the target if nothing else can be
+// collapsed without flipping triangles or tearing an edge. error, if it isn't null, gets the largest root mean square
+// distance of a collapsed vertex's triangles from where they were, in the mesh's units
+int		SimplifyMesh(const DWORD* indices, int indexCount, const VertexNT* vertices, int vertexCount, int targetIndexCount,
+					 DWORD* out, float* error = nullptr);
+
+#endif
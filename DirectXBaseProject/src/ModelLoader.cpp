@@ -1,8 +1,22 @@
 #include "ModelLoader.h"
+#include "AnimationCompressor.h"
+#include "GameTimer.h"
+#include "MeshOptimizer.h"
+#include "MeshSimplifier.h"
+#include "ThreadPool.h"
+#include <iomanip>
+#include <sstream>
+#include <algorithm>
+#include <string.h>
 
 
 ModelLoader::ModelLoader(void){
 	numNodes = 0;
+	defaultMaterial = -1;
+	rootBone = -1;
+	skinned = false;
+	lodCount = DEFAULT_LOD_COUNT;
+	reportStats = false;
 }
 
 
@@ -16,9 +30,1108 @@ ModelLoader::~ModelLoader(void){
 	indexData.clear();
 }
 
+// how deep the node tree is followed up from a mesh, which is only there to stop a broken file looping forever
+static const int MAX_NODE_DEPTH = 256;
+
+// FBX times count in these
+static const double FBX_TICKS_PER_SECOND = 46186158000.0;
+
+// a Properties70 entry of an object - P: name, type, label, flags, then the value
+static const FBXNode* FindProperty(const FBXNode* object, const char* name){
+	const FBXNode* properties = object ? object->GetChild("Properties70") : nullptr;
+	if (!properties)
+		return nullptr;
+	for (const FBXNode* property = properties->GetChild("P"); property; property = property->GetNextNamed("P")){
+		if (property->IsString(0, name))
+			return property;
+	}
+	return nullptr;
+}
+
+static Vector3f GetVectorProperty(const FBXNode* object, const char* name, const Vector3f& fallback){
+	const FBXNode* property = FindProperty(object, name);
+	if (!property || property->GetPropertyCount() < 7)
+		return fallback;
+	return Vector3f((float)property->GetDouble(4), (float)property->GetDouble(5), (float)property->GetDouble(6));
+}
+
+static int GetIntProperty(const FBXNode* object, const char* name, int fallback){
+	const FBXNode* property = FindProperty(object, name);
+	if (!property || property->GetPropertyCount() < 5)
+		return fallback;
+	return (int)property->GetInt(4);
+}
+
+// binary files name objects "name\0\1Class" and ASCII ones "Class::name"
+static std::string GetObjectName(const FBXNode* object){
+	std::string name = object->GetString(1);
+	size_t end = name.find('\0');
+	if (end != std::string::npos)
+		name.erase(end);
+	size_t start = name.find("::");
+	if (start != std::string::npos)
+		name.erase(0, start + 2);
+	return name;
+}
+
+// the file name of a path without the directories, which are wherever the model was made
+static std::string GetFileName(const std::string& path){
+	size_t slash = path.find_last_of("/\\");
+	return slash == std::string::npos ? path : path.substr(slash + 1);
+}
+
+// rotations are in degrees, applied one axis at a time in the node's rotation order, X then Y then Z unless it says otherwise
+static D3DXMATRIX EulerRotation(const Vector3f& degrees, int order){
+	static const int axes[6][3] = {{0, 1, 2}, {0, 2, 1}, {1, 2, 0}, {1, 0, 2}, {2, 0, 1}, {2, 1, 0}};
+	if (order < 0 || order > 5)
+		order = 0;
+
+	D3DXMATRIX rotation, m;
+	D3DXMatrixIdentity(&rotation);
+	for (int i = 0; i < 3; i++){
+		int axis = axes[order][i];
+		float angle = D3DXToRadian(((const float*)degrees)[axis]);
+		if (axis == 0)
+			D3DXMatrixRotationX(&m, angle);
+		else if (axis == 1)
+			D3DXMatrixRotationY(&m, angle);
+		else
+			D3DXMatrixRotationZ(&m, angle);
+		rotation *= m;
+	}
+	return rotation;
+}
+
+static D3DXMATRIX Translation(const Vector3f& t){
+	D3DXMATRIX m;
+	D3DXMatrixTranslation(&m, t.x, t.y, t.z);
+	return m;
+}
+
+// FBX keeps matrices as 16 doubles with the translation last, the same layout as D3DX's
+static bool GetMatrix(const FBXNode* node, D3DXMATRIX& m){
+	std::vector<double> values;
+	if (!node || !node->GetArray(0, values) || values.size() != 16)
+		return false;
+	for (int i = 0; i < 16; i++)
+		m.m[i/4][i%4] = (float)values[i];
+	return true;
+}
+
+static void DecomposePose(const D3DXMATRIX& m, BonePose& pose){
+	memset(&pose, 0, sizeof(pose));
+	if (FAILED(D3DXMatrixDecompose(&pose.scale, &pose.rotation, &pose.translation, &m))){
+		pose.rotation = D3DXQUATERNION(0.0f, 0.0f, 0.0f, 1.0f);
+		pose.translation = Vector3f(m.m[3][0], m.m[3][1], m.m[3][2]);
+		pose.scale = Vector3f(1.0f, 1.0f, 1.0f);
+	}
+}
+
+// keeps the strongest influences on a vertex, strongest first
+static void AddInfluence(VertexSkin& skin, int bone, float weight){
+	if (!(weight > 0.0f))
+		return;
+	int slot = 4;
+	while (slot > 0 && skin.weights[slot-1] < weight)
+		slot--;
+	if (slot == 4)
+		return;
+	for (int i = 3; i > slot; i--){
+		skin.weights[i] = skin.weights[i-1];
+		skin.bones[i] = skin.bones[i-1];
+	}
+	skin.weights[slot] = weight;
+	skin.bones[slot] = (BYTE)bone;
+}
+
+// a component of a bone's translation, rotation or scaling - a curve if it's animated, otherwise a value that holds
+struct AnimationChannel
+{
+	std::vector<long long>	times;
+	std::vector<float>		values;
+	float					value;
+};
+
+// the curve between its keys, which is linear however the file says the keys are interpolated - the clips are
+// sampled finely enough for it not to show
+static float EvaluateChannel(const AnimationChannel& channel, long long time){
+	if (channel.times.empty())
+		return channel.value;
+	std::vector<long long>::const_iterator next = std::upper_bound(channel.times.begin(), channel.times.end(), time);
+	if (next == channel.times.begin())
+		return channel.values.front();
+	if (next == channel.times.end())
+		return channel.values.back();
+	int key = next - channel.times.begin() - 1;
+	double t = (double)(time - channel.times[key])/(double)(channel.times[key+1] - channel.times[key]);
+	return channel.values[key] + (float)((channel.values[key+1] - channel.values[key])*t);
+}
+
 bool ModelLoader::LoadModel(const char* filename){
 
+	GameTimer timer;
+	timer.reset();
+
+	// Map the file and read its node tree - the arrays stay in the file until the meshes ask for them.
+	FBXDocument document;
+	if (!document.Open(filename)){
+		return false;
+	}
+
+	// Every object has its id as its first property, and the connections join them up child first - a mesh's geometry
+	// and materials to the model node that places it, models to the ones above them and textures to materials.
+	Scene scene;
+	const FBXNode* objects = document.Find("Objects");
+	if (objects){
+		for (const FBXNode* object = objects->GetFirstChild(); object; object = object->GetNext())
+			scene.objects[object->GetInt(0)] = object;
+	}
+	const FBXNode* connections = document.Find("Connections");
+	if (connections){
+		for (const FBXNode* connection = connections->GetChild("C"); connection; connection = connection->GetNextNamed("C")){
+			long long child = connection->GetInt(1);
+			long long parent = connection->GetInt(2);
+			std::map<long long, const FBXNode*>::const_iterator parentObject = scene.objects.find(parent);
+			if (connection->IsString(0, "OO")){
+				// Models are also connected to display layers and the like, which don't move them.
+				if (parentObject != scene.objects.end() && parentObject->second->IsNamed("Model"))
+					scene.parents[child] = parent;
+				scene.children[parent].push_back(child);
+			}
+			else if (connection->IsString(0, "OP")){
+				// Animation curve nodes are connected to the property of the model they animate, and the curves to the
+				// component of the curve node they drive.
+				std::map<long long, const FBXNode*>::const_iterator childObject = scene.objects.find(child);
+				if (connection->IsString(3, "DiffuseColor") || connection->IsString(3, "Diffuse"))
+					scene.diffuseMaps[parent] = child;
+				else if (childObject != scene.objects.end() && childObject->second->IsNamed("AnimationCurveNode"))
+					scene.animatedProperties[parent].push_back(std::make_pair(child, connection->GetString(3)));
+				else if (parentObject != scene.objects.end() && parentObject->second->IsNamed("AnimationCurveNode"))
+					scene.curves[parent].push_back(std::make_pair(child, connection->GetString(3)));
+			}
+		}
+	}
+
+	// A model with a skin deformer anywhere in it is skinned as a whole - every mesh gets bone weights, the ones without
+	// a skin of their own following the node they hang from.
+	if (objects){
+		for (const FBXNode* deformer = objects->GetChild("Deformer"); deformer && !skinned; deformer = deformer->GetNextNamed("Deformer"))
+			skinned = deformer->IsString(2, "Skin");
+	}
+
+	// Every mesh is a Geometry object of the Mesh class, wherever it hangs in the scene.
+	if (objects){
+		for (const FBXNode* geometry = objects->GetChild("Geometry"); geometry; geometry = geometry->GetNextNamed("Geometry")){
+			if (geometry->IsString(2, "Mesh")){
+				numNodes++;
+				if (!GetMeshData(scene, geometry->GetInt(0), geometry))
+					return false;
+			}
+		}
+	}
+
+	if (skinned && bones.size() > MESH_MAX_BONES){
+		std::cout << filename << " has " << bones.size() << " bones, more than the " << MESH_MAX_BONES << " a model can be skinned with" << std::endl;
+		skinned = false;
+		skinData.clear();
+		bones.clear();
+	}
+	if (skinned)
+		LoadAnimations(scene, objects);
+
+	SortSubsets();
+	OptimizeMeshes();
+	BuildLods();
+
+	timer.tick();
+	std::cout << "Loaded " << numNodes << " meshes, " << materials.size() << " materials, " << vertexData.size() << " vertices and " << indexData.size() << " indices (" << lods.size() << " levels of detail, " << bones.size() << " bones, " << clips.size() << " clips) in " << timer.getDeltaTime()*1000.0f << " ms" << std::endl;
+
+	return true;
+}
+
+// FBX builds a node's transform from its parent's as T * Roff * Rp * Rpre * R * Rpost^-1 * Rp^-1 * Soff * Sp * S * Sp^-1,
+// which for D3DX's row vectors runs the other way round. The translation, rotation and scaling are passed in so animated
+// values can stand in for the node's own.
+static D3DXMATRIX GetLocalTransform(const FBXNode* model, const Vector3f& translation, const Vector3f& rotation, const Vector3f& scaling){
+	Vector3f zero(0.0f, 0.0f, 0.0f);
+	Vector3f rotationPivot = GetVectorProperty(model, "RotationPivot", zero);
+	Vector3f scalingPivot = GetVectorProperty(model, "ScalingPivot", zero);
+
+	// Pre and post rotations are always X then Y then Z, and only count when the node's rotation limits are on.
+	D3DXMATRIX preRotation, postRotation;
+	D3DXMatrixIdentity(&preRotation);
+	D3DXMatrixIdentity(&postRotation);
+	if (GetIntProperty(model, "RotationActive", 0)){
+		preRotation = EulerRotation(GetVectorProperty(model, "PreRotation", zero), 0);
+		postRotation = EulerRotation(GetVectorProperty(model, "PostRotation", zero), 0);
+		D3DXMatrixTranspose(&postRotation, &postRotation);
+	}
+
+	D3DXMATRIX scale;
+	D3DXMatrixScaling(&scale, scaling.x, scaling.y, scaling.z);
+
+	return Translation(-scalingPivot) * scale * Translation(scalingPivot) *
+		   Translation(GetVectorProperty(model, "ScalingOffset", zero)) *
+		   Translation(-rotationPivot) * postRotation * EulerRotation(rotation, GetIntProperty(model, "RotationOrder", 0)) *
+		   preRotation * Translation(rotationPivot) *
+		   Translation(GetVectorProperty(model, "RotationOffset", zero)) *
+		   Translation(translation);
+}
+
+static D3DXMATRIX GetLocalTransform(const FBXNode* model){
+	Vector3f zero(0.0f, 0.0f, 0.0f);
+	return GetLocalTransform(model, GetVectorProperty(model, "Lcl Translation", zero), GetVectorProperty(model, "Lcl Rotation", zero),
+							 GetVectorProperty(model, "Lcl Scaling", Vector3f(1.0f, 1.0f, 1.0f)));
+}
+
+D3DXMATRIX ModelLoader::GetModelTransform(Scene& scene, long long modelId, int depth){
+	std::map<long long, D3DXMATRIX>::const_iterator found = scene.transforms.find(modelId);
+	if (found != scene.transforms.end())
+		return found->second;
+
+	D3DXMATRIX transform;
+	D3DXMatrixIdentity(&transform);
+	std::map<long long, const FBXNode*>::const_iterator object = scene.objects.find(modelId);
+	if (object != scene.objects.end()){
+		transform = GetLocalTransform(object->second);
+
+		std::map<long long, long long>::const_iterator parent = scene.parents.find(modelId);
+		if (parent != scene.parents.end() && depth < MAX_NODE_DEPTH)
+			transform *= GetModelTransform(scene, parent->second, depth + 1);
+	}
+
+	scene.transforms[modelId] = transform;
+	return transform;
+}
+
+DWORD ModelLoader::GetMaterial(Scene& scene, long long materialId){
+	std::map<long long, DWORD>::const_iterator found = scene.materials.find(materialId);
+	if (found != scene.materials.end())
+		return found->second;
+
+	const FBXNode* material = scene.objects[materialId];
+	std::string diffuseMap;
+	std::map<long long, long long>::const_iterator texture = scene.diffuseMaps.find(materialId);
+	if (texture != scene.diffuseMaps.end()){
+		std::map<long long, const FBXNode*>::const_iterator textureObject = scene.objects.find(texture->second);
+		if (textureObject != scene.objects.end()){
+			const FBXNode* file = textureObject->second->GetChild("RelativeFilename");
+			if (!file || file->GetString(0).empty())
+				file = textureObject->second->GetChild("FileName");
+			if (file)
+				diffuseMap = GetFileName(file->GetString(0));
+		}
+	}
+
+	DWORD index = AddMaterial(GetObjectName(material).c_str(), diffuseMap.c_str(),
+							  GetVectorProperty(material, "DiffuseColor", Vector3f(1.0f, 1.0f, 1.0f)));
+	scene.materials[materialId] = index;
+	return index;
+}
+
+DWORD ModelLoader::AddMaterial(const char* name, const char* diffuseMap, const Vector3f& diffuseColor){
+	// Names too long for the table are cut short.
+	MeshMaterial material;
+	memset(&material, 0, sizeof(material));
+	strncpy(material.name, name, MESH_NAME_LENGTH - 1);
+	strncpy(material.diffuseMap, diffuseMap, MESH_NAME_LENGTH - 1);
+	material.diffuseColor = diffuseColor;
+	materials.push_back(material);
+	return materials.size() - 1;
+}
+
+// Bones are added parents first, so a bone's parent is always before it. Its inverse bind matrix starts out as where
+// its node is in the file, which a skin cluster binding a mesh to it then replaces.
+int ModelLoader::AddBone(Scene& scene, long long modelId, int depth){
+	std::map<long long, int>::const_iterator found = scene.bones.find(modelId);
+	if (found != scene.bones.end())
+		return found->second;
+	std::map<long long, const FBXNode*>::const_iterator object = scene.objects.find(modelId);
+	if (object == scene.objects.end() || !object->second->IsNamed("Model"))
+		return -1;
+
+	int parent = -1;
+	std::map<long long, long long>::const_iterator parentModel = scene.parents.find(modelId);
+	if (parentModel != scene.parents.end() && depth < MAX_NODE_DEPTH)
+		parent = AddBone(scene, parentModel->second, depth + 1);
+
+	MeshBone bone;
+	memset(&bone, 0, sizeof(bone));
+	strncpy(bone.name, GetObjectName(object->second).c_str(), MESH_NAME_LENGTH - 1);
+	bone.parent = parent;
+	D3DXMATRIX transform = GetModelTransform(scene, modelId, 0);
+	D3DXMatrixInverse(&bone.inverseBind, nullptr, &transform);
+	DecomposePose(GetLocalTransform(object->second), bone.bindPose);
+
+	bones.push_back(bone);
+	scene.bones[modelId] = bones.size() - 1;
+	scene.boneModels.push_back(modelId);
+	return bones.size() - 1;
+}
+
+// A bone that stays where the model is, for meshes that don't hang from a node.
+int ModelLoader::GetRootBone(Scene& scene){
+	if (rootBone < 0){
+		MeshBone bone;
+		memset(&bone, 0, sizeof(bone));
+		strncpy(bone.name, "root", MESH_NAME_LENGTH - 1);
+		bone.parent = -1;
+		D3DXMatrixIdentity(&bone.inverseBind);
+		bone.bindPose.rotation = D3DXQUATERNION(0.0f, 0.0f, 0.0f, 1.0f);
+		bone.bindPose.scale = Vector3f(1.0f, 1.0f, 1.0f);
+		bones.push_back(bone);
+		scene.boneModels.push_back(0);
+		rootBone = bones.size() - 1;
+	}
+	return rootBone;
+}
+
+// A mesh's skin is a Skin deformer connected to its geometry, with a Cluster under it for every bone that moves it. A
+// cluster has the control points the bone moves and how much, and where the mesh was relative to the bone when they
+// were bound (Transform - the bone itself is TransformLink). The vertices are already in the model's space, so the
+// inverse bind matrix takes them back to the mesh's space first.
+void ModelLoader::GetSkinWeights(Scene& scene, long long geometryId, long long modelId, int controlPoints, std::vector<VertexSkin>& pointSkins){
+	VertexSkin none;
+	memset(&none, 0, sizeof(none));
+	pointSkins.assign(controlPoints, none);
+
+	D3DXMATRIX meshInverse;
+	D3DXMatrixIdentity(&meshInverse);
+	if (modelId){
+		D3DXMATRIX meshTransform = GetModelTransform(scene, modelId, 0);
+		D3DXMatrixInverse(&meshInverse, nullptr, &meshTransform);
+	}
+
+	const std::vector<long long>& deformers = scene.children[geometryId];
+	for (unsigned int d = 0; d < deformers.size(); d++){
+		const FBXNode* skin = scene.objects.count(deformers[d]) ? scene.objects[deformers[d]] : nullptr;
+		if (!skin || !skin->IsNamed("Deformer") || !skin->IsString(2, "Skin"))
+			continue;
+
+		const std::vector<long long>& clusters = scene.children[deformers[d]];
+		for (unsigned int c = 0; c < clusters.size(); c++){
+			const FBXNode* cluster = scene.objects.count(clusters[c]) ? scene.objects[clusters[c]] : nullptr;
+			if (!cluster || !cluster->IsNamed("Deformer") || !cluster->IsString(2, "Cluster"))
+				continue;
+
+			int bone = -1;
+			const std::vector<long long>& links = scene.children[clusters[c]];
+			for (unsigned int l = 0; l < links.size() && bone < 0; l++)
+				bone = AddBone(scene, links[l], 0);
+			if (bone < 0)
+				continue;
+
+			D3DXMATRIX meshBind;
+			if (GetMatrix(cluster->GetChild("Transform"), meshBind))
+				bones[bone].inverseBind = meshInverse * meshBind;
+
+			std::vector<int> indices;
+			std::vector<double> weights;
+			const FBXNode* indexArray = cluster->GetChild("Indexes");
+			const FBXNode* weightArray = cluster->GetChild("Weights");
+			if (!indexArray || !weightArray || !indexArray->GetArray(0, indices) || !weightArray->GetArray(0, weights))
+				continue;
+			for (unsigned int i = 0; i < indices.size() && i < weights.size(); i++){
+				if (indices[i] >= 0 && indices[i] < controlPoints)
+					AddInfluence(pointSkins[indices[i]], bone, (float)weights[i]);
+			}
+		}
+	}
+
+	// The weights that are kept are scaled back up to add up to 1, and points no bone moves follow the mesh's node.
+	int nodeBone = -1;
+	for (int i = 0; i < controlPoints; i++){
+		VertexSkin& skin = pointSkins[i];
+		float total = skin.weights[0] + skin.weights[1] + skin.weights[2] + skin.weights[3];
+		if (total > 0.0f){
+			for (int j = 0; j < 4; j++)
+				skin.weights[j] /= total;
+			continue;
+		}
+		if (nodeBone < 0){
+			nodeBone = modelId ? AddBone(scene, modelId, 0) : -1;
+			if (nodeBone < 0)
+				nodeBone = GetRootBone(scene);
+		}
+		skin.bones[0] = (BYTE)nodeBone;
+		skin.weights[0] = 1.0f;
+	}
+}
+
+// Every animation stack is a clip. Only the first layer of a stack is used, which is all most exporters write - it has
+// a curve node for each property it animates, connected to the model, with a curve for each component under it. The
+// bones are sampled a frame at a time through the same transform as the nodes, so pivots and pre rotations carry over,
+// then the frames are compressed down to the keys that are needed (see AnimationCompressor.h).
+void ModelLoader::LoadAnimations(Scene& scene, const FBXNode* objects){
+	if (!objects || bones.empty())
+		return;
+	AnimationTolerance tolerance = GetDefaultTolerance(&bones[0], bones.size());
+	std::vector<BonePose> poses;
+	static const char* properties[3] = {"Lcl Translation", "Lcl Rotation", "Lcl Scaling"};
+	static const char* components[3] = {"d|X", "d|Y", "d|Z"};
+
+	for (const FBXNode* stack = objects->GetChild("AnimationStack"); stack; stack = stack->GetNextNamed("AnimationStack")){
+		long long layerId = 0;
+		const std::vector<long long>& layers = scene.children[stack->GetInt(0)];
+		for (unsigned int i = 0; i < layers.size() && !layerId; i++){
+			if (scene.objects.count(layers[i]) && scene.objects[layers[i]]->IsNamed("AnimationLayer"))
+				layerId = layers[i];
+		}
+		if (!layerId)
+			continue;
+		const std::vector<long long>& layerNodes = scene.children[layerId];
+
+		// Nine channels for every bone - translation, rotation and scaling, X, Y and Z.
+		std::vector<AnimationChannel> channels(bones.size()*9);
+		bool animated = false;
+		long long firstKey = 0, lastKey = 0;
+		for (unsigned int b = 0; b < bones.size(); b++){
+			const FBXNode* model = scene.boneModels[b] ? scene.objects[scene.boneModels[b]] : nullptr;
+			Vector3f zero(0.0f, 0.0f, 0.0f), one(1.0f, 1.0f, 1.0f);
+			Vector3f values[3] = {GetVectorProperty(model, properties[0], zero), GetVectorProperty(model, properties[1], zero),
+								  GetVectorProperty(model, properties[2], one)};
+			for (int p = 0; p < 3; p++){
+				for (int c = 0; c < 3; c++)
+					channels[b*9 + p*3 + c].value = ((const float*)values[p])[c];
+			}
+			if (!model)
+				continue;
+
+			const std::vector<std::pair<long long, std::string> >& curveNodes = scene.animatedProperties[scene.boneModels[b]];
+			for (unsigned int n = 0; n < curveNodes.size(); n++){
+				int p = 0;
+				while (p < 3 && curveNodes[n].second != properties[p])
+					p++;
+				if (p == 3 || std::find(layerNodes.begin(), layerNodes.end(), curveNodes[n].first) == layerNodes.end())
+					continue;
+
+				const FBXNode* curveNode = scene.objects[curveNodes[n].first];
+				const std::vector<std::pair<long long, std::string> >& curves = scene.curves[curveNodes[n].first];
+				for (int c = 0; c < 3; c++){
+					AnimationChannel& channel = channels[b*9 + p*3 + c];
+					const FBXNode* value = FindProperty(curveNode, components[c]);
+					if (value && value->GetPropertyCount() > 4)
+						channel.value = (float)value->GetDouble(4);
+
+					for (unsigned int k = 0; k < curves.size(); k++){
+						if (curves[k].second != components[c] || !scene.objects.count(curves[k].first))
+							continue;
+						const FBXNode* curve = scene.objects[curves[k].first];
+						const FBXNode* keyTimes = curve->GetChild("KeyTime");
+						const FBXNode* keyValues = curve->GetChild("KeyValueFloat");
+						if (!keyTimes || !keyValues || !keyTimes->GetArray(0, channel.times) || !keyValues->GetArray(0, channel.values) ||
+							channel.times.empty() || channel.times.size() != channel.values.size()){
+							channel.times.clear();
+							channel.values.clear();
+							continue;
+						}
+						firstKey = animated ? Min(firstKey, channel.times.front()) : channel.times.front();
+						lastKey = animated ? Max(lastKey, channel.times.back()) : channel.times.back();
+						animated = true;
+					}
+				}
+			}
+		}
+		if (!animated)
+			continue;
+
+		// The stack says how long it runs, otherwise it's as long as its keys.
+		long long start = firstKey, stop = lastKey;
+		const FBXNode* localStart = FindProperty(stack, "LocalStart");
+		const FBXNode* localStop = FindProperty(stack, "LocalStop");
+		if (localStart && localStop && localStart->GetPropertyCount() > 4 && localStop->GetPropertyCount() > 4 &&
+			localStop->GetInt(4) > localStart->GetInt(4)){
+			start = localStart->GetInt(4);
+			stop = localStop->GetInt(4);
+		}
+
+		MeshClip clip;
+		memset(&clip, 0, sizeof(clip));
+		strncpy(clip.name, GetObjectName(stack).c_str(), MESH_NAME_LENGTH - 1);
+		clip.duration = (float)((stop - start)/FBX_TICKS_PER_SECOND);
+		clip.frameCount = Min((DWORD)ceilf(clip.duration*ANIMATION_SAMPLE_RATE) + 1, (DWORD)MESH_MAX_CLIP_FRAMES);
+		clip.frameRate = clip.frameCount > 1 ? (clip.frameCount - 1)/clip.duration : 0.0f;
+
+		poses.clear();
+		poses.reserve(clip.frameCount*bones.size());
+		for (DWORD f = 0; f < clip.frameCount; f++){
+			long long time = clip.frameCount > 1 ? start + (long long)((double)(stop - start)*f/(clip.frameCount - 1)) : start;
+			for (unsigned int b = 0; b < bones.size(); b++){
+				BonePose pose = bones[b].bindPose;
+				if (scene.boneModels[b]){
+					const AnimationChannel* channel = &channels[b*9];
+					Vector3f translation(EvaluateChannel(channel[0], time), EvaluateChannel(channel[1], time), EvaluateChannel(channel[2], time));
+					Vector3f rotation(EvaluateChannel(channel[3], time), EvaluateChannel(channel[4], time), EvaluateChannel(channel[5], time));
+					Vector3f scaling(EvaluateChannel(channel[6], time), EvaluateChannel(channel[7], time), EvaluateChannel(channel[8], time));
+					DecomposePose(GetLocalTransform(scene.objects[scene.boneModels[b]], translation, rotation, scaling), pose);
+				}
+				poses.push_back(pose);
+			}
+		}
+
+		AnimationCompressionStats stats;
+		CompressClip(clip, &poses[0], &bones[0], bones.size(), tolerance, tracks, keys, &stats);
+		if (reportStats){
+			std::cout << std::fixed << std::setprecision(3) << "Clip " << clip.name << ": " << clip.frameCount << " frames, " <<
+						 stats.rawBytes << " -> " << stats.compressedBytes << " bytes (" << stats.ratio << ":1), max joint error " <<
+						 stats.maxJointError << std::endl;
+		}
+		clips.push_back(clip);
+	}
+}
+
+bool ModelLoader::GetMeshData(Scene& scene, long long geometryId, const FBXNode* geometry){
+	std::vector<double> positions;
+	std::vector<int> polygonVertices;
+	const FBXNode* vertices = geometry->GetChild("Vertices");
+	const FBXNode* polygons = geometry->GetChild("PolygonVertexIndex");
+	if (!vertices || !polygons || !vertices->GetArray(0, positions) || !polygons->GetArray(0, polygonVertices))
+		return false;
+
+	int controlPoints = positions.size()/3;
+
+	std::vector<double> normals, uvs;
+	std::vector<int> cornerNormals, cornerUVs;
+	GetLayerElement(geometry->GetChild("LayerElementNormal"), "Normals", "NormalsIndex", 3, polygonVertices, normals, cornerNormals);
+	GetLayerElement(geometry->GetChild("LayerElementUV"), "UV", "UVIndex", 2, polygonVertices, uvs, cornerUVs);
+
+	// The model node the mesh hangs from places it in the scene, along with a transform of its own that moves the mesh
+	// but not the nodes under it, and its materials in the order the mesh's material indices count them.
+	D3DXMATRIX transform;
+	D3DXMatrixIdentity(&transform);
+	std::vector<DWORD> meshMaterials;
+	long long modelId = 0;
+	std::map<long long, long long>::const_iterator model = scene.parents.find(geometryId);
+	if (model != scene.parents.end()){
+		modelId = model->second;
+		const FBXNode* modelObject = scene.objects[model->second];
+		Vector3f zero(0.0f, 0.0f, 0.0f);
+		Vector3f s = GetVectorProperty(modelObject, "GeometricScaling", Vector3f(1.0f, 1.0f, 1.0f));
+		D3DXMATRIX scaling;
+		D3DXMatrixScaling(&scaling, s.x, s.y, s.z);
+		transform = scaling * EulerRotation(GetVectorProperty(modelObject, "GeometricRotation", zero), 0) *
+					Translation(GetVectorProperty(modelObject, "GeometricTranslation", zero)) * GetModelTransform(scene, model->second, 0);
+
+		const std::vector<long long>& children = scene.children[model->second];
+		for (unsigned int i = 0; i < children.size(); i++){
+			std::map<long long, const FBXNode*>::const_iterator child = scene.objects.find(children[i]);
+			if (child != scene.objects.end() && child->second->IsNamed("Material"))
+				meshMaterials.push_back(GetMaterial(scene, children[i]));
+		}
+	}
+
+	std::vector<VertexSkin> pointSkins;
+	if (skinned)
+		GetSkinWeights(scene, geometryId, modelId, controlPoints, pointSkins);
+
+	// Every corner gets its own position, normal and texture coordinate, which are welded back together where they match.
+	// The last polygon vertex of every polygon is stored as -(index + 1).
+	std::vector<VertexNT> corners;
+	std::vector<VertexSkin> cornerSkins;
+	std::vector<int> polygonStarts;
+	corners.reserve(polygonVertices.size());
+	cornerSkins.reserve(pointSkins.empty() ? 0 : polygonVertices.size());
+	polygonStarts.push_back(0);
+	for (unsigned int corner = 0; corner < polygonVertices.size(); corner++){
+		int index = polygonVertices[corner];
+		bool last = index < 0;
+		if (last)
+			index = ~index;
+		if (index >= controlPoints)
+			return false;
+
+		VertexNT vert;
+		vert.pos = Vector3f((float)positions[index*3], (float)positions[index*3 + 1], (float)positions[index*3 + 2]);
+		vert.normal = Vector3f(0.0f, 0.0f, 0.0f);
+		vert.texC = Vector2f(0.0f, 0.0f);
+		if (!cornerNormals.empty() && cornerNormals[corner] >= 0){
+			const double* n = &normals[cornerNormals[corner]*3];
+			Vector3f normal((float)n[0], (float)n[1], (float)n[2]);
+			D3DXVec3Normalize(&vert.normal, &normal);
+		}
+		if (!cornerUVs.empty() && cornerUVs[corner] >= 0){
+			const double* uv = &uvs[cornerUVs[corner]*2];
+			vert.texC = Vector2f((float)uv[0], (float)-uv[1]);//invert the V texture coordinate
+		}
+		corners.push_back(vert);
+		if (!pointSkins.empty())
+			cornerSkins.push_back(pointSkins[index]);
+
+		if (last)
+			polygonStarts.push_back(corners.size());
+	}
+	int polygonCount = polygonStarts.size() - 1;
+
+	// Which of the node's materials each polygon uses, either one for the whole mesh or one each.
+	std::vector<int> polygonMaterials(polygonCount, 0);
+	std::vector<int> materialIndices;
+	const FBXNode* materialElement = geometry->GetChild("LayerElementMaterial");
+	const FBXNode* materialArray = materialElement ? materialElement->GetChild("Materials") : nullptr;
+	if (materialArray && materialArray->GetArray(0, materialIndices) && !materialIndices.empty()){
+		const FBXNode* mapping = materialElement->GetChild("MappingInformationType");
+		bool byPolygon = mapping && mapping->IsString(0, "ByPolygon");
+		for (int p = 0; p < polygonCount; p++){
+			if (byPolygon)
+				polygonMaterials[p] = p < (int)materialIndices.size() ? materialIndices[p] : -1;
+			else
+				polygonMaterials[p] = materialIndices[0];
+		}
+	}
+
+	AddMesh(corners, cornerSkins, polygonStarts, polygonMaterials, meshMaterials, transform);
+	return true;
+}
+
+void ModelLoader::AddMesh(std::vector<VertexNT>& corners, std::vector<VertexSkin>& cornerSkins, const std::vector<int>& polygonStarts,
+						  const std::vector<int>& polygonMaterials, const std::vector<DWORD>& meshMaterials, const D3DXMATRIX& transform){
+	int polygonCount = polygonStarts.size() - 1;
+
+	// Normals go through the inverse transpose, which keeps them square to the surface when it's scaled unevenly. A
+	// mirroring transform turns the polygons inside out, so their corners are turned round to face out again.
+	if (!D3DXMatrixIsIdentity(&transform)){
+		D3DXMATRIX normalTransform;
+		D3DXMatrixInverse(&normalTransform, nullptr, &transform);
+		D3DXMatrixTranspose(&normalTransform, &normalTransform);
+		for (unsigned int i = 0; i < corners.size(); i++){
+			D3DXVec3TransformCoord(&corners[i].pos, &corners[i].pos, &transform);
+			if (corners[i].normal != Vector3f(0.0f, 0.0f, 0.0f)){
+				D3DXVec3TransformNormal(&corners[i].normal, &corners[i].normal, &normalTransform);
+				D3DXVec3Normalize(&corners[i].normal, &corners[i].normal);
+			}
+		}
+		if (D3DXMatrixDeterminant(&transform) < 0.0f){
+			for (int p = 0; p < polygonCount; p++){
+				std::reverse(corners.begin() + polygonStarts[p], corners.begin() + polygonStarts[p+1]);
+				if (!cornerSkins.empty())
+					std::reverse(cornerSkins.begin() + polygonStarts[p], cornerSkins.begin() + polygonStarts[p+1]);
+			}
+		}
+	}
+
+	// A subset for each material the polygons use, in the order of the node's materials. Polygons without one of them
+	// share a plain material.
+	std::vector<std::pair<int, int> > order(polygonCount);
+	for (int p = 0; p < polygonCount; p++){
+		int material = polygonMaterials[p];
+		order[p] = std::make_pair(material >= 0 && material < (int)meshMaterials.size() ? material : -1, p);
+	}
+	std::sort(order.begin(), order.end());
+
+	for (unsigned int i = 0; i < order.size(); ){
+		unsigned int end = i;
+		int cornerCount = 0;
+		for (; end < order.size() && order[end].first == order[i].first; end++)
+			cornerCount += polygonStarts[order[end].second + 1] - polygonStarts[order[end].second];
+
+		DWORD material;
+		if (order[i].first >= 0)
+			material = meshMaterials[order[i].first];
+		else{
+			if (defaultMaterial < 0)
+				defaultMaterial = AddMaterial("default", "", Vector3f(1.0f, 1.0f, 1.0f));
+			material = defaultMaterial;
+		}
+
+		BeginMesh(cornerCount, material, transform, !cornerSkins.empty());
+		for (; i < end; i++){
+			int p = order[i].second;
+			AddPolygon(&corners[polygonStarts[p]], cornerSkins.empty() ? nullptr : &cornerSkins[polygonStarts[p]], polygonStarts[p+1] - polygonStarts[p]);
+		}
+		EndMesh();
+	}
+}
+
+void ModelLoader::BeginMesh(int expectedCorners, DWORD material, const D3DXMATRIX& transform, bool skinned){
+	// Later subsets go after the ones already loaded and aren't welded to them, so each one's vertices stay together.
+	MeshSubset subset;
+	memset(&subset, 0, sizeof(subset));
+	subset.firstIndex = indexData.size();
+	subset.firstVertex = vertexData.size();
+	subset.material = material;
+	subset.transform = transform;
+	subsets.push_back(subset);
+	welder.Begin(&vertexData, expectedCorners, skinned ? &skinData : nullptr);
+	indexData.reserve(indexData.size() + expectedCorners*2);
+}
+
+void ModelLoader::EndMesh(){
+	MeshSubset& subset = subsets.back();
+	subset.indexCount = indexData.size() - subset.firstIndex;
+	subset.vertexCount = vertexData.size() - subset.firstVertex;
+}
+
+void ModelLoader::AddPolygon(const VertexNT* corners, const VertexSkin* skins, int count){
+	// Lines and points have nothing to draw.
+	if (count < 3)
+		return;
+
+	// Corners are only welded if their bones match too, so two control points in exactly the same place that move
+	// with different bones stay apart.
+	polygonIndices.resize(count);
+	for (int i = 0; i < count; i++)
+		polygonIndices[i] = welder.Add(corners[i], skins ? &skins[i] : nullptr);
+
+	if (count == 3){
+		indexData.insert(indexData.end(), polygonIndices.begin(), polygonIndices.end());
+		return;
+	}
+
+	TriangulatePolygon(corners, count, polygonTriangles);
+	for (unsigned int i = 0; i < polygonTriangles.size(); i++)
+		indexData.push_back(polygonIndices[polygonTriangles[i]]);
+}
+
+// Ear clipping in the plane the polygon faces most, so concave polygons come out right as well as convex ones.
+// The triangles keep the polygon's winding.
+void ModelLoader::TriangulatePolygon(const VertexNT* corners, int count, std::vector<int>& triangles){
+	triangles.clear();
+
+	// Newell's method gives the polygon's normal even when it isn't quite flat.
+	Vector3f normal(0.0f, 0.0f, 0.0f);
+	for (int i = 0; i < count; i++){
+		const Vector3f& a = corners[i].pos;
+		const Vector3f& b = corners[(i + 1) % count].pos;
+		normal.x += (a.y - b.y)*(a.z + b.z);
+		normal.y += (a.z - b.z)*(a.x + b.x);
+		normal.z += (a.x - b.x)*(a.y + b.y);
+	}
+
+	// Drop the normal's largest axis, which turns the polygon anticlockwise in the other two if that axis is positive.
+	int u = 1, v = 2;
+	float direction = normal.x;
+	if (fabsf(normal.y) > fabsf(normal.x) && fabsf(normal.y) >= fabsf(normal.z)){
+		u = 2; v = 0;
+		direction = normal.y;
+	}
+	else if (fabsf(normal.z) > fabsf(normal.x) && fabsf(normal.z) > fabsf(normal.y)){
+		u = 0; v = 1;
+		direction = normal.z;
+	}
+	float sign = direction < 0.0f ? -1.0f : 1.0f;
+
+	std::vector<int> ring(count);
+	for (int i = 0; i < count; i++)
+		ring[i] = i;
+
+	int i = 0;
+	int misses = 0;
+	while (ring.size() > 3){
+		int n = ring.size();
+		int prev = ring[(i + n - 1) % n];
+		int cur = ring[i % n];
+		int next = ring[(i + 1) % n];
+		const float* a = corners[prev].pos;
+		const float* b = corners[cur].pos;
+		const float* c = corners[next].pos;
+
+		// An ear is a convex corner with none of the other corners inside the triangle it makes.
+		float cross = ((b[u] - a[u])*(c[v] - a[v]) - (b[v] - a[v])*(c[u] - a[u]))*sign;
+		bool ear = cross > 0.0f;
+		for (int k = 0; ear && k < n; k++){
+			int other = ring[k];
+			if (other == prev || other == cur || other == next)
+				continue;
+			const float* p = corners[other].pos;
+			float ab = ((b[u] - a[u])*(p[v] - a[v]) - (b[v] - a[v])*(p[u] - a[u]))*sign;
+			float bc = ((c[u] - b[u])*(p[v] - b[v]) - (c[v] - b[v])*(p[u] - b[u]))*sign;
+			float ca = ((a[u] - c[u])*(p[v] - c[v]) - (a[v] - c[v])*(p[u] - c[u]))*sign;
+			if (ab >= 0.0f && bc >= 0.0f && ca >= 0.0f)
+				ear = false;
+		}
+
+		// A polygon too broken to have any ears left is finished off as a fan.
+		if (ear || misses >= n){
+			triangles.push_back(prev);
+			triangles.push_back(cur);
+			triangles.push_back(next);
+			ring.erase(ring.begin() + i % n);
+			i = i % n;
+			if (i >= (int)ring.size())
+				i = 0;
+			misses = 0;
+		}
+		else{
+			i = (i + 1) % n;
+			misses++;
+		}
+	}
+	triangles.push_back(ring[0]);
+	triangles.push_back(ring[1]);
+	triangles.push_back(ring[2]);
+}
+
+// Every mesh is reordered on its own, with its indices made relative to its first vertex while it is. Each one only
+// touches its own vertices and indices, so they're done in parallel.
+void ModelLoader::OptimizeMeshes(){
+	meshReports.assign(subsets.size(), std::string());
+	ThreadPool::GetShared()->ParallelFor(subsets.size(), 1, OptimizeMeshRange, this);
+
+	for (unsigned int m = 0; m < meshReports.size(); m++)
+		std::cout << meshReports[m];
+	meshReports.clear();
+}
+
+void ModelLoader::OptimizeMeshRange(int first, int last, void* data){
+	ModelLoader* loader = (ModelLoader*)data;
+	for (int m = first; m < last; m++)
+		loader->OptimizeMesh(m);
+}
+
+void ModelLoader::OptimizeMesh(int m){
+	const MeshSubset& subset = subsets[m];
+	if (subset.indexCount == 0)
+		return;
+
+	std::vector<DWORD> indices(indexData.begin() + subset.firstIndex, indexData.begin() + subset.firstIndex + subset.indexCount);
+	std::vector<int> clusters;
+	for (unsigned int i = 0; i < indices.size(); i++)
+		indices[i] -= subset.firstVertex;
+	VertexNT* vertices = &vertexData[subset.firstVertex];
+
+	VertexCacheStats cacheBefore, cacheAfter;
+	OverdrawStats overdrawBefore, overdrawAfter;
+	VertexFetchStats fetchBefore, fetchAfter;
+	if (reportStats){
+		MeasureVertexCache(&indices[0], sizeof(DWORD), indices.size(), false, DEFAULT_VERTEX_CACHE, cacheBefore);
+		MeasureOverdraw(&indices[0], indices.size(), vertices, subset.vertexCount, overdrawBefore);
+		MeasureVertexFetch(&indices[0], indices.size(), subset.vertexCount, sizeof(VertexNT), fetchBefore);
+	}
+
+	OptimizeVertexCache(&indices[0], indices.size(), subset.vertexCount, DEFAULT_VERTEX_CACHE, &clusters);
+	OptimizeOverdraw(&indices[0], indices.size(), vertices, subset.vertexCount, clusters);
+	// The bones follow their vertices to wherever they're moved.
+	if (skinData.empty())
+		OptimizeVertexFetch(&indices[0], indices.size(), vertices, subset.vertexCount);
+	else{
+		std::vector<DWORD> remap;
+		OptimizeVertexFetch(&indices[0], indices.size(), vertices, subset.vertexCount, &remap);
+		std::vector<VertexSkin> skin(skinData.begin() + subset.firstVertex, skinData.begin() + subset.firstVertex + subset.vertexCount);
+		for (unsigned int i = 0; i < remap.size(); i++)
+			skinData[subset.firstVertex + remap[i]] = skin[i];
+	}
+
+	// The numbers are printed once every mesh is done so they come out in order.
+	if (reportStats){
+		MeasureVertexCache(&indices[0], sizeof(DWORD), indices.size(), false, DEFAULT_VERTEX_CACHE, cacheAfter);
+		MeasureOverdraw(&indices[0], indices.size(), vertices, subset.vertexCount, overdrawAfter);
+		MeasureVertexFetch(&indices[0], indices.size(), subset.vertexCount, sizeof(VertexNT), fetchAfter);
+		std::ostringstream report;
+		report << std::fixed << std::setprecision(3) << "Mesh " << m << ": ACMR " << cacheBefore.acmr << " -> " << cacheAfter.acmr <<
+				  ", overdraw " << overdrawBefore.overdraw << " -> " << overdrawAfter.overdraw <<
+				  ", overfetch " << fetchBefore.overfetch << " -> " << fetchAfter.overfetch << std::endl;
+		meshReports[m] = report.str();
+	}
+
+	for (unsigned int i = 0; i < indices.size(); i++)
+		indexData[subset.firstIndex + i] = indices[i] + subset.firstVertex;
+}
+
+// Each level is simplified from the one before it and goes on the end of the index array, so every level draws from
+// the same vertices. A subset's levels only depend on its own triangles, so every subset's chain is built in parallel
+// and the levels are put together afterwards.
+void ModelLoader::BuildLods(){
+	lods.clear();
+	batches.clear();
+
+	// the indices each subset has in the last level put together
+	std::vector<DWORD> lastFirst(subsets.size()), lastCount(subsets.size());
+	for (unsigned int m = 0; m < subsets.size(); m++){
+		lastFirst[m] = subsets[m].firstIndex;
+		lastCount[m] = subsets[m].indexCount;
+	}
+
+	MeshLod full;
+	memset(&full, 0, sizeof(full));
+	full.indexCount = indexData.size();
+	AddBatches(full, lastFirst, lastCount);
+	lods.push_back(full);
+	if (lodCount < 2)
+		return;
+
+	lodChains.assign(subsets.size(), LodChain());
+	ThreadPool::GetShared()->ParallelFor(subsets.size(), 1, SimplifyMeshRange, this);
+
+	for (int level = 1; level < lodCount; level++){
+		MeshLod lod;
+		memset(&lod, 0, sizeof(lod));
+		lod.firstIndex = indexData.size();
+		for (unsigned int m = 0; m < subsets.size(); m++){
+			DWORD first = indexData.size();
+			const LodChain& chain = lodChains[m];
+			if (level <= (int)chain.levels.size()){
+				const std::vector<DWORD>& indices = chain.levels[level-1];
+				for (unsigned int i = 0; i < indices.size(); i++)
+					indexData.push_back(indices[i] + subsets[m].firstVertex);
+				lod.error = Max(lod.error, chain.errors[level-1]);
+			}
+			lastFirst[m] = first;
+			lastCount[m] = indexData.size() - first;
+		}
+		lod.indexCount = indexData.size() - lod.firstIndex;
+
+		// A level that hardly got any simpler isn't worth its indices, and the ones after it wouldn't be either.
+		if (lod.indexCount == 0 || lod.indexCount > lods.back().indexCount*LOD_MIN_REDUCTION){
+			indexData.resize(lod.firstIndex);
+			break;
+		}
+		AddBatches(lod, lastFirst, lastCount);
+		lods.push_back(lod);
+
+		if (reportStats)
+			std::cout << std::fixed << std::setprecision(3) << "LOD " << level << ": " << lod.indexCount/3 << " triangles, error " << lod.error << std::endl;
+	}
+	lodChains.clear();
+}
+
+void ModelLoader::SimplifyMeshRange(int first, int last, void* data){
+	ModelLoader* loader = (ModelLoader*)data;
+	for (int m = first; m < last; m++)
+		loader->SimplifyMesh(m);
+}
+
+// The errors of the levels are added up since each is only measured against the one it was simplified from.
+void ModelLoader::SimplifyMesh(int m){
+	const MeshSubset& subset = subsets[m];
+	LodChain& chain = lodChains[m];
+
+	std::vector<DWORD> source(indexData.begin() + subset.firstIndex, indexData.begin() + subset.firstIndex + subset.indexCount);
+	for (unsigned int i = 0; i < source.size(); i++)
+		source[i] -= subset.firstVertex;
+
+	float totalError = 0.0f;
+	for (int level = 1; level < lodCount && !source.empty(); level++){
+		std::vector<DWORD> simplified(source.size());
+		float error = 0.0f;
+		int target = (int)(source.size()/3*LOD_REDUCTION)*3;
+		int count = ::SimplifyMesh(&source[0], source.size(), &vertexData[subset.firstVertex], subset.vertexCount, target, &simplified[0], &error);
+		simplified.resize(count);
+		if (count > 0)
+			OptimizeVertexCache(&simplified[0], count, subset.vertexCount);
+
+		totalError += error;
+		chain.levels.push_back(simplified);
+		chain.errors.push_back(totalError);
+		source.swap(simplified);
+	}
+}
+
+// A level's subsets sit one after the other in the order they're sorted in, so the ones that share a material make a
+// single run of the index array.
+void ModelLoader::AddBatches(MeshLod& lod, const std::vector<DWORD>& first, const std::vector<DWORD>& count){
+	lod.firstBatch = batches.size();
+	for (unsigned int m = 0; m < subsets.size(); m++){
+		if (count[m] == 0)
+			continue;
+		if (batches.size() > lod.firstBatch && batches.back().material == subsets[m].material &&
+			batches.back().firstIndex + batches.back().indexCount == first[m]){
+			batches.back().indexCount += count[m];
+			continue;
+		}
+		MeshBatch batch = {first[m], count[m], subsets[m].material, 0};
+		batches.push_back(batch);
+	}
+	lod.batchCount = batches.size() - lod.firstBatch;
+}
+
+// Subsets are loaded mesh by mesh - moving the ones with the same material next to each other, vertices and all, lets
+// each material be drawn with one call. Subsets with the same material keep the order they were loaded in.
+void ModelLoader::SortSubsets(){
+	std::vector<std::pair<DWORD, int> > order(subsets.size());
+	for (unsigned int m = 0; m < subsets.size(); m++)
+		order[m] = std::make_pair(subsets[m].material, (int)m);
+	std::sort(order.begin(), order.end());
+
+	bool sorted = true;
+	for (unsigned int m = 0; m < order.size(); m++)
+		sorted = sorted && order[m].second == (int)m;
+	if (sorted)
+		return;
+
+	std::vector<VertexNT> vertices;
+	std::vector<VertexSkin> skin;
+	std::vector<DWORD> indices;
+	std::vector<MeshSubset> moved;
+	vertices.reserve(vertexData.size());
+	skin.reserve(skinData.size());
+	indices.reserve(indexData.size());
+	moved.reserve(subsets.size());
+	for (unsigned int m = 0; m < order.size(); m++){
+		MeshSubset subset = subsets[order[m].second];
+		vertices.insert(vertices.end(), vertexData.begin() + subset.firstVertex, vertexData.begin() + subset.firstVertex + subset.vertexCount);
+		if (!skinData.empty())
+			skin.insert(skin.end(), skinData.begin() + subset.firstVertex, skinData.begin() + subset.firstVertex + subset.vertexCount);
+		for (DWORD i = 0; i < subset.indexCount; i++)
+			indices.push_back(indexData[subset.firstIndex + i] - subset.firstVertex + (vertices.size() - subset.vertexCount));
+		subset.firstVertex = vertices.size() - subset.vertexCount;
+		subset.firstIndex = indices.size() - subset.indexCount;
+		moved.push_back(subset);
+	}
+	vertexData.swap(vertices);
+	skinData.swap(skin);
+	indexData.swap(indices);
+	subsets.swap(moved);
+}
+
+bool ModelLoader::GetLayerElement(const FBXNode* element, const char* valuesName, const char* indexName, int components,
+								  const std::vector<int>& polygonVertices, std::vector<double>& values, std::vector<int>& cornerValues){
+	cornerValues.clear();
+	const FBXNode* valuesNode = element ? element->GetChild(valuesName) : nullptr;
+	if (!valuesNode || !valuesNode->GetArray(0, values))
+		return false;
+
+	const FBXNode* mappingNode = element->GetChild("MappingInformationType");
+	const FBXNode* referenceNode = element->GetChild("ReferenceInformationType");
+	std::string mapping = mappingNode ? mappingNode->GetString(0) : std::string("ByPolygonVertex");
+	std::string reference = referenceNode ? referenceNode->GetString(0) : std::string("Direct");
+
+	std::vector<int> index;
+	if (reference == "IndexToDirect" || reference == "Index"){
+		const FBXNode* indexNode = element->GetChild(indexName);
+		if (!indexNode || !indexNode->GetArray(0, index))
+			return false;
+	}
+
+	// What the values are stored against - every corner, every control point, every polygon or the whole mesh.
+	enum {BY_CORNER, BY_CONTROL_POINT, BY_POLYGON, ALL_SAME} by = ALL_SAME;
+	if (mapping == "ByPolygonVertex")
+		by = BY_CORNER;
+	else if (mapping == "ByVertice" || mapping == "ByVertex" || mapping == "ByControlPoint")
+		by = BY_CONTROL_POINT;
+	else if (mapping == "ByPolygon")
+		by = BY_POLYGON;
+
+	int valueCount = values.size()/components;
+	cornerValues.resize(polygonVertices.size());
+	int polygon = 0;
+	for (unsigned int corner = 0; corner < polygonVertices.size(); corner++){
+		int key = 0;
+		if (by == BY_CORNER)
+			key = corner;
+		else if (by == BY_CONTROL_POINT)
+			key = polygonVertices[corner] < 0 ? ~polygonVertices[corner] : polygonVertices[corner];
+		else if (by == BY_POLYGON)
+			key = polygon;
+
+		int value = key;
+		if (!index.empty())
+			value = key < (int)index.size() ? index[key] : -1;
+		cornerValues[corner] = (value >= 0 && value < valueCount) ? value : -1;
+
+		if (polygonVertices[corner] < 0)
+			polygon++;
+	}
+
+	return true;
+}
+
+#if defined(MODELLOADER_USE_FBXSDK)
+#pragma comment(lib, "fbxsdk-2013.3-mdd.lib")
+
+bool ModelLoader::LoadModelWithSDK(const char* filename){
+
 	std::cout << "Starting model loader..." << std::endl;
+	GameTimer timer;
+	timer.reset();
 
 	// Initialize the sdk manager. This object handles all our memory management.
     FbxManager* lSdkManager = FbxManager::Create();
@@ -61,9 +1174,15 @@ bool ModelLoader::LoadModel(const char* filename){
 
     // Destroy the sdk manager and all other objects it was handling.
     lSdkManager->Destroy();
+	sdkMaterials.clear();
 
+	SortSubsets();
+	OptimizeMeshes();
+	BuildLods();
+
+	timer.tick();
 	std::cout << "Number of fbx nodes: " << numNodes << std::endl;
-	std::cout << "Finished model loading" << std::endl;
+	std::cout << "Finished model loading in " << timer.getDeltaTime()*1000.0f << " ms" << std::endl;
 
 	return true;
 }
@@ -72,7 +1191,7 @@ bool ModelLoader::GetNodeData(FbxNode *pNode){
 	numNodes++;
 
 	if (pNode->GetMesh() != NULL){
-		if (!GetMeshData(pNode->GetMesh()))
+		if (!PopulateVertexData(pNode, pNode->GetMesh()))
 			return false;
 	}
 
@@ -86,72 +1205,79 @@ bool ModelLoader::GetNodeData(FbxNode *pNode){
 	return true;
 }
 
-bool ModelLoader::GetMeshData(FbxMesh *pMesh){
-
-	std::cout << "Mesh detected " << std::endl;
-	std::cout << "Polygon count " << pMesh->GetPolygonCount() << std::endl;
-	fbxDouble3 translation = pMesh->GetNode()->LclTranslation.Get();
-    fbxDouble3 rotation = pMesh->GetNode()->LclRotation.Get();
-    fbxDouble3 scaling = pMesh->GetNode()->LclScaling.Get();
-
-	std::cout << "Translation: " << translation[0] << "," << translation[1] << "," << translation[2] << std::endl;
-	std::cout << "Rotation: " << rotation[0] << "," << rotation[1] << "," << rotation[2] << std::endl;
-	std::cout << "Scaling: " << scaling[0] << "," << scaling[1] << "," << scaling[2] << std::endl;
-
-	//Get Vertex Data
-	if (!PopulateVertexData(pMesh))
-		return false;
-
-	//Get Index Data
-	if (!PopulateIndexData(pMesh))
-		return false;
-
-	return true;
-}
-
-bool ModelLoader::PopulateVertexData(FbxMesh *pMesh){
+bool ModelLoader::PopulateVertexData(FbxNode *pNode, FbxMesh *pMesh){
 	
-	//Each index of this array corresponds to a vertex in the mesh
-	FbxVector4* vertexarray = pMesh->GetControlPoints();
-	int vertexcount = pMesh->GetControlPointsCount();
-	int polygonCount = pMesh->GetPolygonCount();
-
-	//std::cout << "Loading " << pMesh->GetTextureUVCount()<< " texture UVs" << std::endl;
+	//Where the node puts the mesh in the scene, with the node's geometric transform that only moves its own mesh.
+	//FbxAMatrix keeps the translation in its last row like D3DX does
+	FbxAMatrix geometric(pNode->GetGeometricTranslation(FbxNode::eSourcePivot), pNode->GetGeometricRotation(FbxNode::eSourcePivot),
+						 pNode->GetGeometricScaling(FbxNode::eSourcePivot));
+	FbxAMatrix global = pNode->EvaluateGlobalTransform() * geometric;
+	D3DXMATRIX transform;
+	for (int r = 0; r < 4; r++){
+		for (int c = 0; c < 4; c++)
+			transform(r, c) = (float)global.Get(r, c);
+	}
 
-	std::cout << "Loading " << vertexcount << " vertices" << std::endl;
-	//Now stores each vertex in my array
-	for (int i = 0; i < vertexcount; ++i){
-		VertexNT vert;
-		//Get coordinates
-		vert.pos.x = vertexarray[i].mData[0];
-		vert.pos.y = vertexarray[i].mData[1];
-		vert.pos.z = vertexarray[i].mData[2];
+	//The node's materials, which the mesh's material indices count
+	std::vector<DWORD> meshMaterials;
+	for (int i = 0; i < pNode->GetMaterialCount(); i++){
+		FbxSurfaceMaterial* material = pNode->GetMaterial(i);
+		std::map<FbxSurfaceMaterial*, DWORD>::const_iterator found = sdkMaterials.find(material);
+		if (found != sdkMaterials.end()){
+			meshMaterials.push_back(found->second);
+			continue;
+		}
 
-		vert.texC = Vector2f(0,0);
+		std::string diffuseMap;
+		FbxProperty diffuse = material->FindProperty(FbxSurfaceMaterial::sDiffuse);
+		FbxFileTexture* texture = diffuse.IsValid() ? diffuse.GetSrcObject<FbxFileTexture>(0) : NULL;
+		if (texture){
+			diffuseMap = texture->GetFileName();
+			size_t slash = diffuseMap.find_last_of("/\\");
+			if (slash != std::string::npos)
+				diffuseMap.erase(0, slash + 1);
+		}
+		Vector3f diffuseColor(1.0f, 1.0f, 1.0f);
+		if (material->GetClassId().Is(FbxSurfaceLambert::ClassId)){
+			FbxDouble3 color = ((FbxSurfaceLambert*)material)->Diffuse.Get();
+			diffuseColor = Vector3f((float)color[0], (float)color[1], (float)color[2]);
+		}
 
-		vertexData.push_back(vert);
+		DWORD index = AddMaterial(material->GetName(), diffuseMap.c_str(), diffuseColor);
+		sdkMaterials[material] = index;
+		meshMaterials.push_back(index);
 	}
+	FbxGeometryElementMaterial* materialElement = pMesh->GetElementMaterial();
 
-	std::cout << "Loading normals and texture coordinates" << std::endl;
+	//Each index of this array corresponds to a vertex in the mesh
+	FbxVector4* vertexarray = pMesh->GetControlPoints();
+	FbxLayerElementUV* fbxLayerUV = pMesh->GetLayer(0) ? pMesh->GetLayer(0)->GetUVs() : NULL;
+	std::vector<VertexNT> corners;
+	std::vector<int> polygonStarts, polygonMaterials;
+	polygonStarts.push_back(0);
 
-	//Get normals
 	// For each polygon in the input mesh
 	for (int polygon = 0; polygon < pMesh->GetPolygonCount(); polygon++) {
 		// For each vertex in the polygon
-		for (unsigned polygonVertex = 0; polygonVertex < 3; polygonVertex++) {
+		for (int polygonVertex = 0; polygonVertex < pMesh->GetPolygonSize(polygon); polygonVertex++) {
 			int fbxCornerIndex = pMesh->GetPolygonVertex(polygon, polygonVertex);
-			
-			// Get vertex position
-			//FbxVector4 fbxVertex = fbxControlPoints[fbxCornerIndex];
+			if (fbxCornerIndex < 0)
+				return false;
+
+			VertexNT vert;
+			//Get coordinates
+			vert.pos.x = vertexarray[fbxCornerIndex].mData[0];
+			vert.pos.y = vertexarray[fbxCornerIndex].mData[1];
+			vert.pos.z = vertexarray[fbxCornerIndex].mData[2];
+
 			// Get normal
 			KFbxVector4 fbxNormal;
 			pMesh->GetPolygonVertexNormal(polygon, polygonVertex, fbxNormal);
 			fbxNormal.Normalize();
-			vertexData[fbxCornerIndex].normal = Vector3f(fbxNormal.mData[0],fbxNormal.mData[1],fbxNormal.mData[2]);
+			vert.normal = Vector3f(fbxNormal.mData[0],fbxNormal.mData[1],fbxNormal.mData[2]);
 
 			// Get texture coordinate
-			FbxVector2 fbxUV = KFbxVector2(0.0, 0.0);
-			FbxLayerElementUV* fbxLayerUV = pMesh->GetLayer(0)->GetUVs();
+			vert.texC = Vector2f(0,0);
 			if (fbxLayerUV) {
 				int UVIndex = 0;
 				switch (fbxLayerUV->GetMappingMode()) {
@@ -163,35 +1289,29 @@ bool ModelLoader::PopulateVertexData(FbxMesh *pMesh){
 						UVIndex = pMesh->GetTextureUVIndex(polygon, polygonVertex, FbxLayerElement::eTextureDiffuse);
 						break;
 				}
-				fbxUV = fbxLayerUV->GetDirectArray().GetAt(UVIndex);
-				vertexData[fbxCornerIndex].texC = Vector2f(fbxUV.mData[0],-fbxUV.mData[1]);//invert the V texture coordinate
+				FbxVector2 fbxUV = fbxLayerUV->GetDirectArray().GetAt(UVIndex);
+				vert.texC = Vector2f(fbxUV.mData[0],-fbxUV.mData[1]);//invert the V texture coordinate
 			}
+			corners.push_back(vert);
 		}
-	}
-
-	/*for (int i = 0; i < vertexData.size(); i++){
-		if (vertexData[i].texC == Vector2f(0,0))
-			std::cout << "Zero tex coord detected" << std::endl;
-	}*/
-
-	std::cout << "Finished Loading" << std::endl;
-
-	return true;
-}
+		polygonStarts.push_back(corners.size());
 
-bool ModelLoader::PopulateIndexData(FbxMesh *pMesh){
-	std::cout << "Loading " << pMesh->GetPolygonVertexCount() << " indices" << std::endl;
-	for (int i = 0; i < pMesh->GetPolygonCount(); i++) {
-		for (int j = 0; j < pMesh->GetPolygonSize(i); j++) {
-			int fbxCornerIndex = pMesh->GetPolygonVertex(i, j);
-			indexData.push_back(fbxCornerIndex);
+		// Get the polygon's material, one for the whole mesh unless it's mapped by polygon
+		int material = 0;
+		if (materialElement && materialElement->GetIndexArray().GetCount() > 0){
+			if (materialElement->GetMappingMode() == FbxGeometryElement::eByPolygon)
+				material = polygon < materialElement->GetIndexArray().GetCount() ? materialElement->GetIndexArray().GetAt(polygon) : -1;
+			else
+				material = materialElement->GetIndexArray().GetAt(0);
 		}
+		polygonMaterials.push_back(material);
 	}
 
-	std::cout << "Finished Loading" << std::endl;
-
+	std::vector<VertexSkin> cornerSkins;
+	AddMesh(corners, cornerSkins, polygonStarts, polygonMaterials, meshMaterials, transform);
 	return true;
 }
+#endif
 
 VertexNT* ModelLoader::GetVertexData(){
 	return &vertexData[0];
@@ -207,4 +1327,80 @@ int ModelLoader::GetVertexCount(){
 
 int ModelLoader::GetIndexCount(){
 	return indexData.size();
+}
+
+void ModelLoader::SetReportStats(bool report){
+	reportStats = report;
+}
+
+const MeshSubset* ModelLoader::GetSubsetData(){
+	return subsets.empty() ? nullptr : &subsets[0];
+}
+
+int ModelLoader::GetSubsetCount(){
+	return subsets.size();
+}
+
+const MeshMaterial* ModelLoader::GetMaterialData(){
+	return materials.empty() ? nullptr : &materials[0];
+}
+
+int ModelLoader::GetMaterialCount(){
+	return materials.size();
+}
+
+const MeshBatch* ModelLoader::GetBatchData(){
+	return batches.empty() ? nullptr : &batches[0];
+}
+
+int ModelLoader::GetBatchCount(){
+	return batches.size();
+}
+
+void ModelLoader::SetLodCount(int count){
+	lodCount = Max(count, 1);
+}
+
+const VertexSkin* ModelLoader::GetSkinData(){
+	return skinData.empty() ? nullptr : &skinData[0];
+}
+
+const MeshBone* ModelLoader::GetBoneData(){
+	return bones.empty() ? nullptr : &bones[0];
+}
+
+int ModelLoader::GetBoneCount(){
+	return bones.size();
+}
+
+const MeshClip* ModelLoader::GetClipData(){
+	return clips.empty() ? nullptr : &clips[0];
+}
+
+int ModelLoader::GetClipCount(){
+	return clips.size();
+}
+
+const MeshTrack* ModelLoader::GetTrackData(){
+	return tracks.empty() ? nullptr : &tracks[0];
+}
+
+int ModelLoader::GetTrackCount(){
+	return tracks.size();
+}
+
+const MeshKey* ModelLoader::GetKeyData(){
+	return keys.empty() ? nullptr : &keys[0];
+}
+
+int ModelLoader::GetKeyCount(){
+	return keys.size();
+}
+
+const MeshLod* ModelLoader::GetLodData(){
+	return lods.empty() ? nullptr : &lods[0];
+}
+
+int ModelLoader::GetLodCount(){
+	return lods.size();
 }
\ No newline at end of file
@@ -2,13 +2,33 @@
 #define MODELLOADER_H
 
 ///A CLASS THAT HANDLES LOADING MODEL INFORMATION FOR .FBX MODEL FORMATS
-///REQUIRES THE FBXSDK PLUGIN FROM AUTODESK
+///EVERY MESH IN THE SCENE IS PUT WHERE ITS NODE AND THE NODES ABOVE IT PLACE IT AND SPLIT INTO A SUBSET FOR EACH OF ITS
+///MATERIALS, ALL IN ONE VERTEX AND INDEX ARRAY WITH THE SUBSETS OF A MATERIAL NEXT TO EACH OTHER SO IT'S DRAWN WITH ONE CALL
+///BINARY AND ASCII FILES ARE READ DIRECTLY WITH FBXParser. DEFINE MODELLOADER_USE_FBXSDK TO ALSO BUILD
+///LoadModelWithSDK, THE OLD PATH THROUGH THE AUTODESK FBX SDK, TO COMPARE AGAINST
+///EITHER WAY EVERY POLYGON IS TRIANGULATED AND ITS CORNERS WELDED INTO THE FEWEST VERTICES THAT KEEP ALL THE NORMALS AND UVS,
+///THEN EVERY MESH IS REORDERED FOR THE VERTEX CACHE, OVERDRAW AND VERTEX FETCH (SEE MeshOptimizer.h) AND SIMPLIFIED INTO
+///LEVELS OF DETAIL (SEE MeshSimplifier.h) WHOSE INDICES GO AFTER THE FULL DETAIL ONES
+///A SKINNED MODEL ALSO GETS THE BONES THAT MOVE EACH VERTEX, ITS SKELETON AND ITS ANIMATION STACKS SAMPLED INTO CLIPS (SEE Animation.h)
+///AND COMPRESSED (SEE AnimationCompressor.h)
 
+#if defined(MODELLOADER_USE_FBXSDK)
 #include <fbxsdk.h>
+#endif
 #include <vector>
+#include <map>
+#include <string>
 #include <iostream>
 #include "Vertex.h"
 #include "d3dUtil.h"
+#include "FBXParser.h"
+#include "MeshFile.h"
+#include "VertexWelder.h"
+
+const int	DEFAULT_LOD_COUNT	= 4;		// levels of detail built for a model, counting full detail
+const float	LOD_REDUCTION		= 0.5f;		// triangles each level aims to keep from the one before it
+const float	LOD_MIN_REDUCTION	= 0.75f;	// no more levels are built once one keeps more than this of the one before it
+const float	ANIMATION_SAMPLE_RATE = 30.0f;	// frames a second the clips are sampled at
 
 class ModelLoader
 {
@@ -17,6 +37,9 @@ public:
 	~ModelLoader(void);
 
 	bool	LoadModel(const char* filename);
+#if defined(MODELLOADER_USE_FBXSDK)
+	bool	LoadModelWithSDK(const char* filename);
+#endif
 	
 	VertexNT* GetVertexData();
 	DWORD*   GetIndexData();
@@ -24,17 +47,129 @@ public:
 	int		 GetVertexCount();
 	int		 GetIndexCount();
 
+	// prints the vertex cache, overdraw and vertex fetch numbers of every mesh before and after it's optimized, and how
+	// much each clip was compressed and how far that moved its bones
+	void	 SetReportStats(bool report);
+
+	// one subset for each material of each mesh in the file, in the order of their materials
+	const MeshSubset* GetSubsetData();
+	int		 GetSubsetCount();
+
+	// every material the meshes use, there's always at least one
+	const MeshMaterial* GetMaterialData();
+	int		 GetMaterialCount();
+
+	// the runs of each level of detail that draw a material, see MeshLod
+	const MeshBatch* GetBatchData();
+	int		 GetBatchCount();
+
+	// how many levels of detail to build, counting full detail, 1 builds none. Fewer are built if the meshes stop simplifying
+	void	 SetLodCount(int count);
+
+	// level 0 is every subset at full detail, the rest follow it in the index array from the most detailed down
+	const MeshLod* GetLodData();
+	int		 GetLodCount();
+
+	// the bones of every vertex, null if the model isn't skinned
+	const VertexSkin* GetSkinData();
+	const MeshBone* GetBoneData();
+	int		 GetBoneCount();
+	const MeshClip* GetClipData();
+	int		 GetClipCount();
+	const MeshTrack* GetTrackData();
+	int		 GetTrackCount();
+	const MeshKey* GetKeyData();
+	int		 GetKeyCount();
+
 private:
+	// adds a mesh from the corners of its polygons, in its node's space, with the first corner of every polygon in
+	// polygonStarts (and the end of the last one after them) and which of meshMaterials each polygon uses. cornerSkins
+	// has the bones of every corner if the model is skinned and is empty if it isn't
+	void AddMesh(std::vector<VertexNT>& corners, std::vector<VertexSkin>& cornerSkins, const std::vector<int>& polygonStarts,
+				 const std::vector<int>& polygonMaterials, const std::vector<DWORD>& meshMaterials, const D3DXMATRIX& transform);
+	// every subset's polygons go between BeginMesh and EndMesh
+	void BeginMesh(int expectedCorners, DWORD material, const D3DXMATRIX& transform, bool skinned);
+	void AddPolygon(const VertexNT* corners, const VertexSkin* skins, int count);	// welds the corners and triangulates the polygon
+	void EndMesh();
+	DWORD AddMaterial(const char* name, const char* diffuseMap, const Vector3f& diffuseColor);
+	void SortSubsets();
+	// the meshes are optimized and simplified in parallel on the shared thread pool
+	void OptimizeMeshes();
+	void OptimizeMesh(int m);
+	static void OptimizeMeshRange(int first, int last, void* data);
+	void BuildLods();
+	void SimplifyMesh(int m);
+	static void SimplifyMeshRange(int first, int last, void* data);
+	void AddBatches(MeshLod& lod, const std::vector<DWORD>& first, const std::vector<DWORD>& count);
+	static void TriangulatePolygon(const VertexNT* corners, int count, std::vector<int>& triangles);
+
+	// the scene's objects by their ids and the connections between them
+	struct Scene
+	{
+		std::map<long long, const FBXNode*>	objects;
+		std::map<long long, long long>		parents;		// the model each object hangs from - a mesh's node or a node's parent
+		std::map<long long, std::vector<long long> > children;	// in the order they're connected, which is how meshes count materials
+		std::map<long long, long long>		diffuseMaps;	// material -> the texture connected to its diffuse colour
+		std::map<long long, D3DXMATRIX>		transforms;		// every model's transform in the scene, worked out as it's needed
+		std::map<long long, DWORD>			materials;		// material -> its place in the loader's materials
+		std::map<long long, int>			bones;			// model -> its place in the loader's bones
+		std::vector<long long>				boneModels;		// and back, 0 for the root bone
+		// model -> the curve nodes animating its properties, and curve node -> the curves animating its components
+		std::map<long long, std::vector<std::pair<long long, std::string> > > animatedProperties;
+		std::map<long long, std::vector<std::pair<long long, std::string> > > curves;
+	};
+
+	bool GetMeshData(Scene& scene, long long geometryId, const FBXNode* geometry);
+	D3DXMATRIX GetModelTransform(Scene& scene, long long modelId, int depth);
+	DWORD GetMaterial(Scene& scene, long long materialId);
+	int AddBone(Scene& scene, long long modelId, int depth);
+	int GetRootBone(Scene& scene);
+	// the bones that move each of a mesh's control points
+	void GetSkinWeights(Scene& scene, long long geometryId, long long modelId, int controlPoints, std::vector<VertexSkin>& pointSkins);
+	void LoadAnimations(Scene& scene, const FBXNode* objects);
+	// which of a layer element's values each corner of the mesh uses, -1 where it has none
+	bool GetLayerElement(const FBXNode* element, const char* valuesName, const char* indexName, int components,
+						 const std::vector<int>& polygonVertices, std::vector<double>& values, std::vector<int>& cornerValues);
+
+#if defined(MODELLOADER_USE_FBXSDK)
 	bool GetNodeData(FbxNode *pNode);
-	bool GetMeshData(FbxMesh *pMesh);
 
-	int numNodes;
+	bool PopulateVertexData(FbxNode *pNode, FbxMesh *pMesh);
 
-	bool PopulateVertexData(FbxMesh *pMesh);
-	bool PopulateIndexData(FbxMesh *pMesh);
+	std::map<FbxSurfaceMaterial*, DWORD> sdkMaterials;	// where each of the scene's materials went in the materials
+#endif
+
+	int numNodes;
+	int defaultMaterial;	// for polygons without a material of their own, -1 until one needs it
+	int rootBone;			// for meshes without a node in a skinned model, -1 until one needs it
+	bool skinned;
+	int lodCount;
+	bool reportStats;
 private:
 	std::vector<VertexNT> vertexData;
 	std::vector<DWORD>	  indexData;
+	std::vector<MeshSubset> subsets;
+	std::vector<MeshMaterial> materials;
+	std::vector<MeshBatch> batches;
+	std::vector<MeshLod>  lods;
+	std::vector<VertexSkin> skinData;		// one for every vertex if the model is skinned
+	std::vector<MeshBone> bones;
+	std::vector<MeshClip> clips;
+	std::vector<MeshTrack> tracks;
+	std::vector<MeshKey> keys;
+
+	// every level of detail of one subset, with its indices relative to its first vertex
+	struct LodChain
+	{
+		std::vector<std::vector<DWORD> > levels;
+		std::vector<float>	  errors;
+	};
+	std::vector<LodChain> lodChains;		// scratch space for BuildLods
+	std::vector<std::string> meshReports;	// and OptimizeMeshes
+
+	VertexWelder		  welder;
+	std::vector<DWORD>	  polygonIndices;		// scratch space for AddPolygon
+	std::vector<int>	  polygonTriangles;
 };
 
 #endif
\ No newline at end of file
@@ -1,13 +1,20 @@
 #include "ModelObject.h"
+#include "ThreadPool.h"
+#include <string.h>
 
 
 
 ModelObject::ModelObject(void){
+	modelLoader = nullptr;
+	currentLod = 0;
+	lodPixelError = DEFAULT_MODEL_PIXEL_ERROR;
+	skinnedVerticesChanged = false;
 }
 
 
 ModelObject::~ModelObject(void){	
 	Shutdown();
+	ReleaseMaterials();
 	if (modelLoader){
 		delete modelLoader;
 		modelLoader = nullptr;
@@ -17,26 +24,299 @@ ModelObject::~ModelObject(void){
 bool ModelObject::LoadModelFromFBX(const char* filename){
 	modelLoader = new ModelLoader();
 	
-	if (!modelLoader->LoadModel(filename)){
-		return false;
+	bool loaded = modelLoader->LoadModel(filename) && CreateFromLoader(*modelLoader, filename);
+
+	//Do not do any other pointer cleanup here - the model loader takes care of that 
+	if (modelLoader){
+		delete modelLoader;
+		modelLoader = nullptr;
 	}
 
-	VertexNT *vertices = modelLoader->GetVertexData();
-	DWORD	*indices  = modelLoader->GetIndexData();	
+	return loaded;
+}
+
+bool ModelObject::LoadCookedModel(const char* filename){
+	MeshFile meshFile;
+	if (!meshFile.Load(filename))
+		return false;
+	return CreateFromMeshFile(meshFile, filename);
+}
+
+bool ModelObject::CreateFromLoader(ModelLoader& loader, const char* filename){
+	VertexNT *vertices = loader.GetVertexData();
+	DWORD	*indices  = loader.GetIndexData();	
 
 	// Set the number of vertices in the vertex array.
-	mVertexCount = modelLoader->GetVertexCount();
+	mVertexCount = loader.GetVertexCount();
 	// Set the number of indices in the index array.
-	mIndexCount = modelLoader->GetIndexCount();
+	mIndexCount = loader.GetIndexCount();
 
 	if (!InitializeBuffers(indices,vertices))
 		return false;
+	SetLods(loader.GetLodData(), loader.GetLodCount(), loader.GetBatchData(), loader.GetBatchCount());
+	LoadMaterials(filename, loader.GetMaterialData(), loader.GetMaterialCount());
+	SetSkin(vertices, loader.GetSkinData(), loader.GetBoneData(), loader.GetBoneCount(), loader.GetClipData(), loader.GetClipCount(),
+			loader.GetTrackData(), loader.GetTrackCount(), loader.GetKeyData(), loader.GetKeyCount());
+	return true;
+}
 
-	//Do not do any other pointer cleanup here - the model loader takes care of that 
-	if (modelLoader){
-		delete modelLoader;
-		modelLoader = nullptr;
-	}
+bool ModelObject::CreateFromMeshFile(const MeshFile& meshFile, const char* filename){
+	mVertexCount = meshFile.GetVertexCount();
+	mIndexCount = meshFile.GetIndexCount();
 
+	//D3D copies the arrays out of the view while making the buffers, so the file can be unmapped as soon as they're made
+	Vector3f boxMin, boxMax;
+	meshFile.GetBounds(boxMin, boxMax);
+	if (!InitializeBuffers(meshFile.GetIndices(), meshFile.GetVertices(), boxMin, boxMax))
+		return false;
+	SetLods(meshFile.GetLods(), meshFile.GetLodCount(), meshFile.GetBatches(), meshFile.GetBatchCount());
+	LoadMaterials(filename, meshFile.GetMaterials(), meshFile.GetMaterialCount());
+	SetSkin(meshFile.GetVertices(), meshFile.GetSkin(), meshFile.GetBones(), meshFile.GetBoneCount(), meshFile.GetClips(),
+			meshFile.GetClipCount(), meshFile.GetTracks(), meshFile.GetTrackCount(), meshFile.GetKeys(), meshFile.GetKeyCount());
 	return true;
-}
\ No newline at end of file
+}
+
+bool ModelObject::IsLoaded()const{
+	return !lods.empty();
+}
+
+bool ModelObject::CookModel(const char* fbxFilename, const char* meshFilename){
+	ModelLoader loader;
+	loader.SetReportStats(true);
+	if (!loader.LoadModel(fbxFilename))
+		return false;
+	return WriteCookedModel(loader, meshFilename);
+}
+
+bool ModelObject::WriteCookedModel(ModelLoader& loader, const char* meshFilename){
+	if (loader.GetVertexCount() == 0 || loader.GetIndexCount() == 0)
+		return false;
+
+	MeshContents contents;
+	contents.vertices = loader.GetVertexData();
+	contents.vertexCount = loader.GetVertexCount();
+	contents.indices = loader.GetIndexData();
+	contents.indexCount = loader.GetIndexCount();
+	contents.subsets = loader.GetSubsetData();
+	contents.subsetCount = loader.GetSubsetCount();
+	contents.materials = loader.GetMaterialData();
+	contents.materialCount = loader.GetMaterialCount();
+	contents.batches = loader.GetBatchData();
+	contents.batchCount = loader.GetBatchCount();
+	contents.lods = loader.GetLodData();
+	contents.lodCount = loader.GetLodCount();
+	contents.skin = loader.GetSkinData();
+	contents.bones = loader.GetBoneData();
+	contents.boneCount = loader.GetBoneCount();
+	contents.clips = loader.GetClipData();
+	contents.clipCount = loader.GetClipCount();
+	contents.tracks = loader.GetTrackData();
+	contents.trackCount = loader.GetTrackCount();
+	contents.keys = loader.GetKeyData();
+	contents.keyCount = loader.GetKeyCount();
+	return MeshFile::Save(meshFilename, contents);
+}
+
+void ModelObject::SetLods(const MeshLod* lodData, int lodCount, const MeshBatch* batchData, int batchCount){
+	//without any levels of detail the whole index buffer is the only one, drawn in one go
+	if (lodData && lodCount > 0 && batchData && batchCount > 0){
+		lods.assign(lodData, lodData + lodCount);
+		batches.assign(batchData, batchData + batchCount);
+	}
+	else{
+		MeshLod full;
+		memset(&full, 0, sizeof(full));
+		full.indexCount = mIndexCount;
+		full.batchCount = 1;
+		lods.assign(1, full);
+		MeshBatch batch = {0, mIndexCount, 0, 0};
+		batches.assign(1, batch);
+	}
+	currentLod = 0;
+}
+
+void ModelObject::LoadMaterials(const char* filename, const MeshMaterial* materialData, int materialCount){
+	ReleaseMaterials();
+	if (materialData)
+		materials.assign(materialData, materialData + materialCount);
+
+	std::string directory(filename);
+	size_t slash = directory.find_last_of("/\\");
+	directory = slash == std::string::npos ? std::string() : directory.substr(0, slash + 1);
+
+	materialTextures.assign(materials.size(), nullptr);
+	for (unsigned int i = 0; i < materials.size(); i++){
+		if (!md3dDevice || materials[i].diffuseMap[0] == 0)
+			continue;
+		std::string path = directory + materials[i].diffuseMap;
+		std::vector<WCHAR> widePath(path.begin(), path.end());
+		widePath.push_back(0);
+
+		TextureLoader* texture = new TextureLoader;
+		if (texture->Initialize(md3dDevice, &widePath[0])){
+			materialTextures[i] = texture;
+		}
+		else{
+			std::cout << "Could not load " << path << " for material " << materials[i].name << ", using the model's texture" << std::endl;
+			delete texture;
+		}
+	}
+}
+
+void ModelObject::ReleaseMaterials(){
+	for (unsigned int i = 0; i < materialTextures.size(); i++){
+		if (materialTextures[i]){
+			materialTextures[i]->Shutdown();
+			delete materialTextures[i];
+		}
+	}
+	materialTextures.clear();
+	materials.clear();
+}
+
+void ModelObject::SetLodPixelError(float pixelError){
+	lodPixelError = pixelError;
+}
+
+void ModelObject::UpdateLOD(const Vector3f& cameraPos, float fovY, int screenHeight){
+	currentLod = 0;
+	if (lods.size() < 2)
+		return;
+
+	//how many pixels a unit of error covers at a distance of one unit
+	float lodScale = screenHeight / (2.0f*tanf(fovY*0.5f));
+	//the errors are in the model's units, which the object is scaled from
+	float errorScale = Max(Max(fabsf(scale.x), fabsf(scale.y)), fabsf(scale.z));
+
+	//distance from the camera to the box around the object
+	Vector3f boxMin, boxMax;
+	GetWorldBounds(boxMin, boxMax);
+	float dx = Max(Max(boxMin.x - cameraPos.x, cameraPos.x - boxMax.x), 0.0f);
+	float dy = Max(Max(boxMin.y - cameraPos.y, cameraPos.y - boxMax.y), 0.0f);
+	float dz = Max(Max(boxMin.z - cameraPos.z, cameraPos.z - boxMax.z), 0.0f);
+	float distance = sqrtf(dx*dx + dy*dy + dz*dz);
+
+	//coarsest level whose error still projects to less than the tolerance
+	while (currentLod + 1 < (int)lods.size() && lods[currentLod+1].error*errorScale*lodScale <= lodPixelError*distance)
+		currentLod++;
+}
+
+int ModelObject::GetLod(){
+	return currentLod;
+}
+
+UINT ModelObject::GetLodStartIndex(){
+	return lods.empty() ? 0 : lods[currentLod].firstIndex;
+}
+
+int ModelObject::GetLodIndexCount(){
+	return lods.empty() ? mIndexCount : lods[currentLod].indexCount;
+}
+
+int ModelObject::GetBatchCount(){
+	return lods.empty() ? 0 : lods[currentLod].batchCount;
+}
+
+UINT ModelObject::GetBatchStartIndex(int which){
+	return batches[lods[currentLod].firstBatch + which].firstIndex;
+}
+
+int ModelObject::GetBatchIndexCount(int which){
+	return batches[lods[currentLod].firstBatch + which].indexCount;
+}
+
+ID3D10ShaderResourceView* ModelObject::GetBatchTexture(int which){
+	DWORD material = batches[lods[currentLod].firstBatch + which].material;
+	if (material < materialTextures.size() && materialTextures[material])
+		return materialTextures[material]->GetTexture();
+	return GetDiffuseTexture();
+}
+
+void ModelObject::SetSkin(const VertexNT* vertexData, const VertexSkin* skinData, const MeshBone* boneData, int boneCount,
+						  const MeshClip* clipData, int clipCount, const MeshTrack* trackData, int trackCount, const MeshKey* keyData, int keyCount){
+	bindVertices.clear();
+	skinnedVertices.clear();
+	skin.clear();
+	bones.clear();
+	clips.clear();
+	tracks.clear();
+	keys.clear();
+	skinnedVerticesChanged = false;
+	if (skinData && boneData && boneCount > 0){
+		bindVertices.assign(vertexData, vertexData + mVertexCount);
+		skinnedVertices = bindVertices;
+		skin.assign(skinData, skinData + mVertexCount);
+		bones.assign(boneData, boneData + boneCount);
+		if (clipData && trackData && keyData){
+			clips.assign(clipData, clipData + clipCount);
+			tracks.assign(trackData, trackData + trackCount);
+			keys.assign(keyData, keyData + keyCount);
+		}
+	}
+
+	//the player points into the arrays, so it's only set up once they're filled
+	animation.Initialize(bones.empty() ? nullptr : &bones[0], (int)bones.size(), clips.empty() ? nullptr : &clips[0], (int)clips.size(),
+						 tracks.empty() ? nullptr : &tracks[0], keys.empty() ? nullptr : &keys[0]);
+	if (!clips.empty())
+		animation.Play(0, 0.0f);
+}
+
+bool ModelObject::IsSkinned()const{
+	return !skin.empty();
+}
+
+int ModelObject::GetClipCount()const{
+	return animation.GetClipCount();
+}
+
+int ModelObject::FindClip(const char* name)const{
+	return animation.FindClip(name);
+}
+
+void ModelObject::PlayClip(int clip, float blendTime, bool loop){
+	animation.Play(clip, blendTime, loop);
+}
+
+void ModelObject::SetAnimationSpeed(float speed){
+	animation.SetSpeed(speed);
+}
+
+void ModelObject::Animate(float dt){
+	//without any clips the model never leaves the pose its vertex buffer was made in
+	if (!IsSkinned() || clips.empty())
+		return;
+	animation.Update(dt);
+	SkinVertices(&bindVertices[0], &skin[0], (int)bindVertices.size(), animation.GetPalette(), &skinnedVertices[0]);
+	skinnedVerticesChanged = true;
+
+	//the box the model is culled with follows the pose, or anything swung out of the bind pose's box could be culled
+	boundsMin = boundsMax = skinnedVertices[0].pos;
+	for (unsigned int i = 1; i < skinnedVertices.size(); i++){
+		D3DXVec3Minimize(&boundsMin, &boundsMin, &skinnedVertices[i].pos);
+		D3DXVec3Maximize(&boundsMax, &boundsMax, &skinnedVertices[i].pos);
+	}
+}
+
+void ModelObject::UpdateSkinnedVertices(){
+	if (!skinnedVerticesChanged || !md3dDevice || !mVB)
+		return;
+	md3dDevice->UpdateSubresource(mVB, 0, nullptr, &skinnedVertices[0], 0, 0);
+	skinnedVerticesChanged = false;
+}
+
+struct AnimateJob
+{
+	ModelObject	**models;
+	float		dt;
+};
+
+void ModelObject::AnimateRange(int first, int last, void* data){
+	AnimateJob* job = (AnimateJob*)data;
+	for (int i = first; i < last; i++)
+		job->models[i]->Animate(job->dt);
+}
+
+void ModelObject::AnimateModels(ModelObject** models, int count, float dt){
+	AnimateJob job = {models, dt};
+	ThreadPool::GetShared()->ParallelFor(count, 1, AnimateRange, &job);
+}
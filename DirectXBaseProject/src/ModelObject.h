@@ -3,6 +3,10 @@
 
 #include "GameObject.h"
 #include "ModelLoader.h"
+#include "Animation.h"
+#include <vector>
+
+const float DEFAULT_MODEL_PIXEL_ERROR = 1.0f;	// how far (in pixels) the level of detail drawn may stray from full detail
 
 class ModelObject :	public GameObject
 {
@@ -11,10 +15,76 @@ public:
 	~ModelObject(void);
 
 	bool LoadModelFromFBX(const char* filename);
+	bool LoadCookedModel(const char* filename);		// a model written by CookModel, its buffers are made straight from the mapped file
+
+	// imports an FBX file and writes it out as a MeshFile, the offline step that LoadCookedModel relies on
+	static bool CookModel(const char* fbxFilename, const char* meshFilename);
+	static bool WriteCookedModel(ModelLoader& loader, const char* meshFilename);
+
+	// makes the buffers and textures from a model that's already been read in, which is all that has to happen on the
+	// thread with the device. filename is where it came from, the textures are looked for next to it
+	bool CreateFromLoader(ModelLoader& loader, const char* filename);
+	bool CreateFromMeshFile(const MeshFile& meshFile, const char* filename);
+	bool IsLoaded()const;		// false until the buffers have been made
+
+	// picks the coarsest level of detail whose error projects to no more than the pixel error from where the camera is,
+	// call once per frame. fovY is the vertical field of view of the projection
+	void UpdateLOD(const Vector3f& cameraPos, float fovY, int screenHeight);
+	void SetLodPixelError(float pixelError);
+
+	// the run of the index buffer to draw for the level picked
+	int  GetLod();
+	UINT GetLodStartIndex();
+	int  GetLodIndexCount();
+
+	// the level picked is drawn a material at a time, with the buffers bound once - each batch is a run of the index
+	// buffer and the diffuse texture of its material, or the object's own one if the material hasn't got one
+	int  GetBatchCount();
+	UINT GetBatchStartIndex(int which);
+	int  GetBatchIndexCount(int which);
+	ID3D10ShaderResourceView* GetBatchTexture(int which);
+
+	// skinned models are posed on the CPU. Animate plays the clips, skins the vertices and fits the object's bounds round
+	// them, touching nothing but the object, so lots of models can be animated at once on the workers with AnimateModels.
+	// UpdateSkinnedVertices then copies the result into the vertex buffer, which has to be done on the thread with the
+	// device. Models start on their first clip
+	bool IsSkinned()const;
+	int  GetClipCount()const;
+	int  FindClip(const char* name)const;		// -1 if there isn't one called that
+	void PlayClip(int clip, float blendTime = DEFAULT_CLIP_BLEND_TIME, bool loop = true);
+	void SetAnimationSpeed(float speed);
+	void Animate(float dt);
+	void UpdateSkinnedVertices();
+	static void AnimateModels(ModelObject** models, int count, float dt);
 
 private:
+	void SetLods(const MeshLod* lodData, int lodCount, const MeshBatch* batchData, int batchCount);
+	// the textures are looked for next to the model file, whatever directory they were in when it was made
+	void LoadMaterials(const char* filename, const MeshMaterial* materialData, int materialCount);
+	void ReleaseMaterials();
+	// keeps the vertices as they were skinned and everything needed to move them, null skinData for a model without a skin
+	void SetSkin(const VertexNT* vertexData, const VertexSkin* skinData, const MeshBone* boneData, int boneCount,
+				 const MeshClip* clipData, int clipCount, const MeshTrack* trackData, int trackCount, const MeshKey* keyData, int keyCount);
+	static void AnimateRange(int first, int last, void* data);
+
 	ModelLoader *modelLoader;
+	std::vector<MeshLod> lods;
+	std::vector<MeshBatch> batches;
+	std::vector<MeshMaterial> materials;
+	std::vector<TextureLoader*> materialTextures;	// null for a material without a texture that could be loaded
+	int currentLod;
+	float lodPixelError;
+
+	std::vector<VertexNT> bindVertices;		// as they were skinned
+	std::vector<VertexNT> skinnedVertices;	// where the bones have moved them to, waiting to go into the vertex buffer
+	std::vector<VertexSkin> skin;
+	std::vector<MeshBone> bones;
+	std::vector<MeshClip> clips;
+	std::vector<MeshTrack> tracks;
+	std::vector<MeshKey> keys;
+	AnimationPlayer animation;				// plays from the arrays above
+	bool skinnedVerticesChanged;
 };
 
 
-#endif
\ No newline at end of file
+#endif
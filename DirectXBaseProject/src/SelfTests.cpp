@@ -0,0 +1,364 @@
+#include "SelfTests.h"
+#include "Grid.h"
+#include "MeshSimplifier.h"
+#include "VertexWelder.h"
+#include "Animation.h"
+#include "AnimationCompressor.h"
+#include <iostream>
+#include <iomanip>
+#include <sstream>
+#include <algorithm>
+#include <map>
+#include <set>
+#include <string.h>
+#include <math.h>
+
+static bool Report(const char* name, bool passed){
+	std::cout << "  " << name << (passed ? ": passed" : ": FAILED") << std::endl;
+	return passed;
+}
+
+/////////////////////////////////////////////////////////////////////////
+// THREADING
+/////////////////////////////////////////////////////////////////////////
+
+//the bands of a grid are built on whichever workers pick them up, which mustn't change a byte of the mesh
+static bool TestParallelGridBuild(){
+	return Report("grid built on 1 thread and on 7 matches", Grid::CheckParallelBuild(SELFTEST_GRID_WIDTH, SELFTEST_GRID_DEPTH, SELFTEST_THREADS));
+}
+
+//the noise, thermal passes and droplets of an eroded terrain all run on the pool, and each job only ever writes
+//the heights it owns, so the terrain has to come out the same whether there's one thread or several
+static bool TestParallelErosion(){
+	TerrainGenSettings settings;
+	settings.thermalIterations = SELFTEST_THERMAL_PASSES;
+	settings.droplets = SELFTEST_DROPLETS;
+	int count = SELFTEST_EROSION_WIDTH*SELFTEST_EROSION_DEPTH;
+	std::vector<float> serialHeights(count), parallelHeights(count), noise(count);
+
+	//a pool that was never initialized runs every job in order on this thread
+	ThreadPool serial, parallel;
+	bool passed = parallel.Initialize(SELFTEST_THREADS);
+	TerrainGenerator(settings.seed, &serial).Generate(&serialHeights[0], SELFTEST_EROSION_WIDTH, SELFTEST_EROSION_DEPTH, settings);
+	TerrainGenerator(settings.seed, &parallel).Generate(&parallelHeights[0], SELFTEST_EROSION_WIDTH, SELFTEST_EROSION_DEPTH, settings);
+	TerrainGenerator(settings.seed, &serial).GenerateNoise(&noise[0], SELFTEST_EROSION_WIDTH, SELFTEST_EROSION_DEPTH, settings);
+
+	int different = 0;
+	float moved = 0.0f;
+	for (int i = 0; i < count; i++){
+		different += memcmp(&serialHeights[i], &parallelHeights[i], sizeof(float)) != 0;
+		moved = Max(moved, fabsf(serialHeights[i] - noise[i]));
+	}
+	//the erosion has to have done something or there's nothing to compare
+	passed = passed && different == 0 && moved > 0.0f;
+
+	std::cout << std::fixed << std::setprecision(3) << "  " << SELFTEST_DROPLETS << " droplets and " << SELFTEST_THERMAL_PASSES <<
+				 " thermal passes moved heights up to " << moved << ", " << different << " heights differ" << std::endl;
+	return Report("terrain eroded on 1 thread and on 7 matches", passed);
+}
+
+/////////////////////////////////////////////////////////////////////////
+// DEFORMING
+/////////////////////////////////////////////////////////////////////////
+
+//a deform only rebuilds the vertices round it, and has to leave the grid as if it had all been built again
+static bool TestDeform(){
+	return Report("deformed grid matches a full rebuild", Grid::CheckDeform(SELFTEST_DEFORM_WIDTH, SELFTEST_DEFORM_DEPTH));
+}
+
+/////////////////////////////////////////////////////////////////////////
+// TILING
+/////////////////////////////////////////////////////////////////////////
+
+static bool TestTilePaging(){
+	int loads, evictions;
+	bool passed = Grid::CheckTilePaging(SELFTEST_TILES, SELFTEST_TILE_SIZE, SELFTEST_TILE_BUDGET, SELFTEST_TILE_FRAMES, loads, evictions);
+	std::cout << "  " << SELFTEST_TILES*SELFTEST_TILES << " tiles, room for " << SELFTEST_TILE_BUDGET << ": " << loads <<
+				 " loaded and " << evictions << " evicted over " << SELFTEST_TILE_FRAMES << " frames" << std::endl;
+	return Report("tiles paged within the budget, least recently used first", passed);
+}
+
+/////////////////////////////////////////////////////////////////////////
+// SIMPLIFIER
+/////////////////////////////////////////////////////////////////////////
+
+//a closed mesh made in rings of vertices, with the first of each repeated at the end so the texture coordinates wrap.
+//The repeats are worked out from the same angles as the first so they land in exactly the same place
+struct ClosedMesh
+{
+	const char*				name;
+	std::vector<VertexNT>	vertices;
+	std::vector<DWORD>		indices;
+	bool					sphere;			// around the origin, otherwise a torus around the y axis
+};
+
+//a torus of 2*rings*sides triangles, which has no pole so every quad makes two
+static void MakeTorus(int rings, int sides, ClosedMesh& mesh){
+	mesh.name = "torus";
+	mesh.sphere = false;
+	for (int i = 0; i <= rings; i++){
+		float u = 2.0f*PI*(i % rings)/rings;
+		for (int j = 0; j <= sides; j++){
+			float v = 2.0f*PI*(j % sides)/sides;
+			Vector3f normal(cosf(u)*cosf(v), sinf(v), sinf(u)*cosf(v));
+			Vector3f pos(cosf(u)*SELFTEST_TORUS_RADIUS, 0.0f, sinf(u)*SELFTEST_TORUS_RADIUS);
+			VertexNT vertex = {pos + normal*SELFTEST_TUBE_RADIUS, normal, Vector2f((float)i/rings, (float)j/sides)};
+			mesh.vertices.push_back(vertex);
+		}
+	}
+	for (int i = 0; i < rings; i++){
+		for (int j = 0; j < sides; j++){
+			DWORD a = i*(sides + 1) + j, b = a + 1, c = a + sides + 1, d = c + 1;
+			DWORD quad[6] = {a, b, c, c, b, d};
+			mesh.indices.insert(mesh.indices.end(), quad, quad + 6);
+		}
+	}
+}
+
+//a UV sphere - the first and last stacks have a triangle a slice since the corners at the pole are all in one place
+static void MakeSphere(int slices, int stacks, ClosedMesh& mesh){
+	mesh.name = "sphere";
+	mesh.sphere = true;
+	for (int s = 0; s <= stacks; s++){
+		float v = PI*s/stacks;
+		float ringRadius = (s == 0 || s == stacks) ? 0.0f : sinf(v);
+		float y = s == 0 ? 1.0f : (s == stacks ? -1.0f : cosf(v));
+		for (int i = 0; i <= slices; i++){
+			float u = 2.0f*PI*(i % slices)/slices;
+			Vector3f normal(cosf(u)*ringRadius, y, sinf(u)*ringRadius);
+			VertexNT vertex = {normal, normal, Vector2f((float)i/slices, (float)s/stacks)};
+			mesh.vertices.push_back(vertex);
+		}
+	}
+	for (int s = 0; s < stacks; s++){
+		for (int i = 0; i < slices; i++){
+			DWORD a = s*(slices + 1) + i, b = a + 1, c = a + slices + 1, d = c + 1;
+			if (s != 0){
+				DWORD triangle[3] = {a, b, c};
+				mesh.indices.insert(mesh.indices.end(), triangle, triangle + 3);
+			}
+			if (s != stacks - 1){
+				DWORD triangle[3] = {c, b, d};
+				mesh.indices.insert(mesh.indices.end(), triangle, triangle + 3);
+			}
+		}
+	}
+}
+
+//counts what's wrong with the triangles as a closed surface. Vertices are told apart by position, since the seams
+//of the texture coordinates have two at the same place
+static void CheckClosedMesh(const ClosedMesh& mesh, const DWORD* indices, int indexCount, int& duplicated, int& inverted, int& openOrShared){
+	std::map<std::vector<float>, int> positions;
+	std::vector<int> position(mesh.vertices.size());
+	for (unsigned int v = 0; v < mesh.vertices.size(); v++){
+		const Vector3f& p = mesh.vertices[v].pos;
+		std::vector<float> key(3);
+		key[0] = p.x; key[1] = p.y; key[2] = p.z;
+		std::map<std::vector<float>, int>::iterator found = positions.insert(std::make_pair(key, (int)positions.size())).first;
+		position[v] = found->second;
+	}
+
+	std::set<std::vector<int> > triangles;
+	std::map<std::pair<int, int>, int> edges;
+	duplicated = inverted = openOrShared = 0;
+	for (int i = 0; i < indexCount; i += 3){
+		std::vector<int> corners(3);
+		for (int k = 0; k < 3; k++){
+			corners[k] = position[indices[i + k]];
+			int next = position[indices[i + (k + 1) % 3]];
+			edges[std::make_pair(Min(corners[k], next), Max(corners[k], next))]++;
+		}
+		std::sort(corners.begin(), corners.end());
+		if (corners[0] == corners[1] || corners[1] == corners[2] || !triangles.insert(corners).second)
+			duplicated++;
+
+		//the triangle has to face the same way as the surface it was made from at its middle
+		const Vector3f& a = mesh.vertices[indices[i]].pos;
+		const Vector3f& b = mesh.vertices[indices[i + 1]].pos;
+		const Vector3f& c = mesh.vertices[indices[i + 2]].pos;
+		Vector3f normal, edge1 = b - a, edge2 = c - a, middle = (a + b + c)/3.0f, outward = middle;
+		D3DXVec3Cross(&normal, &edge1, &edge2);
+		if (!mesh.sphere){
+			Vector3f axis(middle.x, 0.0f, middle.z);
+			D3DXVec3Normalize(&axis, &axis);
+			outward = middle - axis*SELFTEST_TORUS_RADIUS;
+		}
+		if (D3DXVec3Dot(&normal, &outward) <= 0.0f)
+			inverted++;
+	}
+	for (std::map<std::pair<int, int>, int>::iterator e = edges.begin(); e != edges.end(); e++){
+		if (e->second != 2)
+			openOrShared++;
+	}
+}
+
+//each level is half the one before, the way ModelLoader simplifies its levels of detail. A closed mesh has to stay
+//closed, with no triangle on top of another, no edge between more than two and none turned inside out
+static bool TestSimplifierClosedMesh(ClosedMesh& mesh){
+	std::vector<DWORD> source(mesh.indices);
+	bool passed = true;
+	for (int level = 1; level <= SELFTEST_SIMPLIFY_LEVELS; level++){
+		std::vector<DWORD> simplified(source.size());
+		int count = SimplifyMesh(&source[0], source.size(), &mesh.vertices[0], mesh.vertices.size(), source.size()/2, &simplified[0]);
+		simplified.resize(count);
+
+		int duplicated, inverted, openOrShared;
+		CheckClosedMesh(mesh, &simplified[0], count, duplicated, inverted, openOrShared);
+		bool ok = duplicated == 0 && inverted == 0 && openOrShared == 0;
+		std::cout << "  " << mesh.name << " 1/" << (1 << level) << ": " << count/3 << " of " << mesh.indices.size()/3 << " triangles, " <<
+					 duplicated << " duplicated, " << inverted << " inverted, " << openOrShared << " edges not between two" <<
+					 (ok ? "" : " FAILED") << std::endl;
+		passed = passed && ok;
+		source.swap(simplified);
+	}
+	return passed;
+}
+
+static bool TestSimplifier(){
+	ClosedMesh torus, sphere;
+	MakeTorus(SELFTEST_TORUS_RINGS, SELFTEST_TORUS_SIDES, torus);
+	MakeSphere(SELFTEST_SPHERE_SLICES, SELFTEST_SPHERE_STACKS, sphere);
+
+	//the meshes have to pass before they're simplified for the check to mean anything
+	int duplicated, inverted, openOrShared;
+	CheckClosedMesh(torus, &torus.indices[0], torus.indices.size(), duplicated, inverted, openOrShared);
+	bool passed = duplicated + inverted + openOrShared == 0;
+	CheckClosedMesh(sphere, &sphere.indices[0], sphere.indices.size(), duplicated, inverted, openOrShared);
+	passed = passed && duplicated + inverted + openOrShared == 0;
+	Report("generated torus and sphere are closed", passed);
+
+	passed = TestSimplifierClosedMesh(torus) && passed;
+	passed = TestSimplifierClosedMesh(sphere) && passed;
+	return Report("simplified closed meshes stay closed", passed);
+}
+
+/////////////////////////////////////////////////////////////////////////
+// WELDING
+/////////////////////////////////////////////////////////////////////////
+
+//two corners of a skinned mesh in exactly the same place only become one vertex if the same bones move them
+static bool TestSkinnedWelding(){
+	VertexNT corner = {Vector3f(1.0f, 2.0f, 3.0f), Vector3f(0.0f, 1.0f, 0.0f), Vector2f(0.5f, 0.5f)};
+	VertexSkin skins[2];
+	memset(skins, 0, sizeof(skins));
+	skins[0].bones[0] = 1;
+	skins[0].weights[0] = 1.0f;
+	skins[1].bones[0] = 2;
+	skins[1].weights[0] = 1.0f;
+
+	std::vector<VertexNT> vertices;
+	std::vector<VertexSkin> vertexSkins;
+	VertexWelder welder;
+	welder.Begin(&vertices, 4, &vertexSkins);
+	DWORD first = welder.Add(corner, &skins[0]);
+	DWORD second = welder.Add(corner, &skins[1]);
+	DWORD again = welder.Add(corner, &skins[0]);
+
+	bool passed = first != second && again == first && vertices.size() == 2 && vertexSkins.size() == 2 &&
+				  vertexSkins[second].bones[0] == 2;
+	return Report("skinned corners only weld with the same bones", passed);
+}
+
+/////////////////////////////////////////////////////////////////////////
+// ANIMATION COMPRESSION
+/////////////////////////////////////////////////////////////////////////
+
+//a branching skeleton a unit between joints, with a clip that has a bit of everything - bones swinging at different
+//speeds, bones that never move, a root that walks and bobs and a bone that grows and shrinks
+static void MakeTestClip(std::vector<MeshBone>& bones, MeshClip& clip, std::vector<BonePose>& poses){
+	bones.resize(SELFTEST_BONES);
+	for (int b = 0; b < SELFTEST_BONES; b++){
+		MeshBone& bone = bones[b];
+		memset(&bone, 0, sizeof(bone));
+		std::ostringstream name;
+		name << "bone" << b;
+		strncpy(bone.name, name.str().c_str(), MESH_NAME_LENGTH - 1);
+		bone.parent = b == 0 ? -1 : (b - 1)/2;
+		D3DXMatrixIdentity(&bone.inverseBind);
+		D3DXQuaternionIdentity(&bone.bindPose.rotation);
+		bone.bindPose.translation = b == 0 ? Vector3f(0.0f, 0.0f, 0.0f) : Vector3f(0.0f, 1.0f, 0.0f);
+		bone.bindPose.scale = Vector3f(1.0f, 1.0f, 1.0f);
+	}
+
+	memset(&clip, 0, sizeof(clip));
+	strncpy(clip.name, "test", MESH_NAME_LENGTH - 1);
+	clip.frameRate = 30.0f;
+	clip.frameCount = SELFTEST_FRAMES;
+	clip.duration = (SELFTEST_FRAMES - 1)/clip.frameRate;
+
+	poses.resize(SELFTEST_FRAMES*SELFTEST_BONES);
+	for (int f = 0; f < SELFTEST_FRAMES; f++){
+		float time = f/clip.frameRate;
+		for (int b = 0; b < SELFTEST_BONES; b++){
+			BonePose& pose = poses[f*SELFTEST_BONES + b];
+			pose = bones[b].bindPose;
+			if (b % 4 != 3){
+				Vector3f axis(1.0f, (b % 5)*0.3f, 0.2f);
+				D3DXQuaternionRotationAxis(&pose.rotation, &axis, 0.6f*sinf(time*(1.0f + b*0.25f) + b));
+			}
+			if (b == 0)
+				pose.translation = Vector3f(0.0f, 0.2f*sinf(time*6.0f), time*1.5f);
+			if (b == 5)
+				pose.scale = Vector3f(1.0f, 1.0f, 1.0f)*(1.0f + 0.1f*sinf(time*2.0f));
+		}
+	}
+}
+
+//every frame sampled back out of the compressed clip has to be within the tolerance of the frame it came from, channel
+//by channel, every joint within the joint tolerance of where the frame put it, and the clip has to come out smaller than it went in
+static bool TestAnimationCompression(){
+	std::vector<MeshBone> bones;
+	MeshClip clip;
+	std::vector<BonePose> poses;
+	MakeTestClip(bones, clip, poses);
+
+	AnimationTolerance tolerance = GetDefaultTolerance(&bones[0], SELFTEST_BONES);
+	std::vector<MeshTrack> tracks;
+	std::vector<MeshKey> keys;
+	AnimationCompressionStats stats;
+	CompressClip(clip, &poses[0], &bones[0], SELFTEST_BONES, tolerance, tracks, keys, &stats);
+
+	float maxError[CHANNEL_COUNT] = {0.0f, 0.0f, 0.0f};
+	std::vector<BonePose> sampled(SELFTEST_BONES);
+	for (int f = 0; f < SELFTEST_FRAMES; f++){
+		SampleClip(clip, &tracks[0], &keys[0], SELFTEST_BONES, f/clip.frameRate, false, &sampled[0]);
+		for (int b = 0; b < SELFTEST_BONES; b++){
+			const BonePose& raw = poses[f*SELFTEST_BONES + b];
+			const BonePose& got = sampled[b];
+			Vector3f moved = raw.translation - got.translation;
+			Vector3f scaled = raw.scale - got.scale;
+			maxError[CHANNEL_ROTATION] = Max(maxError[CHANNEL_ROTATION], RotationAngle(raw.rotation, got.rotation));
+			maxError[CHANNEL_TRANSLATION] = Max(maxError[CHANNEL_TRANSLATION], D3DXVec3Length(&moved));
+			maxError[CHANNEL_SCALE] = Max(maxError[CHANNEL_SCALE], Max(Max(fabsf(scaled.x), fabsf(scaled.y)), fabsf(scaled.z)));
+		}
+	}
+
+	//the sampler's time to frame conversion can land a hair off the frame, so a hair over the tolerance is let through
+	const float tolerances[CHANNEL_COUNT] = {tolerance.rotation, tolerance.translation, tolerance.scale};
+	bool passed = stats.ratio > 1.0f && stats.maxJointError <= tolerance.joint;
+	for (int c = 0; c < CHANNEL_COUNT; c++)
+		passed = passed && maxError[c] <= tolerances[c]*1.001f + 1e-6f;
+
+	std::cout << std::fixed << std::setprecision(2) << "  " << SELFTEST_BONES << " bones, " << SELFTEST_FRAMES << " frames: " <<
+				 stats.rawBytes << " bytes down to " << stats.compressedBytes << ", " << stats.ratio << ":1, max joint error " <<
+				 std::setprecision(6) << stats.maxJointError << " of " << tolerance.joint << std::endl;
+	std::cout << "  rotation error " << maxError[CHANNEL_ROTATION] << " of " << tolerance.rotation << ", translation " <<
+				 maxError[CHANNEL_TRANSLATION] << " of " << tolerance.translation << ", scale " << maxError[CHANNEL_SCALE] <<
+				 " of " << tolerance.scale << std::endl;
+	return Report("compressed clip within its tolerance", passed);
+}
+
+/////////////////////////////////////////////////////////////////////////
+
+bool RunSelfTests(){
+	bool passed = true;
+	passed = TestParallelGridBuild() && passed;
+	passed = TestParallelErosion() && passed;
+	passed = TestDeform() && passed;
+	passed = TestTilePaging() && passed;
+	passed = TestSimplifier() && passed;
+	passed = TestSkinnedWelding() && passed;
+	passed = TestAnimationCompression() && passed;
+	std::cout << (passed ? "All checks passed" : "Some checks FAILED") << std::endl;
+	return passed;
+}
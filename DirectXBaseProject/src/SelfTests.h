@@ -0,0 +1,36 @@
+#ifndef _H_SELFTESTS
+#define _H_SELFTESTS
+
+///CHECKS RUN FROM THE CONSOLE WITH -test INSTEAD OF STARTING THE GAME, FOR WHAT CAN GO WRONG WITHOUT ANYTHING ON SCREEN
+///SHOWING IT. NONE OF THEM NEED A DEVICE OR ANY ASSETS - THEY MAKE WHAT THEY CHECK
+
+const int SELFTEST_GRID_WIDTH	= 1000;		// sides of the generated terrain the parallel build is checked on, not a
+const int SELFTEST_GRID_DEPTH	= 700;		// whole number of bands so the last band is a short one
+const int SELFTEST_THREADS		= 7;		// workers the parallel build runs on, whatever the machine has
+const int SELFTEST_EROSION_WIDTH	= 300;		// sides of the terrain the erosion is checked on, not a whole
+const int SELFTEST_EROSION_DEPTH	= 200;		// number of erosion blocks or bands
+const int SELFTEST_THERMAL_PASSES	= 25;
+const int SELFTEST_DROPLETS			= 60000;
+const int SELFTEST_DEFORM_WIDTH		= 150;		// sides of the terrain the deforms are checked on
+const int SELFTEST_DEFORM_DEPTH		= 110;
+
+const int SELFTEST_TILES			= 8;		// tiles along each side of the terrain the paging is checked on
+const int SELFTEST_TILE_SIZE		= 16;		// quads along each side of a tile
+const int SELFTEST_TILE_BUDGET		= 6;		// tiles that fit the budget, the camera never has more than 4 in reach
+const int SELFTEST_TILE_FRAMES		= 400;		// two and a half times round
+
+const int SELFTEST_TORUS_RINGS		= 120;		// 14400 triangles
+const int SELFTEST_TORUS_SIDES		= 60;
+const float SELFTEST_TORUS_RADIUS	= 1.0f;
+const float SELFTEST_TUBE_RADIUS	= 0.35f;
+const int SELFTEST_SPHERE_SLICES	= 80;		// 9440 triangles
+const int SELFTEST_SPHERE_STACKS	= 60;
+const int SELFTEST_SIMPLIFY_LEVELS	= 4;		// halved each time, down to a sixteenth
+
+const int SELFTEST_BONES			= 24;		// in the skeleton the compressed clip moves
+const int SELFTEST_FRAMES			= 121;		// four seconds at 30 frames a second
+
+// prints what each check measured and whether it passed. Returns false if any of them failed
+bool RunSelfTests();
+
+#endif
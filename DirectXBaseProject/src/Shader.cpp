@@ -218,20 +218,26 @@ void Shader::SetShaderParameters(D3DXMATRIX worldMatrix, D3DXMATRIX viewMatrix,
 }
 
 //RenderShader will invoke the HLSL shader program through the technique pointer.
-void Shader::RenderShader(ID3D10Device* device, int indexCount)
+void Shader::RenderShader(ID3D10Device* device, int indexCount, UINT startIndex, INT baseVertex)
+{
+	RenderShader(device, mTechnique, mLayout, indexCount, startIndex, baseVertex);
+}
+
+//the same with a technique and input layout other than the shader's main ones
+void Shader::RenderShader(ID3D10Device* device, ID3D10EffectTechnique* technique, ID3D10InputLayout* layout, int indexCount, UINT startIndex, INT baseVertex)
 {
 	D3D10_TECHNIQUE_DESC techniqueDesc;
 
 	// Set the input layout.
-	device->IASetInputLayout(mLayout);
+	device->IASetInputLayout(layout);
 
 	// Get the description structure of the technique from inside the shader so it can be used for rendering.
-	mTechnique->GetDesc(&techniqueDesc);
+	technique->GetDesc(&techniqueDesc);
 
 	// Go through each pass in the technique (should be just one currently) and render the triangles.
 	for(unsigned int i = 0; i < techniqueDesc.Passes; i++)
 	{
-		mTechnique->GetPassByIndex(i)->Apply(0);
-		device->DrawIndexed(indexCount, 0, 0);
+		technique->GetPassByIndex(i)->Apply(0);
+		device->DrawIndexed(indexCount, startIndex, baseVertex);
 	}
 }
\ No newline at end of file
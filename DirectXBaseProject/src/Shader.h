@@ -25,7 +25,8 @@ protected:
 	void OutputShaderErrorMessage(ID3D10Blob* errorMessage, HWND hwnd, WCHAR* shaderFilename);
 
 	void SetShaderParameters(D3DXMATRIX worldMatrix, D3DXMATRIX viewMatrix, D3DXMATRIX projectionMatrix);
-	void RenderShader(ID3D10Device* device, int indexCount);
+	void RenderShader(ID3D10Device* device, int indexCount, UINT startIndex = 0, INT baseVertex = 0);
+	void RenderShader(ID3D10Device* device, ID3D10EffectTechnique* technique, ID3D10InputLayout* layout, int indexCount, UINT startIndex, INT baseVertex);
 
 protected:
 	ID3D10Effect* mEffect;
@@ -0,0 +1,17 @@
+#ifndef _SIMDMATH_H
+#define _SIMDMATH_H
+
+///PICKS THE VECTOR INSTRUCTION SET THE KERNELS ARE BUILT WITH
+//SSE2 is there on every x86/x64 target we build for. AVX is only used when the compiler is told it may
+//(/arch:AVX defines __AVX__). Define NO_SIMD to build the scalar fallbacks instead, e.g. for comparing results.
+
+#if !defined(NO_SIMD) && (defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2) || defined(__SSE2__))
+	#define USE_SSE 1
+	#include <emmintrin.h>
+	#if defined(__AVX__)
+		#define USE_AVX 1
+		#include <immintrin.h>
+	#endif
+#endif
+
+#endif
@@ -0,0 +1,124 @@
+#include "TerrainCache.h"
+#include <stdio.h>
+
+
+TerrainCache::TerrainCache(void){
+	header = nullptr;
+}
+
+TerrainCache::~TerrainCache(void){
+	Close();
+}
+
+void TerrainCache::Close(){
+	file.Close();
+	header = nullptr;
+}
+
+bool TerrainCache::Load(const char* filename, const TerrainCacheKey& key){
+	Close();
+
+	if (!file.Open(filename))
+		return false;
+
+	if (file.GetSize() < sizeof(Header)){
+		Close();
+		return false;
+	}
+
+	const Header* h = (const Header*)file.GetData();
+	if (h->magic != TERRAIN_CACHE_MAGIC || h->version != TERRAIN_CACHE_VERSION || h->vertexSize != sizeof(VertexNT) ||
+		memcmp(&h->key, &key, sizeof(TerrainCacheKey)) != 0 || h->width < 2 || h->depth < 2){
+		Close();
+		return false;
+	}
+
+	//a cache cut short while it was being written is just as useless as a stale one
+	UINT64 expected = sizeof(Header) + (UINT64)h->width*h->depth*sizeof(float) +
+					  (UINT64)h->vertexCount*sizeof(VertexNT) + (UINT64)h->indexCount*sizeof(DWORD);
+	if (expected != file.GetSize()){
+		Close();
+		return false;
+	}
+
+	header = h;
+	return true;
+}
+
+bool TerrainCache::Save(const char* filename, const TerrainCacheKey& key, int width, int depth, float maxHeight, const float* heights,
+						const VertexNT* vertices, DWORD vertexCount, const DWORD* indices, DWORD indexCount){
+	Header h;
+	memset(&h, 0, sizeof(h));
+	h.magic = TERRAIN_CACHE_MAGIC;
+	h.version = TERRAIN_CACHE_VERSION;
+	h.vertexSize = sizeof(VertexNT);
+	h.key = key;
+	h.width = width;
+	h.depth = depth;
+	h.maxHeight = maxHeight;
+	h.vertexCount = vertices ? vertexCount : 0;
+	h.indexCount = indices ? indexCount : 0;
+
+	FILE *fp = fopen(filename, "wb");
+	if (!fp)
+		return false;
+
+	bool result = fwrite(&h, sizeof(h), 1, fp) == 1 &&
+				  fwrite(heights, sizeof(float), width*depth, fp) == (size_t)(width*depth) &&
+				  fwrite(vertices, sizeof(VertexNT), h.vertexCount, fp) == h.vertexCount &&
+				  fwrite(indices, sizeof(DWORD), h.indexCount, fp) == h.indexCount;
+
+	if (fclose(fp) != 0)
+		result = false;
+
+	//don't leave a broken cache behind, it would only be rejected on every run
+	if (!result)
+		remove(filename);
+	return result;
+}
+
+UINT64 TerrainCache::Hash(const void* data, size_t size, UINT64 seed){
+	const unsigned char* bytes = (const unsigned char*)data;
+	UINT64 hash = seed;
+	for (size_t i = 0; i < size; i++){
+		hash ^= bytes[i];
+		hash *= 1099511628211ULL;
+	}
+	return hash;
+}
+
+int TerrainCache::GetWidth()const{
+	return header ? header->width : 0;
+}
+
+int TerrainCache::GetDepth()const{
+	return header ? header->depth : 0;
+}
+
+float TerrainCache::GetMaxHeight()const{
+	return header ? header->maxHeight : 0.0f;
+}
+
+const float* TerrainCache::GetHeights()const{
+	return header ? (const float*)(header + 1) : nullptr;
+}
+
+const VertexNT* TerrainCache::GetVertices()const{
+	if (!header || header->vertexCount == 0)
+		return nullptr;
+	return (const VertexNT*)(GetHeights() + header->width*header->depth);
+}
+
+DWORD TerrainCache::GetVertexCount()const{
+	return header ? header->vertexCount : 0;
+}
+
+const DWORD* TerrainCache::GetIndices()const{
+	if (!header || header->indexCount == 0)
+		return nullptr;
+	return (const DWORD*)((const unsigned char*)(GetHeights() + header->width*header->depth) + header->vertexCount*sizeof(VertexNT));
+}
+
+DWORD TerrainCache::GetIndexCount()const{
+	return header ? header->indexCount : 0;
+}
@@ -0,0 +1,83 @@
+/////////////////////////////////////////////////////////////////////////
+// TERRAIN CACHE - THE BUILT TERRAIN SAVED TO DISK SO IT CAN BE MAPPED BACK IN ON THE NEXT RUN
+/////////////////////////////////////////////////////////////////////////
+
+#ifndef _TERRAINCACHE_H
+#define _TERRAINCACHE_H
+
+#include "d3dUtil.h"
+#include "Vertex.h"
+#include "MappedFile.h"
+
+const unsigned int TERRAIN_CACHE_MAGIC		= 0x434E5254;	// "TRNC"
+const unsigned int TERRAIN_CACHE_VERSION	= 2;			// bump whenever the layout or the way the terrain is built changes
+
+// everything the built terrain depends on - a cache is only used if all of it matches
+struct TerrainCacheKey
+{
+	UINT64				sourceHash;			// hash of the heightmap file's contents
+	float				heightFactor;
+	float				cellSpacing;
+	int					textureRepeat;
+	int					smoothKernel;
+	int					smoothIterations;
+	float				smoothAmount;
+	int					sourceFormat;		// -1 for a TGA, otherwise the HEIGHTMAP_FORMAT of a raw heightmap
+	int					sourceWidth;		// dimensions given for a raw heightmap
+	int					sourceDepth;
+	int					pad;
+};
+
+/*
+File layout - all of it little endian and 4 byte aligned so the arrays can be used straight out of the mapped view
+	Header
+	float		heights[width*depth]
+	VertexNT	vertices[vertexCount]	(none if the terrain was tiled)
+	DWORD		indices[indexCount]		(none if the terrain was tiled or geomipmapped)
+*/
+class TerrainCache
+{
+public:
+	TerrainCache(void);
+	~TerrainCache(void);
+
+	// maps the cache and checks it was written by this version for the same key, returns false if it can't be used
+	bool	Load(const char* filename, const TerrainCacheKey& key);
+	void	Close();
+
+	static bool Save(const char* filename, const TerrainCacheKey& key, int width, int depth, float maxHeight, const float* heights,
+					 const VertexNT* vertices, DWORD vertexCount, const DWORD* indices, DWORD indexCount);
+
+	// 64 bit FNV-1a, pass the previous result as the seed to carry on hashing more data
+	static UINT64 Hash(const void* data, size_t size, UINT64 seed = 14695981039346656037ULL);
+
+	// the arrays point into the mapped file and stay valid until it's closed
+	int					GetWidth()const;
+	int					GetDepth()const;
+	float				GetMaxHeight()const;
+	const float*		GetHeights()const;
+	const VertexNT*		GetVertices()const;
+	DWORD				GetVertexCount()const;
+	const DWORD*		GetIndices()const;
+	DWORD				GetIndexCount()const;
+
+private:
+	struct Header
+	{
+		unsigned int		magic;
+		unsigned int		version;
+		unsigned int		vertexSize;		// sizeof(VertexNT) when it was written
+		unsigned int		pad;
+		TerrainCacheKey		key;
+		int					width, depth;
+		float				maxHeight;
+		DWORD				vertexCount;
+		DWORD				indexCount;
+		unsigned int		pad2;
+	};
+
+	MappedFile		file;
+	const Header	*header;
+};
+
+#endif
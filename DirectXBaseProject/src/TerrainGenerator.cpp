@@ -0,0 +1,524 @@
+#include "TerrainGenerator.h"
+#include "ThreadPool.h"
+#include <math.h>
+#include <string.h>
+#include <vector>
+
+const int	GENERATE_BAND_ROWS		= 16;		// rows per job
+const int	MAX_ROW_CHUNK			= 256;		// columns of noise worked out at a time
+
+const float	THERMAL_RATE			= 0.125f;	// share of the excess slope moved to each lower neighbour per pass
+
+const int	HYDRAULIC_BLOCK			= 64;		// droplets stay inside their own block of cells
+const int	HYDRAULIC_ROUNDS		= 4;		// the blocks shift by half a block between rounds so no seams form along them
+const int	DROPLET_LIFETIME		= 30;
+const float	DROPLET_INERTIA			= 0.05f;
+const float	DROPLET_CAPACITY		= 4.0f;
+const float	DROPLET_MIN_CAPACITY	= 0.01f;
+const float	DROPLET_ERODE			= 0.3f;
+const float	DROPLET_DEPOSIT			= 0.3f;
+const float	DROPLET_EVAPORATE		= 0.01f;
+const float	DROPLET_GRAVITY			= 4.0f;
+
+TerrainGenSettings::TerrainGenSettings(){
+	seed = 1;
+	noise = NOISE_PERLIN;
+	octaves = 6;
+	frequency = 1.0f / 128.0f;
+	lacunarity = 2.0f;
+	gain = 0.5f;
+	heightScale = 50.0f;
+	thermalIterations = 0;
+	talus = 0.5f;
+	droplets = 0;
+}
+
+//everything a job on the thread pool needs
+struct TerrainGenerator::Job
+{
+	float						*heights;
+	float						*scratch;		// second copy of the heights for the thermal passes
+	int							rows, cols;
+	const TerrainGenSettings	*settings;
+	const TerrainGenerator		*generator;
+	float						talus;
+
+	//hydraulic erosion
+	int							round;
+	int							blockCols;
+	int							blockOffset;
+	std::vector<int>			blocks;			// blocks of the current phase
+	std::vector<int>			droplets;		// droplets for every block this round
+};
+
+//small fast generator, plenty for shuffling tables and placing droplets
+static unsigned int NextRandom(unsigned int& state){
+	state ^= state << 13;
+	state ^= state >> 17;
+	state ^= state << 5;
+	return state;
+}
+
+static unsigned int MixSeed(unsigned int a, unsigned int b){
+	unsigned int h = a*0x9E3779B9u ^ (b + 0x7F4A7C15u + (a << 6) + (a >> 2));
+	return h ? h : 1;
+}
+
+static inline float Fade(float t){
+	return t*t*t*(t*(t*6.0f - 15.0f) + 10.0f);
+}
+
+TerrainGenerator::TerrainGenerator(unsigned int seed, ThreadPool* pool){
+	this->seed = seed;
+	this->pool = pool;
+	unsigned int state = MixSeed(seed, 0);
+
+	for (int i = 0; i < 256; i++)
+		perm[i] = i;
+	for (int i = 255; i > 0; i--){
+		int j = NextRandom(state) % (i + 1);
+		int swap = perm[i];
+		perm[i] = perm[j];
+		perm[j] = swap;
+	}
+	for (int i = 0; i < 256; i++)
+		perm[256 + i] = perm[i];
+
+	//eight evenly spread unit gradients, and a value between -1 and 1 for value noise
+	for (int i = 0; i < 256; i++){
+		float angle = (i & 7)*(3.14159265f / 4.0f);
+		gradX[i] = cosf(angle);
+		gradY[i] = sinf(angle);
+		values[i] = (NextRandom(state) & 0xFFFF) / 32767.5f - 1.0f;
+	}
+}
+
+float TerrainGenerator::Noise(NOISE_TYPE type, float x, float y)const{
+	int xi = (int)x;
+	int yi = (int)y;
+	float xf = x - (float)xi;
+	float yf = y - (float)yi;
+	int X = xi & 255;
+	int Y = yi & 255;
+
+	int h00 = perm[perm[X] + Y];
+	int h10 = perm[perm[X + 1] + Y];
+	int h01 = perm[perm[X] + Y + 1];
+	int h11 = perm[perm[X + 1] + Y + 1];
+
+	float n00, n10, n01, n11;
+	if (type == NOISE_VALUE){
+		n00 = values[h00];
+		n10 = values[h10];
+		n01 = values[h01];
+		n11 = values[h11];
+	}
+	else{
+		n00 = gradX[h00]*xf + gradY[h00]*yf;
+		n10 = gradX[h10]*(xf - 1.0f) + gradY[h10]*yf;
+		n01 = gradX[h01]*xf + gradY[h01]*(yf - 1.0f);
+		n11 = gradX[h11]*(xf - 1.0f) + gradY[h11]*(yf - 1.0f);
+	}
+
+	float u = Fade(xf);
+	float v = Fade(yf);
+	float top = n00 + (n10 - n00)*u;
+	float bottom = n01 + (n11 - n01)*u;
+	return top + (bottom - top)*v;
+}
+
+//a single octave for count points along a row - the lattice lookups are scalar, the rest four at a time
+void TerrainGenerator::NoiseRow(NOISE_TYPE type, const float* x, float y, int count, float* out)const{
+	int i = 0;
+#if defined(USE_SSE)
+	int yi = (int)y;
+	float yf = y - (float)yi;
+	int Y = yi & 255;
+	float v = Fade(yf);
+	__m128 vyf = _mm_set1_ps(yf);
+	__m128 vyf1 = _mm_set1_ps(yf - 1.0f);
+	__m128 vv = _mm_set1_ps(v);
+	__m128 one = _mm_set1_ps(1.0f);
+	__m128 six = _mm_set1_ps(6.0f);
+	__m128 fifteen = _mm_set1_ps(15.0f);
+	__m128 ten = _mm_set1_ps(10.0f);
+
+	for (; i + 4 <= count; i += 4){
+		__m128 vx = _mm_loadu_ps(x + i);
+		__m128i xi = _mm_cvttps_epi32(vx);		//positive so truncating floors
+		__m128 xf = _mm_sub_ps(vx, _mm_cvtepi32_ps(xi));
+
+		int lattice[4];
+		_mm_storeu_si128((__m128i*)lattice, xi);
+
+		float a00[4], a10[4], a01[4], a11[4];	//corner values, or gradients along x
+		float b00[4], b10[4], b01[4], b11[4];	//gradients along y
+		for (int k = 0; k < 4; k++){
+			int X = lattice[k] & 255;
+			int h00 = perm[perm[X] + Y];
+			int h10 = perm[perm[X + 1] + Y];
+			int h01 = perm[perm[X] + Y + 1];
+			int h11 = perm[perm[X + 1] + Y + 1];
+			if (type == NOISE_VALUE){
+				a00[k] = values[h00];	a10[k] = values[h10];
+				a01[k] = values[h01];	a11[k] = values[h11];
+			}
+			else{
+				a00[k] = gradX[h00];	b00[k] = gradY[h00];
+				a10[k] = gradX[h10];	b10[k] = gradY[h10];
+				a01[k] = gradX[h01];	b01[k] = gradY[h01];
+				a11[k] = gradX[h11];	b11[k] = gradY[h11];
+			}
+		}
+
+		__m128 n00, n10, n01, n11;
+		if (type == NOISE_VALUE){
+			n00 = _mm_loadu_ps(a00);
+			n10 = _mm_loadu_ps(a10);
+			n01 = _mm_loadu_ps(a01);
+			n11 = _mm_loadu_ps(a11);
+		}
+		else{
+			__m128 xf1 = _mm_sub_ps(xf, one);
+			n00 = _mm_add_ps(_mm_mul_ps(_mm_loadu_ps(a00), xf), _mm_mul_ps(_mm_loadu_ps(b00), vyf));
+			n10 = _mm_add_ps(_mm_mul_ps(_mm_loadu_ps(a10), xf1), _mm_mul_ps(_mm_loadu_ps(b10), vyf));
+			n01 = _mm_add_ps(_mm_mul_ps(_mm_loadu_ps(a01), xf), _mm_mul_ps(_mm_loadu_ps(b01), vyf1));
+			n11 = _mm_add_ps(_mm_mul_ps(_mm_loadu_ps(a11), xf1), _mm_mul_ps(_mm_loadu_ps(b11), vyf1));
+		}
+
+		//u = xf^3 (xf (6xf - 15) + 10)
+		__m128 u = _mm_mul_ps(_mm_mul_ps(_mm_mul_ps(xf, xf), xf),
+							  _mm_add_ps(_mm_mul_ps(xf, _mm_sub_ps(_mm_mul_ps(xf, six), fifteen)), ten));
+		__m128 top = _mm_add_ps(n00, _mm_mul_ps(_mm_sub_ps(n10, n00), u));
+		__m128 bottom = _mm_add_ps(n01, _mm_mul_ps(_mm_sub_ps(n11, n01), u));
+		_mm_storeu_ps(out + i, _mm_add_ps(top, _mm_mul_ps(_mm_sub_ps(bottom, top), vv)));
+	}
+#endif
+	for (; i < count; i++){
+		out[i] = Noise(type, x[i], y);
+	}
+}
+
+void TerrainGenerator::GenerateRows(Job* job, int firstRow, int lastRow)const{
+	const TerrainGenSettings& settings = *job->settings;
+	NOISE_TYPE octaveNoise = (settings.noise == NOISE_VALUE) ? NOISE_VALUE : NOISE_PERLIN;
+
+	float x[MAX_ROW_CHUNK], octave[MAX_ROW_CHUNK], sum[MAX_ROW_CHUNK];
+
+	//the amplitudes add up to this, used to bring the sum back to -1..1 (0..1 for ridged)
+	float totalAmplitude = 0.0f;
+	float amplitude = 1.0f;
+	for (int o = 0; o < settings.octaves; o++){
+		totalAmplitude += amplitude;
+		amplitude *= settings.gain;
+	}
+	float scale = (totalAmplitude > 0.0f) ? 1.0f / totalAmplitude : 0.0f;
+
+	for (int row = firstRow; row < lastRow; row++){
+		float* out = job->heights + row*job->cols;
+
+		for (int first = 0; first < job->cols; first += MAX_ROW_CHUNK){
+			int count = (job->cols - first < MAX_ROW_CHUNK) ? job->cols - first : MAX_ROW_CHUNK;
+			memset(sum, 0, count*sizeof(float));
+
+			float frequency = settings.frequency;
+			amplitude = 1.0f;
+			for (int o = 0; o < settings.octaves; o++){
+				//every octave is moved off somewhere else on the lattice so they don't line up at the origin,
+				//far enough that every coordinate stays positive
+				float offset = 1000.0f + 97.31f*o;
+				for (int j = 0; j < count; j++)
+					x[j] = (first + j)*frequency + offset;
+				NoiseRow(octaveNoise, x, row*frequency + offset, count, octave);
+
+				if (settings.noise == NOISE_RIDGED){
+					for (int j = 0; j < count; j++){
+						float ridge = 1.0f - fabsf(octave[j])*1.4f;	//gradient noise peaks at about 0.7
+						ridge = ridge > 0.0f ? ridge : 0.0f;
+						sum[j] += ridge*ridge*amplitude;
+					}
+				}
+				else{
+					for (int j = 0; j < count; j++)
+						sum[j] += octave[j]*amplitude;
+				}
+
+				frequency *= settings.lacunarity;
+				amplitude *= settings.gain;
+			}
+
+			if (settings.noise == NOISE_RIDGED){
+				for (int j = 0; j < count; j++)
+					out[first + j] = sum[j]*scale*settings.heightScale;
+			}
+			else{
+				for (int j = 0; j < count; j++)
+					out[first + j] = (sum[j]*scale*0.5f + 0.5f)*settings.heightScale;
+			}
+		}
+	}
+}
+
+ThreadPool* TerrainGenerator::GetPool()const{
+	return pool ? pool : ThreadPool::GetShared();
+}
+
+void TerrainGenerator::GenerateRowsJob(int first, int last, void* data){
+	Job* job = (Job*)data;
+	job->generator->GenerateRows(job, first, last);
+}
+
+void TerrainGenerator::GenerateNoise(float* heights, int rows, int cols, const TerrainGenSettings& settings){
+	Job job;
+	job.heights = heights;
+	job.scratch = nullptr;
+	job.rows = rows;
+	job.cols = cols;
+	job.settings = &settings;
+	job.generator = this;
+	GetPool()->ParallelFor(rows, GENERATE_BAND_ROWS, GenerateRowsJob, &job);
+}
+
+/*
+Thermal erosion - wherever a neighbour is more than talus lower, part of the difference slides down to it. Every
+cell works out what it gains and loses from the heights before the pass and writes to the other buffer, so the rows
+don't depend on each other and the result doesn't depend on the order they're done in.
+*/
+static inline float ThermalCell(float h, float up, float down, float left, float right, float talus){
+	float n[4] = {up, down, left, right};
+	float change = 0.0f;
+	for (int k = 0; k < 4; k++){
+		float inflow = n[k] - h - talus;
+		float outflow = h - n[k] - talus;
+		change += (inflow > 0.0f ? inflow : 0.0f) - (outflow > 0.0f ? outflow : 0.0f);
+	}
+	return h + change*THERMAL_RATE;
+}
+
+void TerrainGenerator::ThermalRows(Job* job, int firstRow, int lastRow)const{
+	const float* src = job->heights;
+	float* dst = job->scratch;
+	int rows = job->rows;
+	int cols = job->cols;
+	float talus = job->talus;
+
+	for (int row = firstRow; row < lastRow; row++){
+		const float* centre = src + row*cols;
+		const float* up = src + (row > 0 ? row - 1 : row)*cols;
+		const float* down = src + (row < rows - 1 ? row + 1 : row)*cols;
+		float* out = dst + row*cols;
+
+		//the edge columns use themselves as the missing neighbour, which moves nothing
+		out[0] = ThermalCell(centre[0], up[0], down[0], centre[0], centre[1], talus);
+		out[cols - 1] = ThermalCell(centre[cols - 1], up[cols - 1], down[cols - 1], centre[cols - 2], centre[cols - 1], talus);
+
+		int col = 1;
+#if defined(USE_SSE)
+		__m128 vTalus = _mm_set1_ps(talus);
+		__m128 vRate = _mm_set1_ps(THERMAL_RATE);
+		__m128 zero = _mm_setzero_ps();
+		for (; col + 4 <= cols - 1; col += 4){
+			__m128 h = _mm_loadu_ps(centre + col);
+			__m128 n[4] = {_mm_loadu_ps(up + col), _mm_loadu_ps(down + col), _mm_loadu_ps(centre + col - 1), _mm_loadu_ps(centre + col + 1)};
+			__m128 change = zero;
+			for (int k = 0; k < 4; k++){
+				__m128 inflow = _mm_max_ps(_mm_sub_ps(_mm_sub_ps(n[k], h), vTalus), zero);
+				__m128 outflow = _mm_max_ps(_mm_sub_ps(_mm_sub_ps(h, n[k]), vTalus), zero);
+				change = _mm_add_ps(change, _mm_sub_ps(inflow, outflow));
+			}
+			_mm_storeu_ps(out + col, _mm_add_ps(h, _mm_mul_ps(change, vRate)));
+		}
+#endif
+		for (; col < cols - 1; col++){
+			out[col] = ThermalCell(centre[col], up[col], down[col], centre[col - 1], centre[col + 1], talus);
+		}
+	}
+}
+
+void TerrainGenerator::ThermalRowsJob(int first, int last, void* data){
+	Job* job = (Job*)data;
+	job->generator->ThermalRows(job, first, last);
+}
+
+void TerrainGenerator::ErodeThermal(float* heights, int rows, int cols, int iterations, float talus){
+	if (iterations <= 0 || rows < 2 || cols < 2)
+		return;
+
+	float* buffer = new float[rows*cols];
+
+	Job job;
+	job.rows = rows;
+	job.cols = cols;
+	job.generator = this;
+	job.talus = talus;
+	job.heights = heights;
+	job.scratch = buffer;
+
+	for (int i = 0; i < iterations; i++){
+		GetPool()->ParallelFor(rows, GENERATE_BAND_ROWS, ThermalRowsJob, &job);
+		float* swap = job.heights;
+		job.heights = job.scratch;
+		job.scratch = swap;
+	}
+
+	//an odd number of passes leaves the result in the scratch buffer
+	if (job.heights != heights)
+		memcpy(heights, job.heights, rows*cols*sizeof(float));
+	delete [] buffer;
+}
+
+/*
+Hydraulic erosion - drops of water roll downhill picking up sediment where they speed up and dropping it where they
+slow down. Drops are kept inside blocks of cells and the blocks are done in four phases like the squares of a
+chessboard, so two blocks being worked on at the same time are always a whole block apart. Each block has its own
+random numbers so the result doesn't depend on the threads.
+*/
+void TerrainGenerator::HydraulicBlock(Job* job, int block)const{
+	float* heights = job->heights;
+	int cols = job->cols;
+
+	int blockRow = block / job->blockCols;
+	int blockCol = block % job->blockCols;
+	int x0 = blockCol*HYDRAULIC_BLOCK - job->blockOffset;
+	int y0 = blockRow*HYDRAULIC_BLOCK - job->blockOffset;
+	int x1 = x0 + HYDRAULIC_BLOCK;
+	int y1 = y0 + HYDRAULIC_BLOCK;
+	//a drop's cell and the corners it touches all have to stay on the terrain
+	x0 = x0 > 0 ? x0 : 0;
+	y0 = y0 > 0 ? y0 : 0;
+	x1 = x1 < cols - 1 ? x1 : cols - 1;
+	y1 = y1 < job->rows - 1 ? y1 : job->rows - 1;
+	if (x1 <= x0 || y1 <= y0)
+		return;
+
+	unsigned int state = MixSeed(MixSeed(seed, job->round + 1), block);
+
+	for (int d = 0; d < job->droplets[block]; d++){
+		float posX = x0 + (NextRandom(state) & 0xFFFF) / 65536.0f*(x1 - x0);
+		float posY = y0 + (NextRandom(state) & 0xFFFF) / 65536.0f*(y1 - y0);
+		float dirX = 0.0f, dirY = 0.0f;
+		float speed = 1.0f;
+		float water = 1.0f;
+		float sediment = 0.0f;
+
+		for (int step = 0; step < DROPLET_LIFETIME; step++){
+			int cx = (int)posX;
+			int cy = (int)posY;
+			float fx = posX - cx;
+			float fy = posY - cy;
+			float* corner = heights + cy*cols + cx;
+
+			//height and slope from the four corners of the cell
+			float h00 = corner[0], h10 = corner[1], h01 = corner[cols], h11 = corner[cols + 1];
+			float gradX = (h10 - h00)*(1.0f - fy) + (h11 - h01)*fy;
+			float gradY = (h01 - h00)*(1.0f - fx) + (h11 - h10)*fx;
+			float height = h00*(1.0f - fx)*(1.0f - fy) + h10*fx*(1.0f - fy) + h01*(1.0f - fx)*fy + h11*fx*fy;
+
+			dirX = dirX*DROPLET_INERTIA - gradX*(1.0f - DROPLET_INERTIA);
+			dirY = dirY*DROPLET_INERTIA - gradY*(1.0f - DROPLET_INERTIA);
+			float length = sqrtf(dirX*dirX + dirY*dirY);
+			if (length < 1e-6f)
+				break;
+			dirX /= length;
+			dirY /= length;
+			posX += dirX;
+			posY += dirY;
+
+			//off the block - whatever it's carrying is lost
+			if (posX < x0 || posX >= x1 || posY < y0 || posY >= y1)
+				break;
+
+			int nx = (int)posX;
+			int ny = (int)posY;
+			float nfx = posX - nx;
+			float nfy = posY - ny;
+			const float* next = heights + ny*cols + nx;
+			float newHeight = next[0]*(1.0f - nfx)*(1.0f - nfy) + next[1]*nfx*(1.0f - nfy) + next[cols]*(1.0f - nfx)*nfy + next[cols + 1]*nfx*nfy;
+			float deltaHeight = newHeight - height;
+
+			float capacity = -deltaHeight*speed*water*DROPLET_CAPACITY;
+			capacity = capacity > DROPLET_MIN_CAPACITY ? capacity : DROPLET_MIN_CAPACITY;
+
+			float weights[4] = {(1.0f - fx)*(1.0f - fy), fx*(1.0f - fy), (1.0f - fx)*fy, fx*fy};
+			float* corners[4] = {corner, corner + 1, corner + cols, corner + cols + 1};
+
+			if (sediment > capacity || deltaHeight > 0.0f){
+				//uphill it fills the hole it's climbing out of, otherwise it drops what it can't carry
+				float deposit = (deltaHeight > 0.0f) ? (deltaHeight < sediment ? deltaHeight : sediment) : (sediment - capacity)*DROPLET_DEPOSIT;
+				sediment -= deposit;
+				for (int k = 0; k < 4; k++)
+					*corners[k] += deposit*weights[k];
+			}
+			else{
+				//never dig deeper than the drop is falling or it would carve a pit
+				float erode = (capacity - sediment)*DROPLET_ERODE;
+				erode = erode < -deltaHeight ? erode : -deltaHeight;
+				for (int k = 0; k < 4; k++)
+					*corners[k] -= erode*weights[k];
+				sediment += erode;
+			}
+
+			float speedSq = speed*speed + deltaHeight*DROPLET_GRAVITY;
+			speed = speedSq > 0.0f ? sqrtf(speedSq) : 0.0f;
+			water *= 1.0f - DROPLET_EVAPORATE;
+		}
+	}
+}
+
+void TerrainGenerator::HydraulicBlocksJob(int first, int last, void* data){
+	Job* job = (Job*)data;
+	for (int i = first; i < last; i++)
+		job->generator->HydraulicBlock(job, job->blocks[i]);
+}
+
+void TerrainGenerator::ErodeHydraulic(float* heights, int rows, int cols, int droplets){
+	if (droplets <= 0 || rows < 2 || cols < 2)
+		return;
+
+	Job job;
+	job.heights = heights;
+	job.scratch = nullptr;
+	job.rows = rows;
+	job.cols = cols;
+	job.generator = this;
+
+	for (int round = 0; round < HYDRAULIC_ROUNDS; round++){
+		job.round = round;
+		job.blockOffset = (round & 1) ? HYDRAULIC_BLOCK/2 : 0;
+		job.blockCols = (cols - 1 + job.blockOffset + HYDRAULIC_BLOCK - 1) / HYDRAULIC_BLOCK;
+		int blockRows = (rows - 1 + job.blockOffset + HYDRAULIC_BLOCK - 1) / HYDRAULIC_BLOCK;
+		int blockCount = job.blockCols*blockRows;
+
+		//share this round's drops out by block area so the rain falls evenly
+		int roundDroplets = droplets / HYDRAULIC_ROUNDS + (round < droplets % HYDRAULIC_ROUNDS ? 1 : 0);
+		job.droplets.assign(blockCount, 0);
+		long long totalCells = (long long)(rows - 1)*(cols - 1);
+		long long cellsBefore = 0;
+		for (int b = 0; b < blockCount; b++){
+			int bx = b % job.blockCols, by = b / job.blockCols;
+			int x0 = bx*HYDRAULIC_BLOCK - job.blockOffset, y0 = by*HYDRAULIC_BLOCK - job.blockOffset;
+			int x1 = x0 + HYDRAULIC_BLOCK, y1 = y0 + HYDRAULIC_BLOCK;
+			x0 = x0 > 0 ? x0 : 0;			y0 = y0 > 0 ? y0 : 0;
+			x1 = x1 < cols - 1 ? x1 : cols - 1;	y1 = y1 < rows - 1 ? y1 : rows - 1;
+			long long cells = (long long)(x1 - x0)*(y1 - y0);
+			job.droplets[b] = (int)(roundDroplets*(cellsBefore + cells) / totalCells - roundDroplets*cellsBefore / totalCells);
+			cellsBefore += cells;
+		}
+
+		for (int phase = 0; phase < 4; phase++){
+			job.blocks.clear();
+			for (int b = 0; b < blockCount; b++){
+				int bx = b % job.blockCols, by = b / job.blockCols;
+				if ((bx & 1) == (phase & 1) && (by & 1) == (phase >> 1))
+					job.blocks.push_back(b);
+			}
+			GetPool()->ParallelFor((int)job.blocks.size(), 1, HydraulicBlocksJob, &job);
+		}
+	}
+}
+
+void TerrainGenerator::Generate(float* heights, int rows, int cols, const TerrainGenSettings& settings){
+	GenerateNoise(heights, rows, cols, settings);
+	ErodeHydraulic(heights, rows, cols, settings.droplets);
+	ErodeThermal(heights, rows, cols, settings.thermalIterations, settings.talus);
+}
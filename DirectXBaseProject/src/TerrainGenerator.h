@@ -0,0 +1,76 @@
+/////////////////////////////////////////////////////////////////////////
+// TERRAIN GENERATOR - NOISE HEIGHTFIELDS AND EROSION FOR PROCEDURAL TERRAIN
+/////////////////////////////////////////////////////////////////////////
+
+#ifndef _TERRAINGENERATOR_H
+#define _TERRAINGENERATOR_H
+
+#include "SimdMath.h"
+
+class ThreadPool;
+
+// NOISE_VALUE	- smoothly blended random values on a lattice, soft rolling hills
+// NOISE_PERLIN	- gradient noise, the usual fractal terrain
+// NOISE_RIDGED	- folded gradient noise giving sharp ridges and valleys, mountain ranges
+enum NOISE_TYPE{NOISE_VALUE = 0, NOISE_PERLIN = 1, NOISE_RIDGED = 2};
+
+struct TerrainGenSettings
+{
+	unsigned int	seed;
+	NOISE_TYPE		noise;
+	int				octaves;
+	float			frequency;			// cycles per cell of the first octave
+	float			lacunarity;			// frequency multiplier from one octave to the next
+	float			gain;				// amplitude multiplier from one octave to the next
+	float			heightScale;		// heights end up between 0 and this
+
+	int				thermalIterations;	// passes of slope collapse, 0 for none
+	float			talus;				// height difference between neighbours above which material slides down
+	int				droplets;			// rain drops run over the terrain for hydraulic erosion, 0 for none
+
+	TerrainGenSettings();
+};
+
+/*
+The heights are generated row major with a pitch of cols, a band of rows per job on the thread pool with the noise
+worked out four columns at a time. The erosion passes are spread over the pool as well and always give the same
+terrain for the same seed however many threads there are.
+*/
+class TerrainGenerator
+{
+public:
+	// runs on pool, or on the shared pool if it's null
+	TerrainGenerator(unsigned int seed, ThreadPool* pool = nullptr);
+
+	void	Generate(float* heights, int rows, int cols, const TerrainGenSettings& settings);
+
+	void	GenerateNoise(float* heights, int rows, int cols, const TerrainGenSettings& settings);
+	void	ErodeThermal(float* heights, int rows, int cols, int iterations, float talus);
+	void	ErodeHydraulic(float* heights, int rows, int cols, int droplets);
+
+	float	Noise(NOISE_TYPE type, float x, float y)const;		// a single octave at a point, x and y have to be positive
+
+private:
+	struct Job;
+
+	void	NoiseRow(NOISE_TYPE type, const float* x, float y, int count, float* out)const;	// one octave along a row
+	void	GenerateRows(Job* job, int firstRow, int lastRow)const;
+	void	ThermalRows(Job* job, int firstRow, int lastRow)const;
+	void	HydraulicBlock(Job* job, int block)const;
+
+	static void GenerateRowsJob(int first, int last, void* data);
+	static void ThermalRowsJob(int first, int last, void* data);
+	static void HydraulicBlocksJob(int first, int last, void* data);
+
+	ThreadPool*	GetPool()const;
+
+private:
+	unsigned int	seed;
+	ThreadPool		*pool;
+	int				perm[512];			// shuffled 0-255 twice over so lookups can run past 255
+	float			gradX[256];			// gradient (and value noise value) for every hash
+	float			gradY[256];
+	float			values[256];
+};
+
+#endif
@@ -0,0 +1,118 @@
+#include "TerrainIndices.h"
+#include <vector>
+#include <algorithm>
+
+//quads across a window - its top and bottom row of vertices have to fit in the cache together
+static int GetWindowWidth(int cacheSize){
+	return Max(cacheSize/2 - 1, 1);
+}
+
+int GetPatchIndexCount(int rows, int cols, bool strip, int cacheSize){
+	if (rows <= 0 || cols <= 0)
+		return 0;
+	if (!strip)
+		return rows*cols*6;
+
+	//every strip is a row of a window - the first vertex twice to get the winding right, two per column of
+	//vertices, and a cut before every strip but the first
+	int window = GetWindowWidth(cacheSize);
+	int windows = (cols + window - 1)/window;
+	return rows*(2*(cols + windows) + windows) + rows*windows - 1;
+}
+
+int BuildPatchIndices(int rows, int cols, int pitch, bool strip, WORD* out, int cacheSize){
+	int window = GetWindowWidth(cacheSize);
+	int k = 0;
+
+	for (int firstCol = 0; firstCol < cols; firstCol += window){
+		int lastCol = Min(firstCol + window, cols);
+
+		for (int i = 0; i < rows; i++){
+			int top = i*pitch;
+			int bottom = top + pitch;
+
+			if (!strip){
+				for (int j = firstCol; j < lastCol; j++){
+					out[k]   = (WORD)(top+j);
+					out[k+1] = (WORD)(top+j+1);
+					out[k+2] = (WORD)(bottom+j);
+
+					out[k+3] = (WORD)(bottom+j);
+					out[k+4] = (WORD)(top+j+1);
+					out[k+5] = (WORD)(bottom+j+1);
+					k += 6;
+				}
+				continue;
+			}
+
+			//top, bottom, top, bottom... gives the same diagonal as the list but every triangle wound the wrong
+			//way, so the strip opens with a degenerate triangle to flip them
+			if (k > 0)
+				out[k++] = STRIP_CUT_INDEX16;
+			out[k++] = (WORD)(top+firstCol);
+			for (int j = firstCol; j <= lastCol; j++){
+				out[k++] = (WORD)(top+j);
+				out[k++] = (WORD)(bottom+j);
+			}
+		}
+	}
+	return k;
+}
+
+int GetMaxPatchRows(int cols, int pitch){
+	if (pitch <= 0 || cols > 0xFFFE)
+		return 0;
+	//the strip cut index is kept out of range of the vertices too
+	return Max((0xFFFE - cols)/pitch, 0);
+}
+
+void MeasureVertexCache(const void* indices, UINT indexSize, int count, bool strip, int cacheSize, VertexCacheStats& stats){
+	memset(&stats, 0, sizeof(stats));
+
+	UINT cut = (indexSize == 2) ? 0xFFFF : 0xFFFFFFFF;
+	std::vector<UINT> cache(Max(cacheSize, 1), cut);		// FIFO, next is where the next vertex goes
+	int next = 0;
+	std::vector<UINT> seen;
+	UINT window[3];
+	int inStrip = 0;
+
+	for (int i = 0; i < count; i++){
+		UINT index = (indexSize == 2) ? ((const WORD*)indices)[i] : ((const DWORD*)indices)[i];
+		if (strip && index == cut){
+			inStrip = 0;
+			continue;
+		}
+
+		if (std::find(cache.begin(), cache.end(), index) == cache.end()){
+			cache[next] = index;
+			next = (next + 1) % cache.size();
+			stats.misses++;
+		}
+		seen.push_back(index);
+
+		//count the triangles that cover some area
+		if (strip){
+			window[0] = window[1];
+			window[1] = window[2];
+			window[2] = index;
+			if (++inStrip >= 3 && window[0] != window[1] && window[1] != window[2] && window[0] != window[2])
+				stats.triangles++;
+		}
+		else if (i % 3 == 2){
+			stats.triangles++;
+		}
+	}
+
+	std::sort(seen.begin(), seen.end());
+	stats.vertices = std::unique(seen.begin(), seen.end()) - seen.begin();
+	stats.acmr = stats.triangles ? (float)stats.misses / stats.triangles : 0.0f;
+	stats.atvr = stats.vertices ? (float)stats.misses / stats.vertices : 0.0f;
+}
+
+void AddVertexCacheStats(VertexCacheStats& total, const VertexCacheStats& stats){
+	total.triangles += stats.triangles;
+	total.misses += stats.misses;
+	total.vertices += stats.vertices;
+	total.acmr = total.triangles ? (float)total.misses / total.triangles : 0.0f;
+	total.atvr = total.vertices ? (float)total.misses / total.vertices : 0.0f;
+}
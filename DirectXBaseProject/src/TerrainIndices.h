@@ -0,0 +1,47 @@
+/////////////////////////////////////////////////////////////////////////
+// TERRAIN INDICES - 16 BIT PATCH INDEX LISTS ORDERED FOR THE VERTEX CACHE
+/////////////////////////////////////////////////////////////////////////
+
+#ifndef _TERRAININDICES_H
+#define _TERRAININDICES_H
+
+#include "d3dUtil.h"
+
+// TERRAIN_INDEX_LIST32		- one 32 bit triangle list over the whole grid in row order, 24 bytes a quad
+// TERRAIN_INDEX_LIST16		- 16 bit triangle lists per patch ordered for the vertex cache, 12 bytes a quad
+// TERRAIN_INDEX_STRIP16	- 16 bit triangle strips per patch cut with 0xFFFF, about 5 bytes a quad
+enum TERRAIN_INDEX_MODE{TERRAIN_INDEX_LIST32 = 0, TERRAIN_INDEX_LIST16 = 1, TERRAIN_INDEX_STRIP16 = 2};
+
+const WORD	STRIP_CUT_INDEX16		= 0xFFFF;
+const int	DEFAULT_VERTEX_CACHE	= 24;		// post-transform cache entries assumed when ordering
+
+/*
+A patch of rows x cols quads is indexed as if its first vertex were vertex 0 with rows of the vertex buffer pitch
+vertices apart, so it's drawn with its first vertex as the base vertex and every patch of the same shape can share
+the same indices. The patch is walked in vertical windows of quads narrow enough that the vertices of one row of
+a window are still in the cache when the row below it is drawn, top to bottom inside each window. The triangles
+are the same two per quad the 32 bit list uses.
+*/
+
+// indices needed for a patch - the largest index used is rows*pitch + cols, which has to fit in 16 bits
+int		GetPatchIndexCount(int rows, int cols, bool strip, int cacheSize = DEFAULT_VERTEX_CACHE);
+int		BuildPatchIndices(int rows, int cols, int pitch, bool strip, WORD* out, int cacheSize = DEFAULT_VERTEX_CACHE);
+
+// most rows of quads a patch can have in a buffer with the given pitch before its indices run out of 16 bits, 0 if none fit
+int		GetMaxPatchRows(int cols, int pitch);
+
+struct VertexCacheStats
+{
+	UINT	triangles;			// not counting the degenerate ones
+	UINT	misses;				// vertices that had to be transformed
+	UINT	vertices;			// distinct vertices referenced
+	float	acmr;				// average cache miss ratio - misses per triangle, 0.5 is the best a grid can do
+	float	atvr;				// average transform to vertex ratio - misses per distinct vertex, 1 is ideal
+};
+
+// runs indices through a FIFO post-transform cache of cacheSize entries. indexSize is 2 or 4, strips are cut with
+// all bits set. A patch list drawn as separate batches is measured by adding up the stats of each
+void MeasureVertexCache(const void* indices, UINT indexSize, int count, bool strip, int cacheSize, VertexCacheStats& stats);
+void AddVertexCacheStats(VertexCacheStats& total, const VertexCacheStats& stats);
+
+#endif
@@ -0,0 +1,368 @@
+#include "TerrainKernels.h"
+#include <math.h>
+
+/*
+The surface is y = h(x,z) so its normal is (-dh/dx, 1, -dh/dz). Rows run along -z, so going down a row is a
+step of -cellSpacing in z and the sign of the row difference flips.
+*/
+void ComputeTerrainNormal(const float* heights, int rows, int cols, int row, int col, float cellSpacing,
+						  float& nx, float& ny, float& nz){
+	int left  = col > 0 ? col - 1 : col;
+	int right = col < cols - 1 ? col + 1 : col;
+	int up    = row > 0 ? row - 1 : row;
+	int down  = row < rows - 1 ? row + 1 : row;
+
+	float slopeX = (heights[row*cols + right] - heights[row*cols + left]) / ((right - left)*cellSpacing);
+	float slopeZ = (heights[down*cols + col] - heights[up*cols + col]) / ((down - up)*cellSpacing);
+
+	float x = -slopeX;
+	float z = slopeZ;
+	float invLength = 1.0f / sqrtf(x*x + 1.0f + z*z);
+
+	nx = x*invLength;
+	ny = invLength;
+	nz = z*invLength;
+}
+
+void ComputeTerrainNormalRow(const float* heights, int rows, int cols, int row, int firstCol, int count, float cellSpacing,
+							 float* nx, float* ny, float* nz){
+	int lastCol = firstCol + count;		// one past the end
+	int col = firstCol;
+
+	//the first and last column of the grid need one sided differences - do them on their own
+	if (col == 0 && col < lastCol){
+		ComputeTerrainNormal(heights, rows, cols, row, col, cellSpacing, nx[0], ny[0], nz[0]);
+		col++;
+	}
+	int interiorEnd = lastCol < cols - 1 ? lastCol : cols - 1;
+
+	const float* centre = heights + row*cols;
+	const float* up     = heights + (row > 0 ? row - 1 : row)*cols;
+	const float* down   = heights + (row < rows - 1 ? row + 1 : row)*cols;
+	float invX = 1.0f / (2.0f*cellSpacing);
+	float invZ = 1.0f / (((row < rows - 1 ? row + 1 : row) - (row > 0 ? row - 1 : row))*cellSpacing);
+
+#if defined(USE_AVX)
+	{
+		__m256 vInvX = _mm256_set1_ps(-invX);
+		__m256 vInvZ = _mm256_set1_ps(invZ);
+		__m256 one   = _mm256_set1_ps(1.0f);
+		for (; col + 8 <= interiorEnd; col += 8){
+			__m256 x = _mm256_mul_ps(_mm256_sub_ps(_mm256_loadu_ps(centre + col + 1), _mm256_loadu_ps(centre + col - 1)), vInvX);
+			__m256 z = _mm256_mul_ps(_mm256_sub_ps(_mm256_loadu_ps(down + col), _mm256_loadu_ps(up + col)), vInvZ);
+			__m256 lengthSq = _mm256_add_ps(_mm256_add_ps(_mm256_mul_ps(x, x), one), _mm256_mul_ps(z, z));
+			__m256 invLength = _mm256_div_ps(one, _mm256_sqrt_ps(lengthSq));
+
+			int i = col - firstCol;
+			_mm256_storeu_ps(nx + i, _mm256_mul_ps(x, invLength));
+			_mm256_storeu_ps(ny + i, invLength);
+			_mm256_storeu_ps(nz + i, _mm256_mul_ps(z, invLength));
+		}
+	}
+#endif
+#if defined(USE_SSE)
+	{
+		__m128 vInvX = _mm_set1_ps(-invX);
+		__m128 vInvZ = _mm_set1_ps(invZ);
+		__m128 one   = _mm_set1_ps(1.0f);
+		for (; col + 4 <= interiorEnd; col += 4){
+			__m128 x = _mm_mul_ps(_mm_sub_ps(_mm_loadu_ps(centre + col + 1), _mm_loadu_ps(centre + col - 1)), vInvX);
+			__m128 z = _mm_mul_ps(_mm_sub_ps(_mm_loadu_ps(down + col), _mm_loadu_ps(up + col)), vInvZ);
+			__m128 lengthSq = _mm_add_ps(_mm_add_ps(_mm_mul_ps(x, x), one), _mm_mul_ps(z, z));
+			__m128 invLength = _mm_div_ps(one, _mm_sqrt_ps(lengthSq));
+
+			int i = col - firstCol;
+			_mm_storeu_ps(nx + i, _mm_mul_ps(x, invLength));
+			_mm_storeu_ps(ny + i, invLength);
+			_mm_storeu_ps(nz + i, _mm_mul_ps(z, invLength));
+		}
+	}
+#endif
+	//whatever is left over (or everything without SIMD)
+	for (; col < interiorEnd; col++){
+		float x = (centre[col + 1] - centre[col - 1]) * -invX;
+		float z = (down[col] - up[col]) * invZ;
+		float invLength = 1.0f / sqrtf(x*x + 1.0f + z*z);
+
+		int i = col - firstCol;
+		nx[i] = x*invLength;
+		ny[i] = invLength;
+		nz[i] = z*invLength;
+	}
+
+	if (col < lastCol){
+		int i = col - firstCol;
+		ComputeTerrainNormal(heights, rows, cols, row, col, cellSpacing, nx[i], ny[i], nz[i]);
+	}
+}
+
+void SmoothHeightsExponential(float* heights, int rows, int cols, float factor){
+	float k = factor;
+	float kPrev = 1.0f - k;
+
+	for (int row = 0; row < rows; row++){
+		float* current = heights + row*cols;
+
+		//along the row - every sample depends on the one before it so this part stays scalar
+		for (int col = 1; col < cols; col++){
+			current[col] = current[col - 1]*kPrev + current[col]*k;
+		}
+
+		if (row == 0)
+			continue;
+
+		//into the row above, which is already finished
+		const float* previous = current - cols;
+		int col = 0;
+#if defined(USE_AVX)
+		{
+			__m256 vk = _mm256_set1_ps(k);
+			__m256 vkPrev = _mm256_set1_ps(kPrev);
+			for (; col + 8 <= cols; col += 8){
+				__m256 blended = _mm256_add_ps(_mm256_mul_ps(_mm256_loadu_ps(previous + col), vkPrev), _mm256_mul_ps(_mm256_loadu_ps(current + col), vk));
+				_mm256_storeu_ps(current + col, blended);
+			}
+		}
+#endif
+#if defined(USE_SSE)
+		{
+			__m128 vk = _mm_set1_ps(k);
+			__m128 vkPrev = _mm_set1_ps(kPrev);
+			for (; col + 4 <= cols; col += 4){
+				__m128 blended = _mm_add_ps(_mm_mul_ps(_mm_loadu_ps(previous + col), vkPrev), _mm_mul_ps(_mm_loadu_ps(current + col), vk));
+				_mm_storeu_ps(current + col, blended);
+			}
+		}
+#endif
+		for (; col < cols; col++){
+			current[col] = previous[col]*kPrev + current[col]*k;
+		}
+	}
+}
+
+//filters one row along x into dst, clamping the samples off either end of the row
+static void FilterRowX(const float* src, float* dst, int cols, const float* weights, int radius){
+	int taps = 2*radius + 1;
+	int interiorStart = radius < cols ? radius : cols;
+	int interiorEnd = cols - radius > interiorStart ? cols - radius : interiorStart;
+
+	for (int col = 0; col < cols; col++){
+		//jump over the part of the row that has all its taps inside it
+		if (col == interiorStart)
+			col = interiorEnd;
+		if (col >= cols)
+			break;
+
+		float sum = 0.0f;
+		for (int t = 0; t < taps; t++){
+			int c = col + t - radius;
+			c = c < 0 ? 0 : (c > cols - 1 ? cols - 1 : c);
+			sum += src[c]*weights[t];
+		}
+		dst[col] = sum;
+	}
+
+	int col = interiorStart;
+#if defined(USE_SSE)
+	for (; col + 4 <= interiorEnd; col += 4){
+		__m128 sum = _mm_setzero_ps();
+		for (int t = 0; t < taps; t++){
+			sum = _mm_add_ps(sum, _mm_mul_ps(_mm_loadu_ps(src + col + t - radius), _mm_set1_ps(weights[t])));
+		}
+		_mm_storeu_ps(dst + col, sum);
+	}
+#endif
+	for (; col < interiorEnd; col++){
+		float sum = 0.0f;
+		for (int t = 0; t < taps; t++){
+			sum += src[col + t - radius]*weights[t];
+		}
+		dst[col] = sum;
+	}
+}
+
+void SmoothHeightsSeparable(float* heights, int rows, int cols, const float* weights, int radius, float* scratch){
+	int taps = 2*radius + 1;
+	const float* tapRows[2*MAX_SMOOTH_RADIUS + 1];		//the rows of the ring each tap reads for the current output row
+	if (radius < 0 || radius > MAX_SMOOTH_RADIUS)
+		return;
+
+	//fill the ring with the rows the first output row needs
+	int filtered = 0;	//rows filtered along x so far
+	for (; filtered < rows && filtered <= radius; filtered++){
+		FilterRowX(heights + filtered*cols, scratch + (filtered % taps)*cols, cols, weights, radius);
+	}
+
+	for (int row = 0; row < rows; row++){
+		//the row radius rows further down has to be filtered along x before this row gets overwritten below.
+		//rows above it were all read into the ring already so writing back in place is safe
+		if (filtered < rows && filtered <= row + radius){
+			FilterRowX(heights + filtered*cols, scratch + (filtered % taps)*cols, cols, weights, radius);
+			filtered++;
+		}
+
+		for (int t = 0; t < taps; t++){
+			int r = row + t - radius;
+			r = r < 0 ? 0 : (r > rows - 1 ? rows - 1 : r);
+			tapRows[t] = scratch + (r % taps)*cols;
+		}
+
+		float* dst = heights + row*cols;
+		int col = 0;
+#if defined(USE_AVX)
+		for (; col + 8 <= cols; col += 8){
+			__m256 sum = _mm256_setzero_ps();
+			for (int t = 0; t < taps; t++){
+				sum = _mm256_add_ps(sum, _mm256_mul_ps(_mm256_loadu_ps(tapRows[t] + col), _mm256_set1_ps(weights[t])));
+			}
+			_mm256_storeu_ps(dst + col, sum);
+		}
+#endif
+#if defined(USE_SSE)
+		for (; col + 4 <= cols; col += 4){
+			__m128 sum = _mm_setzero_ps();
+			for (int t = 0; t < taps; t++){
+				sum = _mm_add_ps(sum, _mm_mul_ps(_mm_loadu_ps(tapRows[t] + col), _mm_set1_ps(weights[t])));
+			}
+			_mm_storeu_ps(dst + col, sum);
+		}
+#endif
+		for (; col < cols; col++){
+			float sum = 0.0f;
+			for (int t = 0; t < taps; t++){
+				sum += tapRows[t][col]*weights[t];
+			}
+			dst[col] = sum;
+		}
+	}
+}
+
+/*
+Each cell is split along the diagonal from its top right to its bottom left corner:
+	A*--*B
+	 | /|
+	 |/ |
+	C*--*D
+s runs from A to B and t from A to C. s + t <= 1 is the upper triangle ABC, otherwise the lower triangle DCB.
+*/
+static void SampleTerrainHeight(const float* heights, int rows, int cols, float invSpacing, float originX, float originZ,
+								float x, float z, float& height, float* nx, float* ny, float* nz){
+	float c = (x - originX)*invSpacing;
+	float d = (originZ - z)*invSpacing;
+	c = c < 0.0f ? 0.0f : (c > (float)(cols - 1) ? (float)(cols - 1) : c);
+	d = d < 0.0f ? 0.0f : (d > (float)(rows - 1) ? (float)(rows - 1) : d);
+
+	int col = (int)c;
+	int row = (int)d;
+	col = col < cols - 2 ? col : cols - 2;
+	row = row < rows - 2 ? row : rows - 2;
+
+	const float* top = heights + row*cols + col;
+	float A = top[0];
+	float B = top[1];
+	float C = top[cols];
+	float D = top[cols + 1];
+
+	float s = c - (float)col;
+	float t = d - (float)row;
+
+	float slopeS, slopeT;	//height change per cell along s and t
+	if (s + t <= 1.0f){
+		slopeS = B - A;
+		slopeT = C - A;
+		height = A + s*slopeS + t*slopeT;
+	}
+	else{
+		slopeS = D - C;
+		slopeT = D - B;
+		height = D + (1.0f - s)*(C - D) + (1.0f - t)*(B - D);
+	}
+
+	if (nx){
+		//t runs along -z
+		float fx = -slopeS*invSpacing;
+		float fz = slopeT*invSpacing;
+		float invLength = 1.0f / sqrtf(fx*fx + 1.0f + fz*fz);
+		*nx = fx*invLength;
+		*ny = invLength;
+		*nz = fz*invLength;
+	}
+}
+
+void SampleTerrainHeights(const float* heights, int rows, int cols, float cellSpacing, float originX, float originZ,
+						  const float* x, const float* z, int count, float* outHeights, float* nx, float* ny, float* nz){
+	float invSpacing = 1.0f / cellSpacing;
+	int i = 0;
+
+#if defined(USE_SSE)
+	{
+		__m128 vInvSpacing = _mm_set1_ps(invSpacing);
+		__m128 vOriginX = _mm_set1_ps(originX);
+		__m128 vOriginZ = _mm_set1_ps(originZ);
+		__m128 zero = _mm_setzero_ps();
+		__m128 one = _mm_set1_ps(1.0f);
+		__m128 maxC = _mm_set1_ps((float)(cols - 1));
+		__m128 maxD = _mm_set1_ps((float)(rows - 1));
+		__m128 maxCellC = _mm_set1_ps((float)(cols - 2));
+		__m128 maxCellD = _mm_set1_ps((float)(rows - 2));
+
+		for (; i + 4 <= count; i += 4){
+			__m128 c = _mm_mul_ps(_mm_sub_ps(_mm_loadu_ps(x + i), vOriginX), vInvSpacing);
+			__m128 d = _mm_mul_ps(_mm_sub_ps(vOriginZ, _mm_loadu_ps(z + i)), vInvSpacing);
+			c = _mm_min_ps(_mm_max_ps(c, zero), maxC);
+			d = _mm_min_ps(_mm_max_ps(d, zero), maxD);
+
+			//both are positive so truncating is the same as flooring
+			__m128i col = _mm_cvttps_epi32(_mm_min_ps(c, maxCellC));
+			__m128i row = _mm_cvttps_epi32(_mm_min_ps(d, maxCellD));
+			__m128 s = _mm_sub_ps(c, _mm_cvtepi32_ps(col));
+			__m128 t = _mm_sub_ps(d, _mm_cvtepi32_ps(row));
+
+			//the corners can be anywhere in the array so they're fetched one at a time
+			int rowIndex[4], colIndex[4];
+			_mm_storeu_si128((__m128i*)rowIndex, row);
+			_mm_storeu_si128((__m128i*)colIndex, col);
+
+			float a[4], b[4], cc[4], dd[4];
+			for (int k = 0; k < 4; k++){
+				const float* top = heights + rowIndex[k]*cols + colIndex[k];
+				a[k] = top[0];
+				b[k] = top[1];
+				cc[k] = top[cols];
+				dd[k] = top[cols + 1];
+			}
+			__m128 A = _mm_loadu_ps(a);
+			__m128 B = _mm_loadu_ps(b);
+			__m128 C = _mm_loadu_ps(cc);
+			__m128 D = _mm_loadu_ps(dd);
+
+			//work out both triangles and keep the one each point is in
+			__m128 upper = _mm_cmple_ps(_mm_add_ps(s, t), one);
+			__m128 upperS = _mm_sub_ps(B, A);
+			__m128 upperT = _mm_sub_ps(C, A);
+			__m128 upperHeight = _mm_add_ps(A, _mm_add_ps(_mm_mul_ps(s, upperS), _mm_mul_ps(t, upperT)));
+			__m128 lowerS = _mm_sub_ps(D, C);
+			__m128 lowerT = _mm_sub_ps(D, B);
+			__m128 lowerHeight = _mm_add_ps(D, _mm_add_ps(_mm_mul_ps(_mm_sub_ps(one, s), _mm_sub_ps(C, D)), _mm_mul_ps(_mm_sub_ps(one, t), _mm_sub_ps(B, D))));
+
+			_mm_storeu_ps(outHeights + i, _mm_or_ps(_mm_and_ps(upper, upperHeight), _mm_andnot_ps(upper, lowerHeight)));
+
+			if (nx){
+				__m128 slopeS = _mm_or_ps(_mm_and_ps(upper, upperS), _mm_andnot_ps(upper, lowerS));
+				__m128 slopeT = _mm_or_ps(_mm_and_ps(upper, upperT), _mm_andnot_ps(upper, lowerT));
+				__m128 normalX = _mm_mul_ps(_mm_sub_ps(zero, slopeS), vInvSpacing);
+				__m128 normalZ = _mm_mul_ps(slopeT, vInvSpacing);
+				__m128 lengthSq = _mm_add_ps(_mm_add_ps(_mm_mul_ps(normalX, normalX), one), _mm_mul_ps(normalZ, normalZ));
+				__m128 invLength = _mm_div_ps(one, _mm_sqrt_ps(lengthSq));
+				_mm_storeu_ps(nx + i, _mm_mul_ps(normalX, invLength));
+				_mm_storeu_ps(ny + i, invLength);
+				_mm_storeu_ps(nz + i, _mm_mul_ps(normalZ, invLength));
+			}
+		}
+	}
+#endif
+	for (; i < count; i++){
+		SampleTerrainHeight(heights, rows, cols, invSpacing, originX, originZ, x[i], z[i], outHeights[i],
+							nx ? nx + i : nullptr, ny ? ny + i : nullptr, nz ? nz + i : nullptr);
+	}
+}
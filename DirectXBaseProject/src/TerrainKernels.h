@@ -0,0 +1,42 @@
+/////////////////////////////////////////////////////////////////////////
+// TERRAIN KERNELS - VECTORISED ROUTINES THAT WORK ON HEIGHT ARRAYS
+/////////////////////////////////////////////////////////////////////////
+
+#ifndef _TERRAINKERNELS_H
+#define _TERRAINKERNELS_H
+
+#include "SimdMath.h"
+
+/*
+All the kernels take a row major height array of rows x cols samples with a row pitch of cols, laid out the
+same way as the grid - columns run along +x and rows along -z, one cellSpacing apart.
+*/
+
+// normals from central differences of the heights (one sided along the borders). Works on count vertices of
+// one row starting at firstCol and writes them out in structure of arrays form
+void ComputeTerrainNormalRow(const float* heights, int rows, int cols, int row, int firstCol, int count, float cellSpacing,
+							 float* nx, float* ny, float* nz);
+
+// the same normal for a single vertex, for when only a handful are needed
+void ComputeTerrainNormal(const float* heights, int rows, int cols, int row, int col, float cellSpacing,
+						  float& nx, float& ny, float& nz);
+
+// the smoothing the loader has always done - each row is blended left to right into its left neighbour and then into
+// the already smoothed row above it. Going row by row in one pass gives exactly the heights that sweeping the whole
+// array along x and then along z does, without walking down the columns
+void SmoothHeightsExponential(float* heights, int rows, int cols, float factor);
+
+// heights (and optionally face normals) of the terrain surface under count points, using the same two triangles per
+// cell that the mesh is drawn with. originX/originZ is where the first sample of the array sits. Points off the
+// edge of the terrain are clamped onto it. nx, ny and nz may be null if the normals aren't wanted
+void SampleTerrainHeights(const float* heights, int rows, int cols, float cellSpacing, float originX, float originZ,
+						  const float* x, const float* z, int count, float* outHeights, float* nx, float* ny, float* nz);
+
+const int MAX_SMOOTH_RADIUS = 16;	// widest kernel SmoothHeightsSeparable takes
+
+// convolves the heights with a normalised kernel of 2*radius+1 weights along x and then along z, clamping at the
+// borders. Each row is filtered along x into a ring of the last 2*radius+1 rows which the z pass reads from, so
+// the array is only swept once and is filtered in place. scratch has to hold (2*radius+1)*cols floats
+void SmoothHeightsSeparable(float* heights, int rows, int cols, const float* weights, int radius, float* scratch);
+
+#endif
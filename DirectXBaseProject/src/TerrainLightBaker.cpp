@@ -0,0 +1,196 @@
+#include "TerrainLightBaker.h"
+#include "ThreadPool.h"
+#include <math.h>
+#include <string.h>
+
+const int BAKE_BAND_ROWS = 16;		//rows baked by each job on the thread pool
+
+//rows and columns one step in each direction moves - rows run towards -z in the world
+static const int DIRECTION_ROW[HORIZON_DIRECTIONS] = {0, -1, -1, -1, 0, 1, 1, 1};
+static const int DIRECTION_COL[HORIZON_DIRECTIONS] = {1, 1, 0, -1, -1, -1, 0, 1};
+
+struct TerrainLightBaker::Job
+{
+	const float*	heights;
+	int				rows, cols;
+	float			cellSpacing;
+	int				firstRow, firstCol;
+	int				lastCol;
+	BYTE*			occlusion;
+	BYTE*			horizons;
+	int				pitch;
+	int				planeSize;		// bytes between the two horizon planes
+	const TerrainLightBaker* baker;
+};
+
+//slope = max(slope, (sample - centre)*invDistance) along count vertices
+static void MaxSlopeSpan(const float* centre, const float* sample, float invDistance, int count, float* slope){
+	int j = 0;
+#if defined(USE_AVX)
+	{
+		__m256 vInv = _mm256_set1_ps(invDistance);
+		for (; j + 8 <= count; j += 8){
+			__m256 rise = _mm256_sub_ps(_mm256_loadu_ps(sample + j), _mm256_loadu_ps(centre + j));
+			_mm256_storeu_ps(slope + j, _mm256_max_ps(_mm256_loadu_ps(slope + j), _mm256_mul_ps(rise, vInv)));
+		}
+	}
+#endif
+#if defined(USE_SSE)
+	{
+		__m128 vInv = _mm_set1_ps(invDistance);
+		for (; j + 4 <= count; j += 4){
+			__m128 rise = _mm_sub_ps(_mm_loadu_ps(sample + j), _mm_loadu_ps(centre + j));
+			_mm_storeu_ps(slope + j, _mm_max_ps(_mm_loadu_ps(slope + j), _mm_mul_ps(rise, vInv)));
+		}
+	}
+#endif
+	for (; j < count; j++){
+		slope[j] = Max(slope[j], (sample[j] - centre[j])*invDistance);
+	}
+}
+
+//sin^2 of the horizon angle is t^2/(1 + t^2) for a slope of t
+static inline float SinSquared(float t){
+	return t*t / (1.0f + t*t);
+}
+
+//turns the slopes of a row, count for each direction one after the other, into its occlusion and horizon bytes
+static void StoreRow(const float* slopes, int count, BYTE* occlusion, DWORD* horizons[2]){
+	int j = 0;
+#if defined(USE_SSE)
+	{
+		__m128 one = _mm_set1_ps(1.0f);
+		__m128 half = _mm_set1_ps(0.5f);
+		__m128 scale = _mm_set1_ps(255.0f);
+		__m128 aoScale = _mm_set1_ps(-255.0f/HORIZON_DIRECTIONS);
+		for (; j + 4 <= count; j += 4){
+			__m128 occluded = _mm_setzero_ps();
+			for (int plane = 0; plane < 2; plane++){
+				__m128i packed = _mm_setzero_si128();
+				for (int k = 0; k < 4; k++){
+					__m128 t = _mm_loadu_ps(slopes + (plane*4 + k)*count + j);
+					__m128 t2 = _mm_mul_ps(t, t);
+					__m128 sinSq = _mm_div_ps(t2, _mm_add_ps(one, t2));
+					occluded = _mm_add_ps(occluded, sinSq);
+					__m128i value = _mm_cvttps_epi32(_mm_add_ps(_mm_mul_ps(_mm_sqrt_ps(sinSq), scale), half));
+					packed = _mm_or_si128(packed, _mm_slli_epi32(value, k*8));
+				}
+				if (horizons[plane])
+					_mm_storeu_si128((__m128i*)(horizons[plane] + j), packed);
+			}
+
+			//four bytes out of the low byte of each lane. Rounded by adding a half and truncating like the loop below rather
+			//than with _mm_cvtps_epi32, which rounds halves to even, so a vertex gets the same byte whichever loop bakes it
+			__m128i value = _mm_cvttps_epi32(_mm_add_ps(_mm_add_ps(scale, _mm_mul_ps(occluded, aoScale)), half));
+			value = _mm_packs_epi32(value, value);
+			value = _mm_packus_epi16(value, value);
+			*(int*)(occlusion + j) = _mm_cvtsi128_si32(value);
+		}
+	}
+#endif
+	for (; j < count; j++){
+		float occluded = 0.0f;
+		for (int plane = 0; plane < 2; plane++){
+			DWORD packed = 0;
+			for (int k = 0; k < 4; k++){
+				float sinSq = SinSquared(slopes[(plane*4 + k)*count + j]);
+				occluded += sinSq;
+				packed |= (DWORD)(sqrtf(sinSq)*255.0f + 0.5f) << (k*8);
+			}
+			if (horizons[plane])
+				horizons[plane][j] = packed;
+		}
+		occlusion[j] = (BYTE)(255.0f - occluded*(255.0f/HORIZON_DIRECTIONS) + 0.5f);
+	}
+}
+
+TerrainLightBaker::TerrainLightBaker(void){
+	Initialize();
+}
+
+void TerrainLightBaker::Initialize(int reach){
+	reach = Max(reach, 1);
+	steps.clear();
+	for (int s = 1; s < reach; s = Max(s + 1, s*3/2))
+		steps.push_back(s);
+	steps.push_back(reach);
+}
+
+int TerrainLightBaker::GetReach()const{
+	return steps.back();
+}
+
+void TerrainLightBaker::BakeRows(Job* job, int firstRow, int lastRow)const{
+	int rows = job->rows;
+	int cols = job->cols;
+	int count = job->lastCol - job->firstCol + 1;
+	float* slopes = new float[count*HORIZON_DIRECTIONS];
+
+	for (int row = firstRow; row < lastRow; row++){
+		int i = job->firstRow + row;
+		const float* centre = job->heights + i*cols;
+		memset(slopes, 0, count*HORIZON_DIRECTIONS*sizeof(float));
+
+		for (int k = 0; k < HORIZON_DIRECTIONS; k++){
+			int di = DIRECTION_ROW[k];
+			int dj = DIRECTION_COL[k];
+			float stepLength = job->cellSpacing*((di != 0 && dj != 0) ? sqrtf(2.0f) : 1.0f);
+			float* slope = slopes + k*count;
+
+			for (unsigned int s = 0; s < steps.size(); s++){
+				int r = i + di*steps[s];
+				if (r < 0 || r >= rows)
+					break;
+
+				//only the vertices whose sample is still on the grid, the terrain is taken to stop at its edge
+				int offset = dj*steps[s];
+				int c0 = Max(job->firstCol, -offset);
+				int c1 = Min(job->lastCol, cols - 1 - offset);
+				if (c0 > c1)
+					break;
+				MaxSlopeSpan(centre + c0, job->heights + r*cols + c0 + offset, 1.0f / (steps[s]*stepLength), c1 - c0 + 1,
+							 slope + c0 - job->firstCol);
+			}
+		}
+
+		BYTE* occlusion = job->occlusion + row*job->pitch;
+		DWORD* horizons[2] = {nullptr, nullptr};
+		if (job->horizons){
+			horizons[0] = (DWORD*)(job->horizons + row*job->pitch*4);
+			horizons[1] = (DWORD*)(job->horizons + job->planeSize + row*job->pitch*4);
+		}
+		StoreRow(slopes, count, occlusion, horizons);
+	}
+
+	delete [] slopes;
+}
+
+void TerrainLightBaker::BakeRowsJob(int first, int last, void* data){
+	Job* job = (Job*)data;
+	job->baker->BakeRows(job, first, last);
+}
+
+void TerrainLightBaker::Bake(const float* heights, int rows, int cols, float cellSpacing, int firstRow, int firstCol, int lastRow, int lastCol,
+							 BYTE* occlusion, BYTE* horizons, int pitch){
+	firstRow = Max(firstRow, 0);
+	firstCol = Max(firstCol, 0);
+	lastRow = Min(lastRow, rows - 1);
+	lastCol = Min(lastCol, cols - 1);
+	if (firstRow > lastRow || firstCol > lastCol)
+		return;
+
+	Job job;
+	job.heights = heights;
+	job.rows = rows;
+	job.cols = cols;
+	job.cellSpacing = cellSpacing;
+	job.firstRow = firstRow;
+	job.firstCol = firstCol;
+	job.lastCol = lastCol;
+	job.occlusion = occlusion;
+	job.horizons = horizons;
+	job.pitch = pitch;
+	job.planeSize = pitch*(lastRow - firstRow + 1)*4;
+	job.baker = this;
+	ThreadPool::GetShared()->ParallelFor(lastRow - firstRow + 1, BAKE_BAND_ROWS, BakeRowsJob, &job);
+}
@@ -0,0 +1,51 @@
+/////////////////////////////////////////////////////////////////////////
+// TERRAIN LIGHT BAKER - AMBIENT OCCLUSION AND HORIZON MAPS FROM THE HEIGHTS
+/////////////////////////////////////////////////////////////////////////
+
+#ifndef _TERRAINLIGHTBAKER_H
+#define _TERRAINLIGHTBAKER_H
+
+#include "d3dUtil.h"
+#include "SimdMath.h"
+#include <vector>
+
+const int HORIZON_DIRECTIONS	= 8;		// every 45 degrees, starting along +x and turning towards +z
+const int DEFAULT_HORIZON_REACH	= 64;		// cells out from a vertex the terrain can still shade it
+
+/*
+The horizon of a vertex in a direction is the steepest the terrain rises looking that way. It's found by sampling the
+heights at distances that grow by about a half each step out to the reach, so close by detail is caught while the
+far hills cost only a few samples. Every vertex of a row looks the same number of rows and columns away for a given
+direction and distance, so a whole row is swept at once with the samples for consecutive vertices next to each other
+in memory, eight or four at a time. Rows are baked on the thread pool and don't depend on each other.
+
+The ambient occlusion is the part of the sky a flat vertex can't see weighted by the cosine, the average over the
+directions of the sine squared of the horizon angle. Both are stored a byte per value - occlusion as 255 for open sky,
+horizons as the sine of the angle - so the shader gets them with a single sample each.
+*/
+class TerrainLightBaker
+{
+public:
+	TerrainLightBaker(void);
+
+	void	Initialize(int reach = DEFAULT_HORIZON_REACH);
+	int		GetReach()const;
+
+	// bakes the vertices of rows [firstRow, lastRow] and columns [firstCol, lastCol] of a rows x cols heightfield.
+	// occlusion gets a byte for each of them with a pitch of pitch bytes, starting with firstRow/firstCol. horizons
+	// can be null, otherwise it gets two planes pitch*(lastRow - firstRow + 1) texels apart of 4 bytes a texel,
+	// directions 0-3 in the first and 4-7 in the second
+	void	Bake(const float* heights, int rows, int cols, float cellSpacing, int firstRow, int firstCol, int lastRow, int lastCol,
+				 BYTE* occlusion, BYTE* horizons, int pitch);
+
+private:
+	struct Job;
+
+	void	BakeRows(Job* job, int firstRow, int lastRow)const;
+	static void BakeRowsJob(int first, int last, void* data);
+
+private:
+	std::vector<int>	steps;		// distances sampled, in steps along a direction
+};
+
+#endif
@@ -1,8 +1,12 @@
 #include "TerrainLoader.h"
 
 TerrainLoader::TerrainLoader(){
-	height = 0;
+	height = nullptr;
 	terrainWidth = terrainDepth = 0;
+
+	smoothKernel = SMOOTH_EXPONENTIAL;
+	smoothIterations = 4;
+	smoothAmount = 0.75f;
 }
 
 TerrainLoader::~TerrainLoader(){
@@ -12,148 +16,160 @@ TerrainLoader::~TerrainLoader(){
 }
 
 bool TerrainLoader::LoadTerrain(char* filename){
-	height = 0;
+	delete [] height;
+	height = nullptr;
 
-	//store the heightmap to a file
-	FILE * fTGA = LoadTGA(filename);
+	//map the heightmap into memory - the heights are read straight out of the view so the image is never copied
+	MappedFile file;
+	if (!file.Open(filename)){
+		MessageBox(NULL, L"Could not open texture file", L"ERROR", MB_OK);
+		return false;
+	}
 
 	//compute the heights from that file
-	if (fTGA != NULL){
-		if (!ComputeHeights(fTGA)){
-			return false;
-		}
+	if (!ComputeHeightsTGA(file.GetData(), file.GetSize())){
+		return false;
 	}
 	return true;
 }
 
-FILE * TerrainLoader::LoadTGA(char* filename){
-	FILE * fTGA;										// File pointer to texture file
-	fTGA = fopen(filename, "rb");						// Open file for reading
+bool TerrainLoader::LoadTerrainRaw(char* filename, HEIGHTMAP_FORMAT format, int width, int depth){
+	delete [] height;
+	height = nullptr;
 
-	if(fTGA == NULL){									// If it didn't open....	
-		MessageBox(NULL, L"Could not open texture file", L"ERROR", MB_OK);	// Display an error message
-		return NULL;														// Exit function
+	MappedFile file;
+	if (!file.Open(filename)){
+		MessageBox(NULL, L"Could not open heightmap file", L"ERROR", MB_OK);
+		return false;
 	}
 
-	//we need to see what type of TGA we are loading. 
-	if(fread(&Tgaheader, sizeof(TGAHeader), 1, fTGA) == 0){					// Attempt to read 12 byte header from file	
-		MessageBox(NULL, L"Could not read file header", L"ERROR", MB_OK);		// If it fails, display an error message 
-		if(fTGA != NULL){													// Check to seeiffile is still open		
-			fclose(fTGA);													// If it is, close it
-		}
-		return NULL;														// Exit function
+	if (!ComputeHeightsRaw(file.GetData(), file.GetSize(), format, width, depth)){
+		return false;
 	}
+	return true;
+}
 
-	if(memcmp(UTGAcompare, &Tgaheader, sizeof(Tgaheader)) == 0){			// See if header matches the predefined header
-		
-		return fTGA;														// If so - return the file
-	}
-	else{																	// If header matches neither type	
-		MessageBox(NULL, L"TGA file be type 2 or type 10 ", L"Invalid Image", MB_OK);	// Display an error
-		fclose(fTGA);
-		return NULL;																// Exit function
+bool TerrainLoader::ComputeHeightsTGA(const unsigned char* data, size_t size){
+	TgaDecoder tga;
+
+	if (!tga.Open(data, size)){
+		MessageBox(NULL, L"TGA file must be an 8-32 bit type 2, 3, 10 or 11 image", L"Invalid Image", MB_OK);
+		return false;
 	}
 
-	return NULL;							
-}
+	terrainWidth = tga.GetWidth();
+	terrainDepth = tga.GetHeight();
 
-bool TerrainLoader::ComputeHeights(FILE * fTGA){
-	TGA tga;
+	height = new float[terrainWidth*terrainDepth];
 
-	if(fread(tga.header, sizeof(tga.header), 1, fTGA) == 0){				// Read TGA header											
-		MessageBox(NULL, L"Could not read info header", L"ERROR", MB_OK);	// Display error if not read
-		if(fTGA != NULL){													// if file is still open		
-			fclose(fTGA);													// Close it
+	///The actual height computing and storing
+	//the height lives in the red channel (or the grey level) - the rows are decoded one at a time so a compressed
+	//image is never unpacked as a whole, and they're stored bottom up whichever way up the file is
+	unsigned char* row = new unsigned char[terrainWidth];
+	for (int i = 0; i < terrainDepth; i++){
+		int rowIndex;
+		if (!tga.ReadRow(row, TGA_ROW_RED, rowIndex)){
+			delete [] row;
+			MessageBox(NULL, L"Could not read image data", L"ERROR", MB_OK);
+			return false;
 		}
-		return false;														// Return failure
-	}	
 
-	unsigned int terrainTexture_width	= tga.header[1] * 256 + tga.header[0];			// Determine The TGA Width	(highbyte*256+lowbyte)
-	unsigned int terrainTexture_height	= tga.header[3] * 256 + tga.header[2];			// Determine The TGA Height	(highbyte*256+lowbyte)
-	unsigned int terrainTexture_bpp		= tga.header[4];								// Determine the bits per pixel
-
-	tga.width		= terrainTexture_width;										// Copy width into local structure						
-	tga.height		= terrainTexture_height;									// Copy height into local structure
-	tga.bpp			= terrainTexture_bpp;										// Copy BPP into local structure	
-	
-	if((terrainTexture_width <= 0) || (terrainTexture_height <= 0) || ((terrainTexture_bpp != 24) && (terrainTexture_bpp !=32)))	// Make sure all information is valid
-	{
-		MessageBox(NULL, L"Invalid texture information", L"ERROR", MB_OK);	// Display Error
-		if(fTGA != NULL){													// Check if file is still open		
-			fclose(fTGA);													// If so, close it
+		float* dest = height + rowIndex*terrainWidth;
+		for (int j = 0; j < terrainWidth; j++){
+			dest[j] = row[j];
 		}
-		return false;														// Return failed
 	}
+	delete [] row;
 
-	tga.bytesPerPixel	= (tga.bpp / 8);												// Compute the number of BYTES per pixel
-	tga.imageSize		= (tga.bytesPerPixel * tga.width * tga.height);					// Compute the total amout of memory needed to store data
-	unsigned char *terrainTexture_imageData	= new unsigned char[tga.imageSize];			// Allocate that much memory
+	//smooth out the terrain
+	SmoothHeights();
 
-	if(terrainTexture_imageData == NULL){											// If no space was allocated	
-		MessageBox(NULL, L"Could not allocate memory for image", L"ERROR", MB_OK);	// Display Error
-		fclose(fTGA);														// Close the file
-		return false;														// Return failed
-	}
+	return true;
+}
 
-	if(fread(terrainTexture_imageData, 1, tga.imageSize, fTGA) != tga.imageSize){	// Attempt to read image data	
-		MessageBox(NULL, L"Could not read image data", L"ERROR", MB_OK);			// Display Error
-		if(terrainTexture_imageData != NULL){										// If imagedata has data in it		
-			free(terrainTexture_imageData);											// Delete data from memory
-		}
-		fclose(fTGA);														// Close file
-		return false;														// Return failed
-	}
+bool TerrainLoader::ComputeHeightsRaw(const unsigned char* data, size_t size, HEIGHTMAP_FORMAT format, int width, int depth){
+	size_t bytesPerSample = (format == HEIGHTMAP_R16) ? sizeof(unsigned short) : sizeof(float);
+	size_t sampleCount = size / bytesPerSample;
 
-	height = new float[tga.width*tga.height];
+	//no header to read the size from - if none was given assume the map is square
+	if (width <= 0 || depth <= 0){
+		width = depth = (int)sqrt((double)sampleCount);
+		while ((size_t)(width+1)*(width+1) <= sampleCount)	// guard against sqrt rounding down
+			width = ++depth;
+	}
 
-	// Byte Swapping Optimized By Steve Thomas
-	for(int cswap = 0; cswap < (int)tga.imageSize; cswap += tga.bytesPerPixel){
-		terrainTexture_imageData[cswap] ^= terrainTexture_imageData[cswap+2] ^=
-		terrainTexture_imageData[cswap] ^= terrainTexture_imageData[cswap+2];
+	if (width <= 0 || (size_t)width*depth != sampleCount){
+		MessageBox(NULL, L"Heightmap size does not match its dimensions", L"ERROR", MB_OK);
+		return false;
 	}
 
-	fclose(fTGA); // Close file*/
+	terrainWidth = width;
+	terrainDepth = depth;
 
-	terrainWidth = tga.width;
-	terrainDepth = tga.height;
+	height = new float[width*depth];
 
-	///The actual height computing and storing
-	for (int i = 0; i < terrainWidth; i++){
-		for (int j = 0; j < terrainDepth; j++){
-			float pointHeight = terrainTexture_imageData[(j*terrainWidth+i)*3];
-			height[j*terrainWidth + i] = pointHeight;
+	const int pixelCount = terrainWidth*terrainDepth;
+	if (format == HEIGHTMAP_R16){
+		//map the 16 bit range onto the same 0-255 range an 8 bit map has so HEIGHT_FACTOR scales both the same
+		const unsigned short* samples = (const unsigned short*)data;
+		const float scale = 255.0f / 65535.0f;
+		for (int i = 0; i < pixelCount; i++){
+			height[i] = samples[i] * scale;
 		}
 	}
-
-	delete [] terrainTexture_imageData;
-	terrainTexture_imageData = nullptr;
+	else{
+		//float maps are stored in height units already
+		memcpy(height, data, pixelCount*sizeof(float));
+	}
 
 	//smooth out the terrain
-	for (int i = 0; i < 4; i++)
-		SmoothHeights(0.75f);
+	SmoothHeights();
 
-	return true;															
+	return true;
 }
 
-//Smooth out each vertex depending on the nearest vertices to it using the float as the smoothing factor on how much to decrease/increase height
-void TerrainLoader::SmoothHeights(float factor){	
-	
-	float k = factor;
-	for (int i = 1; i < terrainWidth; i++)
-		for (int j = 0; j < terrainDepth; j++)
-			height[j*terrainWidth + i] = height[j*terrainWidth + i - 1]*(1-k) + height[j*terrainWidth + i] * k;
-
-	for (int i = terrainWidth-2; i < -1; i--)
-		for (int j = 0; j < terrainDepth; j++)
-			height[j*terrainWidth + i] = height[j*terrainWidth + i + 1]*(1-k) + height[j*terrainWidth + i] * k;
-
-	for (int i = 0; i < terrainWidth; i++)
-		for (int j = 1; j < terrainDepth; j++)
-			height[j*terrainWidth + i] = height[(j-1)*terrainWidth + i]*(1-k) + height[j*terrainWidth + i] * k;
-
-	for (int i = 0; i < terrainWidth; i++)
-		for (int j = terrainDepth; j < -1; j--)
-			height[j*terrainWidth + i] = height[(j+1)*terrainWidth + i]*(1-k) + height[j*terrainWidth + i] * k;
+void TerrainLoader::SetSmoothing(SMOOTH_KERNEL kernel, int iterations, float amount){
+	smoothKernel = kernel;
+	smoothIterations = iterations;
+	smoothAmount = amount;
+}
+
+//Smooth out the heights with the chosen kernel. The rows of the heightmap are terrainWidth long so every pass runs along them
+void TerrainLoader::SmoothHeights(){
+	if (smoothKernel == SMOOTH_NONE || smoothIterations <= 0)
+		return;
+
+	if (smoothKernel == SMOOTH_EXPONENTIAL){
+		for (int i = 0; i < smoothIterations; i++)
+			SmoothHeightsExponential(height, terrainDepth, terrainWidth, smoothAmount);
+		return;
+	}
+
+	//box and gaussian are both separable - build the weights along one axis
+	int radius;
+	if (smoothKernel == SMOOTH_BOX)
+		radius = (int)(smoothAmount + 0.5f);
+	else
+		radius = (int)ceilf(smoothAmount*3.0f);		//three standard deviations covers nearly all of the curve
+	radius = Clamp(radius, 0, MAX_SMOOTH_RADIUS);
+	if (radius == 0)
+		return;
+
+	int taps = 2*radius + 1;
+	float weights[2*MAX_SMOOTH_RADIUS + 1];
+	float total = 0.0f;
+	for (int t = 0; t < taps; t++){
+		float d = (float)(t - radius);
+		weights[t] = (smoothKernel == SMOOTH_BOX) ? 1.0f : expf(-d*d / (2.0f*smoothAmount*smoothAmount));
+		total += weights[t];
+	}
+	for (int t = 0; t < taps; t++)
+		weights[t] /= total;
+
+	float *scratch = new float[taps*terrainWidth];
+	for (int i = 0; i < smoothIterations; i++)
+		SmoothHeightsSeparable(height, terrainDepth, terrainWidth, weights, radius, scratch);
+	delete [] scratch;
 }
 
 float TerrainLoader::GetHeight(int x, int z){
@@ -6,9 +6,18 @@
 #define _TERRAINLOADER_H
 
 #include "d3dUtil.h"
-#include "TgaHeader.h"
+#include "TgaDecoder.h"
+#include "MappedFile.h"
+#include "TerrainKernels.h"
 
-const unsigned char UTGAcompare[12] = {0,0,2, 0,0,0,0,0,0,0,0,0};	// Uncompressed TGA Header
+// headerless heightmap formats, one sample per texel stored row after row
+enum HEIGHTMAP_FORMAT{HEIGHTMAP_R16 = 0, HEIGHTMAP_R32F = 1};
+
+// filters the heights can be smoothed with once they're loaded
+// SMOOTH_EXPONENTIAL	- blends each height into its left and upper neighbours, amount is the weight kept (0-1)
+// SMOOTH_BOX			- averages the heights over a square, amount is its radius in texels
+// SMOOTH_GAUSSIAN		- gaussian blur, amount is the standard deviation in texels
+enum SMOOTH_KERNEL{SMOOTH_NONE = 0, SMOOTH_EXPONENTIAL = 1, SMOOTH_BOX = 2, SMOOTH_GAUSSIAN = 3};
 
 class TerrainLoader{
 public:
@@ -16,15 +25,18 @@ public:
 	~TerrainLoader();
 
 	bool	LoadTerrain(char* filename);
+	bool	LoadTerrainRaw(char* filename, HEIGHTMAP_FORMAT format, int width = 0, int depth = 0);	// a width/depth of 0 assumes a square map
+
+	void	SetSmoothing(SMOOTH_KERNEL kernel, int iterations, float amount);	// call before loading, defaults to 4 exponential passes of 0.75
 
 	int		GetWidth();
 	int		GetDepth();
 	float	GetHeight(int x, int z);		// return the height value associated with the X Z coordinate
 
 private:
-	FILE	*LoadTGA(char* filename);		// loads in terrain heightmap to a file returns a pointer to the file
-	bool	ComputeHeights(FILE * fTGA);	// computes the heights from the TGA file
-	void	SmoothHeights(float factor);	// smooths out the heights in the terrain by the given factor
+	bool	ComputeHeightsTGA(const unsigned char* data, size_t size);		// decodes the heights straight out of the mapped TGA file
+	bool	ComputeHeightsRaw(const unsigned char* data, size_t size, HEIGHTMAP_FORMAT format, int width, int depth);
+	void	SmoothHeights();				// smooths out the heights in the terrain with the chosen kernel
 
 private:
 	float	*height;	// an array to hold the height values from the heightmap
@@ -32,7 +44,9 @@ private:
 	int		terrainWidth;
 	int		terrainDepth;
 
-	TGAHeader Tgaheader;
+	SMOOTH_KERNEL	smoothKernel;
+	int				smoothIterations;
+	float			smoothAmount;
 };
 
-#endif
\ No newline at end of file
+#endif
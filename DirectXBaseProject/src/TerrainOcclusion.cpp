@@ -0,0 +1,204 @@
+#include "TerrainOcclusion.h"
+#include <float.h>
+#include <algorithm>
+
+
+TerrainOcclusion::TerrainOcclusion(void){
+	binCount = 0;
+	blockLevel = 0;
+	binsPerRadian = 0.0f;
+	bucketSize = 1.0f;
+	camera = origin = Vector3f(0.0f, 0.0f, 0.0f);
+	tested = culled = 0;
+	Initialize();
+}
+
+void TerrainOcclusion::Initialize(int azimuthBins, int blockLevel){
+	binCount = Max(azimuthBins, 8);
+	this->blockLevel = Max(blockLevel, 0);
+	binsPerRadian = binCount / (2.0f*PI);
+	horizon.resize(binCount);
+	occluders.clear();
+	bucketStart.clear();
+}
+
+//the directions a rectangle on the ground covers from the camera (radians, angle0 < angle1 but either may be outside
+//-pi to pi) and how near and far it reaches. False when the camera is over it, when it covers every direction
+bool TerrainOcclusion::GetSpan(float x0, float z0, float x1, float z1, float& angle0, float& angle1, float& nearest, float& farthest)const{
+	float nearX = Max(Max(x0 - camera.x, camera.x - x1), 0.0f);
+	float nearZ = Max(Max(z0 - camera.z, camera.z - z1), 0.0f);
+	nearest = sqrtf(nearX*nearX + nearZ*nearZ);
+	if (nearest < 1e-3f)
+		return false;
+
+	float farX = Max(camera.x - x0, x1 - camera.x);
+	float farZ = Max(camera.z - z0, z1 - camera.z);
+	farthest = sqrtf(farX*farX + farZ*farZ);
+
+	//measured from the direction of the centre, which is less than pi away from every corner
+	float centre = atan2f((z0 + z1)*0.5f - camera.z, (x0 + x1)*0.5f - camera.x);
+	float cornerX[4] = {x0, x1, x0, x1};
+	float cornerZ[4] = {z0, z0, z1, z1};
+	float lo = 0.0f, hi = 0.0f;
+	for (int i = 0; i < 4; i++){
+		float angle = atan2f(cornerZ[i] - camera.z, cornerX[i] - camera.x) - centre;
+		if (angle > PI)
+			angle -= 2.0f*PI;
+		else if (angle < -PI)
+			angle += 2.0f*PI;
+		lo = Min(lo, angle);
+		hi = Max(hi, angle);
+	}
+	angle0 = centre + lo;
+	angle1 = centre + hi;
+	return true;
+}
+
+void TerrainOcclusion::Begin(const TerrainQuadtree& quadtree, const Vector3f& camera, const Vector3f& gridOrigin){
+	origin = gridOrigin;
+	this->camera = camera - gridOrigin;
+	tested = culled = 0;
+	occluders.clear();
+	bucketStart.clear();
+	if (quadtree.GetLevelCount() == 0)
+		return;
+
+	int level = Min(blockLevel, quadtree.GetLevelCount() - 1);
+	int rows, cols;
+	const float* bounds = quadtree.GetLevel(level, rows, cols);
+	int cellRows, cellCols;
+	quadtree.GetLevel(0, cellRows, cellCols);
+
+	float dx = quadtree.GetCellSpacing();
+	float originX = quadtree.GetOriginX();
+	float originZ = quadtree.GetOriginZ();
+	int blockCells = 1 << level;
+	bucketSize = blockCells*dx;
+
+	std::vector<Occluder> unsorted;
+	std::vector<int> buckets;
+	int bucketCount = 0;
+
+	for (int i = 0; i < rows; i++){
+		for (int j = 0; j < cols; j++){
+			float x0 = originX + j*blockCells*dx;
+			float x1 = originX + Min((j + 1)*blockCells, cellCols)*dx;
+			float z1 = originZ - i*blockCells*dx;
+			float z0 = originZ - Min((i + 1)*blockCells, cellRows)*dx;
+
+			float angle0, angle1, nearest, farthest;
+			if (!GetSpan(x0, z0, x1, z1, angle0, angle1, nearest, farthest))
+				continue;
+
+			//only the bins the block covers all the way across
+			Occluder occluder;
+			occluder.firstBin = (int)ceilf((angle0 + PI)*binsPerRadian);
+			occluder.lastBin = (int)floorf((angle1 + PI)*binsPerRadian) - 1;
+			if (occluder.lastBin < occluder.firstBin)
+				continue;
+			int wrap = (occluder.firstBin < 0) ? binCount : (occluder.firstBin >= binCount ? -binCount : 0);
+			occluder.firstBin += wrap;
+			occluder.lastBin += wrap;
+
+			//the lowest the top of the column could be seen at from anywhere on the block
+			float height = bounds[(i*cols + j)*2] - this->camera.y;
+			occluder.elevation = height / (height >= 0.0f ? farthest : nearest);
+
+			int bucket = (int)(farthest / bucketSize);
+			bucketCount = Max(bucketCount, bucket + 1);
+			unsorted.push_back(occluder);
+			buckets.push_back(bucket);
+		}
+	}
+
+	//counting sort into the distance buckets
+	bucketStart.assign(bucketCount + 1, 0);
+	for (unsigned int i = 0; i < buckets.size(); i++)
+		bucketStart[buckets[i] + 1]++;
+	for (int b = 0; b < bucketCount; b++)
+		bucketStart[b + 1] += bucketStart[b];
+
+	occluders.resize(unsorted.size());
+	std::vector<int> next(bucketStart.begin(), bucketStart.end() - 1);
+	for (unsigned int i = 0; i < unsorted.size(); i++)
+		occluders[next[buckets[i]]++] = unsorted[i];
+}
+
+int TerrainOcclusion::Cull(const Vector3f* boxMin, const Vector3f* boxMax, int count, BYTE* visible){
+	struct BoxSpan
+	{
+		int		firstBin, lastBin;
+		float	elevation;
+	};
+	std::vector<BoxSpan> spans(count);
+
+	order.clear();
+	for (int i = 0; i < count; i++){
+		visible[i] = 1;
+		tested++;
+
+		Vector3f lo = boxMin[i] - origin;
+		Vector3f hi = boxMax[i] - origin;
+		float angle0, angle1, nearest, farthest;
+		if (bucketStart.empty() || !GetSpan(lo.x, lo.z, hi.x, hi.z, angle0, angle1, nearest, farthest))
+			continue;
+
+		//every bin the box touches, and the highest it could be seen at
+		BoxSpan& span = spans[i];
+		span.firstBin = (int)floorf((angle0 + PI)*binsPerRadian);
+		span.lastBin = (int)floorf((angle1 + PI)*binsPerRadian);
+		int wrap = (span.firstBin < 0) ? binCount : (span.firstBin >= binCount ? -binCount : 0);
+		span.firstBin += wrap;
+		span.lastBin += wrap;
+		float height = hi.y - camera.y;
+		span.elevation = height / (height >= 0.0f ? nearest : farthest);
+
+		order.push_back(std::make_pair((int)(nearest / bucketSize), i));
+	}
+
+	std::sort(order.begin(), order.end());
+
+	//grow the horizon bucket by bucket, testing each box once every block nearer than it has been added
+	std::fill(horizon.begin(), horizon.end(), -FLT_MAX);
+	int bucketCount = bucketStart.size() - 1;
+	int applied = 0;
+	int hidden = 0;
+
+	for (unsigned int k = 0; k < order.size(); k++){
+		int box = order[k].second;
+		for (; applied < Min(order[k].first, bucketCount); applied++){
+			for (int o = bucketStart[applied]; o < bucketStart[applied + 1]; o++){
+				const Occluder& occluder = occluders[o];
+				for (int b = occluder.firstBin; b <= occluder.lastBin; b++){
+					float& h = horizon[b < binCount ? b : b - binCount];
+					h = Max(h, occluder.elevation);
+				}
+			}
+		}
+
+		const BoxSpan& span = spans[box];
+		bool occluded = true;
+		for (int b = span.firstBin; b <= span.lastBin && occluded; b++){
+			occluded = span.elevation < horizon[b < binCount ? b : b - binCount];
+		}
+		if (occluded){
+			visible[box] = 0;
+			hidden++;
+		}
+	}
+
+	culled += hidden;
+	return hidden;
+}
+
+int TerrainOcclusion::GetTestedCount()const{
+	return tested;
+}
+
+int TerrainOcclusion::GetCulledCount()const{
+	return culled;
+}
+
+int TerrainOcclusion::GetOccluderCount()const{
+	return occluders.size();
+}
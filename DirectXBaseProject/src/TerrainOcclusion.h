@@ -0,0 +1,66 @@
+/////////////////////////////////////////////////////////////////////////
+// TERRAIN OCCLUSION - HORIZON CULLING OF WHAT THE TERRAIN HIDES
+/////////////////////////////////////////////////////////////////////////
+
+#ifndef _TERRAINOCCLUSION_H
+#define _TERRAINOCCLUSION_H
+
+#include "d3dUtil.h"
+#include "TerrainQuadtree.h"
+#include <vector>
+
+/*
+The horizon is kept as the steepest elevation (height over distance) of the terrain in every direction around the
+camera, split into azimuth bins. Each block of the terrain stands in for a solid column up to its lowest height, so
+it hides whatever is below the line from the camera to its top in every direction that crosses it fully. A box is
+culled when it's below the horizon in every direction it covers, counting only blocks that are entirely nearer to
+the camera than the box is - blocks are bucketed by distance so the horizon can be grown front to back while the
+boxes are tested in order of distance. It's conservative, it can only miss culling something, never hide something
+that's in view, and it doesn't depend on where the camera is looking.
+*/
+class TerrainOcclusion
+{
+public:
+	TerrainOcclusion(void);
+
+	// azimuthBins is how finely the horizon is kept, blockLevel the quadtree level whose nodes are the occluders
+	// (blocks of 2^blockLevel cells a side)
+	void Initialize(int azimuthBins = 1024, int blockLevel = 3);
+
+	// gathers this frame's occluders. The camera is in world space, gridOrigin is where the grid's space is in the world
+	void Begin(const TerrainQuadtree& quadtree, const Vector3f& camera, const Vector3f& gridOrigin);
+
+	// tests count world space boxes, visible gets 0 for each box the terrain hides. Returns how many it hid
+	int  Cull(const Vector3f* boxMin, const Vector3f* boxMax, int count, BYTE* visible);
+
+	int  GetTestedCount()const;		// boxes tested since Begin
+	int  GetCulledCount()const;		// of those, the ones the terrain hid
+	int  GetOccluderCount()const;
+
+private:
+	struct Occluder
+	{
+		int		firstBin, lastBin;	// bins fully covered, lastBin may run past the bin count and wraps
+		float	elevation;
+	};
+
+	bool	GetSpan(float x0, float z0, float x1, float z1, float& angle0, float& angle1, float& nearest, float& farthest)const;
+
+private:
+	int						binCount;
+	int						blockLevel;
+	float					binsPerRadian;
+	float					bucketSize;			// distance covered by each bucket of occluders
+	Vector3f				camera;				// in grid space
+	Vector3f				origin;
+
+	std::vector<Occluder>	occluders;			// sorted by bucket
+	std::vector<int>		bucketStart;		// first occluder of each bucket, with one past the end at the back
+	std::vector<float>		horizon;
+	std::vector<std::pair<int,int> > order;		// bucket and index of the boxes while culling
+
+	int						tested;
+	int						culled;
+};
+
+#endif
@@ -0,0 +1,366 @@
+#include "TerrainQuadtree.h"
+#include "ThreadPool.h"
+#include <float.h>
+
+
+TerrainQuadtree::TerrainQuadtree(void){
+	heights = nullptr;
+	gridRows = gridCols = 0;
+	cellSpacing = 1.0f;
+	originX = originZ = 0.0f;
+}
+
+TerrainQuadtree::~TerrainQuadtree(void){
+	Shutdown();
+}
+
+void TerrainQuadtree::Shutdown(){
+	levels.clear();
+	heights = nullptr;
+	gridRows = gridCols = 0;
+}
+
+bool TerrainQuadtree::Build(const float* heights, int rows, int cols, float cellSpacing, float originX, float originZ){
+	Shutdown();
+	if (!heights || rows < 2 || cols < 2)
+		return false;
+
+	this->heights = heights;
+	gridRows = rows;
+	gridCols = cols;
+	this->cellSpacing = cellSpacing;
+	this->originX = originX;
+	this->originZ = originZ;
+
+	//bottom level - the bounds of the four corners of every cell
+	Level cells;
+	cells.rows = rows - 1;
+	cells.cols = cols - 1;
+	cells.bounds.resize(cells.rows*cells.cols*2);
+	for (int i = 0; i < cells.rows; i++){
+		const float* top = heights + i*cols;
+		const float* bottom = top + cols;
+		for (int j = 0; j < cells.cols; j++){
+			float lo = Min(Min(top[j], top[j+1]), Min(bottom[j], bottom[j+1]));
+			float hi = Max(Max(top[j], top[j+1]), Max(bottom[j], bottom[j+1]));
+			cells.bounds[(i*cells.cols + j)*2] = lo;
+			cells.bounds[(i*cells.cols + j)*2 + 1] = hi;
+		}
+	}
+	levels.push_back(cells);
+
+	//merge 2x2 nodes until there's only the root left - odd sized levels just have a thinner last row/column
+	while (levels.back().rows > 1 || levels.back().cols > 1){
+		const Level& below = levels.back();
+		Level level;
+		level.rows = (below.rows + 1) / 2;
+		level.cols = (below.cols + 1) / 2;
+		level.bounds.resize(level.rows*level.cols*2);
+
+		for (int i = 0; i < level.rows; i++){
+			for (int j = 0; j < level.cols; j++){
+				float lo = FLT_MAX;
+				float hi = -FLT_MAX;
+				for (int r = i*2; r < Min(i*2 + 2, below.rows); r++){
+					for (int c = j*2; c < Min(j*2 + 2, below.cols); c++){
+						lo = Min(lo, below.bounds[(r*below.cols + c)*2]);
+						hi = Max(hi, below.bounds[(r*below.cols + c)*2 + 1]);
+					}
+				}
+				level.bounds[(i*level.cols + j)*2] = lo;
+				level.bounds[(i*level.cols + j)*2 + 1] = hi;
+			}
+		}
+		levels.push_back(level);
+	}
+	return true;
+}
+
+bool TerrainQuadtree::GetBounds(int firstRow, int firstCol, int rows, int cols, float& minHeight, float& maxHeight)const{
+	if (levels.empty() || rows <= 0 || cols <= 0)
+		return false;
+
+	minHeight = FLT_MAX;
+	maxHeight = -FLT_MAX;
+	int top = levels.size() - 1;
+	GatherBounds(top, 0, 0, Max(firstRow, 0), Max(firstCol, 0), Min(firstRow + rows, levels[0].rows) - 1, Min(firstCol + cols, levels[0].cols) - 1, minHeight, maxHeight);
+	return minHeight <= maxHeight;
+}
+
+//takes a node whole if the block covers all of it, otherwise looks at its children
+void TerrainQuadtree::GatherBounds(int level, int row, int col, int firstRow, int firstCol, int lastRow, int lastCol, float& lo, float& hi)const{
+	int r0 = row << level;
+	int c0 = col << level;
+	int r1 = Min(((row + 1) << level), levels[0].rows) - 1;
+	int c1 = Min(((col + 1) << level), levels[0].cols) - 1;
+	if (r0 > lastRow || c0 > lastCol || r1 < firstRow || c1 < firstCol)
+		return;
+
+	const Level& node = levels[level];
+	if (level == 0 || (r0 >= firstRow && c0 >= firstCol && r1 <= lastRow && c1 <= lastCol)){
+		lo = Min(lo, node.bounds[(row*node.cols + col)*2]);
+		hi = Max(hi, node.bounds[(row*node.cols + col)*2 + 1]);
+		return;
+	}
+
+	const Level& below = levels[level-1];
+	for (int r = row*2; r < Min(row*2 + 2, below.rows); r++){
+		for (int c = col*2; c < Min(col*2 + 2, below.cols); c++){
+			GatherBounds(level-1, r, c, firstRow, firstCol, lastRow, lastCol, lo, hi);
+		}
+	}
+}
+
+const float* TerrainQuadtree::GetLevel(int level, int& rows, int& cols)const{
+	rows = levels[level].rows;
+	cols = levels[level].cols;
+	return &levels[level].bounds[0];
+}
+
+int TerrainQuadtree::GetLevelCount()const{
+	return levels.size();
+}
+
+float TerrainQuadtree::GetCellSpacing()const{
+	return cellSpacing;
+}
+
+float TerrainQuadtree::GetOriginX()const{
+	return originX;
+}
+
+float TerrainQuadtree::GetOriginZ()const{
+	return originZ;
+}
+
+//only the nodes over the changed vertices are worked out again - a vertex touches the cells on both sides of it
+void TerrainQuadtree::Refit(int firstRow, int firstCol, int lastRow, int lastCol){
+	if (levels.empty())
+		return;
+
+	int r0 = Max(firstRow - 1, 0);
+	int c0 = Max(firstCol - 1, 0);
+	int r1 = Min(lastRow, levels[0].rows - 1);
+	int c1 = Min(lastCol, levels[0].cols - 1);
+
+	Level& cells = levels[0];
+	for (int i = r0; i <= r1; i++){
+		const float* top = heights + i*gridCols;
+		const float* bottom = top + gridCols;
+		for (int j = c0; j <= c1; j++){
+			cells.bounds[(i*cells.cols + j)*2] = Min(Min(top[j], top[j+1]), Min(bottom[j], bottom[j+1]));
+			cells.bounds[(i*cells.cols + j)*2 + 1] = Max(Max(top[j], top[j+1]), Max(bottom[j], bottom[j+1]));
+		}
+	}
+
+	for (unsigned int l = 1; l < levels.size(); l++){
+		const Level& below = levels[l-1];
+		Level& level = levels[l];
+		r0 /= 2;	c0 /= 2;
+		r1 /= 2;	c1 /= 2;
+
+		for (int i = r0; i <= r1; i++){
+			for (int j = c0; j <= c1; j++){
+				float lo = FLT_MAX;
+				float hi = -FLT_MAX;
+				for (int r = i*2; r < Min(i*2 + 2, below.rows); r++){
+					for (int c = j*2; c < Min(j*2 + 2, below.cols); c++){
+						lo = Min(lo, below.bounds[(r*below.cols + c)*2]);
+						hi = Max(hi, below.bounds[(r*below.cols + c)*2 + 1]);
+					}
+				}
+				level.bounds[(i*level.cols + j)*2] = lo;
+				level.bounds[(i*level.cols + j)*2 + 1] = hi;
+			}
+		}
+	}
+}
+
+//slab test against the box of a node - tEnter is where the ray gets into it (0 if it starts inside)
+bool TerrainQuadtree::IntersectBox(int level, int row, int col, const Vector3f& origin, const Vector3f& dir, float maxDistance, float& tEnter)const{
+	const Level& node = levels[level];
+	int firstRow = row << level;
+	int firstCol = col << level;
+	int lastRow = Min((row + 1) << level, gridRows - 1);	//in vertices
+	int lastCol = Min((col + 1) << level, gridCols - 1);
+
+	float lo[3], hi[3];
+	lo[0] = originX + firstCol*cellSpacing;
+	hi[0] = originX + lastCol*cellSpacing;
+	lo[1] = node.bounds[(row*node.cols + col)*2];
+	hi[1] = node.bounds[(row*node.cols + col)*2 + 1];
+	lo[2] = originZ - lastRow*cellSpacing;
+	hi[2] = originZ - firstRow*cellSpacing;
+
+	float o[3] = {origin.x, origin.y, origin.z};
+	float d[3] = {dir.x, dir.y, dir.z};
+	float tMin = 0.0f;
+	float tMax = maxDistance;
+
+	for (int axis = 0; axis < 3; axis++){
+		if (d[axis] == 0.0f){
+			//parallel to this pair of planes, so it's either always between them or never
+			if (o[axis] < lo[axis] || o[axis] > hi[axis])
+				return false;
+			continue;
+		}
+		float inv = 1.0f / d[axis];
+		float t0 = (lo[axis] - o[axis])*inv;
+		float t1 = (hi[axis] - o[axis])*inv;
+		if (t0 > t1){
+			float swap = t0;
+			t0 = t1;
+			t1 = swap;
+		}
+		tMin = Max(tMin, t0);
+		tMax = Min(tMax, t1);
+		if (tMin > tMax)
+			return false;
+	}
+
+	tEnter = tMin;
+	return true;
+}
+
+//the two triangles of a cell split the same way the grid draws them - (A,B,C) and (C,B,D)
+//	A*--*B
+//	 | /|
+//	 |/ |
+//	C*--*D
+bool TerrainQuadtree::IntersectCell(int row, int col, const Vector3f& origin, const Vector3f& dir, float maxDistance, float& hitDistance)const{
+	float x0 = originX + col*cellSpacing;
+	float z0 = originZ - row*cellSpacing;
+	const float* top = heights + row*gridCols + col;
+
+	Vector3f A(x0, top[0], z0);
+	Vector3f B(x0 + cellSpacing, top[1], z0);
+	Vector3f C(x0, top[gridCols], z0 - cellSpacing);
+	Vector3f D(x0 + cellSpacing, top[gridCols + 1], z0 - cellSpacing);
+
+	const Vector3f* triangles[2][3] = {{&A, &B, &C}, {&C, &B, &D}};
+	bool hit = false;
+
+	for (int k = 0; k < 2; k++){
+		//moller-trumbore, hitting either side of the triangle
+		Vector3f edge1 = *triangles[k][1] - *triangles[k][0];
+		Vector3f edge2 = *triangles[k][2] - *triangles[k][0];
+		Vector3f p, q;
+		D3DXVec3Cross(&p, &dir, &edge2);
+		float det = D3DXVec3Dot(&edge1, &p);
+		if (fabsf(det) < 1e-12f)
+			continue;
+		float invDet = 1.0f / det;
+
+		Vector3f s = origin - *triangles[k][0];
+		float u = D3DXVec3Dot(&s, &p)*invDet;
+		if (u < 0.0f || u > 1.0f)
+			continue;
+
+		D3DXVec3Cross(&q, &s, &edge1);
+		float v = D3DXVec3Dot(&dir, &q)*invDet;
+		if (v < 0.0f || u + v > 1.0f)
+			continue;
+
+		float t = D3DXVec3Dot(&edge2, &q)*invDet;
+		if (t >= 0.0f && t <= maxDistance){
+			maxDistance = t;
+			hitDistance = t;
+			hit = true;
+		}
+	}
+	return hit;
+}
+
+bool TerrainQuadtree::RayCast(const Vector3f& origin, const Vector3f& dir, float maxDistance, float& hitDistance)const{
+	if (levels.empty())
+		return false;
+
+	struct Node
+	{
+		int		level, row, col;
+		float	tEnter;
+	};
+
+	//a node is only ever replaced by its own (at most four) children so the stack can't get deeper than this
+	Node stack[32*3 + 1];
+	int top = 0;
+
+	float closest = maxDistance;
+	bool hit = false;
+
+	Node root;
+	root.level = (int)levels.size() - 1;
+	root.row = root.col = 0;
+	if (!IntersectBox(root.level, 0, 0, origin, dir, closest, root.tEnter))
+		return false;
+	stack[top++] = root;
+
+	while (top > 0){
+		Node node = stack[--top];
+		//a closer hit was found since this node was pushed
+		if (node.tEnter > closest)
+			continue;
+
+		if (node.level == 0){
+			float t;
+			if (IntersectCell(node.row, node.col, origin, dir, closest, t)){
+				closest = t;
+				hit = true;
+			}
+			continue;
+		}
+
+		//push the children the ray passes through, furthest first so the nearest is visited next
+		const Level& below = levels[node.level - 1];
+		Node children[4];
+		int childCount = 0;
+		for (int r = node.row*2; r < Min(node.row*2 + 2, below.rows); r++){
+			for (int c = node.col*2; c < Min(node.col*2 + 2, below.cols); c++){
+				Node child;
+				child.level = node.level - 1;
+				child.row = r;
+				child.col = c;
+				if (!IntersectBox(child.level, r, c, origin, dir, closest, child.tEnter))
+					continue;
+
+				//insertion sort, nearest last
+				int k = childCount++;
+				while (k > 0 && children[k-1].tEnter < child.tEnter){
+					children[k] = children[k-1];
+					k--;
+				}
+				children[k] = child;
+			}
+		}
+		for (int k = 0; k < childCount; k++){
+			stack[top++] = children[k];
+		}
+	}
+
+	if (hit)
+		hitDistance = closest;
+	return hit;
+}
+
+void TerrainQuadtree::RayCastRange(int first, int last, void* data){
+	BatchQuery *query = (BatchQuery*)data;
+	for (int i = first; i < last; i++){
+		float t;
+		if (query->tree->RayCast(query->origins[i], query->dirs[i], query->maxDistance, t))
+			query->hitDistances[i] = t;
+		else
+			query->hitDistances[i] = -1.0f;
+	}
+}
+
+void TerrainQuadtree::RayCast(const Vector3f* origins, const Vector3f* dirs, int count, float maxDistance, float* hitDistances)const{
+	BatchQuery query;
+	query.tree = this;
+	query.origins = origins;
+	query.dirs = dirs;
+	query.maxDistance = maxDistance;
+	query.hitDistances = hitDistances;
+
+	//every ray is independent so they're split over the pool in chunks big enough to be worth handing out
+	ThreadPool::GetShared()->ParallelFor(count, 256, RayCastRange, &query);
+}
@@ -0,0 +1,77 @@
+/////////////////////////////////////////////////////////////////////////
+// TERRAIN QUADTREE - MIN/MAX HEIGHT BOUNDS FOR CASTING RAYS AT THE TERRAIN
+/////////////////////////////////////////////////////////////////////////
+
+#ifndef _TERRAINQUADTREE_H
+#define _TERRAINQUADTREE_H
+
+#include "d3dUtil.h"
+#include "Vertex.h"
+#include <vector>
+
+/*
+Every level of the tree is a grid of nodes holding the lowest and highest height underneath them. The bottom
+level has a node per cell of the terrain and every level above merges 2x2 nodes of the one below, up to a single
+root. A ray only walks down into nodes whose bounding box it passes through - nearest first, stopping as soon as
+a hit is closer than any box left to visit - and only tests the two triangles of the cells it reaches.
+*/
+class TerrainQuadtree
+{
+public:
+	TerrainQuadtree(void);
+	~TerrainQuadtree(void);
+
+	// rows/cols are the vertex counts of the grid and heights is row major with a pitch of cols. originX/originZ
+	// is the position of the first vertex, columns run along +x and rows along -z like they do in the grid.
+	// The heights aren't copied so they have to outlive the tree
+	bool Build(const float* heights, int rows, int cols, float cellSpacing, float originX, float originZ);
+	void Shutdown();
+	// call after the heights of the vertices in rows firstRow to lastRow and columns firstCol to lastCol have changed
+	void Refit(int firstRow, int firstCol, int lastRow, int lastCol);
+
+	// lowest and highest height over a block of cells, from the fewest nodes that cover it
+	bool GetBounds(int firstRow, int firstCol, int rows, int cols, float& minHeight, float& maxHeight)const;
+
+	// the nodes of a level as interleaved min/max heights, row major. A node of level l covers 2^l x 2^l cells
+	const float* GetLevel(int level, int& rows, int& cols)const;
+	int   GetLevelCount()const;
+	float GetCellSpacing()const;
+	float GetOriginX()const;
+	float GetOriginZ()const;
+
+	// first hit of the ray with the terrain within maxDistance. Distances are measured in lengths of dir
+	bool RayCast(const Vector3f& origin, const Vector3f& dir, float maxDistance, float& hitDistance)const;
+
+	// casts count rays spread over the thread pool. hitDistances gets the distance of each hit or -1 for a miss
+	void RayCast(const Vector3f* origins, const Vector3f* dirs, int count, float maxDistance, float* hitDistances)const;
+
+private:
+	struct Level
+	{
+		int					rows, cols;		// nodes along each side
+		std::vector<float>	bounds;			// min and max height of each node, interleaved
+	};
+
+	struct BatchQuery
+	{
+		const TerrainQuadtree	*tree;
+		const Vector3f			*origins;
+		const Vector3f			*dirs;
+		float					maxDistance;
+		float					*hitDistances;
+	};
+
+	void	GatherBounds(int level, int row, int col, int firstRow, int firstCol, int lastRow, int lastCol, float& lo, float& hi)const;
+	bool	IntersectBox(int level, int row, int col, const Vector3f& origin, const Vector3f& dir, float maxDistance, float& tEnter)const;
+	bool	IntersectCell(int row, int col, const Vector3f& origin, const Vector3f& dir, float maxDistance, float& hitDistance)const;
+	static void RayCastRange(int first, int last, void* data);
+
+private:
+	const float*		heights;
+	int					gridRows, gridCols;
+	float				cellSpacing;
+	float				originX, originZ;
+	std::vector<Level>	levels;				// levels[0] has a node per cell, the last level is the root
+};
+
+#endif
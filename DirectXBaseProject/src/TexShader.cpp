@@ -1,13 +1,21 @@
 #include "TexShader.h"
+#include "TerrainLightBaker.h"
 
 
 TexShader::TexShader(void)
 {
+	mCompactTechnique = 0;
+	mCompactLayout = 0;
+
+	mOcclusionMap = 0;
+	mHorizonMap[0] = mHorizonMap[1] = 0;
+	mLightMapTransform = D3DXVECTOR4(0.0f, 0.0f, 0.0f, 0.0f);
 }
 
 
 TexShader::~TexShader(void)	
 {
+	ReleaseCOM(mCompactLayout);
 }
 
 bool TexShader::Initialize(ID3D10Device* device, HWND hwnd, TEXTURETYPE texType){
@@ -38,14 +46,15 @@ void TexShader::RenderTexturing(ID3D10Device* device, int indexCount, D3DXMATRIX
 													  D3DXVECTOR3 mEyePos, 
 													  Light lightVar,
 													  ID3D10ShaderResourceView *diffuseMap,
-													  ID3D10ShaderResourceView *specularMap)
+													  ID3D10ShaderResourceView *specularMap,
+													  UINT startIndex)
 {
 
 	// Set the shader parameters that it will use for rendering.
 	SetShaderParametersTexturing(indexCount, worldMatrix, viewMatrix, projectionMatrix, mEyePos, lightVar, diffuseMap, specularMap);
 
 	// Now render the prepared buffers with the shader.
-	RenderShader(device, indexCount);
+	RenderShader(device, indexCount, startIndex);
 }
 
 void TexShader::RenderMultiTexturing(ID3D10Device* device, int indexCount, 
@@ -60,13 +69,29 @@ void TexShader::RenderMultiTexturing(ID3D10Device* device, int indexCount,
 													  ID3D10ShaderResourceView* diffuseMapRV2,
 													  ID3D10ShaderResourceView* diffuseMapRV3,
 													  float maxHeight,
-													  int lightType){
+													  int lightType,
+													  UINT startIndex,
+													  INT baseVertex,
+													  const TerrainVertexLayout* compactLayout){
 
 	// Set the shader parameters that it will use for rendering.
 	SetShaderParametersMultiTexturing(indexCount, worldMatrix, viewMatrix, projectionMatrix, mEyePos, lightVar, specularMap, blendMap,diffuseMapRV1,diffuseMapRV2,diffuseMapRV3,maxHeight,lightType);
 
+	if (compactLayout && mCompactLayout){
+		// The vertex shader rebuilds the positions, normals and texture coordinates from the layout.
+		float origin[4] = {compactLayout->originX, compactLayout->originZ, compactLayout->cellSpacing, 0.0f};
+		float height[4] = {compactLayout->heightBias, compactLayout->heightScale, compactLayout->texScaleRow, compactLayout->texScaleCol};
+		int vertex[4] = {compactLayout->pitch, compactLayout->firstRow, compactLayout->firstCol, compactLayout->baseVertex};
+		mTerrainOrigin->SetFloatVector(origin);
+		mTerrainHeight->SetFloatVector(height);
+		mTerrainVertex->SetIntVector(vertex);
+
+		RenderShader(device, mCompactTechnique, mCompactLayout, indexCount, startIndex, baseVertex);
+		return;
+	}
+
 	// Now render the prepared buffers with the shader.
-	RenderShader(device, indexCount);
+	RenderShader(device, indexCount, startIndex, baseVertex);
 }
 
 void TexShader::SetShaderParametersTexturing(int indexCount, 
@@ -134,6 +159,34 @@ void TexShader::SetShaderParametersMultiTexturing(int indexCount,
 	mHeights[0]->SetFloat(0.0f);
 	mHeights[1]->SetFloat(maxHeight/3.0f);
 	mHeights[2]->SetFloat(maxHeight);
+
+	//Set the baked lighting - the horizon under the light is blended from the two baked directions either side of it
+	mBakedLighting->SetInt(mOcclusionMap ? (mHorizonMap[0] && mHorizonMap[1] ? 2 : 1) : 0);
+	mOcclusionMapVar->SetResource(mOcclusionMap);
+	mHorizonMapVar[0]->SetResource(mHorizonMap[0]);
+	mHorizonMapVar[1]->SetResource(mHorizonMap[1]);
+	mLightMapTransformVar->SetFloatVector((float*)&mLightMapTransform);
+
+	float weights[HORIZON_DIRECTIONS] = {0.0f};
+	float azimuth = atan2f(-lightVar.dir.z, -lightVar.dir.x)/(2.0f*PI)*HORIZON_DIRECTIONS;
+	if (azimuth < 0.0f)
+		azimuth += HORIZON_DIRECTIONS;
+	int direction = Min((int)azimuth, HORIZON_DIRECTIONS - 1);
+	float blend = azimuth - direction;
+	weights[direction] = 1.0f - blend;
+	weights[(direction + 1) % HORIZON_DIRECTIONS] = blend;
+	mHorizonWeights[0]->SetFloatVector(weights);
+	mHorizonWeights[1]->SetFloatVector(weights + 4);
+}
+
+void TexShader::SetBakedLighting(ID3D10ShaderResourceView* occlusionMap,
+								 ID3D10ShaderResourceView* horizonMap0,
+								 ID3D10ShaderResourceView* horizonMap1,
+								 D3DXVECTOR4 mapTransform){
+	mOcclusionMap = occlusionMap;
+	mHorizonMap[0] = horizonMap0;
+	mHorizonMap[1] = horizonMap1;
+	mLightMapTransform = mapTransform;
 }
 
 bool TexShader::InitializeShader(ID3D10Device* device, HWND hwnd, WCHAR* filename){
@@ -235,5 +288,35 @@ bool TexShader::InitializeShader(ID3D10Device* device, HWND hwnd, WCHAR* filenam
 	mHeights[0]			= mEffect->GetVariableByName("height1")->AsScalar();
 	mHeights[1]			= mEffect->GetVariableByName("height2")->AsScalar();
 	mHeights[2]			= mEffect->GetVariableByName("height3")->AsScalar();
+
+	mOcclusionMapVar		= mEffect->GetVariableByName("gOcclusionMap")->AsShaderResource();
+	mHorizonMapVar[0]		= mEffect->GetVariableByName("gHorizonMap0")->AsShaderResource();
+	mHorizonMapVar[1]		= mEffect->GetVariableByName("gHorizonMap1")->AsShaderResource();
+	mLightMapTransformVar	= mEffect->GetVariableByName("gLightMapTransform")->AsVector();
+	mHorizonWeights[0]		= mEffect->GetVariableByName("gHorizonWeights0")->AsVector();
+	mHorizonWeights[1]		= mEffect->GetVariableByName("gHorizonWeights1")->AsVector();
+	mBakedLighting			= mEffect->GetVariableByName("gBakedLighting")->AsScalar();
+
+	// The multitexturing effect can also draw the terrain from compact vertices - the layout has to match VertexTerrain.
+	mCompactTechnique = mEffect->GetTechniqueByName("TextureTechniqueCompact");
+	if(mCompactTechnique->IsValid())
+	{
+		D3D10_INPUT_ELEMENT_DESC compactLayout[] = {
+			{"HEIGHT", 0, DXGI_FORMAT_R16_UNORM, 0, 0, D3D10_INPUT_PER_VERTEX_DATA, 0},
+			{"NORMAL", 0, DXGI_FORMAT_R8G8_UNORM, 0, D3D10_APPEND_ALIGNED_ELEMENT, D3D10_INPUT_PER_VERTEX_DATA, 0},
+		};
+
+		mCompactTechnique->GetPassByIndex(0)->GetDesc(&passDesc);
+		result = device->CreateInputLayout(compactLayout, sizeof(compactLayout) / sizeof(compactLayout[0]), passDesc.pIAInputSignature,
+										   passDesc.IAInputSignatureSize, &mCompactLayout);
+		if(FAILED(result))
+		{
+			return false;
+		}
+
+		mTerrainOrigin	= mEffect->GetVariableByName("gTerrainOrigin")->AsVector();
+		mTerrainHeight	= mEffect->GetVariableByName("gTerrainHeight")->AsVector();
+		mTerrainVertex	= mEffect->GetVariableByName("gTerrainVertex")->AsVector();
+	}
 	return true;
 }
\ No newline at end of file
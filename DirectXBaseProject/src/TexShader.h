@@ -5,6 +5,7 @@
 
 #include "Shader.h"
 #include "Light.h"
+#include "Vertex.h"
 
 enum TEXTURETYPE{REGULAR = 0,MULTI = 1};
 
@@ -22,7 +23,8 @@ public:
 													  D3DXVECTOR3 mEyePos, 
 													  Light lightVar,
 													  ID3D10ShaderResourceView *diffuseMap,
-													  ID3D10ShaderResourceView *specularMap);
+													  ID3D10ShaderResourceView *specularMap,
+													  UINT startIndex = 0);
 
 	void RenderMultiTexturing(ID3D10Device* device, int indexCount, 
 													  D3DXMATRIX worldMatrix, 
@@ -36,7 +38,17 @@ public:
 													  ID3D10ShaderResourceView* diffuseMapRV2,
 													  ID3D10ShaderResourceView* diffuseMapRV3,
 													  float maxHeight,
-													  int lightType = 0);
+													  int lightType = 0,
+													  UINT startIndex = 0,
+													  INT baseVertex = 0,
+													  const TerrainVertexLayout* compactLayout = nullptr);	// draws compact terrain vertices when set
+
+	// lighting baked into the terrain (see Grid::SetBakedLighting) used by the multitexturing draws from now on - a null
+	// occlusion map turns it off and null horizon maps leave out the shadowing of the parallel light
+	void SetBakedLighting(ID3D10ShaderResourceView* occlusionMap,
+						  ID3D10ShaderResourceView* horizonMap0,
+						  ID3D10ShaderResourceView* horizonMap1,
+						  D3DXVECTOR4 mapTransform);
 	~TexShader(void);
 
 private:
@@ -51,6 +63,21 @@ private:
 	ID3D10EffectShaderResourceVariable* mBlendMap;				//for multi texturing
 	ID3D10EffectShaderResourceVariable* mDiffuseMapRV[3];		//for multi texturing
 
+	ID3D10EffectTechnique*				mCompactTechnique;		//for terrain drawn with compact vertices
+	ID3D10InputLayout*					mCompactLayout;
+	ID3D10EffectVectorVariable*			mTerrainOrigin;
+	ID3D10EffectVectorVariable*			mTerrainHeight;
+	ID3D10EffectVectorVariable*			mTerrainVertex;
+
+	ID3D10EffectShaderResourceVariable* mOcclusionMapVar;		//for baked terrain lighting
+	ID3D10EffectShaderResourceVariable* mHorizonMapVar[2];
+	ID3D10EffectVectorVariable*			mLightMapTransformVar;
+	ID3D10EffectVectorVariable*			mHorizonWeights[2];
+	ID3D10EffectScalarVariable*			mBakedLighting;
+	ID3D10ShaderResourceView*			mOcclusionMap;
+	ID3D10ShaderResourceView*			mHorizonMap[2];
+	D3DXVECTOR4							mLightMapTransform;
+
 	void SetShaderParametersTexturing(int indexCount, 
 							D3DXMATRIX worldMatrix, 
 							D3DXMATRIX viewMatrix, 
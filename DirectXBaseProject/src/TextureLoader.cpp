@@ -20,6 +20,53 @@ bool TextureLoader::Initialize(ID3D10Device* device, WCHAR* filename){
 	return true;
 }
 
+bool TextureLoader::Initialize(ID3D10Device* device, const void* texels, UINT width, UINT height, UINT pitch, DXGI_FORMAT format){
+	D3D10_TEXTURE2D_DESC desc;
+	desc.Width = width;
+	desc.Height = height;
+	desc.MipLevels = 1;
+	desc.ArraySize = 1;
+	desc.Format = format;
+	desc.SampleDesc.Count = 1;
+	desc.SampleDesc.Quality = 0;
+	desc.Usage = D3D10_USAGE_DEFAULT;
+	desc.BindFlags = D3D10_BIND_SHADER_RESOURCE;
+	desc.CPUAccessFlags = 0;
+	desc.MiscFlags = 0;
+
+	D3D10_SUBRESOURCE_DATA data;
+	data.pSysMem = texels;
+	data.SysMemPitch = pitch;
+	data.SysMemSlicePitch = 0;
+
+	ID3D10Texture2D* resource = NULL;
+	if (FAILED(device->CreateTexture2D(&desc, &data, &resource))){
+		return false;
+	}
+
+	// The view keeps the texture alive, so this reference can go.
+	HRESULT result = device->CreateShaderResourceView(resource, NULL, &texture);
+	ReleaseCOM(resource);
+	if(FAILED(result)){
+		return false;
+	}
+
+	return true;
+}
+
+void TextureLoader::Update(ID3D10Device* device, const void* texels, UINT pitch, UINT x, UINT y, UINT width, UINT height){
+	if (!texture){
+		return;
+	}
+
+	ID3D10Resource* resource = NULL;
+	texture->GetResource(&resource);
+
+	D3D10_BOX box = {x, y, 0, x + width, y + height, 1};
+	device->UpdateSubresource(resource, 0, &box, texels, pitch, 0);
+	ReleaseCOM(resource);
+}
+
 void TextureLoader::Shutdown(){
 	// Release the texture resource.
 	ReleaseCOM(texture);
@@ -15,6 +15,11 @@ public:
 	bool Initialize(ID3D10Device* device, WCHAR* filename);
 	void Shutdown();
 
+	/*Makes a single mip level texture from texels already in memory, pitch bytes apart a row, for maps that are
+	built at run time. Update replaces a block of it.*/
+	bool Initialize(ID3D10Device* device, const void* texels, UINT width, UINT height, UINT pitch, DXGI_FORMAT format);
+	void Update(ID3D10Device* device, const void* texels, UINT pitch, UINT x, UINT y, UINT width, UINT height);
+
 	/*The GetTexture function returns a pointer to the texture resource so that it 
 	can be used for rendering by shaders.*/
 	ID3D10ShaderResourceView* GetTexture();
@@ -0,0 +1,201 @@
+#include "TgaDecoder.h"
+#include <string.h>
+
+
+/*
+TGA header - 18 bytes, little endian
+	0	id length			8	x origin (2)
+	1	colour map type		10	y origin (2)
+	2	image type			12	width (2)
+	3	colour map spec (5)	14	height (2)
+							16	bits per pixel
+							17	descriptor - bits 0-3 alpha bits, bit 4 right to left, bit 5 top to bottom
+followed by the id field, the colour map and the pixels
+*/
+const size_t TGA_HEADER_SIZE = 18;
+
+TgaDecoder::TgaDecoder(void){
+	data = end = next = nullptr;
+	width = height = 0;
+	bitsPerPixel = bytesPerPixel = alphaBits = 0;
+	greyscale = compressed = topOrigin = rightOrigin = false;
+	rowsRead = 0;
+	packetLeft = 0;
+	packetRepeats = false;
+	memset(packetPixel, 0, sizeof(packetPixel));
+}
+
+bool TgaDecoder::Open(const unsigned char* data, size_t size){
+	this->data = next = nullptr;
+	if (!data || size < TGA_HEADER_SIZE)
+		return false;
+
+	int idLength = data[0];
+	int colourMapType = data[1];
+	int imageType = data[2];
+	int colourMapLength = data[5] | (data[6] << 8);
+	int colourMapEntryBits = data[7];
+
+	switch (imageType){
+	case 2:		greyscale = false;	compressed = false;	break;
+	case 3:		greyscale = true;	compressed = false;	break;
+	case 10:	greyscale = false;	compressed = true;	break;
+	case 11:	greyscale = true;	compressed = true;	break;
+	default:	return false;		//colour mapped or no image at all
+	}
+
+	width = data[12] | (data[13] << 8);
+	height = data[14] | (data[15] << 8);
+	bitsPerPixel = data[16];
+	alphaBits = data[17] & 0x0F;
+	rightOrigin = (data[17] & 0x10) != 0;
+	topOrigin = (data[17] & 0x20) != 0;
+
+	bool validDepth = greyscale ? (bitsPerPixel == 8 || bitsPerPixel == 16)
+								: (bitsPerPixel == 16 || bitsPerPixel == 24 || bitsPerPixel == 32);
+	if (width <= 0 || height <= 0 || !validDepth)
+		return false;
+	bytesPerPixel = bitsPerPixel / 8;
+
+	//a true colour image can still carry a colour map it doesn't use - skip past it
+	size_t offset = TGA_HEADER_SIZE + idLength;
+	if (colourMapType == 1)
+		offset += (colourMapLength*colourMapEntryBits + 7) / 8;
+	if (offset > size)
+		return false;
+
+	//an uncompressed image has to be all there, a compressed one is checked as it's read
+	if (!compressed && (size - offset) / bytesPerPixel < (size_t)width*height)
+		return false;
+
+	this->data = data;
+	end = data + size;
+	next = data + offset;
+	rowsRead = 0;
+	packetLeft = 0;
+	return true;
+}
+
+//turns a pixel as it's stored into BGRA
+void TgaDecoder::DecodePixel(const unsigned char* src, unsigned char* bgra)const{
+	if (greyscale){
+		bgra[0] = bgra[1] = bgra[2] = src[0];
+		bgra[3] = (bytesPerPixel == 2) ? src[1] : 255;
+		return;
+	}
+
+	switch (bytesPerPixel){
+	case 2:{
+		//A1R5G5B5, widening every 5 bit channel to 8 bits
+		unsigned int packed = src[0] | (src[1] << 8);
+		unsigned int r = (packed >> 10) & 31;
+		unsigned int g = (packed >> 5) & 31;
+		unsigned int b = packed & 31;
+		bgra[0] = (unsigned char)((b << 3) | (b >> 2));
+		bgra[1] = (unsigned char)((g << 3) | (g >> 2));
+		bgra[2] = (unsigned char)((r << 3) | (r >> 2));
+		bgra[3] = (alphaBits == 0 || (packed & 0x8000)) ? 255 : 0;
+		break;
+	}
+	case 3:
+		bgra[0] = src[0];
+		bgra[1] = src[1];
+		bgra[2] = src[2];
+		bgra[3] = 255;
+		break;
+	default:
+		bgra[0] = src[0];
+		bgra[1] = src[1];
+		bgra[2] = src[2];
+		bgra[3] = src[3];
+		break;
+	}
+}
+
+bool TgaDecoder::ReadPixel(unsigned char* bgra){
+	if (!compressed){
+		DecodePixel(next, bgra);
+		next += bytesPerPixel;
+		return true;
+	}
+
+	//packets may carry on from one row into the next so they're tracked across calls
+	if (packetLeft == 0){
+		if (next >= end)
+			return false;
+		unsigned char packetHeader = *next++;
+		packetLeft = (packetHeader & 0x7F) + 1;
+		packetRepeats = (packetHeader & 0x80) != 0;
+
+		if (packetRepeats){
+			if (end - next < bytesPerPixel)
+				return false;
+			DecodePixel(next, packetPixel);
+			next += bytesPerPixel;
+		}
+	}
+
+	packetLeft--;
+	if (packetRepeats){
+		memcpy(bgra, packetPixel, 4);
+		return true;
+	}
+
+	if (end - next < bytesPerPixel)
+		return false;
+	DecodePixel(next, bgra);
+	next += bytesPerPixel;
+	return true;
+}
+
+bool TgaDecoder::ReadRow(unsigned char* out, TGA_ROW_FORMAT format, int& row){
+	if (!data || rowsRead >= height)
+		return false;
+
+	if (!compressed && !greyscale && !rightOrigin && format == TGA_ROW_RED && bytesPerPixel >= 3){
+		//the common heightmap case - pick the red byte straight out of each stored BGR(A) pixel
+		for (int i = 0; i < width; i++){
+			out[i] = next[i*bytesPerPixel + 2];
+		}
+		next += width*bytesPerPixel;
+	}
+	else{
+		for (int i = 0; i < width; i++){
+			unsigned char bgra[4];
+			if (!ReadPixel(bgra))
+				return false;
+
+			int x = rightOrigin ? width - 1 - i : i;
+			if (format == TGA_ROW_RED){
+				out[x] = bgra[2];
+			}
+			else{
+				memcpy(out + x*4, bgra, 4);
+			}
+		}
+	}
+
+	row = topOrigin ? height - 1 - rowsRead : rowsRead;
+	rowsRead++;
+	return true;
+}
+
+int TgaDecoder::GetWidth()const{
+	return width;
+}
+
+int TgaDecoder::GetHeight()const{
+	return height;
+}
+
+int TgaDecoder::GetBitsPerPixel()const{
+	return bitsPerPixel;
+}
+
+bool TgaDecoder::IsGreyscale()const{
+	return greyscale;
+}
+
+bool TgaDecoder::IsCompressed()const{
+	return compressed;
+}
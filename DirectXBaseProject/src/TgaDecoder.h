@@ -0,0 +1,56 @@
+#ifndef _H_TGADECODER
+#define _H_TGADECODER
+
+#include <stddef.h>
+
+///DECODES A TGA IMAGE HELD IN MEMORY (USUALLY A MAPPED FILE) ONE ROW AT A TIME
+///HANDLES UNCOMPRESSED AND RLE TRUE COLOUR (TYPES 2 AND 10) AND GREYSCALE (TYPES 3 AND 11) IMAGES OF 8/16/24/32 BITS PER PIXEL
+///ONLY THE BYTES OF THE ROWS READ SO FAR ARE TOUCHED AND NOTHING BIGGER THAN A PIXEL IS BUFFERED
+
+enum TGA_ROW_FORMAT{
+	TGA_ROW_BGRA = 0,		// 4 bytes per pixel
+	TGA_ROW_RED = 1			// 1 byte per pixel - the red channel of a colour image or the grey level of a greyscale one
+};
+
+class TgaDecoder
+{
+public:
+	TgaDecoder(void);
+
+	bool	Open(const unsigned char* data, size_t size);	// reads the header, returns false for anything it can't decode
+
+	// decodes the next row in the order they're stored into out, which has to hold a row in the given format.
+	// row is where it goes counting up from the bottom of the image, whichever way up the file was saved
+	bool	ReadRow(unsigned char* out, TGA_ROW_FORMAT format, int& row);
+
+	int		GetWidth()const;
+	int		GetHeight()const;
+	int		GetBitsPerPixel()const;
+	bool	IsGreyscale()const;
+	bool	IsCompressed()const;
+
+private:
+	bool	ReadPixel(unsigned char* bgra);					// next pixel of the image, unpacking RLE packets as they come
+	void	DecodePixel(const unsigned char* src, unsigned char* bgra)const;
+
+private:
+	const unsigned char*	data;
+	const unsigned char*	end;
+	const unsigned char*	next;			// next byte of pixel data
+
+	int				width, height;
+	int				bitsPerPixel;
+	int				bytesPerPixel;
+	int				alphaBits;
+	bool			greyscale;
+	bool			compressed;
+	bool			topOrigin;				// rows are stored top down instead of bottom up
+	bool			rightOrigin;			// pixels are stored right to left
+	int				rowsRead;
+
+	int				packetLeft;				// pixels left in the current RLE packet
+	bool			packetRepeats;			// a run of one pixel rather than a list of them
+	unsigned char	packetPixel[4];			// the repeated pixel as BGRA
+};
+
+#endif
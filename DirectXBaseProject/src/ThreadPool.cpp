@@ -0,0 +1,197 @@
+#include "ThreadPool.h"
+
+
+ThreadPool::ThreadPool(void){
+	InitializeCriticalSection(&lock);
+	InitializeConditionVariable(&jobAvailable);
+	InitializeConditionVariable(&helperFinished);
+	stopping = false;
+}
+
+ThreadPool::~ThreadPool(void){
+	Shutdown();
+	DeleteCriticalSection(&lock);
+}
+
+bool ThreadPool::Initialize(int threadCount){
+	Shutdown();
+
+	if (threadCount <= 0){
+		SYSTEM_INFO info;
+		GetSystemInfo(&info);
+		threadCount = (int)info.dwNumberOfProcessors - 1;
+	}
+
+	stopping = false;
+	for (int i = 0; i < threadCount; i++){
+		HANDLE thread = CreateThread(NULL, 0, WorkerThread, this, 0, NULL);
+		if (thread == NULL)
+			break;
+		threads.push_back(thread);
+	}
+
+	//no workers is still usable - ParallelFor then runs everything on the calling thread
+	return threadCount == 0 || !threads.empty();
+}
+
+void ThreadPool::Shutdown(){
+	if (threads.empty())
+		return;
+
+	EnterCriticalSection(&lock);
+	stopping = true;
+	WakeAllConditionVariable(&jobAvailable);
+	LeaveCriticalSection(&lock);
+
+	for (size_t i = 0; i < threads.size(); i++){
+		WaitForSingleObject(threads[i], INFINITE);
+		CloseHandle(threads[i]);
+	}
+	threads.clear();
+}
+
+int ThreadPool::GetThreadCount()const{
+	return (int)threads.size();
+}
+
+//function statics aren't made thread safe by VS2010, so the pool is built before WinMain and whichever thread asks
+//for it first starts it while any others wait
+static ThreadPool sharedPool;
+static volatile LONG sharedState = 0;		// 0 until someone starts the pool, 1 while they do, 2 once it's running
+
+ThreadPool* ThreadPool::GetShared(){
+	if (sharedState != 2){
+		if (InterlockedCompareExchange(&sharedState, 1, 0) == 0){
+			sharedPool.Initialize();
+			InterlockedExchange(&sharedState, 2);
+		}
+		else{
+			while (sharedState != 2)
+				Sleep(0);
+		}
+	}
+	return &sharedPool;
+}
+
+void ThreadPool::Submit(JobFunction job, void* data){
+	//with no workers the job has to run straight away
+	if (threads.empty()){
+		job(data);
+		return;
+	}
+
+	Job entry;
+	entry.function = job;
+	entry.data = data;
+
+	EnterCriticalSection(&lock);
+	jobs.push_back(entry);
+	WakeConditionVariable(&jobAvailable);
+	LeaveCriticalSection(&lock);
+}
+
+DWORD WINAPI ThreadPool::WorkerThread(LPVOID param){
+	ThreadPool *pool = (ThreadPool*)param;
+
+	for (;;){
+		EnterCriticalSection(&pool->lock);
+		while (pool->jobs.empty() && !pool->stopping){
+			SleepConditionVariableCS(&pool->jobAvailable, &pool->lock, INFINITE);
+		}
+		if (pool->jobs.empty()){
+			//stopping and nothing left to do
+			LeaveCriticalSection(&pool->lock);
+			return 0;
+		}
+		Job job = pool->jobs.front();
+		pool->jobs.pop_front();
+		LeaveCriticalSection(&pool->lock);
+
+		job.function(job.data);
+	}
+}
+
+void ThreadPool::RunRanges(ParallelForJob* job){
+	int rangeCount = (job->count + job->grain - 1) / job->grain;
+
+	for (;;){
+		int range = (int)InterlockedIncrement(&job->nextRange) - 1;
+		if (range >= rangeCount)
+			return;
+
+		int first = range*job->grain;
+		int last = first + job->grain;
+		if (last > job->count)
+			last = job->count;
+		job->function(first, last, job->data);
+	}
+}
+
+void ThreadPool::ParallelForHelper(void* data){
+	ParallelForJob *job = (ParallelForJob*)data;
+	RunRanges(job);
+
+	//the job lives on the stack of the thread that called ParallelFor, it mustn't be touched after this
+	ThreadPool *pool = job->pool;
+	EnterCriticalSection(&pool->lock);
+	job->outstandingHelpers--;
+	WakeAllConditionVariable(&pool->helperFinished);
+	LeaveCriticalSection(&pool->lock);
+}
+
+void ThreadPool::ParallelFor(int count, int grain, RangeFunction function, void* data){
+	if (count <= 0)
+		return;
+	if (grain < 1)
+		grain = 1;
+
+	int rangeCount = (count + grain - 1) / grain;
+	int helpers = (int)threads.size();
+	if (helpers > rangeCount - 1)
+		helpers = rangeCount - 1;
+
+	if (helpers <= 0){
+		function(0, count, data);
+		return;
+	}
+
+	ParallelForJob job;
+	job.pool = this;
+	job.function = function;
+	job.data = data;
+	job.count = count;
+	job.grain = grain;
+	job.nextRange = 0;
+	job.outstandingHelpers = helpers;
+
+	Job entry;
+	entry.function = ParallelForHelper;
+	entry.data = &job;
+
+	EnterCriticalSection(&lock);
+	for (int i = 0; i < helpers; i++){
+		jobs.push_back(entry);
+	}
+	WakeAllConditionVariable(&jobAvailable);
+	LeaveCriticalSection(&lock);
+
+	//the calling thread works through the ranges as well rather than sitting idle
+	RunRanges(&job);
+
+	//every range has been claimed - helpers still stuck behind other jobs in the queue have nothing left to do
+	//so they are taken back out, then wait for the ones still finishing their last range
+	EnterCriticalSection(&lock);
+	for (std::deque<Job>::iterator it = jobs.begin(); it != jobs.end();){
+		if (it->function == ParallelForHelper && it->data == &job){
+			it = jobs.erase(it);
+			job.outstandingHelpers--;
+		}
+		else{
+			++it;
+		}
+	}
+	while (job.outstandingHelpers > 0){
+		SleepConditionVariableCS(&helperFinished, &lock, INFINITE);
+	}
+	LeaveCriticalSection(&lock);
+}
@@ -0,0 +1,68 @@
+#ifndef _H_THREADPOOL
+#define _H_THREADPOOL
+
+//condition variables need vista and up
+#ifndef _WIN32_WINNT
+#define _WIN32_WINNT   0x0600
+#endif
+
+#include <windows.h>
+#include <deque>
+#include <vector>
+
+///FIXED SET OF WORKER THREADS THAT JOBS CAN BE HANDED TO
+///ParallelFor SPLITS A LOOP INTO RANGES THAT THE WORKERS AND THE CALLING THREAD WORK THROUGH TOGETHER -
+///THE RANGES ARE CLAIMED IN ORDER AND EACH ONE WRITES ITS OWN OUTPUT SO THE RESULT IS THE SAME AS A SERIAL LOOP
+class ThreadPool
+{
+public:
+	typedef void (*JobFunction)(void* data);
+	typedef void (*RangeFunction)(int first, int last, void* data);	// handles items [first, last)
+
+	ThreadPool(void);
+	~ThreadPool(void);
+
+	bool	Initialize(int threadCount = 0);	// 0 makes one worker per core besides the calling thread
+	void	Shutdown();							// finishes the queued jobs and joins the workers
+
+	void	Submit(JobFunction job, void* data);	// runs the job on a worker some time later
+	void	ParallelFor(int count, int grain, RangeFunction function, void* data);	// blocks until all count items are done
+
+	int		GetThreadCount()const;
+
+	static ThreadPool* GetShared();		// pool shared by the whole app, started the first time it's asked for
+
+private:
+	ThreadPool(const ThreadPool&);
+	ThreadPool& operator=(const ThreadPool&);
+
+	struct Job
+	{
+		JobFunction	function;
+		void		*data;
+	};
+
+	struct ParallelForJob
+	{
+		ThreadPool		*pool;
+		RangeFunction	function;
+		void			*data;
+		int				count;
+		int				grain;
+		volatile LONG	nextRange;
+		int				outstandingHelpers;	// helper jobs queued or running, guarded by the pool lock
+	};
+
+	static DWORD WINAPI WorkerThread(LPVOID param);
+	static void RunRanges(ParallelForJob* job);
+	static void ParallelForHelper(void* data);
+
+	std::vector<HANDLE>	threads;
+	std::deque<Job>		jobs;
+	CRITICAL_SECTION	lock;
+	CONDITION_VARIABLE	jobAvailable;
+	CONDITION_VARIABLE	helperFinished;
+	bool				stopping;
+};
+
+#endif
@@ -15,6 +15,33 @@ struct VertexNT
 	Vector2f	texC;
 };
 
+//which bones move a vertex and how much, strongest first. The weights add up to 1, the ones left over are 0
+struct VertexSkin
+{
+	BYTE		bones[4];
+	float		weights[4];
+};
+
+//compact terrain vertex - x and z aren't stored, the shader works them out from the vertex's place in the grid.
+//The height is a 16 bit fraction of the terrain's height range and the normal is octahedral encoded into two bytes
+struct VertexTerrain
+{
+	USHORT		height;
+	BYTE		normal[2];
+};
+
+//what the shader needs to turn a VertexTerrain back into a position, normal and texture coordinate
+struct TerrainVertexLayout
+{
+	float	originX, originZ;			// position of grid vertex (0,0)
+	float	cellSpacing;
+	float	heightBias, heightScale;	// height = heightBias + height/65535*heightScale
+	float	texScaleRow, texScaleCol;	// texture coordinate per grid row/column
+	int		pitch;						// vertices per row of the vertex buffer
+	int		firstRow, firstCol;			// grid vertex the vertex buffer starts at
+	int		baseVertex;					// the base vertex of the draw - SV_VertexID doesn't include it
+};
+
 struct VertexC
 {
 	Vector3f	pos;
@@ -0,0 +1,82 @@
+#include "VertexWelder.h"
+#include <string.h>
+
+const DWORD EMPTY_SLOT = 0xFFFFFFFF;
+const int MIN_SLOTS = 64;
+
+static inline DWORD HashWords(DWORD hash, const void* data, int size){
+	const DWORD* words = (const DWORD*)data;
+	for (int i = 0; i < size/(int)sizeof(DWORD); i++){
+		hash = (hash ^ words[i])*16777619u;
+		hash ^= hash >> 15;
+	}
+	return hash;
+}
+
+//mixes all eight words of the vertex, and the five of its skin if it has one, so that near identical vertices land
+//far apart in the table
+static inline DWORD HashVertex(const VertexNT& vertex, const VertexSkin* skin){
+	DWORD hash = HashWords(2166136261u, &vertex, sizeof(VertexNT));
+	if (skin)
+		hash = HashWords(hash, skin, sizeof(VertexSkin));
+	hash *= 0x85EBCA6Bu;
+	hash ^= hash >> 13;
+	return hash;
+}
+
+VertexWelder::VertexWelder(void){
+	vertices = nullptr;
+	skins = nullptr;
+	first = 0;
+	mask = 0;
+}
+
+void VertexWelder::Begin(std::vector<VertexNT>* vertexArray, int expectedCorners, std::vector<VertexSkin>* skinArray){
+	vertices = vertexArray;
+	skins = skinArray;
+	first = vertices->size();
+
+	//kept at most half full so the probe sequences stay short
+	int size = MIN_SLOTS;
+	while (size < expectedCorners*2)
+		size *= 2;
+	slots.assign(size, EMPTY_SLOT);
+	mask = size - 1;
+}
+
+DWORD VertexWelder::Add(const VertexNT& vertex, const VertexSkin* skin){
+	if (!skins)
+		skin = nullptr;
+	DWORD slot = HashVertex(vertex, skin) & mask;
+	while (slots[slot] != EMPTY_SLOT){
+		if (memcmp(&(*vertices)[slots[slot]], &vertex, sizeof(VertexNT)) == 0 &&
+			(!skin || memcmp(&(*skins)[slots[slot]], skin, sizeof(VertexSkin)) == 0))
+			return slots[slot];
+		slot = (slot + 1) & mask;
+	}
+
+	DWORD index = vertices->size();
+	vertices->push_back(vertex);
+	if (skin)
+		skins->push_back(*skin);
+	slots[slot] = index;
+
+	if ((index - first + 1)*2 > slots.size())
+		Grow();
+	return index;
+}
+
+int VertexWelder::GetVertexCount()const{
+	return vertices ? vertices->size() - first : 0;
+}
+
+void VertexWelder::Grow(){
+	slots.assign(slots.size()*2, EMPTY_SLOT);
+	mask = slots.size() - 1;
+	for (DWORD index = first; index < vertices->size(); index++){
+		DWORD slot = HashVertex((*vertices)[index], skins ? &(*skins)[index] : nullptr) & mask;
+		while (slots[slot] != EMPTY_SLOT)
+			slot = (slot + 1) & mask;
+		slots[slot] = index;
+	}
+}
@@ -0,0 +1,38 @@
+#ifndef _H_VERTEXWELDER
+#define _H_VERTEXWELDER
+
+#include "Vertex.h"
+#include <vector>
+
+///BUILDS A VERTEX ARRAY WITH NO TWO VERTICES THE SAME OUT OF THE CORNERS OF A MESH, ONE AT A TIME
+///EVERY CORNER IS LOOKED UP IN AN OPEN ADDRESSING HASH TABLE OF THE VERTICES ADDED SO FAR AND ONLY APPENDED IF IT'S NEW
+///VERTICES ARE COMPARED BIT FOR BIT, SO ONLY CORNERS WITH EXACTLY THE SAME POSITION, NORMAL AND TEXTURE COORDINATE ARE WELDED
+///- AND THE SAME BONES AND WEIGHTS AS WELL WHEN THE MESH IS SKINNED
+
+class VertexWelder
+{
+public:
+	VertexWelder(void);
+
+	// welds into the end of vertices from now on - the ones already in it are left alone and never matched against.
+	// expectedCorners sizes the table up front, it grows past that if it has to. If skins isn't null it runs alongside
+	// vertices, and every vertex's skin is appended to it too
+	void	Begin(std::vector<VertexNT>* vertices, int expectedCorners, std::vector<VertexSkin>* skins = nullptr);
+
+	// the index in the vertex array of the vertex, which is appended if there isn't already one the same. skin has to
+	// be given if Begin was given skins
+	DWORD	Add(const VertexNT& vertex, const VertexSkin* skin = nullptr);
+
+	int		GetVertexCount()const;		// vertices added since Begin
+
+private:
+	void	Grow();
+
+	std::vector<VertexNT>*	vertices;
+	std::vector<VertexSkin>* skins;
+	DWORD					first;		// where this run of vertices starts in the array
+	std::vector<DWORD>		slots;		// indices into the vertex array, EMPTY_SLOT where there's none
+	DWORD					mask;
+};
+
+#endif